@@ -155,6 +155,13 @@ struct bdmf_db_set
 
     /** fastlock */
     bdmf_fastlock fastlock;
+
+    /** Wait-free-read policy: per-record reader counters */
+    bdmf_atomic_t *rcu_readers;
+
+    /** Wait-free-read policy: key of the record whose readers might still
+     * reference shadow_data. BDMF_DB_KEY_INVAL if none */
+    bdmf_db_key_t rcu_retired_key;
 };
 
 
@@ -548,6 +555,120 @@ static void ddbe_nb_read_shadow_write_unlock_write(bdmf_db_set_t *set, int is_de
     bdmf_ta_mutex_unlock(&set->mutex_update);
 }
 
+/** wait-free-read/rcu write policy: Lock entry for reading.
+ *  The reader only announces itself in the record's reader counter
+ *  and picks up the current data pointer. It never blocks or spins.
+ */
+static void *ddbe_wf_read_rcu_write_lock_read(bdmf_db_set_t *set, bdmf_db_key_t key)
+{
+    bdmf_db_entry_t *entry;
+
+    entry = set->key_to_handle(set, key);
+    if (!entry)
+        return NULL;
+    bdmf_atomic_inc(&set->rcu_readers[key]);
+    /* Pairs with the barrier in ddbe_wf_read_rcu_write_wait_retired().
+     * Either the writer sees this reader or the reader sees the new pointer */
+    bdmf_smp_mb();
+    if (!(entry->flags & BDMF_DB_FLAG_VALID))
+    {
+        bdmf_atomic_dec(&set->rcu_readers[key]);
+        return NULL;
+    }
+    return *(void * volatile *)&entry->data;
+}
+
+
+/** wait-free-read/rcu write policy: Unlock entry for reading */
+static void ddbe_wf_read_rcu_write_unlock_read(bdmf_db_set_t *set, bdmf_db_key_t key)
+{
+    assert(set->key_to_handle(set, key));
+    assert(bdmf_atomic_read(&set->rcu_readers[key]) > 0);
+    /* Make sure that all reads from the record are done before the reader leaves */
+    bdmf_smp_mb();
+    bdmf_atomic_dec(&set->rcu_readers[key]);
+}
+
+
+/** wait-free-read/rcu write policy: wait until shadow area is no longer
+ *  referenced by readers of the record it was swapped out of.
+ *  Called with mutex_update taken.
+ */
+static void ddbe_wf_read_rcu_write_wait_retired(bdmf_db_set_t *set)
+{
+    bdmf_db_key_t key = set->rcu_retired_key;
+
+    if (key == BDMF_DB_KEY_INVAL)
+        return;
+    bdmf_smp_mb();
+    while (bdmf_atomic_read(&set->rcu_readers[key]))
+        bdmf_yield();
+    set->rcu_retired_key = BDMF_DB_KEY_INVAL;
+}
+
+
+/** wait-free-read/rcu write policy: Lock entry for writing/deletion.
+ *  Record data is copied to the shadow area which is published by
+ *  ddbe_wf_read_rcu_write_unlock_write().
+ *  returned value of NULL means error only in case that is_deletion is 0
+ */
+static void *ddbe_wf_read_rcu_write_lock_write(bdmf_db_set_t *set, bdmf_db_key_t key, int is_deletion)
+{
+    bdmf_db_entry_t *entry;
+
+    bdmf_ta_mutex_lock(&set->mutex_update);
+
+    entry = set->key_to_handle(set, key);
+
+    /* Deletion only clears the valid flag. Record data stays in place,
+     * so readers that still hold the pointer are not affected.
+     * mutex_update is released in unlock.
+     */
+    if (is_deletion)
+    {
+        if (entry && (entry->flags & BDMF_DB_FLAG_VALID))
+            set->entry_delete(set, entry);
+        return NULL;
+    }
+
+    /* see comment in ddbe_nb_read_shadow_write_lock_write() */
+    if (set->write_locked_entry || !entry || !(entry->flags & BDMF_DB_FLAG_VALID))
+    {
+        bdmf_ta_mutex_unlock(&set->mutex_update);
+        return NULL;
+    }
+    set->write_locked_entry = entry;
+
+    /* Shadow area can be reused only when the last reader of the previous copy is gone */
+    ddbe_wf_read_rcu_write_wait_retired(set);
+    memcpy(set->shadow_data, entry->data, set->entry_size);
+    return set->shadow_data;
+}
+
+
+/** wait-free-read/rcu write policy: Unlock entry for writing/deletion.
+ *  Publishes the updated copy by swapping record data pointer. Readers that
+ *  picked up the old pointer keep using it until they unlock.
+ */
+static void ddbe_wf_read_rcu_write_unlock_write(bdmf_db_set_t *set, int is_deletion)
+{
+    bdmf_db_entry_t *entry = set->write_locked_entry;
+    void *old_data;
+
+    if (!is_deletion)
+    {
+        assert(entry);
+        old_data = entry->data;
+        /* Shadow content must be visible before the new pointer */
+        bdmf_smp_mb();
+        *(void * volatile *)&entry->data = set->shadow_data;
+        set->shadow_data = old_data;
+        set->rcu_retired_key = set->handle_to_key(set, entry);
+        set->write_locked_entry = NULL;
+    }
+    bdmf_ta_mutex_unlock(&set->mutex_update);
+}
+
 /** none policy: set read-lock */
 static inline void ddbe_set_lock_read_dummy(bdmf_db_set_t *set)
 {
@@ -827,7 +948,9 @@ int bdmf_db_make_set_of_records(const bdmf_db_sor_init_t *init, int alloc_record
             if (alloc_records)
             {
                 int size = init->max_entries * init->record_size;
-                if (init->lock_policy == BDMF_DB_LOCK_NB_READ_SHADOW_WRITE)
+                int has_shadow = (init->lock_policy == BDMF_DB_LOCK_NB_READ_SHADOW_WRITE ||
+                                  init->lock_policy == BDMF_DB_LOCK_WF_READ_RCU_WRITE);
+                if (has_shadow)
                     size += init->record_size; /* room for shadow entry */
                 /* Allocate data + 1 extra for shadow area */
                 data = bdmf_calloc(size);
@@ -842,7 +965,7 @@ int bdmf_db_make_set_of_records(const bdmf_db_sor_init_t *init, int alloc_record
                     bdmf_db_entry_t *entry = (bdmf_db_entry_t *)sor->entry.data + i;
                     entry->data = data + i * init->record_size;
                 }
-                if (init->lock_policy == BDMF_DB_LOCK_NB_READ_SHADOW_WRITE)
+                if (has_shadow)
                     sor->shadow_data = data + i * init->record_size;
             }
 
@@ -903,6 +1026,32 @@ int bdmf_db_make_set_of_records(const bdmf_db_sor_init_t *init, int alloc_record
             sor->unlock_set_recursively_modify = ddbe_set_unlock_recursively_modify_sem ;
             break;
 
+        case BDMF_DB_LOCK_WF_READ_RCU_WRITE:
+            /* Record readers are wait-free. Set-level locks are semaphore-based */
+            sor->rcu_readers = bdmf_calloc(sizeof(bdmf_atomic_t) * init->max_entries);
+            if (!sor->rcu_readers)
+            {
+                if (data)
+                    bdmf_free(data);
+                bdmf_free(entries);
+                bdmf_free(sor);
+                return BDMF_ERR_NOMEM;
+            }
+            for(i=0; i<init->max_entries; i++)
+                bdmf_atomic_init(&sor->rcu_readers[i], 0);
+            sor->rcu_retired_key = BDMF_DB_KEY_INVAL;
+            sor->lock_record_write = ddbe_wf_read_rcu_write_lock_write;
+            sor->lock_record_read = ddbe_wf_read_rcu_write_lock_read;
+            sor->unlock_record_write = ddbe_wf_read_rcu_write_unlock_write;
+            sor->unlock_record_read = ddbe_wf_read_rcu_write_unlock_read;
+            sor->lock_set_read = ddbe_set_lock_read_sem;
+            sor->unlock_set_read = ddbe_set_unlock_read_sem;
+            sor->lock_set_modify = ddbe_set_lock_modify_sem;
+            sor->unlock_set_modify = ddbe_set_unlock_modify_sem;
+            sor->lock_set_recursively_modify = ddbe_set_lock_recursively_modify_sem ;
+            sor->unlock_set_recursively_modify = ddbe_set_unlock_recursively_modify_sem ;
+            break;
+
         default:
             printf("Lock policy %d is not supported\n", init->lock_policy);
             if (data)
@@ -64,6 +64,8 @@ typedef enum
     BDMF_DB_LOCK_NONE,                /**< No record-level locking. Can be used for records containing independent fields */
     BDMF_DB_LOCK_NB_READ_SHADOW_WRITE,/**< Non-blocking read, write using shadow area (default) */
     BDMF_DB_LOCK_SEM_READ_SEM_WRITE,  /**< Strong locking. Both read and write locks use semaphores */
+    BDMF_DB_LOCK_WF_READ_RCU_WRITE,   /**< Wait-free read, write using shadow area and pointer swap.
+                                           Record readers never block or spin; writers wait for readers of the replaced copy */
     BDMF_DB_LOCK_OTHER                /**< User-defined locking policy */
 } bdmf_db_lock_policy_t;
 
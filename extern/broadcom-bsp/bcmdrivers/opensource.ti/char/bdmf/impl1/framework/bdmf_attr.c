@@ -327,6 +327,7 @@ static int _bdmf_attr_index_val(char **ppbuf, char **index_val)
 }
 
 static int _bdmf_attr_string_split(char *attr,
+        struct bdmf_attr_name_value *pairs_buf, int max_pairs,
         struct bdmf_attr_name_value **p_pairs, int *p_npairs)
 {
     char *pbuf = attr;
@@ -351,10 +352,18 @@ static int _bdmf_attr_string_split(char *attr,
     while ((p = strchr(p + 1, ',')))
         ncommas++;
 
-    /* Allocate pairs array */
-    pairs = bdmf_calloc(sizeof(struct bdmf_attr_name_value) * (ncommas + 1));
-    if (!pairs)
-        return BDMF_ERR_NOMEM;
+    /* Use caller's pairs buffer if it is big enough, allocate otherwise */
+    if (pairs_buf && ncommas < max_pairs)
+    {
+        pairs = pairs_buf;
+        memset(pairs, 0, sizeof(struct bdmf_attr_name_value) * (ncommas + 1));
+    }
+    else
+    {
+        pairs = bdmf_calloc(sizeof(struct bdmf_attr_name_value) * (ncommas + 1));
+        if (!pairs)
+            return BDMF_ERR_NOMEM;
+    }
 
     while (pbuf && *pbuf)
     {
@@ -445,7 +454,9 @@ static int _bdmf_attr_string_split(char *attr,
     *p_npairs = nattrs;
     return 0;
 
-    out_of_loop: bdmf_free(pairs);
+    out_of_loop:
+    if (pairs != pairs_buf)
+        bdmf_free(pairs);
     return BDMF_ERR_PARSE;
 }
 
@@ -468,6 +479,7 @@ int bdmf_attr_string_split(const char *attr,
         struct bdmf_attr_name_value **p_pairs, int *p_npairs)
 {
     char *buf;
+    int rc;
 
     if (!p_pairs || !p_npairs)
         return BDMF_ERR_PARM;
@@ -486,7 +498,79 @@ int bdmf_attr_string_split(const char *attr,
     strcpy(buf, attr);
 
     /* Parse attribute string */
-    return _bdmf_attr_string_split(buf, p_pairs, p_npairs);
+    rc = _bdmf_attr_string_split(buf, NULL, 0, p_pairs, p_npairs);
+    if (rc)
+        bdmf_free(buf);
+    return rc;
+}
+
+/** Split attribute string into { name, value } pairs using scratch buffer
+ *
+ * Same as bdmf_attr_string_split(), but the string copy and pairs array
+ * are placed in the caller-supplied scratch buffer (typically on stack)
+ * when they fit. Otherwise, the function falls back to dynamic allocation.
+ *
+ * \param[in]   attr        Attribute string
+ * \param[in]   sbuf        Scratch buffer
+ * \param[out]  p_pairs     Array of { name, value } pairs. Must be released
+ *                          using bdmf_attr_pairs_release_buf()
+ * \param[out]  p_npairs    Number of elements in the pairs array
+ *
+ * \return
+ *     0    - OK\n
+ *    <0    - error in parameters, parsing error or no memory
+ */
+int bdmf_attr_string_split_buf(const char *attr, struct bdmf_attr_split_buf *sbuf,
+        struct bdmf_attr_name_value **p_pairs, int *p_npairs)
+{
+    char *buf;
+    int len;
+    int rc;
+
+    if (!sbuf || !p_pairs || !p_npairs)
+        return BDMF_ERR_PARM;
+
+    if (!attr || !attr[0])
+    {
+        *p_pairs = NULL;
+        *p_npairs = 0;
+        return 0;
+    }
+
+    /* Copy attr string */
+    len = strlen(attr) + 1;
+    if (len <= sizeof(sbuf->str))
+        buf = sbuf->str;
+    else
+    {
+        buf = bdmf_alloc(len);
+        if (!buf)
+            return BDMF_ERR_NOMEM;
+    }
+    memcpy(buf, attr, len);
+
+    /* Parse attribute string */
+    rc = _bdmf_attr_string_split(buf, sbuf->pairs, BDMF_ATTR_SPLIT_MAX_PAIRS,
+        p_pairs, p_npairs);
+    if (rc && buf != sbuf->str)
+        bdmf_free(buf);
+    return rc;
+}
+
+/** Release {name, value} pairs array returned by bdmf_attr_string_split_buf()
+ *
+ * \param[in]   sbuf    Scratch buffer passed to bdmf_attr_string_split_buf()
+ * \param[in]   pairs   pairs array pointer returned by bdmf_attr_string_split_buf()
+ */
+void bdmf_attr_pairs_release_buf(struct bdmf_attr_split_buf *sbuf,
+    struct bdmf_attr_name_value *pairs)
+{
+    if (!pairs)
+        return;
+    if (pairs[0].name && pairs[0].name != sbuf->str)
+        bdmf_free(pairs[0].name);
+    if (pairs != sbuf->pairs)
+        bdmf_free(pairs);
 }
 
 /** Release {name, value} pairs array allocated by bdmf_attr_string_split()
@@ -968,6 +1052,9 @@ static int _bdmf_attrelem_set_as_buf(bdmf_object_handle mo, struct bdmf_attr *at
         rc = attr->add(mo, attr, index, buffer, size);
     else
         rc = attr->write(mo, attr, *index, buffer, size);
+    /* Key value has changed. Re-index the object */
+    if ((attr->flags & BDMF_ATTR_KEY) && rc >= 0)
+        _bdmf_obj_key_update(mo);
     return rc;
 }
 
@@ -1282,7 +1369,7 @@ static int _bdmf_configure(bdmf_object_handle mo, struct bdmf_attr aattr[],
     }
 
     /* Convert attribute string to { name, index, value } array */
-    rc = _bdmf_attr_string_split(set, &pairs, &npairs);
+    rc = _bdmf_attr_string_split(set, NULL, 0, &pairs, &npairs);
     if (rc)
         return rc;
 
@@ -3034,6 +3121,35 @@ static const char *attr_dft_n_format_by_size(int size, uint32_t flags)
     return n_format->n;
 }
 
+/* Check if attribute value converted from string can be compared with
+ * the value read from object in binary form.
+ * Returns 1 if yes, 0 if attribute must be compared as string
+ */
+int _bdmf_attr_is_key_comparable(const struct bdmf_attr *attr)
+{
+    if (attr->array_size > 1)
+        return 0;
+    switch (attr->type)
+    {
+    case bdmf_attr_number:
+        return (attr->s_to_val == _bdmf_attr_s_to_val_n);
+    case bdmf_attr_string:
+        return (attr->s_to_val == _bdmf_attr_s_to_val_s);
+    case bdmf_attr_enum:
+        return (attr->s_to_val == _bdmf_attr_s_to_val_enum);
+    case bdmf_attr_dyn_enum:
+        return (attr->s_to_val == _bdmf_attr_s_to_val_dyn_enum);
+    case bdmf_attr_ether_addr:
+        return (attr->s_to_val == _bdmf_attr_s_to_val_mac);
+    case bdmf_attr_ipv4_addr:
+        return (attr->s_to_val == _bdmf_attr_s_to_val_ipv4);
+    case bdmf_attr_ipv6_addr:
+        return (attr->s_to_val == _bdmf_attr_s_to_val_ipv6);
+    default:
+        return 0;
+    }
+}
+
 int bdmf_attr_make(struct bdmf_type *drv, struct bdmf_attr *attr)
 {
     int rc;
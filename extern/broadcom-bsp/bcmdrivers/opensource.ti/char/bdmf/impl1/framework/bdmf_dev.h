@@ -344,6 +344,18 @@ struct bdmf_attr_name_value
     struct bdmf_attr *attr;   /**< Attribute control block */
 };
 
+#define BDMF_ATTR_SPLIT_STR_SIZE    128 /**< Attribute string that fits in scratch buffer */
+#define BDMF_ATTR_SPLIT_MAX_PAIRS   8   /**< Number of pairs that fit in scratch buffer */
+
+/** Scratch buffer for splitting short attribute strings without
+ * dynamic allocation. Used with bdmf_attr_string_split_buf()
+ */
+struct bdmf_attr_split_buf
+{
+    char str[BDMF_ATTR_SPLIT_STR_SIZE];                         /**< String copy */
+    struct bdmf_attr_name_value pairs[BDMF_ATTR_SPLIT_MAX_PAIRS]; /**< Pairs array */
+};
+
 /** Declare BDMF type.
  * This macro replaces bdmf_attr_aggregate_type_register() call.
  * It can be used only in drivers included in the same module as the
@@ -391,6 +403,19 @@ DLIST_HEAD(bdmf_link_list, bdmf_link);
 /** Reference list */
 DLIST_HEAD(bdmf_ref_list, bdmf_ref);
 
+/** Per-type allocation counters */
+struct bdmf_type_alloc_stat
+{
+    uint32_t obj_alloc;             /**< Objects allocated */
+    uint32_t obj_free;              /**< Objects released */
+    uint32_t obj_alloc_fail;        /**< Object allocation failures */
+    uint32_t obj_uncached;          /**< Objects allocated by bdmf_calloc(): type has no cache */
+    uint32_t ref_alloc;             /**< References allocated by objects of this type */
+    uint32_t ref_free;              /**< References released */
+    uint32_t link_alloc;            /**< Mux links allocated (charged to DS type) */
+    uint32_t link_free;             /**< Mux links released */
+};
+
 /** Managed Object Type descriptor
  */
 struct bdmf_type
@@ -1027,6 +1052,23 @@ int bdmf_attr_get_enum_hlp(const char *attr, const char *name,
 int bdmf_attr_string_split( const char *attr,
                            struct bdmf_attr_name_value **p_pairs, int *p_npairs);
 
+/** Split attribute string into { name, value } pairs using scratch buffer
+ *
+ * Same as bdmf_attr_string_split(), but doesn't allocate memory if
+ * the string and pairs array fit in the scratch buffer.
+ * \param[in]   attr        Attribute string
+ * \param[in]   sbuf        Scratch buffer
+ * \param[out]  p_pairs     Array of { name, value } pairs. Must be released
+ *                          using bdmf_attr_pairs_release_buf()
+ * \param[out]  p_npairs    Number of elements in the pairs array
+ *
+ * \return
+ *     0    - OK\n
+ *    <0    - error in parameters, parsing error or no memory
+ */
+int bdmf_attr_string_split_buf(const char *attr, struct bdmf_attr_split_buf *sbuf,
+                           struct bdmf_attr_name_value **p_pairs, int *p_npairs);
+
 /** Is attribute type numeric
  * \param[in]   attr_type
  * \return 1 if type is numeric
@@ -1082,6 +1124,14 @@ int bdmf_attr_array_index_to_string(struct bdmf_object *mo, struct bdmf_attr *at
  */
 void bdmf_attr_pairs_release(struct bdmf_attr_name_value *pairs);
 
+/** Release {name, value} pairs array returned by bdmf_attr_string_split_buf()
+ *
+ * \param[in]   sbuf    scratch buffer passed to bdmf_attr_string_split_buf()
+ * \param[in]   pairs   pairs array pointer returned by bdmf_attr_string_split_buf()
+ */
+void bdmf_attr_pairs_release_buf(struct bdmf_attr_split_buf *sbuf,
+                           struct bdmf_attr_name_value *pairs);
+
 /** val_to_s callback target for object reference conversion
  * The function can be used when object reference attribute is declared as
  * bdmf_attr_pointer instead of bdmf_attr_object.
@@ -1180,11 +1230,22 @@ struct bdmf_ref *_bdmf_ref_alloc(struct bdmf_object *mo, struct bdmf_object *ref
 void _bdmf_ref_free(struct bdmf_ref *ref);
 struct bdmf_ref *_bdmf_ref_find_by_attr(struct bdmf_object *mo, struct bdmf_attr *attr, bdmf_index index, int offset);
 
+/* Framework-private type data: key attribute index, object cache, counters */
+int _bdmf_type_priv_init(struct bdmf_type *drv);
+void _bdmf_type_priv_exit(struct bdmf_type *drv);
+int _bdmf_type_alloc_stat_get(struct bdmf_type *drv, struct bdmf_type_alloc_stat *stat, int *obj_cache);
+
+/* Key attribute index */
+int _bdmf_attr_is_key_comparable(const struct bdmf_attr *attr);
+void _bdmf_obj_key_update(struct bdmf_object *mo);
+
 /* Module initialization */
 extern int bdmf_type_module_init(void);
 extern void bdmf_type_module_exit(void);
 extern int bdmf_area_module_init(void);
 extern void bdmf_area_module_exit(void);
+extern int bdmf_object_module_init(void);
+extern void bdmf_object_module_exit(void);
 /** \defgroup bdmf_dev_history History logging
  * \ingroup bdmf_dev
  * History logging feature allows
@@ -1193,6 +1254,37 @@ extern void bdmf_area_module_exit(void);
  * @{
  */
 
+/** History recording format */
+typedef enum
+{
+    bdmf_hist_format_text,          /**< Human-readable text. Recording stops when buffer is full */
+    bdmf_hist_format_binary,        /**< Compact binary records in a ring buffer. The oldest records are overwritten */
+} bdmf_history_format_t;
+
+/** History statistics */
+typedef struct
+{
+    bdmf_history_format_t format;   /**< Recording format */
+    bdmf_boolean record_on;         /**< Recording state */
+    int overflow;                   /**< Text format: recording stopped due to overflow */
+    uint32_t size;                  /**< History buffer size */
+    uint32_t used;                  /**< Number of bytes used in history buffer */
+    uint32_t nrecs;                 /**< Binary format: number of records in the buffer */
+    uint32_t noverwritten;          /**< Binary format: number of records overwritten in the ring buffer */
+    uint32_t ndropped;              /**< Binary format: number of records that were too long to record */
+    uint32_t ntypes;                /**< Binary format: number of interned object types */
+    uint32_t stream_pending;        /**< Binary format: number of bytes not streamed yet */
+    uint32_t stream_gaps;           /**< Binary format: number of times that records were overwritten before streamed */
+} bdmf_history_info_t;
+
+/** Max binary history record size */
+#define BDMF_HISTORY_REC_MAX            8192
+
+/** Min buffer size for \ref bdmf_history_stream_read.
+ * Buffer must fit stream header, type definition and record
+ */
+#define BDMF_HISTORY_READ_MIN_SIZE      (2 * BDMF_HISTORY_REC_MAX + 16)
+
 #ifdef BDMF_HISTORY
 
 /** Init history module
@@ -1211,6 +1303,15 @@ void bdmf_history_module_exit(void);
  */
 int bdmf_history_init(uint32_t size, bdmf_boolean record_on);
 
+/** Init and start history recording in the specified format
+ * \param[in]   size        History buffer size.
+ *                          Binary format ring buffer size is rounded down to a power of 2
+ * \param[in]   record_on   Initial recording state (true=enabled)
+ * \param[in]   format      Recording format
+ * \return 0=OK or error code <0
+ */
+int bdmf_history_init_format(uint32_t size, bdmf_boolean record_on, bdmf_history_format_t format);
+
 /** Stop history recording
  */
 void bdmf_history_stop(void);
@@ -1228,6 +1329,12 @@ int bdmf_history_resume(void);
  */
 int bdmf_history_get(void **buffer, uint32_t *size, uint32_t *rec_size);
 
+/** Get history statistics
+ * \param[out]  info        History statistics
+ * \return 0=OK or error code <0
+ */
+int bdmf_history_info(bdmf_history_info_t *info);
+
 /** Reset history buffer.
  * All recorded history is discarded
  * \return 0=OK or error code <0
@@ -1254,6 +1361,26 @@ int bdmf_history_save(const char *fname);
  */
 int bdmf_history_play(const char *fname, bdmf_boolean stop_on_mismatch);
 
+/** Start streaming binary history to file.
+ * History that is still in the buffer is written first.
+ * Not supported in kernel. Read from BDMF character device instead.
+ * \param[in]   fname   History file name
+ * \return 0=OK or error code <0
+ */
+int bdmf_history_stream_start(const char *fname);
+
+/** Flush and stop streaming binary history to file
+ */
+void bdmf_history_stream_stop(void);
+
+/** Read binary history that wasn't read yet.
+ * The first read returns the stream header.
+ * \param[out]  buf     Buffer. At least \ref BDMF_HISTORY_READ_MIN_SIZE bytes
+ * \param[in]   size    Buffer size
+ * \return number of bytes read (0 if there are no new records) or error code <0
+ */
+int bdmf_history_stream_read(void *buf, uint32_t size);
+
 /*
  * Custom event support
  */
@@ -1374,11 +1501,21 @@ static inline int bdmf_history_resume(void)
     return BDMF_ERR_NOT_SUPPORTED;
 }
 
+static inline int bdmf_history_init_format(uint32_t size, bdmf_boolean record_on, bdmf_history_format_t format)
+{
+    return BDMF_ERR_NOT_SUPPORTED;
+}
+
 static inline int bdmf_history_get(void **buffer, uint32_t *size, uint32_t *rec_size)
 {
     return BDMF_ERR_NOT_SUPPORTED;
 }
 
+static inline int bdmf_history_info(bdmf_history_info_t *info)
+{
+    return BDMF_ERR_NOT_SUPPORTED;
+}
+
 static inline void bdmf_history_reset(void)
 {
 }
@@ -1397,6 +1534,20 @@ static inline int bdmf_history_play(const char *fname)
     return BDMF_ERR_NOT_SUPPORTED;
 }
 
+static inline int bdmf_history_stream_start(const char *fname)
+{
+    return BDMF_ERR_NOT_SUPPORTED;
+}
+
+static inline void bdmf_history_stream_stop(void)
+{
+}
+
+static inline int bdmf_history_stream_read(void *buf, uint32_t size)
+{
+    return BDMF_ERR_NOT_SUPPORTED;
+}
+
 #define BDMF_HISTORY_EVENT(ev, point, format, args...)
 #define BDMF_HISTORY_BI_EVENT(ev, point, args...)
 
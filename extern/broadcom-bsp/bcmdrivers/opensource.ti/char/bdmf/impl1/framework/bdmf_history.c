@@ -46,6 +46,59 @@ typedef enum
     histdec_eof,        /* EOF */
 } histdec_state_t;
 
+/* Binary record buffer */
+struct bhist_wbuf
+{
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t size;
+    int overflow;
+};
+
+/* Binary value tags */
+typedef enum
+{
+    bhist_val_none,     /* NULL value */
+    bhist_val_num,      /* zigzag varint */
+    bhist_val_str,      /* varint length + string without terminating 0 */
+    bhist_val_buf,      /* varint length + data */
+} bhist_val_t;
+
+/* Binary record types */
+#define BHIST_REC_TYPE_DEF      1       /* Object type definition */
+#define BHIST_REC_CUSTOM        2       /* Custom event in text format */
+#define BHIST_REC_EVENT         0x10    /* Built-in event. BHIST_REC_EVENT + bdmf_history_event_t */
+
+#define BHIST_MAGIC             "BDMFHB01"
+#define BHIST_MAGIC_LEN         8
+#define BHIST_REC_HDR_LEN       5
+#define BHIST_REC_MAX           BDMF_HISTORY_REC_MAX
+#define BHIST_MAX_TYPES         256
+#define BHIST_TYPE_NONE         0xffff
+#define BHIST_TYPE_HASH_SIZE    512
+#define BHIST_TYPE_NAME_LEN     32
+#define BHIST_TYPE_DEFS_SIZE    (64 * 1024)
+#define BHIST_MIN_RING_SIZE     (4 * BHIST_REC_MAX)
+#define BHIST_OUT_CHUNK_SIZE    (64 * 1024)
+
+/* Interned object type */
+struct bhist_type
+{
+    struct bdmf_type *drv;
+    char name[BHIST_TYPE_NAME_LEN];
+    uint8_t *def;               /* Type definition record */
+    uint32_t def_len;
+};
+
+/* History stream reader state */
+struct bhist_stream
+{
+    uint32_t pos;               /* Logical ring buffer position */
+    int header_sent;
+    uint32_t ngaps;             /* Number of times records were overwritten before read */
+    uint8_t sent[BHIST_MAX_TYPES / 8]; /* Type definitions sent to the stream */
+};
+
 /* Main hist module's control block */
 #define DEC_BUF_LEN     1024
 #define DEC_BBUF_LEN    (DEC_BUF_LEN / 2)
@@ -53,11 +106,32 @@ struct hist_dev
 {
     bdmf_boolean record_on;
     int level;
+    bdmf_history_format_t format;
     /* History buffer */
     uint32_t buf_size;
     uint32_t rec_size;
     char *buffer;
     int overflow;
+    /* Binary format: ring buffer. head and tail are logical positions */
+    bdmf_fastlock lock;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t nrecs;
+    uint32_t noverwritten;
+    uint32_t ndropped;
+    struct bhist_wbuf rec;      /* Record being built */
+    int rec_skip;
+    char *conv_buf;             /* Value to string conversion buffer */
+    struct bhist_type types[BHIST_MAX_TYPES];
+    uint16_t ntypes;
+    uint16_t type_hash[BHIST_TYPE_HASH_SIZE];  /* type id + 1 hashed by type pointer */
+    uint8_t *type_defs;
+    uint32_t type_defs_len;
+    struct bhist_stream stream;
+#ifndef __KERNEL__
+    bdmf_file fstream;
+    uint8_t *stream_chunk;
+#endif
     /* play-back support */
     struct hist_ev_list ev_list;
     bdmf_file fdec;
@@ -67,6 +141,8 @@ struct hist_dev
     char *pbbuf;
     histdec_state_t dec_state;
     int nline;
+    const char *dec_mem;        /* Decoding from memory rather than from fdec */
+    uint32_t dec_mem_len;
 };
 struct hist_dev hist;
 
@@ -581,672 +657,1940 @@ static void _bdmf_hist_new_and_set(bdmf_history_event_t ev, bdmf_history_point_t
     }
 }
 
-/* Sometimes bdmf API can call other APIs.
- * Record only the outer call
+/*
+ * Binary recording support.
+ *
+ * Binary history is a stream of records. Every record starts with a 5-byte header:
+ *   length (2 bytes LE, including the header), record type (1 byte), object type id (2 bytes LE)
+ * Object types and their attribute names are interned. Type definition record
+ * (BHIST_REC_TYPE_DEF) assigns type id and lists attribute names in aid order.
+ * It precedes the first record that refers to the type in saved or streamed history.
+ * Event parameters are tagged values (see bhist_val_*). Numbers are zigzag varints.
+ *
+ * Event records are kept in a ring buffer. When the buffer is full the oldest records are overwritten.
+ * Type definitions are kept outside the ring, so history remains decodable after wrap-around.
  */
-#define BDMF_HISTORY_HANDLE_POINT(point) \
-    do { \
-        if ((point & bdmf_hist_point_start)) \
-        { \
-            ++hist.level; \
-            if (hist.level > 1) \
-            { \
-                if ((point & bdmf_hist_point_end)) \
-                    --hist.level; \
-                return; \
-            } \
-        } \
-        if ((point & bdmf_hist_point_end)) \
-        { \
-            BUG_ON(hist.level <= 0); \
-            --hist.level; \
-            if (hist.level) \
-                return; \
-        } \
-    } while(0)
 
-/* Record built-in history event */
-void bdmf_history_bi_event(bdmf_history_event_t ev, bdmf_history_point_t point, ...)
+static inline void _bhist_set_u16(uint8_t *p, uint16_t v)
 {
-    va_list args;
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
 
-    BDMF_HISTORY_HANDLE_POINT(point);
+static inline uint16_t _bhist_get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
 
-    if (!hist.record_on)
+static void _bhist_put(struct bhist_wbuf *w, const void *data, uint32_t len)
+{
+    if (w->len + len > w->size)
+    {
+        w->overflow = 1;
         return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
 
-    va_start(args, point);
-    switch(ev)
+static void _bhist_put_varint(struct bhist_wbuf *w, uint64_t v)
+{
+    uint8_t b[10];
+    int n = 0;
+    do
     {
-    case bdmf_hist_ev_set_as_num:       /**< bdmf_attrelem_set_as_num() */
-        _bdmf_hist_set_as_num(ev, point, args);
-        break;
-
-    case bdmf_hist_ev_add_as_num:       /**< bdmf_attrelem_add_as_num() */
-        _bdmf_hist_add_as_num(ev, point, args);
-        break;
-
-    case bdmf_hist_ev_set_as_buf:       /**< bdmf_attrelem_set_as_buf() */
-        _bdmf_hist_set_as_buf(ev, point, args);
-        break;
-
-    case bdmf_hist_ev_add_as_buf:       /**< bdmf_attrelem_add_as_buf() */
-        _bdmf_hist_add_as_buf(ev, point, args);
-        break;
-
-    case bdmf_hist_ev_mattr_set:        /**< bdmf_mattr_set() */
-        _bdmf_hist_mattr_set(ev, point, args);
-        break;
-
-    case bdmf_hist_ev_set_as_string:    /**< bdmf_attrelem_set_as_string() */
-        _bdmf_hist_set_as_string(ev, point, args);
-        break;
-
-    case bdmf_hist_ev_add_as_string:    /**< bdmf_attrelem_add_as_string() */
-        _bdmf_hist_add_as_string(ev, point, args);
-        break;
+        b[n] = v & 0x7f;
+        v >>= 7;
+        if (v)
+            b[n] |= 0x80;
+        ++n;
+    } while (v);
+    _bhist_put(w, b, n);
+}
 
-    case bdmf_hist_ev_delete:           /**< bdmf_attrelem_delete() */
-        _bdmf_hist_delete(ev, point, args);
-        break;
+static void _bhist_put_tag(struct bhist_wbuf *w, uint8_t tag)
+{
+    _bhist_put(w, &tag, 1);
+}
 
-    case bdmf_hist_ev_new_and_configure: /**< bdmf_new_and_configure() */
-        _bdmf_hist_new_and_configure(ev, point, args);
-        break;
+static void _bhist_put_num(struct bhist_wbuf *w, bdmf_number n)
+{
+    _bhist_put_tag(w, bhist_val_num);
+    _bhist_put_varint(w, ((uint64_t)n << 1) ^ (uint64_t)(n >> 63));
+}
 
-    case bdmf_hist_ev_new_and_set:       /**< bdmf_new_and_set() */
-        _bdmf_hist_new_and_set(ev, point, args);
-        break;
+static void _bhist_put_data(struct bhist_wbuf *w, uint8_t tag, const void *data, uint32_t len)
+{
+    _bhist_put_tag(w, tag);
+    _bhist_put_varint(w, len);
+    _bhist_put(w, data, len);
+}
 
-    case bdmf_hist_ev_destroy:           /**< bdmf_destroy() */
-        _bdmf_hist_destroy(ev, point, args);
-        break;
+static void _bhist_put_str(struct bhist_wbuf *w, const char *s)
+{
+    if (!s)
+        _bhist_put_tag(w, bhist_val_none);
+    else
+        _bhist_put_data(w, bhist_val_str, s, strlen(s));
+}
 
-    case bdmf_hist_ev_link:              /**< bdmf_link() */
-    case bdmf_hist_ev_unlink:            /**< bdmf_unlink() */
-        _bdmf_hist_link_unlink(ev, point, args);
-        break;
+static void _bhist_put_obj(struct bhist_wbuf *w, struct bdmf_object *mo)
+{
+    _bhist_put_str(w, mo ? mo->name : NULL);
+}
 
-    case bdmf_hist_ev_configure:         /**< bdmf_configure() */
-        _bdmf_hist_configure(ev, point, args);
-        break;
+/* Put result of attribute value/index to string conversion done in hist.conv_buf */
+static void _bhist_put_conv(struct bhist_wbuf *w, int rc)
+{
+    if (rc < 0)
+        *hist.conv_buf = 0;
+    _bhist_put_str(w, hist.conv_buf);
+}
 
+/* Returns 1 if values of this type can be recorded as raw bytes.
+ * Types that can contain pointers are recorded in string format.
+ */
+static int _bhist_type_is_raw(bdmf_attr_type_t type)
+{
+    switch (type)
+    {
+    case bdmf_attr_number:
+    case bdmf_attr_string:
+    case bdmf_attr_buffer:
+    case bdmf_attr_ether_addr:
+    case bdmf_attr_ip_addr:
+    case bdmf_attr_ipv4_addr:
+    case bdmf_attr_ipv6_addr:
+    case bdmf_attr_boolean:
+    case bdmf_attr_enum:
+    case bdmf_attr_dyn_enum:
+    case bdmf_attr_enum_mask:
+        return 1;
     default:
-        BDMF_TRACE_ERR("history: unknown event %d\n", ev);
-        BUG();
+        return 0;
     }
-    va_end(args);
 }
 
-/* Record custom event
- *
- * History event is represented by a string terminated by "\n" \n
- * event_name event_parameters_separated_by_a_single_space # rc optional_results\\n \n
- *
- * \param[in]   event   Event name - must match event in bdmf_history_event_register()
- * \param[in]   point   Recording point: start of event, end of event or both
- * \param[in]   format  printf-like format
- */
-void bdmf_history_event(const char *event, bdmf_history_point_t point, const char *format, ...)
+static void _bhist_put_index(struct bhist_wbuf *w, struct bdmf_object *mo, bdmf_attr_id aid, bdmf_index index)
 {
-    va_list args;
-
-    BDMF_HISTORY_HANDLE_POINT(point);
-
-    if (!hist.record_on)
-        return;
+    struct bdmf_attr *attr = bdmf_aid_to_attr(mo->drv, aid);
 
-    if ((point & bdmf_hist_point_start))
-        _bdmf_hist_printf("%s ", event);
-    va_start(args, format);
-    _bdmf_hist_vprintf(format, args);
-    va_end(args);
+    _bhist_put_varint(w, aid);
+    if (bdmf_attr_type_is_numeric(attr->index_type))
+        _bhist_put_num(w, index);
+    else if (!index || index == BDMF_INDEX_UNASSIGNED)
+        _bhist_put_tag(w, bhist_val_none);
+    else if (_bhist_type_is_raw(attr->index_type))
+        _bhist_put_data(w, bhist_val_buf, (void *)index, attr->index_size);
+    else
+    {
+        *hist.conv_buf = 0;
+        _bhist_put_conv(w,
+            bdmf_attr_array_index_to_string(mo, attr, index, hist.conv_buf, BHIST_REC_MAX));
+    }
+}
 
-    return;
+static void _bhist_put_index_ptr(struct bhist_wbuf *w, struct bdmf_object *mo, bdmf_attr_id aid,
+    bdmf_index *pindex)
+{
+    struct bdmf_attr *attr = bdmf_aid_to_attr(mo->drv, aid);
+    bdmf_index index;
+    if (bdmf_attr_type_is_numeric(attr->index_type))
+        index = *pindex;
+    else
+        index = (bdmf_index)pindex;
+    _bhist_put_index(w, mo, aid, index);
 }
 
-/*
- * Event decoding (re-playing) support
- */
+/* Put attribute value passed as number. Object references are recorded by name */
+static void _bhist_put_num_or_ref(struct bhist_wbuf *w, struct bdmf_object *mo, bdmf_attr_id aid,
+    bdmf_number val)
+{
+    struct bdmf_attr *attr = bdmf_aid_to_attr(mo->drv, aid);
+    struct bdmf_object *ro;
 
-#define HIST_PB_ERROR(format, args...) \
-    BDMF_TRACE_ERR("BDMF history pb error in line %d. " format, hist.nline, ## args);
+    if (attr->type != bdmf_attr_object)
+    {
+        _bhist_put_num(w, val);
+        return;
+    }
+    ro = (struct bdmf_object *)((long)val);
+    _bhist_put_str(w, ro ? ro->name : "null");
+}
 
-static struct hist_ev *_bdmf_hist_ev_get(const char *event)
+/* Put attribute value passed as buffer */
+static void _bhist_put_buf(struct bhist_wbuf *w, struct bdmf_object *mo, bdmf_attr_id aid,
+    const void *buf, uint32_t size)
 {
-    struct hist_ev *e;
-    STAILQ_FOREACH(e, &hist.ev_list, list)
+    struct bdmf_attr *attr = bdmf_aid_to_attr(mo->drv, aid);
+
+    if (!buf)
+        _bhist_put_tag(w, bhist_val_none);
+    else if (_bhist_type_is_raw(attr->type))
+        _bhist_put_data(w, bhist_val_buf, buf, size);
+    else
     {
-        if (!strcmp(e->event, event))
-            return e;
+        *hist.conv_buf = 0;
+        _bhist_put_conv(w, attr->val_to_s(mo, attr, (void *)buf, hist.conv_buf, BHIST_REC_MAX));
     }
-    return NULL;
 }
 
-/** Get numeric argument
- * \param[out]  n       Numeric argument
- * \return 0=OK or error code <0
- */
-int bdmf_history_decode_num(bdmf_number *n)
+static void _bhist_put_mattr(struct bhist_wbuf *w, struct bdmf_object *mo, bdmf_mattr_t *mattr)
 {
-    char *num_buf;
-    int rc;
-    rc = bdmf_history_decode_string(&num_buf);
-    if (rc)
-        return rc;
-    if (!sscanf(num_buf, "%lld", (long long *)n))
+    bdmf_mattr_entry_t *entry;
+    int i, num_entries;
+
+    num_entries = mattr ? mattr->num_entries : 0;
+    _bhist_put_varint(w, num_entries);
+    for (i = 0; i < num_entries; i++)
     {
-        BDMF_TRACE_ERR("history: can't decode number <%s>\n", num_buf);
-        return BDMF_ERR_PARSE;
+        entry = &mattr->entries[i];
+        _bhist_put_index(w, mo, entry->aid, entry->index);
+        switch (entry->val.val_type)
+        {
+        case bdmf_attr_number:
+            _bhist_put_num_or_ref(w, mo, entry->aid, entry->val.x.num);
+            break;
+        case bdmf_attr_string:
+            _bhist_put_str(w, entry->val.x.s);
+            break;
+        case bdmf_attr_buffer:
+            _bhist_put_buf(w, mo, entry->aid, entry->val.x.buf.ptr, entry->val.x.buf.len);
+            break;
+        default:
+            w->overflow = 1; /* drop the record */
+            break;
+        }
     }
-    return 0;
 }
 
-/* Get string argument */
-static int _bdmf_history_decode_string(char **s)
+/* Build type definition record in type definitions area */
+static int _bhist_type_def_make(struct bdmf_type *drv, uint16_t type_id, struct bhist_type *t)
 {
-    char c=0;
-    int quoted_string=0;
-    int rc;
-    int size = sizeof(hist.dec_buf) - (hist.pdec - hist.dec_buf);
+    struct bhist_wbuf w;
+    int i;
 
-    *s = hist.pdec;
-    if (!hist.fdec)
-        return BDMF_ERR_STATE;
-    if (hist.dec_state == histdec_eol)
-        return BDMF_ERR_PARSE;
-    rc = bdmf_file_read(hist.fdec, &c, 1);
+    w.buf = hist.type_defs + hist.type_defs_len;
+    w.size = BHIST_TYPE_DEFS_SIZE - hist.type_defs_len;
+    if (w.size > BHIST_REC_MAX)
+        w.size = BHIST_REC_MAX;
+    w.len = BHIST_REC_HDR_LEN;
+    w.overflow = (w.size < BHIST_REC_HDR_LEN);
+    _bhist_put_str(&w, drv->name);
+    _bhist_put_varint(&w, drv->nattrs);
+    for (i = 0; i < drv->nattrs; i++)
+        _bhist_put_str(&w, drv->aattr[i].name);
+    if (w.overflow)
+        return BDMF_ERR_OVERFLOW;
+    _bhist_set_u16(w.buf, w.len);
+    w.buf[2] = BHIST_REC_TYPE_DEF;
+    _bhist_set_u16(&w.buf[3], type_id);
+    hist.type_defs_len += w.len;
+    t->def = w.buf;
+    t->def_len = w.len;
+    return 0;
+}
 
-    /* Skip leading spaces */
-    while (rc > 0 && c == ' ')
-        rc = bdmf_file_read(hist.fdec, &c, 1);
+/* Intern object type. Types are identified by name, so that
+ * re-registered type gets the same id.
+ * Returns type id or BHIST_TYPE_NONE
+ */
+static uint16_t _bhist_type_add(struct bdmf_type *drv)
+{
+    struct bhist_type *t;
+    uint16_t id;
 
-    if (c == '"')
+    for (id = 0; id < hist.ntypes; id++)
     {
-        quoted_string = 1;
-        rc = bdmf_file_read(hist.fdec, &c, 1);
+        if (!strncmp(hist.types[id].name, drv->name, BHIST_TYPE_NAME_LEN - 1))
+            break;
     }
-    while((size > 1) && (rc > 0) &&
-        !((c == '\n') || !c || (quoted_string && c == '"') || (!quoted_string && c == ' ')) )
+    if (id >= BHIST_MAX_TYPES)
+        return BHIST_TYPE_NONE;
+    t = &hist.types[id];
+    bdmf_fastlock_lock(&hist.lock);
+    if (_bhist_type_def_make(drv, id, t))
     {
-        *(hist.pdec++) = c;
-        --size;
-        rc = bdmf_file_read(hist.fdec, &c, 1);
+        bdmf_fastlock_unlock(&hist.lock);
+        return BHIST_TYPE_NONE;
     }
-    *(hist.pdec++) = 0;
-    if (size <= 1)
-        return BDMF_ERR_OVERFLOW;
-
-    if (c == '\n')
-        hist.dec_state = histdec_eol;
-    else if (!rc)
-        hist.dec_state = histdec_eof;
+    /* Attribute list might have changed. Make sure that reader gets the new definition */
+    hist.stream.sent[id / 8] &= ~(1 << (id % 8));
+    t->drv = drv;
+    strncpy(t->name, drv->name, BHIST_TYPE_NAME_LEN - 1);
+    if (id == hist.ntypes)
+        ++hist.ntypes;
+    bdmf_fastlock_unlock(&hist.lock);
+    return id;
+}
 
-    if (rc < 0)
-        return BDMF_ERR_IO;
+/* Get type id. Adds type to the type table if necessary */
+static uint16_t _bhist_type_id(struct bdmf_type *drv)
+{
+    uint32_t h = ((unsigned long)drv >> 4) & (BHIST_TYPE_HASH_SIZE - 1);
+    uint16_t id;
+    int i;
 
-    if (quoted_string && c != '"')
-        return BDMF_ERR_PARSE;
+    for (i = 0; i < BHIST_TYPE_HASH_SIZE; i++, h = (h + 1) & (BHIST_TYPE_HASH_SIZE - 1))
+    {
+        id = hist.type_hash[h];
+        if (!id)
+            break;
+        if (hist.types[id - 1].drv == drv &&
+            !strncmp(hist.types[id - 1].name, drv->name, BHIST_TYPE_NAME_LEN - 1))
+        {
+            return id - 1;
+        }
+    }
+    if (i == BHIST_TYPE_HASH_SIZE)
+        return BHIST_TYPE_NONE;
+    id = _bhist_type_add(drv);
+    if (id != BHIST_TYPE_NONE)
+        hist.type_hash[h] = id + 1;
+    return id;
+}
 
-    return 0;
+/* Copy data to/from ring buffer at logical position pos */
+static void _bhist_ring_put(uint32_t pos, const void *data, uint32_t len)
+{
+    uint32_t off = pos & (hist.buf_size - 1);
+    uint32_t n = (len < hist.buf_size - off) ? len : hist.buf_size - off;
+    memcpy(&hist.buffer[off], data, n);
+    if (n < len)
+        memcpy(hist.buffer, (const uint8_t *)data + n, len - n);
 }
 
-/* Get string argument */
-int bdmf_history_decode_string(char **s)
+static void _bhist_ring_get(uint32_t pos, void *data, uint32_t len)
+{
+    uint32_t off = pos & (hist.buf_size - 1);
+    uint32_t n = (len < hist.buf_size - off) ? len : hist.buf_size - off;
+    memcpy(data, &hist.buffer[off], n);
+    if (n < len)
+        memcpy((uint8_t *)data + n, hist.buffer, len - n);
+}
+
+/* Start new record */
+static void _bhist_rec_start(uint8_t rec_type, struct bdmf_type *drv)
+{
+    uint16_t type_id = drv ? _bhist_type_id(drv) : BHIST_TYPE_NONE;
+
+    hist.rec.len = BHIST_REC_HDR_LEN;
+    /* Record that refers to a type that can't be interned is dropped */
+    hist.rec.overflow = (drv && type_id == BHIST_TYPE_NONE);
+    hist.rec_skip = 0;
+    hist.rec.buf[2] = rec_type;
+    _bhist_set_u16(&hist.rec.buf[3], type_id);
+}
+
+#ifndef __KERNEL__
+static void _bhist_stream_flush(void);
+#endif
+
+/* Commit record to the ring buffer, overwriting the oldest records if necessary */
+static void _bhist_rec_commit(void)
+{
+    uint8_t hdr[BHIST_REC_HDR_LEN];
+    uint32_t len = hist.rec.len;
+
+    if (hist.rec_skip)
+        return;
+    if (hist.rec.overflow)
+    {
+        ++hist.ndropped;
+        return;
+    }
+    _bhist_set_u16(hist.rec.buf, len);
+
+    bdmf_fastlock_lock(&hist.lock);
+    while (hist.head - hist.tail + len > hist.buf_size)
+    {
+        _bhist_ring_get(hist.tail, hdr, BHIST_REC_HDR_LEN);
+        hist.tail += _bhist_get_u16(hdr);
+        --hist.nrecs;
+        ++hist.noverwritten;
+    }
+    _bhist_ring_put(hist.head, hist.rec.buf, len);
+    hist.head += len;
+    ++hist.nrecs;
+    bdmf_fastlock_unlock(&hist.lock);
+
+#ifndef __KERNEL__
+    /* Stream to file before unread records can be overwritten */
+    if (hist.fstream && hist.head - hist.stream.pos >= hist.buf_size / 2)
+        _bhist_stream_flush();
+#endif
+}
+
+/* Record built-in event in binary format */
+static void _bhist_bi_event(bdmf_history_event_t ev, bdmf_history_point_t point, va_list args)
+{
+    struct bhist_wbuf *w = &hist.rec;
+    struct bdmf_object *mo, *mo2;
+    bdmf_attr_id aid;
+    bdmf_index index;
+    bdmf_index *pindex;
+    int rc;
+
+    switch (ev)
+    {
+    case bdmf_hist_ev_new_and_configure: /* start: type, owner, string; end: rc, object */
+    case bdmf_hist_ev_new_and_set:       /* start: type, owner, mattr; end: rc, object */
+        if ((point & bdmf_hist_point_start))
+        {
+            struct bdmf_type *drv = va_arg(args, struct bdmf_type *);
+            _bhist_rec_start(BHIST_REC_EVENT + ev, drv);
+            _bhist_put_obj(w, va_arg(args, struct bdmf_object *));
+            if (ev == bdmf_hist_ev_new_and_configure)
+                _bhist_put_str(w, va_arg(args, char *));
+            else
+            {
+                static struct bdmf_object mo_tmp = { .name="*new*" };
+                mo_tmp.drv = drv;
+                _bhist_put_mattr(w, &mo_tmp, va_arg(args, bdmf_mattr_t *));
+            }
+        }
+        if ((point & bdmf_hist_point_end))
+        {
+            rc = va_arg(args, int);
+            _bhist_put_num(w, rc);
+            _bhist_put_obj(w, rc ? NULL : va_arg(args, struct bdmf_object *));
+        }
+        break;
+
+    case bdmf_hist_ev_destroy:           /* start: object */
+        if ((point & bdmf_hist_point_start))
+        {
+            mo = va_arg(args, struct bdmf_object *);
+            _bhist_rec_start(BHIST_REC_EVENT + ev, mo->drv);
+            _bhist_put_obj(w, mo);
+            hist.rec_skip = !mo->owner;
+        }
+        break;
+
+    case bdmf_hist_ev_link:              /* start: object, object; end: rc */
+    case bdmf_hist_ev_unlink:
+        if ((point & bdmf_hist_point_start))
+        {
+            mo = va_arg(args, struct bdmf_object *);
+            mo2 = va_arg(args, struct bdmf_object *);
+            _bhist_rec_start(BHIST_REC_EVENT + ev, mo->drv);
+            _bhist_put_obj(w, mo);
+            _bhist_put_obj(w, mo2);
+        }
+        if ((point & bdmf_hist_point_end))
+            _bhist_put_num(w, va_arg(args, int));
+        break;
+
+    case bdmf_hist_ev_configure:         /* start: object, string; end: rc */
+        if ((point & bdmf_hist_point_start))
+        {
+            mo = va_arg(args, struct bdmf_object *);
+            _bhist_rec_start(BHIST_REC_EVENT + ev, mo->drv);
+            _bhist_put_obj(w, mo);
+            _bhist_put_str(w, va_arg(args, char *));
+            /* skip temp object used for aggregate attribute/index translation */
+            hist.rec_skip = !*mo->name;
+        }
+        if ((point & bdmf_hist_point_end))
+            _bhist_put_num(w, va_arg(args, int));
+        break;
+
+    case bdmf_hist_ev_mattr_set:         /* start: object, mattr; end: rc */
+        if ((point & bdmf_hist_point_start))
+        {
+            mo = va_arg(args, struct bdmf_object *);
+            _bhist_rec_start(BHIST_REC_EVENT + ev, mo->drv);
+            _bhist_put_obj(w, mo);
+            _bhist_put_mattr(w, mo, va_arg(args, bdmf_mattr_t *));
+        }
+        if ((point & bdmf_hist_point_end))
+            _bhist_put_num(w, va_arg(args, int));
+        break;
+
+    case bdmf_hist_ev_set_as_num:        /* object, aid, index, value, rc */
+    case bdmf_hist_ev_set_as_string:
+    case bdmf_hist_ev_set_as_buf:
+    case bdmf_hist_ev_delete:
+        BUG_ON((point & bdmf_hist_point_both) != bdmf_hist_point_both);
+        mo = va_arg(args, struct bdmf_object *);
+        aid = va_arg(args, int);
+        index = va_arg(args, bdmf_index);
+        _bhist_rec_start(BHIST_REC_EVENT + ev, mo->drv);
+        _bhist_put_obj(w, mo);
+        _bhist_put_index(w, mo, aid, index);
+        if (ev == bdmf_hist_ev_set_as_num)
+            _bhist_put_num_or_ref(w, mo, aid, va_arg(args, bdmf_number));
+        else if (ev == bdmf_hist_ev_set_as_string)
+            _bhist_put_str(w, va_arg(args, char *));
+        else if (ev == bdmf_hist_ev_set_as_buf)
+        {
+            void *data = va_arg(args, void *);
+            _bhist_put_buf(w, mo, aid, data, va_arg(args, uint32_t));
+        }
+        _bhist_put_num(w, va_arg(args, int));
+        break;
+
+    case bdmf_hist_ev_add_as_num:        /* object, aid, index ptr, value, rc, index ptr */
+    case bdmf_hist_ev_add_as_string:
+    case bdmf_hist_ev_add_as_buf:
+        BUG_ON((point & bdmf_hist_point_both) != bdmf_hist_point_both);
+        mo = va_arg(args, struct bdmf_object *);
+        aid = va_arg(args, int);
+        pindex = va_arg(args, bdmf_index *);
+        _bhist_rec_start(BHIST_REC_EVENT + ev, mo->drv);
+        _bhist_put_obj(w, mo);
+        _bhist_put_index_ptr(w, mo, aid, pindex);
+        if (ev == bdmf_hist_ev_add_as_num)
+            _bhist_put_num_or_ref(w, mo, aid, va_arg(args, bdmf_number));
+        else if (ev == bdmf_hist_ev_add_as_string)
+            _bhist_put_str(w, va_arg(args, char *));
+        else
+        {
+            void *data = va_arg(args, void *);
+            _bhist_put_buf(w, mo, aid, data, va_arg(args, uint32_t));
+        }
+        _bhist_put_num(w, va_arg(args, int));
+        _bhist_put_index_ptr(w, mo, aid, va_arg(args, bdmf_index *));
+        break;
+
+    default:
+        BDMF_TRACE_ERR("history: unknown event %d\n", ev);
+        BUG();
+    }
+
+    if ((point & bdmf_hist_point_end))
+        _bhist_rec_commit();
+}
+
+/* Record custom event in binary format. The event is kept as text */
+static void _bhist_event(const char *event, bdmf_history_point_t point, const char *format, va_list args)
+{
+    struct bhist_wbuf *w = &hist.rec;
+    int size;
+
+    if ((point & bdmf_hist_point_start))
+    {
+        _bhist_rec_start(BHIST_REC_CUSTOM, NULL);
+        _bhist_put(w, event, strlen(event));
+        _bhist_put(w, " ", 1);
+    }
+    if (!w->overflow)
+    {
+        size = vsnprintf((char *)w->buf + w->len, w->size - w->len, format, args);
+        if (size >= w->size - w->len)
+            w->overflow = 1;
+        else
+            w->len += size;
+    }
+    if ((point & bdmf_hist_point_end))
+        _bhist_rec_commit();
+}
+
+/* Copy history records starting from stream position to the output buffer.
+ * Stream header and type definitions not sent yet are inserted as necessary.
+ * Must be called under hist.lock
+ * Returns number of bytes placed in the buffer
+ */
+static uint32_t _bhist_stream_emit(struct bhist_stream *s, uint8_t *out, uint32_t size)
+{
+    uint8_t hdr[BHIST_REC_HDR_LEN];
+    uint16_t rec_len, type_id;
+    uint32_t len = 0;
+
+    if (!s->header_sent)
+    {
+        if (size < BHIST_MAGIC_LEN)
+            return 0;
+        memcpy(out, BHIST_MAGIC, BHIST_MAGIC_LEN);
+        len = BHIST_MAGIC_LEN;
+        s->header_sent = 1;
+    }
+    /* Reader was too slow. Records were overwritten */
+    if ((int32_t)(hist.tail - s->pos) > 0)
+    {
+        s->pos = hist.tail;
+        ++s->ngaps;
+    }
+    while (s->pos != hist.head)
+    {
+        _bhist_ring_get(s->pos, hdr, BHIST_REC_HDR_LEN);
+        rec_len = _bhist_get_u16(hdr);
+        type_id = _bhist_get_u16(&hdr[3]);
+        if (type_id < hist.ntypes && !(s->sent[type_id / 8] & (1 << (type_id % 8))))
+        {
+            struct bhist_type *t = &hist.types[type_id];
+            if (len + t->def_len > size)
+                break;
+            memcpy(out + len, t->def, t->def_len);
+            len += t->def_len;
+            s->sent[type_id / 8] |= (1 << (type_id % 8));
+        }
+        if (len + rec_len > size)
+            break;
+        _bhist_ring_get(s->pos, out + len, rec_len);
+        len += rec_len;
+        s->pos += rec_len;
+    }
+    return len;
+}
+
+/* Write history starting from stream position to file */
+static int _bhist_write_file(bdmf_file f, struct bhist_stream *s, uint8_t *chunk)
+{
+    uint32_t n;
+
+    do
+    {
+        bdmf_fastlock_lock(&hist.lock);
+        n = _bhist_stream_emit(s, chunk, BHIST_OUT_CHUNK_SIZE);
+        bdmf_fastlock_unlock(&hist.lock);
+        if (n && bdmf_file_write(f, chunk, n) != n)
+            return BDMF_ERR_IO;
+    } while (n);
+    return 0;
+}
+
+/* Save binary history */
+static int _bhist_save(bdmf_file f)
+{
+    struct bhist_stream s = {};
+    uint8_t *chunk;
+    int rc;
+
+    chunk = bdmf_alloc(BHIST_OUT_CHUNK_SIZE);
+    if (!chunk)
+        return BDMF_ERR_NOMEM;
+    bdmf_fastlock_lock(&hist.lock);
+    s.pos = hist.tail;
+    bdmf_fastlock_unlock(&hist.lock);
+    rc = _bhist_write_file(f, &s, chunk);
+    bdmf_free(chunk);
+    return rc;
+}
+
+#ifndef __KERNEL__
+/* Flush streamed history to file */
+static void _bhist_stream_flush(void)
+{
+    if (_bhist_write_file(hist.fstream, &hist.stream, hist.stream_chunk))
+    {
+        BDMF_TRACE_ERR("history: error when writing to stream file. Streaming stopped.\n");
+        bdmf_history_stream_stop();
+    }
+}
+#endif
+
+/* Sometimes bdmf API can call other APIs.
+ * Record only the outer call
+ */
+#define BDMF_HISTORY_HANDLE_POINT(point) \
+    do { \
+        if ((point & bdmf_hist_point_start)) \
+        { \
+            ++hist.level; \
+            if (hist.level > 1) \
+            { \
+                if ((point & bdmf_hist_point_end)) \
+                    --hist.level; \
+                return; \
+            } \
+        } \
+        if ((point & bdmf_hist_point_end)) \
+        { \
+            BUG_ON(hist.level <= 0); \
+            --hist.level; \
+            if (hist.level) \
+                return; \
+        } \
+    } while(0)
+
+/* Record built-in history event */
+void bdmf_history_bi_event(bdmf_history_event_t ev, bdmf_history_point_t point, ...)
+{
+    va_list args;
+
+    BDMF_HISTORY_HANDLE_POINT(point);
+
+    if (!hist.record_on)
+        return;
+
+    va_start(args, point);
+    if (hist.format == bdmf_hist_format_binary)
+    {
+        _bhist_bi_event(ev, point, args);
+        va_end(args);
+        return;
+    }
+    switch(ev)
+    {
+    case bdmf_hist_ev_set_as_num:       /**< bdmf_attrelem_set_as_num() */
+        _bdmf_hist_set_as_num(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_add_as_num:       /**< bdmf_attrelem_add_as_num() */
+        _bdmf_hist_add_as_num(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_set_as_buf:       /**< bdmf_attrelem_set_as_buf() */
+        _bdmf_hist_set_as_buf(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_add_as_buf:       /**< bdmf_attrelem_add_as_buf() */
+        _bdmf_hist_add_as_buf(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_mattr_set:        /**< bdmf_mattr_set() */
+        _bdmf_hist_mattr_set(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_set_as_string:    /**< bdmf_attrelem_set_as_string() */
+        _bdmf_hist_set_as_string(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_add_as_string:    /**< bdmf_attrelem_add_as_string() */
+        _bdmf_hist_add_as_string(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_delete:           /**< bdmf_attrelem_delete() */
+        _bdmf_hist_delete(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_new_and_configure: /**< bdmf_new_and_configure() */
+        _bdmf_hist_new_and_configure(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_new_and_set:       /**< bdmf_new_and_set() */
+        _bdmf_hist_new_and_set(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_destroy:           /**< bdmf_destroy() */
+        _bdmf_hist_destroy(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_link:              /**< bdmf_link() */
+    case bdmf_hist_ev_unlink:            /**< bdmf_unlink() */
+        _bdmf_hist_link_unlink(ev, point, args);
+        break;
+
+    case bdmf_hist_ev_configure:         /**< bdmf_configure() */
+        _bdmf_hist_configure(ev, point, args);
+        break;
+
+    default:
+        BDMF_TRACE_ERR("history: unknown event %d\n", ev);
+        BUG();
+    }
+    va_end(args);
+}
+
+/* Record custom event
+ *
+ * History event is represented by a string terminated by "\n" \n
+ * event_name event_parameters_separated_by_a_single_space # rc optional_results\\n \n
+ *
+ * \param[in]   event   Event name - must match event in bdmf_history_event_register()
+ * \param[in]   point   Recording point: start of event, end of event or both
+ * \param[in]   format  printf-like format
+ */
+void bdmf_history_event(const char *event, bdmf_history_point_t point, const char *format, ...)
+{
+    va_list args;
+
+    BDMF_HISTORY_HANDLE_POINT(point);
+
+    if (!hist.record_on)
+        return;
+
+    va_start(args, format);
+    if (hist.format == bdmf_hist_format_binary)
+        _bhist_event(event, point, format, args);
+    else
+    {
+        if ((point & bdmf_hist_point_start))
+            _bdmf_hist_printf("%s ", event);
+        _bdmf_hist_vprintf(format, args);
+    }
+    va_end(args);
+
+    return;
+}
+
+/*
+ * Event decoding (re-playing) support
+ */
+
+#define HIST_PB_ERROR(format, args...) \
+    BDMF_TRACE_ERR("BDMF history pb error in line %d. " format, hist.nline, ## args);
+
+static struct hist_ev *_bdmf_hist_ev_get(const char *event)
+{
+    struct hist_ev *e;
+    STAILQ_FOREACH(e, &hist.ev_list, list)
+    {
+        if (!strcmp(e->event, event))
+            return e;
+    }
+    return NULL;
+}
+
+/* Get next character of the event being decoded.
+ * Custom events recorded in binary history are decoded from memory
+ * \return 1=OK, 0=end of input, <0-error
+ */
+static int _bdmf_hist_dec_getc(char *c)
+{
+    if (!hist.dec_mem)
+        return bdmf_file_read(hist.fdec, c, 1);
+    if (!hist.dec_mem_len)
+        return 0;
+    *c = *(hist.dec_mem++);
+    --hist.dec_mem_len;
+    return 1;
+}
+
+/** Get numeric argument
+ * \param[out]  n       Numeric argument
+ * \return 0=OK or error code <0
+ */
+int bdmf_history_decode_num(bdmf_number *n)
+{
+    char *num_buf;
+    int rc;
+    rc = bdmf_history_decode_string(&num_buf);
+    if (rc)
+        return rc;
+    if (!sscanf(num_buf, "%lld", (long long *)n))
+    {
+        BDMF_TRACE_ERR("history: can't decode number <%s>\n", num_buf);
+        return BDMF_ERR_PARSE;
+    }
+    return 0;
+}
+
+/* Get string argument */
+static int _bdmf_history_decode_string(char **s)
+{
+    char c=0;
+    int quoted_string=0;
+    int rc;
+    int size = sizeof(hist.dec_buf) - (hist.pdec - hist.dec_buf);
+
+    *s = hist.pdec;
+    if (!hist.fdec && !hist.dec_mem)
+        return BDMF_ERR_STATE;
+    if (hist.dec_state == histdec_eol)
+        return BDMF_ERR_PARSE;
+    rc = _bdmf_hist_dec_getc(&c);
+
+    /* Skip leading spaces */
+    while (rc > 0 && c == ' ')
+        rc = _bdmf_hist_dec_getc(&c);
+
+    if (c == '"')
+    {
+        quoted_string = 1;
+        rc = _bdmf_hist_dec_getc(&c);
+    }
+    while((size > 1) && (rc > 0) &&
+        !((c == '\n') || !c || (quoted_string && c == '"') || (!quoted_string && c == ' ')) )
+    {
+        *(hist.pdec++) = c;
+        --size;
+        rc = _bdmf_hist_dec_getc(&c);
+    }
+    *(hist.pdec++) = 0;
+    if (size <= 1)
+        return BDMF_ERR_OVERFLOW;
+
+    if (c == '\n')
+        hist.dec_state = histdec_eol;
+    else if (!rc)
+        hist.dec_state = histdec_eof;
+
+    if (rc < 0)
+        return BDMF_ERR_IO;
+
+    if (quoted_string && c != '"')
+        return BDMF_ERR_PARSE;
+
+    return 0;
+}
+
+/* Get string argument */
+int bdmf_history_decode_string(char **s)
 {
     static char *null_str="";
     if ((hist.dec_state != histdec_parm) && (hist.dec_state != histdec_out_parm))
     {
-        *s = null_str;
-        return BDMF_ERR_PARSE;
+        *s = null_str;
+        return BDMF_ERR_PARSE;
+    }
+    return _bdmf_history_decode_string(s);
+}
+
+/* Get string argument up to '#' terminator */
+static int _bdmf_history_decode_string_up_to_rc(char **s)
+{
+    char c=0;
+    int rc;
+    int size = sizeof(hist.dec_buf) - (hist.pdec - hist.dec_buf);
+    static char *null_str="";
+    if ((hist.dec_state != histdec_parm) && (hist.dec_state != histdec_out_parm))
+    {
+        *s = null_str;
+        return BDMF_ERR_PARSE;
+    }
+
+    *s = hist.pdec;
+    if (!hist.fdec && !hist.dec_mem)
+        return BDMF_ERR_STATE;
+    if (hist.dec_state == histdec_eol)
+        return BDMF_ERR_PARSE;
+    rc = _bdmf_hist_dec_getc(&c);
+    while((size > 1) && (rc > 0) && !((c == '\n') || (c == '#')) )
+    {
+        /* Ignore spaces */
+        if (c != ' ')
+        {
+            *(hist.pdec++) = c;
+            --size;
+        }
+        rc = _bdmf_hist_dec_getc(&c);
+    }
+    *(hist.pdec++) = 0;
+    if (size <= 1)
+        return BDMF_ERR_OVERFLOW;
+
+    if (c == '\n')
+        hist.dec_state = histdec_eol;
+    else if (!rc)
+        hist.dec_state = histdec_eof;
+
+    if (rc < 0)
+        return BDMF_ERR_IO;
+
+    if (c != '#')
+        return BDMF_ERR_PARSE;
+
+    return 0;
+
+}
+
+/** Get binary argument */
+int bdmf_history_decode_buf(void **buf, uint32_t *size)
+{
+    char *hbuf;
+    int bb_size = sizeof(hist.dec_bbuf) - (hist.pbbuf - hist.dec_bbuf);
+    int rc;
+    rc = bdmf_history_decode_string(&hbuf);
+    if (rc < 0)
+        return rc;
+
+    /* Special handling for NULL passed as buffer */
+    if (*hbuf == '-')
+    {
+        *buf = NULL;
+        *size = 0;
+        return rc;
+    }
+
+    rc = bdmf_strhex(hbuf, (uint8_t *)hist.pbbuf, bb_size);
+    if (rc < 0)
+        return rc;
+    *buf = hist.pbbuf;
+    *size = rc;
+    hist.pbbuf += rc;
+    return 0;
+}
+
+/** Get attribute index argument - from string format */
+static int _bdmf_history_decode_index(char *sbuf, struct bdmf_object *mo, bdmf_attr_id aid, bdmf_index *pindex)
+{
+    struct bdmf_attr *attr = &mo->drv->aattr[aid];
+    int bb_size = sizeof(hist.dec_bbuf) - (hist.pbbuf - hist.dec_bbuf);
+    int rc;
+
+    if ((unsigned)aid >= mo->drv->nattrs)
+        return BDMF_ERR_PARM;
+
+    /* Special handling for NULL passed as buffer */
+    if (*sbuf == '-' || !strcmp(sbuf, "null"))
+    {
+        *pindex = BDMF_INDEX_UNASSIGNED;
+        return 0;
+    }
+    if (bb_size < attr->index_size)
+        return BDMF_ERR_OVERFLOW;
+    rc = bdmf_attr_string_to_array_index(mo, attr, sbuf, hist.pbbuf);
+    if (rc < 0)
+        return rc;
+    if (bdmf_attr_type_is_numeric(attr->index_type))
+        *pindex = *(bdmf_index *)hist.pbbuf;
+    else
+        *pindex = (bdmf_index)hist.pbbuf;
+    hist.pbbuf += attr->index_size;
+    return 0;
+}
+
+/** Decode return code following '#' character. The '#' itself has already been read */
+static int _bdmf_history_decode_rc_value(int *res)
+{
+    char *rc_str;
+    char *pend;
+    int rc;
+
+    rc = _bdmf_history_decode_string(&rc_str);
+    if (rc)
+        return rc;
+
+    if (hist.dec_state != histdec_eol)
+        hist.dec_state = histdec_out_parm;
+    *res = strtol(rc_str, &pend, 10);
+    if (pend && *pend)
+    {
+        HIST_PB_ERROR("Expected numerical res, got %s\n", rc_str);
+        return BDMF_ERR_PARSE;
+    }
+    return 0;
+
+}
+
+/** Decode return code */
+int bdmf_history_decode_rc(int *res)
+{
+    char *out_str;
+    int rc;
+    rc = _bdmf_history_decode_string(&out_str);
+    if (rc)
+        return rc;
+    if (strcmp(out_str, "#"))
+    {
+        HIST_PB_ERROR("Expected '#' got %s\n", out_str);
+        return BDMF_ERR_PARSE;
+    }
+    return _bdmf_history_decode_rc_value(res);
+}
+
+/** Decode mattr
+ * start:   n * { aid, index, type, value }
+ */
+static int _bdmf_hist_decode_mattr(struct bdmf_object *mo, bdmf_mattr_handle mattr)
+{
+    bdmf_number nattrs;
+    int i;
+    int rc = 0;
+
+    rc = bdmf_history_decode_num(&nattrs);
+    if (rc)
+        return rc;
+    if ((unsigned)nattrs > ((bdmf_mattr_t *)mattr)->max_entries)
+    {
+        HIST_PB_ERROR("Error when parsing mattr. nattrs %d is insane\n", (int)nattrs);
+        return BDMF_ERR_PARSE;
+    }
+
+    for(i=0; i<(int)nattrs; i++)
+    {
+        char *attr_name;
+        bdmf_attr_id aid;
+        bdmf_number type;
+        bdmf_index index;
+        char *index_buf;
+
+        rc = bdmf_history_decode_string(&attr_name);
+        rc = rc ? rc : bdmf_attr_by_name(mo->drv, attr_name, &aid);
+        rc = rc ? rc : bdmf_history_decode_string(&index_buf);
+        rc = rc ? rc : _bdmf_history_decode_index(index_buf, mo, aid, &index);
+        rc = rc ? rc : bdmf_history_decode_num(&type);
+        if (rc)
+            break;
+        switch((bdmf_attr_type_t)type)
+        {
+        case bdmf_attr_number:
+        {
+            bdmf_number nval;
+            rc = bdmf_history_decode_num(&nval);
+            rc = rc ? rc : bdmf_attrelem_set_as_num(mattr, (bdmf_attr_id)aid, index, nval);
+        }
+        break;
+
+        case bdmf_attr_string:
+        {
+            char *sval;
+            rc = bdmf_history_decode_string(&sval);
+            rc = rc ? rc : bdmf_attrelem_set_as_string(mattr, (bdmf_attr_id)aid, index, sval);
+        }
+        break;
+
+        case bdmf_attr_buffer:
+        {
+            void *bval;
+            uint32_t bsize = 0;
+            rc = bdmf_history_decode_buf(&bval, &bsize);
+            rc = rc ? rc : bdmf_attrelem_set_as_buf(mattr, (bdmf_attr_id)aid, index, bval, bsize);
+        }
+        break;
+
+        default:
+            rc = BDMF_ERR_PARSE;
+            break;
+        }
+
+        if (rc)
+        {
+            HIST_PB_ERROR("Error when parsing mattr attribute #%d\n", i);
+            break;
+        }
+    }
+    return rc;
+}
+
+/**
+ * start:   type, parent, string
+ * end:     rc
+ */
+static int _bdmf_hist_decode_new_and_configure(void)
+{
+    int rc;
+    char *type;
+    char *parent;
+    char *attrs;
+    char *mo_name = "";
+    struct bdmf_object *owner = NULL;
+    struct bdmf_type *drv = NULL;
+    struct bdmf_object *mo = NULL;
+    int res;
+
+    rc = bdmf_history_decode_string(&type);
+    rc = rc ? rc : bdmf_history_decode_string(&parent);
+    rc = rc ? rc : _bdmf_history_decode_string_up_to_rc(&attrs);
+    rc = rc ? rc : _bdmf_history_decode_rc_value(&res);
+    rc = (rc || res) ? rc : bdmf_history_decode_string(&mo_name);
+    if (rc)
+        return rc;
+
+    rc = bdmf_type_find_get(type, &drv);
+    if (strcmp(parent, "*"))
+        rc = rc ? rc : bdmf_find_get_by_name(parent, &owner);
+    if (rc)
+        rc = BDMF_ERR_HIST_RES_MISMATCH;
+    else
+        rc = bdmf_new_and_configure(drv, owner, attrs, &mo);
+
+    /* Cleanup */
+    if (owner)
+        bdmf_put(owner);
+    if (drv)
+        bdmf_type_put(drv);
+
+    if ((rc != res) || (mo && strcmp(mo->name, mo_name)))
+        return BDMF_ERR_HIST_RES_MISMATCH;
+    return 0;
+}
+
+static int _bdmf_hist_decode_new_and_set(void)
+{
+    static struct bdmf_object mo_tmp = { .name="*new*" };
+    int rc;
+    char *type;
+    char *parent;
+    char *mo_name = "";
+    struct bdmf_object *owner = NULL;
+    struct bdmf_type *drv = NULL;
+    struct bdmf_object *mo = NULL;
+    int actual_res=0, res;
+
+    rc = bdmf_history_decode_string(&type);
+    rc = rc ? rc : bdmf_history_decode_string(&parent);
+    if (rc)
+        return rc;
+
+    /* Find stuff. From this point on we must cleanup */
+    rc = bdmf_type_find_get(type, &drv);
+    if (strcmp(parent, "*"))
+        rc = rc ? rc : bdmf_find_get_by_name(parent, &owner);
+    if (rc)
+    {
+        rc = BDMF_ERR_HIST_RES_MISMATCH;
+        goto exit;
     }
-    return _bdmf_history_decode_string(s);
+
+    /* Now parse mattr and create object */
+    {
+        BDMF_MATTR(my_mattr, drv);
+        mo_tmp.drv = drv;
+        rc = _bdmf_hist_decode_mattr(&mo_tmp, my_mattr);
+        rc = rc ? rc : bdmf_history_decode_rc(&res);
+        rc = (rc || res) ? rc : bdmf_history_decode_string(&mo_name);
+        if (rc)
+            goto exit;
+        actual_res = bdmf_new_and_set(drv, owner, my_mattr, &mo);
+    }
+
+    /* Cleanup */
+exit:
+    if (owner)
+        bdmf_put(owner);
+    if (drv)
+        bdmf_type_put(drv);
+    if (rc)
+        return rc;
+    if ((actual_res != res) || (mo && strcmp(mo->name, mo_name)))
+        return BDMF_ERR_HIST_RES_MISMATCH;
+    return 0;
 }
 
-/* Get string argument up to '#' terminator */
-static int _bdmf_history_decode_string_up_to_rc(char **s)
+static int _bdmf_hist_decode_destroy(void)
 {
-    char c=0;
     int rc;
-    int size = sizeof(hist.dec_buf) - (hist.pdec - hist.dec_buf);
-    static char *null_str="";
-    if ((hist.dec_state != histdec_parm) && (hist.dec_state != histdec_out_parm))
+    char *objstr;
+    struct bdmf_object *mo = NULL;
+
+    rc = bdmf_history_decode_string(&objstr);
+    if (rc)
+        return rc;
+    rc = bdmf_find_get_by_name(objstr, &mo);
+    if (rc)
+        return BDMF_ERR_HIST_RES_MISMATCH;
+    bdmf_destroy(mo);
+    bdmf_put(mo);
+    return 0;
+}
+
+static int _bdmf_hist_decode_link(void)
+{
+    int rc;
+    char *objstr1, *objstr2;
+    struct bdmf_object *mo1=NULL, *mo2=NULL;
+    int res;
+
+    rc = bdmf_history_decode_string(&objstr1);
+    rc = rc ? rc : bdmf_history_decode_string(&objstr2);
+    rc = rc ? rc : bdmf_history_decode_rc(&res);
+    if (rc)
+        return rc;
+    rc = bdmf_find_get_by_name(objstr1, &mo1);
+    rc = rc ? rc : bdmf_find_get_by_name(objstr2, &mo2);
+    if (rc)
+        rc = BDMF_ERR_HIST_RES_MISMATCH;
+    else
+        rc = bdmf_link(mo1, mo2, NULL);
+
+    /* Cleanup */
+    if (mo1)
+        bdmf_put(mo1);
+    if (mo2)
+        bdmf_put(mo2);
+    if (rc != res)
+        return BDMF_ERR_HIST_RES_MISMATCH;
+    return 0;
+}
+
+static int _bdmf_hist_decode_unlink(void)
+{
+    int rc;
+    char *objstr1, *objstr2;
+    struct bdmf_object *mo1=NULL, *mo2=NULL;
+    int res;
+
+    rc = bdmf_history_decode_string(&objstr1);
+    rc = rc ? rc : bdmf_history_decode_string(&objstr2);
+    rc = rc ? rc : bdmf_history_decode_rc(&res);
+    if (rc)
+        return rc;
+    rc = bdmf_find_get_by_name(objstr1, &mo1);
+    rc = rc ? rc : bdmf_find_get_by_name(objstr2, &mo2);
+    if (rc)
+        rc = BDMF_ERR_HIST_RES_MISMATCH;
+    else
+        rc = bdmf_unlink(mo1, mo2);
+
+    /* Cleanup */
+    if (mo1)
+        bdmf_put(mo1);
+    if (mo2)
+        bdmf_put(mo2);
+    if (rc != res)
+        return BDMF_ERR_HIST_RES_MISMATCH;
+    return 0;
+}
+
+static int _bdmf_hist_decode_configure(void)
+{
+    int rc;
+    char *objstr;
+    struct bdmf_object *mo=NULL;
+    char *attrs;
+    int res;
+
+    rc = bdmf_history_decode_string(&objstr);
+    rc = rc ? rc : _bdmf_history_decode_string_up_to_rc(&attrs);
+    rc = rc ? rc : _bdmf_history_decode_rc_value(&res);
+    if (rc)
+        return rc;
+    rc = bdmf_find_get_by_name(objstr, &mo);
+    if (rc)
+        rc = BDMF_ERR_HIST_RES_MISMATCH;
+    else
+        rc = bdmf_configure(mo, attrs);
+
+    /* Cleanup */
+    if (mo)
+        bdmf_put(mo);
+    if (rc != res)
+        return BDMF_ERR_HIST_RES_MISMATCH;
+    return 0;
+}
+
+static int _bdmf_hist_decode_mattr_set(void)
+{
+    int rc;
+    char *objstr;
+    struct bdmf_object *mo=NULL;
+    int actual_res=0, res;
+
+    rc = bdmf_history_decode_string(&objstr);
+    if (rc)
+        return rc;
+    rc = bdmf_find_get_by_name(objstr, &mo);
+    if (rc)
+        return BDMF_ERR_HIST_RES_MISMATCH;
+
+    /* From this point on we must do cleanup */
+
+    /* Now parse mattr and create object */
     {
-        *s = null_str;
-        return BDMF_ERR_PARSE;
+        BDMF_MATTR(my_mattr, mo->drv);
+        rc = _bdmf_hist_decode_mattr(mo, my_mattr);
+        rc = rc ? rc : bdmf_history_decode_rc(&res);
+        if (rc)
+            goto exit;
+        actual_res = bdmf_mattr_set(mo, my_mattr);
     }
 
-    *s = hist.pdec;
-    if (!hist.fdec)
-        return BDMF_ERR_STATE;
-    if (hist.dec_state == histdec_eol)
-        return BDMF_ERR_PARSE;
-    rc = bdmf_file_read(hist.fdec, &c, 1);
-    while((size > 1) && (rc > 0) && !((c == '\n') || (c == '#')) )
+    /* Cleanup */
+exit:
+    if (mo)
+        bdmf_put(mo);
+    if (rc)
+        return rc;
+    if (actual_res != res)
+        return BDMF_ERR_HIST_RES_MISMATCH;
+    return 0;
+}
+
+static int _bdmf_hist_decode_set_add_as_xx(bdmf_attr_type_t as_what, int is_add)
+{
+    int rc;
+    char *objstr;
+    struct bdmf_object *mo=NULL;
+    char *attr_name;
+    bdmf_attr_id aid;
+    bdmf_number nval=0;
+    char *index_buf, *res_index_buf=NULL;
+    bdmf_index index, res_index = 0;
+    bdmf_index *pindex;
+
+    char res_index_actual[128] = "";
+    char *sval=NULL;
+    void *bval=NULL;
+    uint32_t bsize = 0;
+    int res;
+    struct bdmf_attr *attr;
+
+    rc = bdmf_history_decode_string(&objstr);
+    rc = rc ? rc : bdmf_history_decode_string(&attr_name);
+    rc = rc ? rc : bdmf_history_decode_string(&index_buf);
+    if (as_what == bdmf_attr_number)
+        rc = rc ? rc : bdmf_history_decode_num(&nval);
+    else if (as_what == bdmf_attr_string)
+        rc = rc ? rc : bdmf_history_decode_string(&sval);
+    else
+        rc = rc ? rc : bdmf_history_decode_buf(&bval, &bsize);
+    rc = rc ? rc : bdmf_history_decode_rc(&res);
+    if (is_add)
+        rc = rc ? rc : bdmf_history_decode_string(&res_index_buf);
+
+    /* Done reading. Consult data model */
+    rc = rc ? rc : bdmf_find_get_by_name(objstr, &mo);
+    rc = rc ? rc : bdmf_attr_by_name(mo->drv, attr_name, &aid);
+    rc = rc ? rc : _bdmf_history_decode_index(index_buf, mo, aid, &index);
+    if (is_add)
+        rc = rc ? rc : _bdmf_history_decode_index(res_index_buf, mo, aid, &res_index);
+    else
+        res_index = index;
+
+    if (!rc)
     {
-        /* Ignore spaces */
-        if (c != ' ')
+        attr = bdmf_aid_to_attr(mo->drv, aid);
+        pindex = bdmf_attr_type_is_numeric(attr->index_type) ? &index : (bdmf_index *)index;
+        if (as_what == bdmf_attr_number)
         {
-            *(hist.pdec++) = c;
-            --size;
+            if (is_add)
+                rc = bdmf_attrelem_add_as_num(mo, (bdmf_attr_id)aid, pindex, nval);
+            else
+                rc = bdmf_attrelem_set_as_num(mo, (bdmf_attr_id)aid, index, nval);
+        }
+        else if (as_what == bdmf_attr_string)
+        {
+            struct bdmf_attr *attr = bdmf_aid_to_attr(mo->drv, aid);
+            if (attr->type == bdmf_attr_object && sval && *sval=='{')
+            {
+                int sval_len = strlen(sval);
+                if (sval_len)
+                    sval[sval_len-1] = 0;
+                ++sval;
+            }
+            if (is_add)
+                rc = bdmf_attrelem_add_as_string(mo, (bdmf_attr_id)aid, pindex, sval);
+            else
+                rc = bdmf_attrelem_set_as_string(mo, (bdmf_attr_id)aid, index, sval);
+        }
+        else
+        {
+            if (is_add)
+                rc = bdmf_attrelem_add_as_buf(mo, (bdmf_attr_id)aid, pindex, bval, bsize);
+            else
+                rc = bdmf_attrelem_set_as_buf(mo, (bdmf_attr_id)aid, index, bval, bsize);
         }
-        rc = bdmf_file_read(hist.fdec, &c, 1);
     }
-    *(hist.pdec++) = 0;
-    if (size <= 1)
-        return BDMF_ERR_OVERFLOW;
-
-    if (c == '\n')
-        hist.dec_state = histdec_eol;
-    else if (!rc)
-        hist.dec_state = histdec_eof;
-
-    if (rc < 0)
-        return BDMF_ERR_IO;
-
-    if (c != '#')
-        return BDMF_ERR_PARSE;
+    if (!rc)
+    {
+        bdmf_attr_array_index_to_string(mo, attr, index, res_index_actual, sizeof(res_index_actual));
+    }
 
+    /* Cleanup */
+    if (mo)
+        bdmf_put(mo);
+    if ((rc != res) || (!rc && res_index_buf && strcmp(res_index_buf, res_index_actual)))
+        return BDMF_ERR_HIST_RES_MISMATCH;
     return 0;
-
 }
 
-/** Get binary argument */
-int bdmf_history_decode_buf(void **buf, uint32_t *size)
+static int _bdmf_hist_decode_set_as_num(void)
 {
-    char *hbuf;
-    int bb_size = sizeof(hist.dec_bbuf) - (hist.pbbuf - hist.dec_bbuf);
-    int rc;
-    rc = bdmf_history_decode_string(&hbuf);
-    if (rc < 0)
-        return rc;
+    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 0);
+}
 
-    /* Special handling for NULL passed as buffer */
-    if (*hbuf == '-')
-    {
-        *buf = NULL;
-        *size = 0;
-        return rc;
-    }
+static int _bdmf_hist_decode_set_as_string(void)
+{
+    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 0);
+}
 
-    rc = bdmf_strhex(hbuf, (uint8_t *)hist.pbbuf, bb_size);
-    if (rc < 0)
-        return rc;
-    *buf = hist.pbbuf;
-    *size = rc;
-    hist.pbbuf += rc;
-    return 0;
+static int _bdmf_hist_decode_set_as_buf(void)
+{
+    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 0);
 }
 
-/** Get attribute index argument - from string format */
-static int _bdmf_history_decode_index(char *sbuf, struct bdmf_object *mo, bdmf_attr_id aid, bdmf_index *pindex)
+static int _bdmf_hist_decode_add_as_num(void)
 {
-    struct bdmf_attr *attr = &mo->drv->aattr[aid];
-    int bb_size = sizeof(hist.dec_bbuf) - (hist.pbbuf - hist.dec_bbuf);
-    int rc;
+    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 1);
+}
 
-    if ((unsigned)aid >= mo->drv->nattrs)
-        return BDMF_ERR_PARM;
+static int _bdmf_hist_decode_add_as_string(void)
+{
+    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 1);
+}
 
-    /* Special handling for NULL passed as buffer */
-    if (*sbuf == '-' || !strcmp(sbuf, "null"))
-    {
-        *pindex = BDMF_INDEX_UNASSIGNED;
-        return 0;
-    }
-    if (bb_size < attr->index_size)
-        return BDMF_ERR_OVERFLOW;
-    rc = bdmf_attr_string_to_array_index(mo, attr, sbuf, hist.pbbuf);
-    if (rc < 0)
-        return rc;
-    if (bdmf_attr_type_is_numeric(attr->index_type))
-        *pindex = *(bdmf_index *)hist.pbbuf;
-    else
-        *pindex = (bdmf_index)hist.pbbuf;
-    hist.pbbuf += attr->index_size;
-    return 0;
+static int _bdmf_hist_decode_add_as_buf(void)
+{
+    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 1);
 }
 
-/** Decode return code following '#' character. The '#' itself has already been read */
-static int _bdmf_history_decode_rc_value(int *res)
+static int _bdmf_hist_decode_delete(void)
 {
-    char *rc_str;
-    char *pend;
     int rc;
+    char *objstr;
+    struct bdmf_object *mo=NULL;
+    char *index_buf = NULL, *attr_name = NULL;
+    bdmf_attr_id aid;
+    bdmf_index index;
+    int res;
 
-    rc = _bdmf_history_decode_string(&rc_str);
+    rc = bdmf_history_decode_string(&objstr);
+    rc = rc ? rc : bdmf_history_decode_string(&attr_name);
+    rc = rc ? rc : bdmf_history_decode_string(&index_buf);
+    rc = rc ? rc : bdmf_history_decode_rc(&res);
     if (rc)
         return rc;
-
-    if (hist.dec_state != histdec_eol)
-        hist.dec_state = histdec_out_parm;
-    *res = strtol(rc_str, &pend, 10);
-    if (pend && *pend)
-    {
-        HIST_PB_ERROR("Expected numerical res, got %s\n", rc_str);
-        return BDMF_ERR_PARSE;
-    }
+    rc = bdmf_find_get_by_name(objstr, &mo);
+    if (rc)
+        return BDMF_ERR_HIST_RES_MISMATCH;
+    rc = rc ? rc : bdmf_attr_by_name(mo->drv, attr_name, &aid);
+    rc = rc ? rc : _bdmf_history_decode_index(index_buf, mo, aid, &index);
+    rc = bdmf_attrelem_delete(mo, (bdmf_attr_id)aid, index);
+    /* Cleanup */
+    if (mo)
+        bdmf_put(mo);
+    if (rc != res)
+        return BDMF_ERR_HIST_RES_MISMATCH;
     return 0;
-
 }
 
-/** Decode return code */
-int bdmf_history_decode_rc(int *res)
+/* Play-back a single event in text format.
+ * hist.dec_state is set to histdec_eof when there are no more events
+ * \return 0=OK or error code <0
+ */
+static int _bdmf_history_play_event(bdmf_boolean stop_on_mismatch)
 {
-    char *out_str;
+    char *event = "";
+    struct hist_ev *e;
     int rc;
-    rc = _bdmf_history_decode_string(&out_str);
+
+    hist.pdec = hist.dec_buf;
+    hist.dec_state = histdec_event;
+    hist.pbbuf = hist.dec_bbuf;
+    *hist.pdec = 0;
+    rc = _bdmf_history_decode_string(&event);
+    if (rc || ! *event)
+    {
+        hist.dec_state = histdec_eof;
+        return rc;
+    }
+    e = _bdmf_hist_ev_get(event);
+    if (!e)
+    {
+        HIST_PB_ERROR("Can't parse event %s\n", event);
+        rc = BDMF_ERR_PARSE;
+    }
+    hist.dec_state = histdec_parm;
+    rc = rc ? rc : e->decode();
+    if ((rc == BDMF_ERR_HIST_RES_MISMATCH) && !stop_on_mismatch)
+    {
+        HIST_PB_ERROR("Result mismatch when processing event %s. Ignored\n", event);
+        rc = 0;
+    }
     if (rc)
+    {
+        HIST_PB_ERROR("Error \"%s\"\n", bdmf_strerror(rc));
         return rc;
-    if (strcmp(out_str, "#"))
+    }
+    /* skip to EOL or EOF */
+    while((hist.dec_state != histdec_eol) && (hist.dec_state != histdec_eof))
     {
-        HIST_PB_ERROR("Expected '#' got %s\n", out_str);
-        return BDMF_ERR_PARSE;
+        char *tmp;
+        int tmp_rc;
+        tmp_rc = _bdmf_history_decode_string(&tmp);
+        if (tmp_rc)
+            break;
     }
-    return _bdmf_history_decode_rc_value(res);
+    return 0;
 }
 
-/** Decode mattr
- * start:   n * { aid, index, type, value }
+/*
+ * Binary history play-back.
+ * Records are self-delimited, so play-back doesn't need to tokenize text.
+ * Object types and attributes are resolved once per type definition record.
  */
-static int _bdmf_hist_decode_mattr(struct bdmf_object *mo, bdmf_mattr_handle mattr)
-{
-    bdmf_number nattrs;
-    int i;
-    int rc = 0;
 
-    rc = bdmf_history_decode_num(&nattrs);
-    if (rc)
-        return rc;
-    if ((unsigned)nattrs > ((bdmf_mattr_t *)mattr)->max_entries)
-    {
-        HIST_PB_ERROR("Error when parsing mattr. nattrs %d is insane\n", (int)nattrs);
-        return BDMF_ERR_PARSE;
-    }
+#define BHIST_PLAY_BUF_SIZE     (128 * 1024)
+#define BHIST_PLAY_POOL_SIZE    (4 * BHIST_REC_MAX)
+#define BHIST_AID_NONE          0xffff
 
-    for(i=0; i<(int)nattrs; i++)
-    {
-        char *attr_name;
-        bdmf_attr_id aid;
-        bdmf_number type;
-        bdmf_index index;
-        char *index_buf;
+/* Recorded type as seen by play-back */
+struct bhist_play_type
+{
+    struct bdmf_type *drv;
+    uint32_t nattrs;
+    bdmf_attr_id *aids;         /* Local attribute id by recorded attribute id */
+};
 
-        rc = bdmf_history_decode_string(&attr_name);
-        rc = rc ? rc : bdmf_attr_by_name(mo->drv, attr_name, &aid);
-        rc = rc ? rc : bdmf_history_decode_string(&index_buf);
-        rc = rc ? rc : _bdmf_history_decode_index(index_buf, mo, aid, &index);
-        rc = rc ? rc : bdmf_history_decode_num(&type);
-        if (rc)
-            break;
-        switch((bdmf_attr_type_t)type)
-        {
-        case bdmf_attr_number:
-        {
-            bdmf_number nval;
-            rc = bdmf_history_decode_num(&nval);
-            rc = rc ? rc : bdmf_attrelem_set_as_num(mattr, (bdmf_attr_id)aid, index, nval);
-        }
-        break;
+/* Play-back control block */
+struct bhist_play
+{
+    bdmf_file f;
+    uint8_t *buf;               /* Read buffer */
+    uint32_t len;
+    uint32_t pos;
+    struct bhist_play_type types[BHIST_MAX_TYPES];
+    uint8_t *pool;              /* Decoded strings and indexes of the current record */
+    uint32_t pool_len;
+};
 
-        case bdmf_attr_string:
-        {
-            char *sval;
-            rc = bdmf_history_decode_string(&sval);
-            rc = rc ? rc : bdmf_attrelem_set_as_string(mattr, (bdmf_attr_id)aid, index, sval);
-        }
-        break;
+/* Record being decoded */
+struct bhist_rbuf
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    struct bhist_play_type *t;
+};
 
-        case bdmf_attr_buffer:
-        {
-            void *bval;
-            uint32_t bsize = 0;
-            rc = bdmf_history_decode_buf(&bval, &bsize);
-            rc = rc ? rc : bdmf_attrelem_set_as_buf(mattr, (bdmf_attr_id)aid, index, bval, bsize);
-        }
-        break;
+/* Decoded value */
+struct bhist_val
+{
+    bhist_val_t tag;
+    bdmf_number num;            /* bhist_val_num */
+    const void *data;           /* bhist_val_str, bhist_val_buf */
+    uint32_t len;
+    char *s;                    /* 0-terminated copy of bhist_val_str */
+};
 
-        default:
-            rc = BDMF_ERR_PARSE;
-            break;
-        }
+/* Make sure that at least size bytes are available in the read buffer */
+static int _bhist_play_fill(struct bhist_play *pl, uint32_t size)
+{
+    int n;
 
-        if (rc)
-        {
-            HIST_PB_ERROR("Error when parsing mattr attribute #%d\n", i);
+    if (pl->len - pl->pos >= size)
+        return 0;
+    memmove(pl->buf, pl->buf + pl->pos, pl->len - pl->pos);
+    pl->len -= pl->pos;
+    pl->pos = 0;
+    while (pl->len < size)
+    {
+        n = bdmf_file_read(pl->f, pl->buf + pl->len, BHIST_PLAY_BUF_SIZE - pl->len);
+        if (n < 0)
+            return BDMF_ERR_IO;
+        if (!n)
             break;
-        }
+        pl->len += n;
     }
-    return rc;
+    return 0;
 }
 
-/**
- * start:   type, parent, string
- * end:     rc
+/* Get next record
+ * \return record length, 0=EOF or error code <0
  */
-static int _bdmf_hist_decode_new_and_configure(void)
+static int _bhist_play_next(struct bhist_play *pl, const uint8_t **prec)
 {
+    uint16_t rec_len;
     int rc;
-    char *type;
-    char *parent;
-    char *attrs;
-    char *mo_name = "";
-    struct bdmf_object *owner = NULL;
-    struct bdmf_type *drv = NULL;
-    struct bdmf_object *mo = NULL;
-    int res;
 
-    rc = bdmf_history_decode_string(&type);
-    rc = rc ? rc : bdmf_history_decode_string(&parent);
-    rc = rc ? rc : _bdmf_history_decode_string_up_to_rc(&attrs);
-    rc = rc ? rc : _bdmf_history_decode_rc_value(&res);
-    rc = (rc || res) ? rc : bdmf_history_decode_string(&mo_name);
+    rc = _bhist_play_fill(pl, BHIST_REC_HDR_LEN);
     if (rc)
         return rc;
-
-    rc = bdmf_type_find_get(type, &drv);
-    if (strcmp(parent, "*"))
-        rc = rc ? rc : bdmf_find_get_by_name(parent, &owner);
+    if (pl->len == pl->pos)
+        return 0;
+    if (pl->len - pl->pos < BHIST_REC_HDR_LEN)
+        return BDMF_ERR_PARSE;
+    rec_len = _bhist_get_u16(&pl->buf[pl->pos]);
+    if (rec_len < BHIST_REC_HDR_LEN)
+        return BDMF_ERR_PARSE;
+    rc = _bhist_play_fill(pl, rec_len);
     if (rc)
-        rc = BDMF_ERR_HIST_RES_MISMATCH;
-    else
-        rc = bdmf_new_and_configure(drv, owner, attrs, &mo);
+        return rc;
+    if (pl->len - pl->pos < rec_len)
+        return BDMF_ERR_PARSE;
+    *prec = &pl->buf[pl->pos];
+    pl->pos += rec_len;
+    pl->pool_len = 0;
+    return rec_len;
+}
 
-    /* Cleanup */
-    if (owner)
-        bdmf_put(owner);
-    if (drv)
-        bdmf_type_put(drv);
+/* Allocate from the current record pool */
+static void *_bhist_play_alloc(struct bhist_play *pl, uint32_t size)
+{
+    uint32_t offset = (pl->pool_len + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
 
-    if ((rc != res) || (mo && strcmp(mo->name, mo_name)))
-        return BDMF_ERR_HIST_RES_MISMATCH;
+    if (offset + size > BHIST_PLAY_POOL_SIZE)
+        return NULL;
+    pl->pool_len = offset + size;
+    return pl->pool + offset;
+}
+
+static int _bhist_get_varint(struct bhist_rbuf *r, uint64_t *v)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    uint8_t b;
+
+    do
+    {
+        if (r->p >= r->end || shift > 63)
+            return BDMF_ERR_PARSE;
+        b = *(r->p++);
+        val |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while ((b & 0x80));
+    *v = val;
     return 0;
 }
 
-static int _bdmf_hist_decode_new_and_set(void)
+static int _bhist_get_val(struct bhist_play *pl, struct bhist_rbuf *r, struct bhist_val *v)
 {
-    static struct bdmf_object mo_tmp = { .name="*new*" };
+    uint64_t u = 0;
     int rc;
-    char *type;
-    char *parent;
-    char *mo_name = "";
-    struct bdmf_object *owner = NULL;
-    struct bdmf_type *drv = NULL;
-    struct bdmf_object *mo = NULL;
-    int actual_res=0, res;
-
-    rc = bdmf_history_decode_string(&type);
-    rc = rc ? rc : bdmf_history_decode_string(&parent);
-    if (rc)
-        return rc;
 
-    /* Find stuff. From this point on we must cleanup */
-    rc = bdmf_type_find_get(type, &drv);
-    if (strcmp(parent, "*"))
-        rc = rc ? rc : bdmf_find_get_by_name(parent, &owner);
-    if (rc)
+    if (r->p >= r->end)
+        return BDMF_ERR_PARSE;
+    memset(v, 0, sizeof(*v));
+    v->tag = *(r->p++);
+    switch (v->tag)
     {
-        rc = BDMF_ERR_HIST_RES_MISMATCH;
-        goto exit;
-    }
+    case bhist_val_none:
+        return 0;
 
-    /* Now parse mattr and create object */
-    {
-        BDMF_MATTR(my_mattr, drv);
-        mo_tmp.drv = drv;
-        rc = _bdmf_hist_decode_mattr(&mo_tmp, my_mattr);
-        rc = rc ? rc : bdmf_history_decode_rc(&res);
-        rc = (rc || res) ? rc : bdmf_history_decode_string(&mo_name);
+    case bhist_val_num:
+        rc = _bhist_get_varint(r, &u);
+        v->num = (bdmf_number)((u >> 1) ^ (0 - (u & 1)));
+        return rc;
+
+    case bhist_val_str:
+    case bhist_val_buf:
+        rc = _bhist_get_varint(r, &u);
         if (rc)
-            goto exit;
-        actual_res = bdmf_new_and_set(drv, owner, my_mattr, &mo);
+            return rc;
+        if (u > r->end - r->p)
+            return BDMF_ERR_PARSE;
+        v->data = r->p;
+        v->len = (uint32_t)u;
+        r->p += v->len;
+        if (v->tag == bhist_val_str)
+        {
+            v->s = _bhist_play_alloc(pl, v->len + 1);
+            if (!v->s)
+                return BDMF_ERR_OVERFLOW;
+            memcpy(v->s, v->data, v->len);
+            v->s[v->len] = 0;
+        }
+        return 0;
+
+    default:
+        return BDMF_ERR_PARSE;
     }
+}
 
-    /* Cleanup */
-exit:
-    if (owner)
-        bdmf_put(owner);
-    if (drv)
-        bdmf_type_put(drv);
+static int _bhist_get_num(struct bhist_play *pl, struct bhist_rbuf *r, int *n)
+{
+    struct bhist_val v;
+    int rc;
+
+    rc = _bhist_get_val(pl, r, &v);
     if (rc)
         return rc;
-    if ((actual_res != res) || (mo && strcmp(mo->name, mo_name)))
-        return BDMF_ERR_HIST_RES_MISMATCH;
+    if (v.tag != bhist_val_num)
+        return BDMF_ERR_PARSE;
+    *n = (int)v.num;
     return 0;
 }
 
-static int _bdmf_hist_decode_destroy(void)
+/* Get string. NULL string is decoded as NULL */
+static int _bhist_get_str(struct bhist_play *pl, struct bhist_rbuf *r, char **s)
 {
+    struct bhist_val v;
     int rc;
-    char *objstr;
-    struct bdmf_object *mo = NULL;
 
-    rc = bdmf_history_decode_string(&objstr);
+    rc = _bhist_get_val(pl, r, &v);
     if (rc)
         return rc;
-    rc = bdmf_find_get_by_name(objstr, &mo);
-    if (rc)
-        return BDMF_ERR_HIST_RES_MISMATCH;
-    bdmf_destroy(mo);
-    bdmf_put(mo);
+    if (v.tag != bhist_val_str && v.tag != bhist_val_none)
+        return BDMF_ERR_PARSE;
+    *s = v.s;
     return 0;
 }
 
-static int _bdmf_hist_decode_link(void)
+/* Get object by name. If found, object reference must be released by the caller */
+static int _bhist_get_obj(struct bhist_play *pl, struct bhist_rbuf *r, struct bdmf_object **pmo)
 {
+    char *name;
     int rc;
-    char *objstr1, *objstr2;
-    struct bdmf_object *mo1=NULL, *mo2=NULL;
-    int res;
 
-    rc = bdmf_history_decode_string(&objstr1);
-    rc = rc ? rc : bdmf_history_decode_string(&objstr2);
-    rc = rc ? rc : bdmf_history_decode_rc(&res);
-    if (rc)
+    *pmo = NULL;
+    rc = _bhist_get_str(pl, r, &name);
+    if (rc || !name)
         return rc;
-    rc = bdmf_find_get_by_name(objstr1, &mo1);
-    rc = rc ? rc : bdmf_find_get_by_name(objstr2, &mo2);
-    if (rc)
-        rc = BDMF_ERR_HIST_RES_MISMATCH;
-    else
-        rc = bdmf_link(mo1, mo2, NULL);
-
-    /* Cleanup */
-    if (mo1)
-        bdmf_put(mo1);
-    if (mo2)
-        bdmf_put(mo2);
-    if (rc != res)
+    if (bdmf_find_get_by_name(name, pmo))
         return BDMF_ERR_HIST_RES_MISMATCH;
     return 0;
 }
 
-static int _bdmf_hist_decode_unlink(void)
+/* Get attribute id and index */
+static int _bhist_get_index(struct bhist_play *pl, struct bhist_rbuf *r, struct bdmf_object *mo,
+    bdmf_attr_id *paid, bdmf_index *pindex)
 {
+    struct bdmf_attr *attr;
+    struct bhist_val v;
+    uint64_t raid;
+    void *index_buf;
     int rc;
-    char *objstr1, *objstr2;
-    struct bdmf_object *mo1=NULL, *mo2=NULL;
-    int res;
 
-    rc = bdmf_history_decode_string(&objstr1);
-    rc = rc ? rc : bdmf_history_decode_string(&objstr2);
-    rc = rc ? rc : bdmf_history_decode_rc(&res);
+    rc = _bhist_get_varint(r, &raid);
+    rc = rc ? rc : _bhist_get_val(pl, r, &v);
     if (rc)
         return rc;
-    rc = bdmf_find_get_by_name(objstr1, &mo1);
-    rc = rc ? rc : bdmf_find_get_by_name(objstr2, &mo2);
-    if (rc)
-        rc = BDMF_ERR_HIST_RES_MISMATCH;
-    else
-        rc = bdmf_unlink(mo1, mo2);
-
-    /* Cleanup */
-    if (mo1)
-        bdmf_put(mo1);
-    if (mo2)
-        bdmf_put(mo2);
-    if (rc != res)
+    if (!r->t->drv || mo->drv != r->t->drv || raid >= r->t->nattrs || r->t->aids[raid] == BHIST_AID_NONE)
         return BDMF_ERR_HIST_RES_MISMATCH;
+    *paid = r->t->aids[raid];
+    attr = bdmf_aid_to_attr(mo->drv, *paid);
+
+    if (v.tag == bhist_val_none)
+    {
+        *pindex = BDMF_INDEX_UNASSIGNED;
+        return 0;
+    }
+    if (v.tag == bhist_val_num)
+    {
+        *pindex = (bdmf_index)v.num;
+        return 0;
+    }
+    index_buf = _bhist_play_alloc(pl, (attr->index_size > v.len) ? attr->index_size : v.len);
+    if (!index_buf)
+        return BDMF_ERR_OVERFLOW;
+    memset(index_buf, 0, attr->index_size);
+    if (v.tag == bhist_val_buf)
+        memcpy(index_buf, v.data, v.len);
+    else
+    {
+        rc = bdmf_attr_string_to_array_index(mo, attr, v.s, index_buf);
+        if (rc < 0)
+            return rc;
+    }
+    *pindex = (bdmf_index)index_buf;
     return 0;
 }
 
-static int _bdmf_hist_decode_configure(void)
+/* Set or add (if pindex != NULL) recorded attribute value */
+static int _bhist_play_set(bdmf_object_handle mo_or_mattr, struct bdmf_attr *attr, bdmf_attr_id aid,
+    bdmf_index index, bdmf_index *pindex, struct bhist_val *v)
+{
+    char *s = v->s;
+
+    switch (v->tag)
+    {
+    case bhist_val_num:
+        if (pindex)
+            return bdmf_attrelem_add_as_num(mo_or_mattr, aid, pindex, v->num);
+        return bdmf_attrelem_set_as_num(mo_or_mattr, aid, index, v->num);
+
+    case bhist_val_str:
+        /* Object reference converted to string is enclosed in {} */
+        if (attr->type == bdmf_attr_object && *s == '{' && v->len > 1)
+        {
+            s[v->len - 1] = 0;
+            ++s;
+        }
+        if (pindex)
+            return bdmf_attrelem_add_as_string(mo_or_mattr, aid, pindex, s);
+        return bdmf_attrelem_set_as_string(mo_or_mattr, aid, index, s);
+
+    default:
+        if (pindex)
+            return bdmf_attrelem_add_as_buf(mo_or_mattr, aid, pindex, (void *)v->data, v->len);
+        return bdmf_attrelem_set_as_buf(mo_or_mattr, aid, index, (void *)v->data, v->len);
+    }
+}
+
+static int _bhist_get_mattr(struct bhist_play *pl, struct bhist_rbuf *r, struct bdmf_object *mo,
+    bdmf_mattr_handle mattr)
 {
+    struct bhist_val v;
+    bdmf_attr_id aid;
+    bdmf_index index;
+    uint64_t nattrs;
+    uint32_t i;
     int rc;
-    char *objstr;
-    struct bdmf_object *mo=NULL;
-    char *attrs;
-    int res;
 
-    rc = bdmf_history_decode_string(&objstr);
-    rc = rc ? rc : _bdmf_history_decode_string_up_to_rc(&attrs);
-    rc = rc ? rc : _bdmf_history_decode_rc_value(&res);
+    rc = _bhist_get_varint(r, &nattrs);
     if (rc)
         return rc;
-    rc = bdmf_find_get_by_name(objstr, &mo);
-    if (rc)
+    if (nattrs > ((bdmf_mattr_t *)mattr)->max_entries)
+        return BDMF_ERR_PARSE;
+    for (i = 0; i < (uint32_t)nattrs && !rc; i++)
+    {
+        rc = _bhist_get_index(pl, r, mo, &aid, &index);
+        rc = rc ? rc : _bhist_get_val(pl, r, &v);
+        rc = rc ? rc : _bhist_play_set(mattr, bdmf_aid_to_attr(mo->drv, aid), aid, index, NULL, &v);
+    }
+    return rc;
+}
+
+/* bdmf_new_and_configure(), bdmf_new_and_set() */
+static int _bhist_play_new(struct bhist_play *pl, bdmf_history_event_t ev, struct bhist_rbuf *r)
+{
+    static struct bdmf_object mo_tmp = { .name="*new*" };
+    struct bdmf_type *drv = r->t->drv;
+    struct bdmf_object *owner = NULL;
+    struct bdmf_object *mo = NULL;
+    char *attrs = NULL;
+    char *mo_name = NULL;
+    int actual_res = 0, res;
+    int rc;
+
+    rc = _bhist_get_obj(pl, r, &owner);
+    if (!rc && !drv)
         rc = BDMF_ERR_HIST_RES_MISMATCH;
-    else
-        rc = bdmf_configure(mo, attrs);
+    if (!rc && ev == bdmf_hist_ev_new_and_configure)
+    {
+        rc = _bhist_get_str(pl, r, &attrs);
+        rc = rc ? rc : _bhist_get_num(pl, r, &res);
+        rc = rc ? rc : _bhist_get_str(pl, r, &mo_name);
+        if (!rc)
+            actual_res = bdmf_new_and_configure(drv, owner, attrs, &mo);
+    }
+    else if (!rc)
+    {
+        BDMF_MATTR(my_mattr, drv);
+        mo_tmp.drv = drv;
+        rc = _bhist_get_mattr(pl, r, &mo_tmp, my_mattr);
+        rc = rc ? rc : _bhist_get_num(pl, r, &res);
+        rc = rc ? rc : _bhist_get_str(pl, r, &mo_name);
+        if (!rc)
+            actual_res = bdmf_new_and_set(drv, owner, my_mattr, &mo);
+    }
 
     /* Cleanup */
-    if (mo)
-        bdmf_put(mo);
-    if (rc != res)
+    if (owner)
+        bdmf_put(owner);
+    if (rc)
+        return rc;
+    if ((actual_res != res) || (mo && (!mo_name || strcmp(mo->name, mo_name))))
         return BDMF_ERR_HIST_RES_MISMATCH;
     return 0;
 }
 
-static int _bdmf_hist_decode_mattr_set(void)
+/* bdmf_destroy(), bdmf_link(), bdmf_unlink(), bdmf_configure(), bdmf_mattr_set() */
+static int _bhist_play_obj(struct bhist_play *pl, bdmf_history_event_t ev, struct bhist_rbuf *r)
 {
+    struct bdmf_object *mo = NULL, *mo2 = NULL;
+    char *attrs;
+    int actual_res = 0, res = 0;
     int rc;
-    char *objstr;
-    struct bdmf_object *mo=NULL;
-    int actual_res=0, res;
 
-    rc = bdmf_history_decode_string(&objstr);
+    rc = _bhist_get_obj(pl, r, &mo);
+    if (!rc && !mo)
+        rc = BDMF_ERR_PARSE;
     if (rc)
         return rc;
-    rc = bdmf_find_get_by_name(objstr, &mo);
-    if (rc)
-        return BDMF_ERR_HIST_RES_MISMATCH;
 
-    /* From this point on we must do cleanup */
+    switch (ev)
+    {
+    case bdmf_hist_ev_destroy:
+        bdmf_destroy(mo);
+        break;
 
-    /* Now parse mattr and create object */
+    case bdmf_hist_ev_link:
+    case bdmf_hist_ev_unlink:
+        rc = _bhist_get_obj(pl, r, &mo2);
+        rc = rc ? rc : _bhist_get_num(pl, r, &res);
+        if (rc)
+            break;
+        if (ev == bdmf_hist_ev_link)
+            actual_res = bdmf_link(mo, mo2, NULL);
+        else
+            actual_res = bdmf_unlink(mo, mo2);
+        break;
+
+    case bdmf_hist_ev_configure:
+        rc = _bhist_get_str(pl, r, &attrs);
+        rc = rc ? rc : _bhist_get_num(pl, r, &res);
+        if (!rc)
+            actual_res = bdmf_configure(mo, attrs);
+        break;
+
+    default: /* bdmf_hist_ev_mattr_set */
     {
         BDMF_MATTR(my_mattr, mo->drv);
-        rc = _bdmf_hist_decode_mattr(mo, my_mattr);
-        rc = rc ? rc : bdmf_history_decode_rc(&res);
-        if (rc)
-            goto exit;
-        actual_res = bdmf_mattr_set(mo, my_mattr);
+        rc = _bhist_get_mattr(pl, r, mo, my_mattr);
+        rc = rc ? rc : _bhist_get_num(pl, r, &res);
+        if (!rc)
+            actual_res = bdmf_mattr_set(mo, my_mattr);
+        break;
+    }
     }
 
     /* Cleanup */
-exit:
-    if (mo)
-        bdmf_put(mo);
+    bdmf_put(mo);
+    if (mo2)
+        bdmf_put(mo2);
     if (rc)
         return rc;
     if (actual_res != res)
@@ -1254,152 +2598,220 @@ exit:
     return 0;
 }
 
-static int _bdmf_hist_decode_set_add_as_xx(bdmf_attr_type_t as_what, int is_add)
+/* bdmf_attrelem_set_as_xx(), bdmf_attrelem_add_as_xx(), bdmf_attrelem_delete() */
+static int _bhist_play_attrelem(struct bhist_play *pl, bdmf_history_event_t ev, struct bhist_rbuf *r)
 {
+    int is_add = (ev == bdmf_hist_ev_add_as_num || ev == bdmf_hist_ev_add_as_string ||
+        ev == bdmf_hist_ev_add_as_buf);
+    struct bdmf_object *mo = NULL;
+    struct bdmf_attr *attr = NULL;
+    struct bhist_val v;
+    bdmf_attr_id aid = 0, res_aid;
+    bdmf_index index = 0, res_index;
+    bdmf_index *pindex = NULL;
+    int actual_res = 0, res = 0;
     int rc;
-    char *objstr;
-    struct bdmf_object *mo=NULL;
-    char *attr_name;
-    bdmf_attr_id aid;
-    bdmf_number nval=0;
-    char *index_buf, *res_index_buf=NULL;
-    bdmf_index index, res_index = 0;
-    bdmf_index *pindex;
-
-    char res_index_actual[128] = "";
-    char *sval=NULL;
-    void *bval=NULL;
-    uint32_t bsize = 0;
-    int res;
-    struct bdmf_attr *attr;
 
-    rc = bdmf_history_decode_string(&objstr);
-    rc = rc ? rc : bdmf_history_decode_string(&attr_name);
-    rc = rc ? rc : bdmf_history_decode_string(&index_buf);
-    if (as_what == bdmf_attr_number)
-        rc = rc ? rc : bdmf_history_decode_num(&nval);
-    else if (as_what == bdmf_attr_string)
-        rc = rc ? rc : bdmf_history_decode_string(&sval);
-    else
-        rc = rc ? rc : bdmf_history_decode_buf(&bval, &bsize);
-    rc = rc ? rc : bdmf_history_decode_rc(&res);
-    if (is_add)
-        rc = rc ? rc : bdmf_history_decode_string(&res_index_buf);
+    rc = _bhist_get_obj(pl, r, &mo);
+    if (!rc && !mo)
+        rc = BDMF_ERR_PARSE;
+    rc = rc ? rc : _bhist_get_index(pl, r, mo, &aid, &index);
+    if (rc)
+        goto exit;
+    attr = bdmf_aid_to_attr(mo->drv, aid);
 
-    /* Done reading. Consult data model */
-    rc = rc ? rc : bdmf_find_get_by_name(objstr, &mo);
-    rc = rc ? rc : bdmf_attr_by_name(mo->drv, attr_name, &aid);
-    rc = rc ? rc : _bdmf_history_decode_index(index_buf, mo, aid, &index);
-    if (is_add)
-        rc = rc ? rc : _bdmf_history_decode_index(res_index_buf, mo, aid, &res_index);
-    else
-        res_index = index;
+    if (ev == bdmf_hist_ev_delete)
+    {
+        rc = _bhist_get_num(pl, r, &res);
+        if (!rc)
+            actual_res = bdmf_attrelem_delete(mo, aid, index);
+        goto exit;
+    }
 
-    if (!rc)
+    rc = _bhist_get_val(pl, r, &v);
+    rc = rc ? rc : _bhist_get_num(pl, r, &res);
+    if (is_add)
+        rc = rc ? rc : _bhist_get_index(pl, r, mo, &res_aid, &res_index);
+    if (rc)
+        goto exit;
+    if (is_add)
     {
-        attr = bdmf_aid_to_attr(mo->drv, aid);
-        pindex = bdmf_attr_type_is_numeric(attr->index_type) ? &index : (bdmf_index *)index;
-        if (as_what == bdmf_attr_number)
-        {
-            if (is_add)
-                rc = bdmf_attrelem_add_as_num(mo, (bdmf_attr_id)aid, pindex, nval);
-            else
-                rc = bdmf_attrelem_set_as_num(mo, (bdmf_attr_id)aid, index, nval);
-        }
-        else if (as_what == bdmf_attr_string)
-        {
-            struct bdmf_attr *attr = bdmf_aid_to_attr(mo->drv, aid);
-            if (attr->type == bdmf_attr_object && sval && *sval=='{')
-            {
-                int sval_len = strlen(sval);
-                if (sval_len)
-                    sval[sval_len-1] = 0;
-                ++sval;
-            }
-            if (is_add)
-                rc = bdmf_attrelem_add_as_string(mo, (bdmf_attr_id)aid, pindex, sval);
-            else
-                rc = bdmf_attrelem_set_as_string(mo, (bdmf_attr_id)aid, index, sval);
-        }
-        else
-        {
-            if (is_add)
-                rc = bdmf_attrelem_add_as_buf(mo, (bdmf_attr_id)aid, pindex, bval, bsize);
-            else
-                rc = bdmf_attrelem_set_as_buf(mo, (bdmf_attr_id)aid, index, bval, bsize);
-        }
+        if (bdmf_attr_type_is_numeric(attr->index_type))
+            pindex = &index;
+        else if (index != BDMF_INDEX_UNASSIGNED)
+            pindex = (bdmf_index *)index;
     }
-    if (!rc)
+    actual_res = _bhist_play_set(mo, attr, aid, index, pindex, &v);
+
+    /* Compare assigned index */
+    if (is_add && !actual_res && res_index != BDMF_INDEX_UNASSIGNED)
     {
-        bdmf_attr_array_index_to_string(mo, attr, index, res_index_actual, sizeof(res_index_actual));
+        if (bdmf_attr_type_is_numeric(attr->index_type))
+            actual_res = (index != res_index) ? BDMF_ERR_HIST_RES_MISMATCH : 0;
+        else if (!pindex || memcmp(pindex, (void *)res_index, attr->index_size))
+            actual_res = BDMF_ERR_HIST_RES_MISMATCH;
     }
 
-    /* Cleanup */
+exit:
     if (mo)
         bdmf_put(mo);
-    if ((rc != res) || (!rc && res_index_buf && strcmp(res_index_buf, res_index_actual)))
+    if (rc)
+        return rc;
+    if (actual_res != res)
         return BDMF_ERR_HIST_RES_MISMATCH;
     return 0;
 }
 
-static int _bdmf_hist_decode_set_as_num(void)
+/* Object type definition */
+static int _bhist_play_type_def(struct bhist_play *pl, uint16_t type_id, struct bhist_rbuf *r)
 {
-    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 0);
-}
+    struct bhist_play_type *t;
+    char *name;
+    uint64_t nattrs;
+    bdmf_attr_id aid;
+    uint32_t i;
+    int rc;
 
-static int _bdmf_hist_decode_set_as_string(void)
-{
-    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 0);
+    if (type_id >= BHIST_MAX_TYPES)
+        return BDMF_ERR_PARSE;
+    t = &pl->types[type_id];
+
+    /* Type definition is repeated if type was re-registered */
+    if (t->drv)
+        bdmf_type_put(t->drv);
+    if (t->aids)
+        bdmf_free(t->aids);
+    memset(t, 0, sizeof(*t));
+
+    rc = _bhist_get_str(pl, r, &name);
+    rc = rc ? rc : _bhist_get_varint(r, &nattrs);
+    if (rc || !name || nattrs > BHIST_REC_MAX)
+        return rc ? rc : BDMF_ERR_PARSE;
+    if (!nattrs)
+        return 0;
+    t->aids = bdmf_alloc(sizeof(bdmf_attr_id) * nattrs);
+    if (!t->aids)
+        return BDMF_ERR_NOMEM;
+    t->nattrs = (uint32_t)nattrs;
+    /* Records that refer to missing type are reported as mismatch */
+    bdmf_type_find_get(name, &t->drv);
+    for (i = 0; i < t->nattrs && !rc; i++)
+    {
+        rc = _bhist_get_str(pl, r, &name);
+        if (rc || !name || !t->drv || bdmf_attr_by_name(t->drv, name, &aid))
+            aid = BHIST_AID_NONE;
+        t->aids[i] = aid;
+    }
+    return rc;
 }
 
-static int _bdmf_hist_decode_set_as_buf(void)
+/* Play-back a single record */
+static int _bhist_play_record(struct bhist_play *pl, const uint8_t *rec, uint16_t rec_len,
+    bdmf_boolean stop_on_mismatch)
 {
-    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 0);
-}
+    struct bhist_rbuf r = { .p = rec + BHIST_REC_HDR_LEN, .end = rec + rec_len };
+    uint8_t rec_type = rec[2];
+    uint16_t type_id = _bhist_get_u16(&rec[3]);
+    bdmf_history_event_t ev = rec_type - BHIST_REC_EVENT;
+    int rc;
 
-static int _bdmf_hist_decode_add_as_num(void)
-{
-    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 1);
-}
+    if (rec_type == BHIST_REC_TYPE_DEF)
+        return _bhist_play_type_def(pl, type_id, &r);
 
-static int _bdmf_hist_decode_add_as_string(void)
-{
-    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 1);
-}
+    if (rec_type == BHIST_REC_CUSTOM)
+    {
+        /* Custom event. Use text decoder */
+        hist.dec_mem = (const char *)r.p;
+        hist.dec_mem_len = r.end - r.p;
+        rc = _bdmf_history_play_event(stop_on_mismatch);
+        hist.dec_mem = NULL;
+        return rc;
+    }
 
-static int _bdmf_hist_decode_add_as_buf(void)
-{
-    return _bdmf_hist_decode_set_add_as_xx(bdmf_attr_string, 1);
+    if (rec_type < BHIST_REC_EVENT || ev <= bdmf_hist_ev_none || ev >= bdmf_hist_ev__num_of ||
+        type_id >= BHIST_MAX_TYPES)
+    {
+        HIST_PB_ERROR("Unexpected record type %u\n", rec_type);
+        return BDMF_ERR_PARSE;
+    }
+    r.t = &pl->types[type_id];
+    switch (ev)
+    {
+    case bdmf_hist_ev_new_and_configure:
+    case bdmf_hist_ev_new_and_set:
+        rc = _bhist_play_new(pl, ev, &r);
+        break;
+
+    case bdmf_hist_ev_destroy:
+    case bdmf_hist_ev_link:
+    case bdmf_hist_ev_unlink:
+    case bdmf_hist_ev_configure:
+    case bdmf_hist_ev_mattr_set:
+        rc = _bhist_play_obj(pl, ev, &r);
+        break;
+
+    default:
+        rc = _bhist_play_attrelem(pl, ev, &r);
+        break;
+    }
+
+    if ((rc == BDMF_ERR_HIST_RES_MISMATCH) && !stop_on_mismatch)
+    {
+        HIST_PB_ERROR("Result mismatch when processing event %s. Ignored\n", _bdmf_hist_ev_name(ev));
+        rc = 0;
+    }
+    else if (rc)
+        HIST_PB_ERROR("Error \"%s\" when processing event %s\n", bdmf_strerror(rc), _bdmf_hist_ev_name(ev));
+    return rc;
 }
 
-static int _bdmf_hist_decode_delete(void)
+/* Play-back binary history file. Magic has already been read */
+static int _bhist_play(bdmf_file f, bdmf_boolean stop_on_mismatch)
 {
-    int rc;
-    char *objstr;
-    struct bdmf_object *mo=NULL;
-    char *index_buf = NULL, *attr_name = NULL;
-    bdmf_attr_id aid;
-    bdmf_index index;
-    int res;
+    struct bhist_play *pl;
+    const uint8_t *rec = NULL;
+    int rec_len;
+    int rc = 0;
+    int i;
+
+    pl = bdmf_calloc(sizeof(*pl));
+    if (!pl)
+        return BDMF_ERR_NOMEM;
+    pl->f = f;
+    pl->buf = bdmf_alloc(BHIST_PLAY_BUF_SIZE);
+    pl->pool = bdmf_alloc(BHIST_PLAY_POOL_SIZE);
+    if (!pl->buf || !pl->pool)
+        rc = BDMF_ERR_NOMEM;
+
+    hist.nline = 0;
+    while (!rc)
+    {
+        rec_len = _bhist_play_next(pl, &rec);
+        if (rec_len <= 0)
+        {
+            rc = rec_len;
+            if (rc)
+                HIST_PB_ERROR("Truncated or corrupted record\n");
+            break;
+        }
+        ++hist.nline;
+        rc = _bhist_play_record(pl, rec, rec_len, stop_on_mismatch);
+    }
 
-    rc = bdmf_history_decode_string(&objstr);
-    rc = rc ? rc : bdmf_history_decode_string(&attr_name);
-    rc = rc ? rc : bdmf_history_decode_string(&index_buf);
-    rc = rc ? rc : bdmf_history_decode_rc(&res);
-    if (rc)
-        return rc;
-    rc = bdmf_find_get_by_name(objstr, &mo);
-    if (rc)
-        return BDMF_ERR_HIST_RES_MISMATCH;
-    rc = rc ? rc : bdmf_attr_by_name(mo->drv, attr_name, &aid);
-    rc = rc ? rc : _bdmf_history_decode_index(index_buf, mo, aid, &index);
-    rc = bdmf_attrelem_delete(mo, (bdmf_attr_id)aid, index);
     /* Cleanup */
-    if (mo)
-        bdmf_put(mo);
-    if (rc != res)
-        return BDMF_ERR_HIST_RES_MISMATCH;
-    return 0;
+    for (i = 0; i < BHIST_MAX_TYPES; i++)
+    {
+        if (pl->types[i].drv)
+            bdmf_type_put(pl->types[i].drv);
+        if (pl->types[i].aids)
+            bdmf_free(pl->types[i].aids);
+    }
+    if (pl->buf)
+        bdmf_free(pl->buf);
+    if (pl->pool)
+        bdmf_free(pl->pool);
+    bdmf_free(pl);
+    return rc;
 }
 
 /*
@@ -1461,13 +2873,43 @@ void bdmf_history_module_exit(void)
 
 /** Init and start history recording */
 int bdmf_history_init(uint32_t size, bdmf_boolean record_on)
+{
+    return bdmf_history_init_format(size, record_on, bdmf_hist_format_text);
+}
+
+/** Init and start history recording in the specified format */
+int bdmf_history_init_format(uint32_t size, bdmf_boolean record_on, bdmf_history_format_t format)
 {
     if (hist.buffer)
         return BDMF_ERR_ALREADY;
+    if (format == bdmf_hist_format_binary)
+    {
+        if (size < BHIST_MIN_RING_SIZE)
+            return BDMF_ERR_PARM;
+        /* Ring buffer size must be a power of 2 */
+        while ((size & (size - 1)))
+            size &= size - 1;
+        hist.rec.buf = bdmf_alloc(BHIST_REC_MAX);
+        hist.rec.size = BHIST_REC_MAX;
+        hist.conv_buf = bdmf_alloc(BHIST_REC_MAX);
+        hist.type_defs = bdmf_alloc(BHIST_TYPE_DEFS_SIZE);
+        if (!hist.rec.buf || !hist.conv_buf || !hist.type_defs)
+        {
+            bdmf_history_free();
+            return BDMF_ERR_NOMEM;
+        }
+        bdmf_fastlock_init(&hist.lock);
+    }
+    else if (format != bdmf_hist_format_text)
+        return BDMF_ERR_PARM;
     /* Allocate history structure and buffer */
     hist.buffer = bdmf_calloc(size);
     if (!hist.buffer)
+    {
+        bdmf_history_free();
         return BDMF_ERR_NOMEM;
+    }
+    hist.format = format;
     hist.record_on = record_on;
     hist.buf_size = size;
     return 0;
@@ -1501,7 +2943,39 @@ int bdmf_history_get(void **buffer, uint32_t *size, uint32_t *rec_size)
         return BDMF_ERR_PARM;
     *buffer = hist.buffer;
     *size = hist.buf_size;
-    *rec_size = hist.rec_size;
+    if (hist.format == bdmf_hist_format_binary)
+        *rec_size = hist.head - hist.tail;
+    else
+        *rec_size = hist.rec_size;
+    return 0;
+}
+
+/** Get history statistics */
+int bdmf_history_info(bdmf_history_info_t *info)
+{
+    if (!info)
+        return BDMF_ERR_PARM;
+    memset(info, 0, sizeof(*info));
+    if (!hist.buffer)
+        return BDMF_ERR_NOT_SUPPORTED;
+    info->format = hist.format;
+    info->record_on = hist.record_on;
+    info->size = hist.buf_size;
+    if (hist.format == bdmf_hist_format_text)
+    {
+        info->used = hist.rec_size;
+        info->overflow = hist.overflow;
+        return 0;
+    }
+    bdmf_fastlock_lock(&hist.lock);
+    info->used = hist.head - hist.tail;
+    info->nrecs = hist.nrecs;
+    info->noverwritten = hist.noverwritten;
+    info->ndropped = hist.ndropped;
+    info->ntypes = hist.ntypes;
+    info->stream_pending = hist.head - hist.stream.pos;
+    info->stream_gaps = hist.stream.ngaps;
+    bdmf_fastlock_unlock(&hist.lock);
     return 0;
 }
 
@@ -1512,6 +2986,13 @@ int bdmf_history_get(void **buffer, uint32_t *size, uint32_t *rec_size)
 void bdmf_history_reset(void)
 {
     hist.rec_size = 0;
+    if (hist.format == bdmf_hist_format_binary)
+    {
+        bdmf_fastlock_lock(&hist.lock);
+        hist.tail = hist.head;
+        hist.nrecs = 0;
+        bdmf_fastlock_unlock(&hist.lock);
+    }
 }
 
 /** Release history buffer.
@@ -1520,8 +3001,15 @@ void bdmf_history_reset(void)
  */
 void bdmf_history_free(void)
 {
+    bdmf_history_stream_stop();
     if (hist.buffer)
         bdmf_free(hist.buffer);
+    if (hist.rec.buf)
+        bdmf_free(hist.rec.buf);
+    if (hist.conv_buf)
+        bdmf_free(hist.conv_buf);
+    if (hist.type_defs)
+        bdmf_free(hist.type_defs);
     memset(&hist, 0, offsetof(struct hist_dev, ev_list));
 }
 
@@ -1544,15 +3032,95 @@ int bdmf_history_save(const char *fname)
         BDMF_TRACE_ERR("history: can't open history file %s for writing\n", fname);
         return BDMF_ERR_IO;
     }
+    if (hist.format == bdmf_hist_format_binary)
+    {
+        rc = _bhist_save(f);
+        bdmf_file_close(f);
+        return rc;
+    }
     rc = bdmf_file_write(f, hist.buffer, hist.rec_size);
     bdmf_file_close(f);
     return (rc==hist.rec_size) ? 0 : BDMF_ERR_IO;
 }
 
+/** Start streaming binary history to file */
+int bdmf_history_stream_start(const char *fname)
+{
+#ifndef __KERNEL__
+    uint32_t fmode = BDMF_FMODE_WRONLY | BDMF_FMODE_CREATE | BDMF_FMODE_TRUNCATE;
+    bdmf_file f;
+
+    if (!hist.buffer || hist.format != bdmf_hist_format_binary)
+        return BDMF_ERR_NOT_SUPPORTED;
+    if (!fname)
+        return BDMF_ERR_PARM;
+    if (hist.fstream)
+        return BDMF_ERR_ALREADY;
+    hist.stream_chunk = bdmf_alloc(BHIST_OUT_CHUNK_SIZE);
+    if (!hist.stream_chunk)
+        return BDMF_ERR_NOMEM;
+    f = bdmf_file_open(fname, fmode);
+    if (!f)
+    {
+        BDMF_TRACE_ERR("history: can't open history file %s for writing\n", fname);
+        bdmf_free(hist.stream_chunk);
+        hist.stream_chunk = NULL;
+        return BDMF_ERR_IO;
+    }
+    /* Stream everything that is still in the buffer */
+    bdmf_fastlock_lock(&hist.lock);
+    memset(&hist.stream, 0, sizeof(hist.stream));
+    hist.stream.pos = hist.tail;
+    bdmf_fastlock_unlock(&hist.lock);
+    hist.fstream = f;
+    _bhist_stream_flush();
+    return 0;
+#else
+    /* Kernel history is streamed by reading from the BDMF character device */
+    return BDMF_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/** Stop streaming binary history to file */
+void bdmf_history_stream_stop(void)
+{
+#ifndef __KERNEL__
+    bdmf_file f = hist.fstream;
+
+    if (!f)
+        return;
+    _bhist_write_file(f, &hist.stream, hist.stream_chunk);
+    hist.fstream = 0;
+    bdmf_file_close(f);
+    bdmf_free(hist.stream_chunk);
+    hist.stream_chunk = NULL;
+#endif
+}
+
+/** Read binary history records that weren't read yet */
+int bdmf_history_stream_read(void *buf, uint32_t size)
+{
+    uint32_t n;
+
+    if (!hist.buffer || hist.format != bdmf_hist_format_binary)
+        return BDMF_ERR_NOT_SUPPORTED;
+    if (!buf || size < BDMF_HISTORY_READ_MIN_SIZE)
+        return BDMF_ERR_PARM;
+#ifndef __KERNEL__
+    if (hist.fstream)
+        return BDMF_ERR_STATE;
+#endif
+    bdmf_fastlock_lock(&hist.lock);
+    n = _bhist_stream_emit(&hist.stream, buf, size);
+    bdmf_fastlock_unlock(&hist.lock);
+    return n;
+}
+
 /** Play-back history file */
 int bdmf_history_play(const char *fname, bdmf_boolean stop_on_mismatch)
 {
     uint32_t fmode = BDMF_FMODE_RDONLY;
+    char magic[BHIST_MAGIC_LEN];
     int rc;
     if (!fname)
         return BDMF_ERR_PARM;
@@ -1564,49 +3132,31 @@ int bdmf_history_play(const char *fname, bdmf_boolean stop_on_mismatch)
         BDMF_TRACE_ERR("history: can't open history file %s for reading\n", fname);
         return BDMF_ERR_IO;
     }
+
+    /* Binary history starts from magic */
+    if (bdmf_file_read(hist.fdec, magic, BHIST_MAGIC_LEN) == BHIST_MAGIC_LEN &&
+        !memcmp(magic, BHIST_MAGIC, BHIST_MAGIC_LEN))
+    {
+        rc = _bhist_play(hist.fdec, stop_on_mismatch);
+        bdmf_file_close(hist.fdec);
+        hist.fdec = 0;
+        return rc;
+    }
+
+    /* Text history. Re-open to start from the beginning */
+    bdmf_file_close(hist.fdec);
+    hist.fdec = bdmf_file_open(fname, fmode);
+    if (!hist.fdec)
+        return BDMF_ERR_IO;
     hist.nline = 0;
     do
     {
-        char *event = "";
-        struct hist_ev *e;
-        hist.pdec = hist.dec_buf;
-        hist.dec_state = histdec_event;
-        hist.pbbuf = hist.dec_bbuf;
-        *hist.pdec = 0;
         ++hist.nline;
-        rc = _bdmf_history_decode_string(&event);
-        if (rc || ! *event)
-            break;
-        e = _bdmf_hist_ev_get(event);
-        if (!e)
-        {
-            HIST_PB_ERROR("Can't parse event %s\n", event);
-            rc = BDMF_ERR_PARSE;
-        }
-        hist.dec_state = histdec_parm;
-        rc = rc ? rc : e->decode();
-        if ((rc == BDMF_ERR_HIST_RES_MISMATCH) && !stop_on_mismatch)
-        {
-            HIST_PB_ERROR("Result mismatch when processing event %s. Ignored\n", event);
-            rc = 0;
-        }
-        if (rc)
-        {
-            HIST_PB_ERROR("Error \"%s\"\n", bdmf_strerror(rc));
-            break;
-        }
-        /* skip to EOL or EOF */
-        while((hist.dec_state != histdec_eol) && (hist.dec_state != histdec_eof))
-        {
-            char *tmp;
-            int tmp_rc;
-            tmp_rc = _bdmf_history_decode_string(&tmp);
-            if (tmp_rc)
-                break;
-        }
-    } while(hist.dec_state != histdec_eof);
+        rc = _bdmf_history_play_event(stop_on_mismatch);
+    } while(!rc && hist.dec_state != histdec_eof);
 
     bdmf_file_close(hist.fdec);
+    hist.fdec = 0;
 
     return rc;
 }
@@ -1647,14 +3197,16 @@ void bdmf_history_event_unregister(const char *event)
 /* Init and start history recording
     BDMFMON_MAKE_PARM("size", "History buffer size", BDMFMON_PARM_NUMBER_, 0),
     BDMFMON_MAKE_PARM_ENUM("record_on", "Record mode", bool_table, "on"),
+    BDMFMON_MAKE_PARM_ENUM_DEFVAL("format", "Recording format", format_table, 0, "text"),
 */
 static int bdmf_mon_hist_init(bdmf_session_handle session,
                                const bdmfmon_cmd_parm_t parm[],  uint16_t n_parms)
 {
     uint32_t size = (uint32_t)parm[0].value.number;
     bdmf_boolean record_on = (bdmf_boolean)parm[1].value.number;
+    bdmf_history_format_t format = (bdmf_history_format_t)parm[2].value.number;
     int rc;
-    rc = bdmf_history_init(size, record_on);
+    rc = bdmf_history_init_format(size, record_on, format);
     return rc;
 }
 
@@ -1699,6 +3251,51 @@ static int bdmf_mon_hist_play(bdmf_session_handle session,
     return bdmf_history_play(fname, stop_on_mismatch);
 }
 
+/* Start streaming history to file
+    BDMFMON_MAKE_PARM("file", "File name", BDMFMON_PARM_STRING, 0),
+*/
+static int bdmf_mon_hist_stream(bdmf_session_handle session,
+                               const bdmfmon_cmd_parm_t parm[],  uint16_t n_parms)
+{
+    char *fname = (char *)parm[0].value.string;
+    return bdmf_history_stream_start(fname);
+}
+
+/* Stop streaming history to file
+*/
+static int bdmf_mon_hist_stream_stop(bdmf_session_handle session,
+                               const bdmfmon_cmd_parm_t parm[],  uint16_t n_parms)
+{
+    bdmf_history_stream_stop();
+    return 0;
+}
+
+/* Print history statistics
+*/
+static int bdmf_mon_hist_info(bdmf_session_handle session,
+                               const bdmfmon_cmd_parm_t parm[],  uint16_t n_parms)
+{
+    bdmf_history_info_t info;
+    int rc;
+
+    rc = bdmf_history_info(&info);
+    if (rc)
+        return rc;
+    bdmf_session_print(session, "format=%s recording=%s size=%u used=%u\n",
+        (info.format == bdmf_hist_format_binary) ? "binary" : "text",
+        info.record_on ? "on" : "off", info.size, info.used);
+    if (info.format == bdmf_hist_format_text)
+    {
+        bdmf_session_print(session, "overflow=%d\n", info.overflow);
+        return 0;
+    }
+    bdmf_session_print(session, "records=%u overwritten=%u dropped=%u types=%u\n",
+        info.nrecs, info.noverwritten, info.ndropped, info.ntypes);
+    bdmf_session_print(session, "stream: pending=%u gaps=%u\n",
+        info.stream_pending, info.stream_gaps);
+    return 0;
+}
+
 bdmfmon_handle_t bdmf_hist_mon_init(void)
 {
     bdmfmon_handle_t bdmf_dir;
@@ -1715,9 +3312,15 @@ bdmfmon_handle_t bdmf_hist_mon_init(void)
             { .name="on",    .val=1},
             BDMFMON_ENUM_LAST
         };
+        static bdmfmon_enum_val_t format_table[] = {
+            { .name="text",     .val=bdmf_hist_format_text},
+            { .name="binary",   .val=bdmf_hist_format_binary},
+            BDMFMON_ENUM_LAST
+        };
         static bdmfmon_cmd_parm_t parms[]={
             BDMFMON_MAKE_PARM("size", "History buffer size", BDMFMON_PARM_NUMBER, 0),
             BDMFMON_MAKE_PARM_ENUM_DEFVAL("record_on", "Record mode", on_off_table, 0, "on"),
+            BDMFMON_MAKE_PARM_ENUM_DEFVAL("format", "Recording format", format_table, 0, "text"),
             BDMFMON_PARM_LIST_TERMINATOR
         };
         bdmfmon_cmd_add(hist_dir, "init", bdmf_mon_hist_init,
@@ -1758,6 +3361,25 @@ bdmfmon_handle_t bdmf_hist_mon_init(void)
                       "Playback history recording",
                       BDMF_ACCESS_ADMIN, NULL, parms);
     }
+    {
+        static bdmfmon_cmd_parm_t parms[]={
+            BDMFMON_MAKE_PARM("file", "File name", BDMFMON_PARM_STRING, 0),
+            BDMFMON_PARM_LIST_TERMINATOR
+        };
+        bdmfmon_cmd_add(hist_dir, "stream", bdmf_mon_hist_stream,
+                      "Stream binary history to file",
+                      BDMF_ACCESS_ADMIN, NULL, parms);
+    }
+    {
+        bdmfmon_cmd_add(hist_dir, "stream_stop", bdmf_mon_hist_stream_stop,
+                      "Stop streaming history to file",
+                      BDMF_ACCESS_ADMIN, NULL, NULL);
+    }
+    {
+        bdmfmon_cmd_add(hist_dir, "info", bdmf_mon_hist_info,
+                      "History statistics",
+                      BDMF_ACCESS_GUEST, NULL, NULL);
+    }
 
     return hist_dir;
 }
@@ -237,6 +237,7 @@ int bdmf_init(const struct bdmf_init_config *init_config)
 #endif
 
     rc = rc ? rc : bdmf_area_module_init();
+    rc = rc ? rc : bdmf_object_module_init();
     rc = rc ? rc : bdmf_type_module_init();
 #ifdef BDMF_SHELL
     bdmf_flow_mon_init(NULL);
@@ -273,6 +274,7 @@ void bdmf_exit(void)
     bdmf_history_module_exit();
 #endif
     bdmf_type_module_exit();
+    bdmf_object_module_exit();
     bdmf_area_module_exit();
 }
 
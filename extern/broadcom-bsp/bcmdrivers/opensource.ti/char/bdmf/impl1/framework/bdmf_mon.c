@@ -1041,6 +1041,49 @@ static int bdmf_mon_trace_level(bdmf_session_handle session,
     return 0;
 }
 
+/* Display per-type allocation counters
+    BDMFMON_MAKE_PARM("type",  "object type", BDMFMON_PARM_STRING, BDMFMON_PARM_FLAG_OPTIONAL),
+*/
+static void _bdmf_mon_type_alloc_stat(bdmf_session_handle session, struct bdmf_type *drv)
+{
+    struct bdmf_type_alloc_stat stat, *st = &stat;
+    int obj_cache;
+
+    if (_bdmf_type_alloc_stat_get(drv, st, &obj_cache))
+        return;
+    bdmf_session_print(session, "%-20s %-5s %8u %8u %8u %6u %6u %8u %8u %6u %6u\n",
+        drv->name, obj_cache ? "yes" : "no", drv->nobjs,
+        st->obj_alloc, st->obj_free, st->obj_uncached, st->obj_alloc_fail,
+        st->ref_alloc, st->ref_free, st->link_alloc, st->link_free);
+}
+
+static int bdmf_mon_alloc_stat(bdmf_session_handle session,
+                               const bdmfmon_cmd_parm_t parm[],  uint16_t n_parms)
+{
+    char *type=parm[0].value.string;
+    struct bdmf_type *drv=NULL;
+    int rc;
+
+    bdmf_session_print(session, "%-20s %-5s %8s %8s %8s %6s %6s %8s %8s %6s %6s\n",
+        "type", "cache", "objs", "obj_alc", "obj_free", "nocach", "fail",
+        "ref_alc", "ref_free", "lnk_a", "lnk_f");
+    if (bdmfmon_parm_is_set(session, 0))
+    {
+        rc = bdmf_type_find_get(type, &drv);
+        if (rc)
+        {
+            bdmf_session_print(session, "Type %s is not registered\n", type);
+            return rc;
+        }
+        _bdmf_mon_type_alloc_stat(session, drv);
+        bdmf_type_put(drv);
+        return 0;
+    }
+    while((drv=bdmf_type_get_next(drv)))
+        _bdmf_mon_type_alloc_stat(session, drv);
+    return 0;
+}
+
 static int _bdmf_mon_is_aggr_present(const struct bdmf_aggr_type *at,
     const struct bdmf_aggr_type *ref_aggrs[], int naggrs)
 {
@@ -1773,6 +1816,15 @@ bdmfmon_handle_t bdmf_flow_mon_init(bdmfmon_handle_t root_dir)
                       "Detailed object type help",
                       BDMF_ACCESS_GUEST, NULL, parms);
     }
+    {
+        static bdmfmon_cmd_parm_t parms[]={
+            BDMFMON_MAKE_PARM("type",  "object type", BDMFMON_PARM_STRING, BDMFMON_PARM_FLAG_OPTIONAL),
+            BDMFMON_PARM_LIST_TERMINATOR
+        };
+        bdmfmon_cmd_add(bdmf_dir, "alloc", bdmf_mon_alloc_stat,
+                      "Object/reference allocation counters",
+                      BDMF_ACCESS_GUEST, NULL, parms);
+    }
 
     mattr_dir = bdmfmon_dir_add(bdmf_dir, "mattr",
                              "mattr (attribute groups) support",
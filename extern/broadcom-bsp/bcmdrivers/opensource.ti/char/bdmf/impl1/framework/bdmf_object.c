@@ -57,28 +57,609 @@
 
 static void _bdmf_unlink(struct bdmf_object *ds, struct bdmf_object *us, struct bdmf_link *link);
 
+/*
+ * Key attribute index.
+ *
+ * Objects of types that use the default "get" callback are hashed by the
+ * binary values of their BDMF_ATTR_KEY attributes, so that bdmf_find_get()
+ * doesn't have to convert key attributes of every object to string and compare.
+ * The index is built only if all key attributes can be compared in binary form.
+ * Otherwise bdmf_default_get_cb() falls back to the list scan.
+ * Per-type index control block hangs off drv->frm_priv (struct bdmf_type_priv)
+ * and is protected by drv->lock.
+ * Per-object index entry is allocated together with the object, right after
+ * struct bdmf_object.
+ */
+#define BDMF_KEY_MAX_ATTRS      8   /* Max number of key attributes in indexed type */
+#define BDMF_KEY_MAX_SIZE       64  /* Max total size of key attributes in indexed type */
+#define BDMF_KEY_HASH_MIN_SIZE  16  /* Initial number of hash buckets. Must be power of 2 */
+
+/* Per-object key entry state */
+typedef enum
+{
+    bdmf_obj_key_none,      /* Object is not in object list yet */
+    bdmf_obj_key_hashed,    /* Object is in the hash table */
+    bdmf_obj_key_unhashed   /* Object is in object list, but its key couldn't be read */
+} bdmf_obj_key_state;
+
+/* Per-object key entry */
+struct bdmf_obj_key
+{
+    struct bdmf_obj_key *next;      /* Next entry in hash bucket */
+    uint32_t hash;                  /* Hash value */
+    bdmf_obj_key_state state;       /* Entry state */
+    uint8_t key[0];                 /* Key attribute values */
+};
+
+/* Per-type key index control block */
+struct bdmf_key_index
+{
+    int nkeys;                                  /* Number of key attributes */
+    uint32_t key_size;                          /* Total size of key attribute values */
+    struct bdmf_attr *key_attrs[BDMF_KEY_MAX_ATTRS]; /* Key attributes */
+    uint32_t hash_size;                         /* Number of hash buckets */
+    uint32_t nhashed;                           /* Number of hashed objects */
+    uint32_t nunhashed;                         /* Number of listed objects that are not hashed */
+    struct bdmf_obj_key **hash;                 /* Hash buckets */
+};
+
+#define BDMF_OBJ_KEY(mo)        ((struct bdmf_obj_key *)((mo) + 1))
+#define BDMF_OBJ_KEY_TO_OBJ(k)  (((struct bdmf_object *)(k)) - 1)
+
+#define BDMF_OBJ_CACHE_NAME_SIZE    48  /* Object cache name buffer size */
+
+/* Framework-private part of object type.
+ * Hangs off drv->frm_priv so that the layout of struct bdmf_type,
+ * which prebuilt drivers are compiled against, doesn't change.
+ * NULL if it couldn't be allocated: the type is then neither indexed nor cached.
+ */
+struct bdmf_type_priv
+{
+    struct bdmf_key_index *key_index;       /* Key index. NULL if the type is not indexed */
+    bdmf_mem_cache *obj_cache;              /* Object cache. NULL if objects are allocated by bdmf_calloc() */
+    char obj_cache_name[BDMF_OBJ_CACHE_NAME_SIZE]; /* Object cache name, unique per type */
+    struct bdmf_type_alloc_stat alloc_stat; /* Allocation counters */
+};
+
+/* Counters of types without private data. Never reported */
+static struct bdmf_type_alloc_stat bdmf_alloc_stat_dummy;
+
+static inline struct bdmf_type_priv *_bdmf_type_priv(struct bdmf_type *drv)
+{
+    return (struct bdmf_type_priv *)drv->frm_priv;
+}
+
+static inline struct bdmf_key_index *_bdmf_key_index(struct bdmf_type *drv)
+{
+    struct bdmf_type_priv *priv = _bdmf_type_priv(drv);
+    return priv ? priv->key_index : NULL;
+}
+
+static inline bdmf_mem_cache *_bdmf_obj_cache(struct bdmf_type *drv)
+{
+    struct bdmf_type_priv *priv = _bdmf_type_priv(drv);
+    return priv ? priv->obj_cache : NULL;
+}
+
+static inline struct bdmf_type_alloc_stat *_bdmf_alloc_stat(struct bdmf_type *drv)
+{
+    struct bdmf_type_priv *priv = _bdmf_type_priv(drv);
+    return priv ? &priv->alloc_stat : &bdmf_alloc_stat_dummy;
+}
+
+/* FNV-1a hash of binary key */
+static uint32_t _bdmf_key_hash(const uint8_t *key, uint32_t size)
+{
+    uint32_t hash = 2166136261U;
+    while (size--)
+    {
+        hash ^= *(key++);
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/* Normalise attribute value in key buffer: string tail after 0-terminator is ignored */
+static void _bdmf_key_attr_normalize(struct bdmf_attr *attr, uint8_t *val)
+{
+    if (attr->type == bdmf_attr_string)
+    {
+        uint32_t len = strnlen((char *)val, attr->size);
+        memset(val + len, 0, attr->size - len);
+    }
+}
+
+/* Build binary key from object's key attribute values.
+ * Called without drv->lock because attribute read callbacks can sleep
+ */
+static int _bdmf_obj_key_make(struct bdmf_key_index *ki, struct bdmf_object *mo, uint8_t *key)
+{
+    int i;
+    int rc;
+
+    memset(key, 0, ki->key_size);
+    for (i = 0; i < ki->nkeys; i++)
+    {
+        struct bdmf_attr *attr = ki->key_attrs[i];
+        rc = attr->read(mo, attr, 0, key, attr->size);
+        if (rc < 0)
+            return rc;
+        _bdmf_key_attr_normalize(attr, key);
+        key += attr->size;
+    }
+    return 0;
+}
+
+/* Build binary key from key attribute { name, value } pairs in the order of ki->key_attrs.
+ * Returns 0 if key was built or error if the pairs can't be mapped to binary key.
+ */
+static int _bdmf_key_from_pairs(struct bdmf_key_index *ki, struct bdmf_attr_name_value *akey_attrs, uint8_t *key)
+{
+    int i;
+    int rc;
+
+    memset(key, 0, ki->key_size);
+    for (i = 0; i < ki->nkeys; i++)
+    {
+        struct bdmf_attr *attr = ki->key_attrs[i];
+        if (akey_attrs[i].attr != attr || akey_attrs[i].array_index || !akey_attrs[i].value)
+            return BDMF_ERR_NOT_SUPPORTED;
+        rc = attr->s_to_val(NULL, attr, akey_attrs[i].value, key, attr->size);
+        if (rc < 0)
+            return rc;
+        _bdmf_key_attr_normalize(attr, key);
+        key += attr->size;
+    }
+    return 0;
+}
+
+/* Insert entry into hash table. Called under drv->lock */
+static void _bdmf_key_hash_insert(struct bdmf_key_index *ki, struct bdmf_obj_key *k)
+{
+    struct bdmf_obj_key **bucket = &ki->hash[k->hash & (ki->hash_size - 1)];
+    k->next = *bucket;
+    *bucket = k;
+    k->state = bdmf_obj_key_hashed;
+    ++ki->nhashed;
+}
+
+/* Remove entry from hash table. Called under drv->lock */
+static void _bdmf_key_hash_remove(struct bdmf_key_index *ki, struct bdmf_obj_key *k)
+{
+    struct bdmf_obj_key **pk = &ki->hash[k->hash & (ki->hash_size - 1)];
+    while (*pk && *pk != k)
+        pk = &(*pk)->next;
+    BUG_ON(!*pk);
+    *pk = k->next;
+    k->next = NULL;
+    --ki->nhashed;
+}
+
+/* Double the number of hash buckets if the table is getting crowded.
+ * Called without drv->lock. Failure to grow is not fatal: chains just get longer.
+ */
+static void _bdmf_key_hash_grow(struct bdmf_type *drv, struct bdmf_key_index *ki)
+{
+    struct bdmf_obj_key **new_hash, **old_hash;
+    uint32_t new_size, old_size;
+    uint32_t i;
+
+    new_size = ki->hash_size * 2;
+    if (ki->nhashed < new_size)
+        return;
+    new_hash = bdmf_calloc(sizeof(struct bdmf_obj_key *) * new_size);
+    if (!new_hash)
+        return;
+
+    bdmf_fastlock_lock(&drv->lock);
+    if (ki->hash_size >= new_size)
+    {
+        /* Somebody else has done the job */
+        bdmf_fastlock_unlock(&drv->lock);
+        bdmf_free(new_hash);
+        return;
+    }
+    old_hash = ki->hash;
+    old_size = ki->hash_size;
+    for (i = 0; i < old_size; i++)
+    {
+        struct bdmf_obj_key *k = old_hash[i], *k_next;
+        while (k)
+        {
+            k_next = k->next;
+            k->next = new_hash[k->hash & (new_size - 1)];
+            new_hash[k->hash & (new_size - 1)] = k;
+            k = k_next;
+        }
+    }
+    ki->hash = new_hash;
+    ki->hash_size = new_size;
+    bdmf_fastlock_unlock(&drv->lock);
+    bdmf_free(old_hash);
+}
+
+/* Build index entry of object that is about to be added to the type's object list.
+ * Called without drv->lock because attribute read callbacks can sleep.
+ * Returns the value to be passed to _bdmf_obj_key_add()
+ */
+static int _bdmf_obj_key_prepare(struct bdmf_object *mo)
+{
+    struct bdmf_key_index *ki = _bdmf_key_index(mo->drv);
+    struct bdmf_obj_key *k;
+
+    if (!ki)
+        return 0;
+    k = BDMF_OBJ_KEY(mo);
+    if (_bdmf_obj_key_make(ki, mo, k->key))
+        return BDMF_ERR_NOT_SUPPORTED;
+    k->hash = _bdmf_key_hash(k->key, ki->key_size);
+    return 0;
+}
+
+/* Index object prepared by _bdmf_obj_key_prepare().
+ * Called under drv->lock together with adding the object to the object list,
+ * so that lookup never sees a listed object that is not indexed
+ */
+static void _bdmf_obj_key_add(struct bdmf_object *mo, int prepare_rc)
+{
+    struct bdmf_key_index *ki = _bdmf_key_index(mo->drv);
+    struct bdmf_obj_key *k;
+
+    if (!ki)
+        return;
+    k = BDMF_OBJ_KEY(mo);
+    if (prepare_rc)
+    {
+        k->state = bdmf_obj_key_unhashed;
+        ++ki->nunhashed;
+    }
+    else
+        _bdmf_key_hash_insert(ki, k);
+}
+
+/* Grow key index after objects were added. Called without drv->lock */
+static void _bdmf_obj_key_grow(struct bdmf_type *drv)
+{
+    struct bdmf_key_index *ki = _bdmf_key_index(drv);
+
+    if (ki)
+        _bdmf_key_hash_grow(drv, ki);
+}
+
+/* Remove object from index. Called under drv->lock */
+static void _bdmf_obj_key_remove(struct bdmf_object *mo)
+{
+    struct bdmf_key_index *ki = _bdmf_key_index(mo->drv);
+    struct bdmf_obj_key *k;
+
+    if (!ki)
+        return;
+    k = BDMF_OBJ_KEY(mo);
+    if (k->state == bdmf_obj_key_hashed)
+        _bdmf_key_hash_remove(ki, k);
+    else if (k->state == bdmf_obj_key_unhashed)
+        --ki->nunhashed;
+    k->state = bdmf_obj_key_none;
+}
+
+/** Re-index object after key attribute change.
+ * The function is called by the framework when key attribute is set.
+ * Drivers that change key attribute value internally must call it as well.
+ * \param[in]   mo      Managed object
+ */
+void _bdmf_obj_key_update(struct bdmf_object *mo)
+{
+    struct bdmf_key_index *ki = _bdmf_key_index(mo->drv);
+    struct bdmf_obj_key *k;
+    uint8_t key[BDMF_KEY_MAX_SIZE];
+    int rc;
+
+    if (!ki)
+        return;
+    k = BDMF_OBJ_KEY(mo);
+    /* Objects that are being created are indexed when added to the object list */
+    if (k->state == bdmf_obj_key_none)
+        return;
+    rc = _bdmf_obj_key_make(ki, mo, key);
+    bdmf_fastlock_lock(&mo->drv->lock);
+    if (k->state != bdmf_obj_key_none)
+    {
+        _bdmf_obj_key_remove(mo);
+        if (rc)
+        {
+            k->state = bdmf_obj_key_unhashed;
+            ++ki->nunhashed;
+        }
+        else
+        {
+            memcpy(k->key, key, ki->key_size);
+            k->hash = _bdmf_key_hash(key, ki->key_size);
+            _bdmf_key_hash_insert(ki, k);
+        }
+    }
+    bdmf_fastlock_unlock(&mo->drv->lock);
+}
+
+/* Look up object in the key index.
+ * Returns 0 if found, BDMF_ERR_NOENT if definitely not found,
+ * BDMF_ERR_NOT_SUPPORTED if the list must be scanned.
+ */
+static int _bdmf_key_index_find(struct bdmf_type *drv, struct bdmf_object *owner,
+    struct bdmf_attr_name_value *akey_attrs, struct bdmf_object **pmo)
+{
+    struct bdmf_key_index *ki = _bdmf_key_index(drv);
+    struct bdmf_obj_key *k;
+    uint8_t key[BDMF_KEY_MAX_SIZE];
+    uint32_t hash;
+    int rc;
+
+    if (!ki)
+        return BDMF_ERR_NOT_SUPPORTED;
+    if (_bdmf_key_from_pairs(ki, akey_attrs, key))
+        return BDMF_ERR_NOT_SUPPORTED;
+    hash = _bdmf_key_hash(key, ki->key_size);
+
+    bdmf_fastlock_lock(&drv->lock);
+    /* Some objects are not in the index. Can't say "not found" for sure */
+    rc = ki->nunhashed ? BDMF_ERR_NOT_SUPPORTED : BDMF_ERR_NOENT;
+    for (k = ki->hash[hash & (ki->hash_size - 1)]; k; k = k->next)
+    {
+        struct bdmf_object *mo = BDMF_OBJ_KEY_TO_OBJ(k);
+        if (k->hash != hash || memcmp(k->key, key, ki->key_size))
+            continue;
+        if (owner && mo->owner != owner)
+            continue;
+        *pmo = mo;
+        rc = 0;
+        break;
+    }
+    bdmf_fastlock_unlock(&drv->lock);
+
+    return rc;
+}
+
+/* Create key index for object type.
+ * The index is created only if the type uses the default "get" callback
+ * and all its key attributes are comparable in binary form.
+ * Failure to create the index is not an error: lookup falls back to list scan.
+ */
+static void _bdmf_key_index_init(struct bdmf_type *drv, struct bdmf_type_priv *priv)
+{
+    struct bdmf_key_index *ki;
+    struct bdmf_attr *attr;
+
+    if (drv->get || drv->max_objs == 1 || !drv->aattr)
+        return;
+
+    ki = bdmf_calloc(sizeof(struct bdmf_key_index));
+    if (!ki)
+        return;
+    for (attr = &drv->aattr[0]; attr->name; attr++)
+    {
+        if (!(attr->flags & BDMF_ATTR_KEY))
+            continue;
+        if (ki->nkeys >= BDMF_KEY_MAX_ATTRS ||
+            ki->key_size + attr->size > BDMF_KEY_MAX_SIZE ||
+            !_bdmf_attr_is_key_comparable(attr))
+        {
+            bdmf_free(ki);
+            return;
+        }
+        ki->key_attrs[ki->nkeys++] = attr;
+        ki->key_size += attr->size;
+    }
+    if (!ki->nkeys)
+    {
+        bdmf_free(ki);
+        return;
+    }
+    ki->hash_size = BDMF_KEY_HASH_MIN_SIZE;
+    ki->hash = bdmf_calloc(sizeof(struct bdmf_obj_key *) * ki->hash_size);
+    if (!ki->hash)
+    {
+        bdmf_free(ki);
+        return;
+    }
+    priv->key_index = ki;
+}
+
+/* Release key index of object type */
+static void _bdmf_key_index_exit(struct bdmf_type_priv *priv)
+{
+    struct bdmf_key_index *ki = priv->key_index;
+    if (!ki)
+        return;
+    priv->key_index = NULL;
+    bdmf_free(ki->hash);
+    bdmf_free(ki);
+}
+
+/*
+ * Object, reference and link caches.
+ *
+ * Objects of each type are allocated from a per-type cache sized for
+ * extra_size + struct bdmf_object + key index entry, so that create/destroy
+ * churn doesn't go through the general-purpose allocator.
+ * References with small (or numeric) index and mux links are allocated from
+ * global caches. Blocks that don't fit and blocks of caches that couldn't be
+ * created are allocated by bdmf_calloc().
+ * Whether a block came from a cache is decided the same way on release:
+ * caches exist for the whole lifetime of the blocks they serve.
+ */
+#define BDMF_REF_CACHE_INDEX_SIZE   16  /* Non-numeric index size that fits in ref cache block */
+
+static bdmf_mem_cache *bdmf_ref_cache;
+static bdmf_mem_cache *bdmf_link_cache;
+static uint32_t bdmf_obj_cache_seq;     /* Makes object cache names unique */
+
+/* Object block size including extra_size and key index entry */
+static uint32_t _bdmf_obj_alloc_size(struct bdmf_type *drv)
+{
+    uint32_t size = drv->extra_size + sizeof(struct bdmf_object);
+    if (_bdmf_key_index(drv))
+        size += sizeof(struct bdmf_obj_key) + _bdmf_key_index(drv)->key_size;
+    return size;
+}
+
+/* Create object cache of object type. Must be called after _bdmf_key_index_init().
+ * Failure to create the cache is not an error: objects are allocated by bdmf_calloc()
+ */
+static void _bdmf_obj_cache_init(struct bdmf_type *drv, struct bdmf_type_priv *priv)
+{
+    if (drv->max_objs == 1)
+        return;
+    /* Type names are not unique system-wide, and some kernels keep the name pointer */
+    snprintf(priv->obj_cache_name, sizeof(priv->obj_cache_name), "bdmf%u_%s",
+        ++bdmf_obj_cache_seq, drv->name);
+    priv->obj_cache = bdmf_mem_cache_create(priv->obj_cache_name, _bdmf_obj_alloc_size(drv));
+}
+
+/* Destroy object cache of object type */
+static void _bdmf_obj_cache_exit(struct bdmf_type_priv *priv)
+{
+    if (!priv->obj_cache)
+        return;
+    bdmf_mem_cache_destroy(priv->obj_cache);
+    priv->obj_cache = NULL;
+}
+
+/** Create framework-private data of object type: key index and object cache.
+ * Failure is not an error: the type is then neither indexed nor cached.
+ * \param[in]   drv     Managed object type
+ * \return 0
+ */
+int _bdmf_type_priv_init(struct bdmf_type *drv)
+{
+    struct bdmf_type_priv *priv;
+
+    priv = bdmf_calloc(sizeof(struct bdmf_type_priv));
+    drv->frm_priv = priv;
+    if (!priv)
+        return 0;
+    /* Key index first: it determines object block size */
+    _bdmf_key_index_init(drv, priv);
+    _bdmf_obj_cache_init(drv, priv);
+    return 0;
+}
+
+/** Release framework-private data of object type.
+ * Called when the last reference to the type is gone. Can sleep
+ * \param[in]   drv     Managed object type
+ */
+void _bdmf_type_priv_exit(struct bdmf_type *drv)
+{
+    struct bdmf_type_priv *priv = _bdmf_type_priv(drv);
+
+    if (!priv)
+        return;
+    drv->frm_priv = NULL;
+    _bdmf_obj_cache_exit(priv);
+    _bdmf_key_index_exit(priv);
+    bdmf_free(priv);
+}
+
+/** Get allocation counters of object type
+ * \param[in]   drv         Managed object type
+ * \param[out]  stat        Allocation counters
+ * \param[out]  obj_cache   1 if objects are allocated from type's cache
+ * \return 0 or BDMF_ERR_NOENT if the type has no counters
+ */
+int _bdmf_type_alloc_stat_get(struct bdmf_type *drv, struct bdmf_type_alloc_stat *stat, int *obj_cache)
+{
+    struct bdmf_type_priv *priv = _bdmf_type_priv(drv);
+
+    if (!priv)
+        return BDMF_ERR_NOENT;
+    *stat = priv->alloc_stat;
+    *obj_cache = (priv->obj_cache != NULL);
+    return 0;
+}
+
+/* Allocate mux link. Charged to DS object type */
+static struct bdmf_link *_bdmf_link_alloc(struct bdmf_object *ds)
+{
+    struct bdmf_link *link;
+
+    if (bdmf_link_cache)
+        link = bdmf_mem_cache_alloc(bdmf_link_cache);
+    else
+        link = bdmf_calloc(sizeof(struct bdmf_link));
+    if (link)
+        ++_bdmf_alloc_stat(ds->drv)->link_alloc;
+    return link;
+}
+
+static void _bdmf_link_free(struct bdmf_object *ds, struct bdmf_link *link)
+{
+    ++_bdmf_alloc_stat(ds->drv)->link_free;
+    if (bdmf_link_cache)
+        bdmf_mem_cache_free(bdmf_link_cache, link);
+    else
+        bdmf_free(link);
+}
+
+int bdmf_object_module_init(void)
+{
+    bdmf_ref_cache = bdmf_mem_cache_create("bdmf_ref",
+        sizeof(struct bdmf_ref) + BDMF_REF_CACHE_INDEX_SIZE);
+    bdmf_link_cache = bdmf_mem_cache_create("bdmf_link", sizeof(struct bdmf_link));
+    return 0;
+}
+
+void bdmf_object_module_exit(void)
+{
+    if (bdmf_ref_cache)
+        bdmf_mem_cache_destroy(bdmf_ref_cache);
+    if (bdmf_link_cache)
+        bdmf_mem_cache_destroy(bdmf_link_cache);
+    bdmf_ref_cache = NULL;
+    bdmf_link_cache = NULL;
+}
+
+/* Reference block size */
+static uint32_t _bdmf_ref_size(struct bdmf_attr *attr)
+{
+    uint32_t size = sizeof(struct bdmf_ref);
+    if (attr && !bdmf_attr_type_is_numeric(attr->index_type))
+        size += attr->index_size;
+    return size;
+}
+
+/* Is reference block served by the ref cache */
+static inline int _bdmf_ref_is_cached(uint32_t size)
+{
+    return bdmf_ref_cache && size <= sizeof(struct bdmf_ref) + BDMF_REF_CACHE_INDEX_SIZE;
+}
+
 void _bdmf_ref_free(struct bdmf_ref *ref)
 {
     bdmf_fastlock_lock(&ref->client->drv->lock);
     DLIST_REMOVE(ref, ref_list);
     DLIST_REMOVE(ref, client_list);
+    ++_bdmf_alloc_stat(ref->client->drv)->ref_free;
     bdmf_fastlock_unlock(&ref->client->drv->lock);
     bdmf_put(ref->ref_obj);
-    bdmf_free(ref);
+    if (_bdmf_ref_is_cached(_bdmf_ref_size(ref->attr)))
+        bdmf_mem_cache_free(bdmf_ref_cache, ref);
+    else
+        bdmf_free(ref);
 }
 
 struct bdmf_ref *_bdmf_ref_alloc(struct bdmf_object *mo, struct bdmf_object *ref_obj, struct bdmf_attr *attr)
 {
     struct bdmf_ref *ref;
-    uint32_t size = sizeof(struct bdmf_ref);
+    uint32_t size = _bdmf_ref_size(attr);
     int is_numeric = (attr==NULL) || bdmf_attr_type_is_numeric(attr->index_type);
-    if (!is_numeric)
-        size += attr->index_size;
-    ref = bdmf_calloc(size);
+    if (_bdmf_ref_is_cached(size))
+        ref = bdmf_mem_cache_alloc(bdmf_ref_cache);
+    else
+        ref = bdmf_calloc(size);
     if (!ref)
         return NULL;
+    ++_bdmf_alloc_stat(mo->drv)->ref_alloc;
     ref->client = mo;
     ref->ref_obj = ref_obj;
+    ref->attr = attr;   /* Release path relies on it to find the block's allocator */
     if (!is_numeric)
         ref->attr_index = (bdmf_index)(ref + 1);
     bdmf_get(ref_obj);
@@ -148,7 +729,9 @@ static void _bdmf_obj_destroy(struct bdmf_object *mo)
     if (mo->owner)
         DLIST_REMOVE(mo, osiblings);
     DLIST_REMOVE(mo, siblings);
+    _bdmf_obj_key_remove(mo);
     --drv->nobjs;
+    ++_bdmf_alloc_stat(drv)->obj_free;
     bdmf_fastlock_unlock(&drv->lock);
     /* Object is about to finally die. If it is still referencing other objects
      * - decrement reference count of those objects
@@ -160,7 +743,10 @@ static void _bdmf_obj_destroy(struct bdmf_object *mo)
         if (drv->seg_auto_alloc[i] && mo->mem_seg_base[i])
             bdmf_mem_free(drv->seg_type[i], mo->mem_seg_base[i]);
     }
-    bdmf_free((void *)((unsigned long)mo-mo->drv->extra_size));
+    if (_bdmf_obj_cache(drv))
+        bdmf_mem_cache_free(_bdmf_obj_cache(drv), (void *)((unsigned long)mo-drv->extra_size));
+    else
+        bdmf_free((void *)((unsigned long)mo-drv->extra_size));
     bdmf_type_put(drv);
 }
 
@@ -224,17 +810,27 @@ void bdmf_put(bdmf_object_handle mo)
  */
 struct bdmf_object *bdmf_object_alloc(struct bdmf_type *drv)
 {
+    struct bdmf_type_alloc_stat *stat = _bdmf_alloc_stat(drv);
+    bdmf_mem_cache *cache = _bdmf_obj_cache(drv);
     void *alloc_ptr;
-    uint32_t size;
     struct bdmf_object *mo;
 
-    size = sizeof(struct bdmf_object);
-    alloc_ptr = bdmf_calloc(size+drv->extra_size);
+    if (cache)
+        alloc_ptr = bdmf_mem_cache_alloc(cache);
+    else
+    {
+        alloc_ptr = bdmf_calloc(_bdmf_obj_alloc_size(drv));
+        ++stat->obj_uncached;
+    }
     if (!alloc_ptr)
+    {
+        ++stat->obj_alloc_fail;
         return NULL;
+    }
     mo = (struct bdmf_object *)((unsigned long)alloc_ptr+drv->extra_size);
     ++drv->usecount;
     ++drv->nobjs;
+    ++stat->obj_alloc;
     mo->drv = drv;
     mo->usecount = 1;
     mo->state = bdmf_state_init;
@@ -349,6 +945,7 @@ int bdmf_new_and_configure(bdmf_type_handle drv,
              bdmf_object_handle *pmo)
 {
     struct bdmf_object *mo = NULL;
+    int key_rc;
     int rc=0;
 
     bdmf_lock();
@@ -366,11 +963,14 @@ int bdmf_new_and_configure(bdmf_type_handle drv,
     if (rc)
         goto cleanup;
 
+    key_rc = _bdmf_obj_key_prepare(mo);
     bdmf_fastlock_lock(&mo->drv->lock);
+    _bdmf_obj_key_add(mo, key_rc);
     DLIST_INSERT_HEAD(&drv->obj_list, mo, siblings);
     if (mo->owner)
         DLIST_INSERT_HEAD(&mo->owner->children, mo, osiblings);
     bdmf_fastlock_unlock(&mo->drv->lock);
+    _bdmf_obj_key_grow(drv);
     *pmo = mo;
     mo->state = bdmf_state_active;
     BDMF_HISTORY_BI_EVENT(bdmf_hist_ev_new_and_configure, bdmf_hist_point_end, rc, mo);
@@ -406,6 +1006,7 @@ int bdmf_new_and_set(bdmf_type_handle drv,
 {
     const bdmf_mattr_t *mattr = (const bdmf_mattr_t *)hmattr;
     struct bdmf_object *mo = NULL;
+    int key_rc;
     int rc=0;
 
     bdmf_lock();
@@ -424,11 +1025,14 @@ int bdmf_new_and_set(bdmf_type_handle drv,
     if (rc)
         goto cleanup;
 
+    key_rc = _bdmf_obj_key_prepare(mo);
     bdmf_fastlock_lock(&mo->drv->lock);
+    _bdmf_obj_key_add(mo, key_rc);
     DLIST_INSERT_HEAD(&drv->obj_list, mo, siblings);
     if (mo->owner)
         DLIST_INSERT_HEAD(&mo->owner->children, mo, osiblings);
     bdmf_fastlock_unlock(&mo->drv->lock);
+    _bdmf_obj_key_grow(drv);
     *pmo = mo;
     mo->state = bdmf_state_active;
     BDMF_HISTORY_BI_EVENT(bdmf_hist_ev_new_and_set, bdmf_hist_point_end, rc, mo);
@@ -560,9 +1164,11 @@ static int bdmf_default_get_cb(struct bdmf_type *drv,
                                 struct bdmf_object **pmo, int suppress_trace)
 {
     struct bdmf_attr *attr;
-    struct bdmf_object *mo, *mo_tmp;
+    struct bdmf_object *mo = NULL, *mo_tmp;
+    struct bdmf_attr_name_value akey_buf[BDMF_KEY_MAX_ATTRS];
     struct bdmf_attr_name_value *akey_attrs;
     struct bdmf_attr_name_value *aall_attrs=NULL;
+    struct bdmf_attr_split_buf split_buf;
     int nkeys=0;
     int key=0;
     int nattrs;
@@ -589,9 +1195,18 @@ static int bdmf_default_get_cb(struct bdmf_type *drv,
     }
     if (!nkeys)
         return BDMF_ERR_NOENT;
-    akey_attrs = bdmf_calloc(sizeof(struct bdmf_attr_name_value)*nkeys);
-    if (!akey_attrs)
-        return BDMF_ERR_NOMEM;
+    /* Typical key fits in the stack buffer. Allocate only if it doesn't */
+    if (nkeys <= BDMF_KEY_MAX_ATTRS)
+    {
+        akey_attrs = akey_buf;
+        memset(akey_attrs, 0, sizeof(struct bdmf_attr_name_value)*nkeys);
+    }
+    else
+    {
+        akey_attrs = bdmf_calloc(sizeof(struct bdmf_attr_name_value)*nkeys);
+        if (!akey_attrs)
+            return BDMF_ERR_NOMEM;
+    }
     attr = &drv->aattr[0];
     while(attr && attr->name && key<nkeys)
     {
@@ -601,7 +1216,7 @@ static int bdmf_default_get_cb(struct bdmf_type *drv,
     }
 
     /* Split discriminator string to { name, value } pairs */
-    rc = bdmf_attr_string_split(discr, &aall_attrs, &nattrs);
+    rc = bdmf_attr_string_split_buf(discr, &split_buf, &aall_attrs, &nattrs);
     if (rc)
         goto get_cb_done;
 
@@ -639,6 +1254,15 @@ static int bdmf_default_get_cb(struct bdmf_type *drv,
             akey_attrs[i].value = aall_attrs[j].value;
     }
 
+    /* Try the key index first */
+    rc = _bdmf_key_index_find(drv, owner, akey_attrs, &mo);
+    if (rc != BDMF_ERR_NOT_SUPPORTED)
+    {
+        if (!rc)
+            *pmo = mo;
+        goto get_cb_done;
+    }
+
     /* If there is an owner - scan list of objects owned by the same owner.
      * Otherwise, scan list of all objects of the given type.
      * Look for key match
@@ -671,8 +1295,8 @@ static int bdmf_default_get_cb(struct bdmf_type *drv,
     
 get_cb_done:
     if (aall_attrs)
-        bdmf_attr_pairs_release(aall_attrs);
-    if (akey_attrs)
+        bdmf_attr_pairs_release_buf(&split_buf, aall_attrs);
+    if (akey_attrs != akey_buf)
         bdmf_free(akey_attrs);
 
     return rc;
@@ -786,11 +1410,12 @@ bdmf_object_handle bdmf_get_next(bdmf_type_handle drv,
         if (filter && mo_next)
         {
             struct bdmf_attr_name_value *apairs=NULL;
-            int npairs;
+            struct bdmf_attr_split_buf split_buf;
+            int npairs = 0;
             int rc;
             int i;
             
-            rc = bdmf_attr_string_split(filter, &apairs, &npairs);
+            rc = bdmf_attr_string_split_buf(filter, &split_buf, &apairs, &npairs);
             if (rc)
                 mo_next = NULL;
 
@@ -817,7 +1442,7 @@ bdmf_object_handle bdmf_get_next(bdmf_type_handle drv,
                 mo_next = DLIST_NEXT(mo_next, siblings);;
             }
             if (apairs)
-                bdmf_attr_pairs_release(apairs);
+                bdmf_attr_pairs_release_buf(&split_buf, apairs);
         }
     }
     
@@ -984,7 +1609,7 @@ int bdmf_link(bdmf_object_handle ds, bdmf_object_handle us, const char *attrs)
     if ((ds->drv->flags & BDMF_DRV_FLAG_MUXUP) ||
         (us->drv->flags & BDMF_DRV_FLAG_MUXDOWN))
     {
-        link = bdmf_alloc(sizeof(struct bdmf_link));
+        link = _bdmf_link_alloc(ds);
         if (!link)
         {
             BDMF_HISTORY_BI_EVENT(bdmf_hist_ev_link, bdmf_hist_point_end, BDMF_ERR_NOMEM);
@@ -1013,7 +1638,7 @@ int bdmf_link(bdmf_object_handle ds, bdmf_object_handle us, const char *attrs)
     {
         bdmf_unlock();
         if (link)
-            bdmf_free(link);
+            _bdmf_link_free(ds, link);
         BDMF_TRACE_RET(rc, "%s -> %s\n", ds->name, us->name);
     }
 
@@ -1051,7 +1676,7 @@ static void _bdmf_unlink(struct bdmf_object *ds, struct bdmf_object *us, struct
         /* mux-mux using intermediary object */
         DLIST_REMOVE(link, usl);
         DLIST_REMOVE(link, dsl);
-        bdmf_free(link);
+        _bdmf_link_free(ds, link);
     }
     else
     {
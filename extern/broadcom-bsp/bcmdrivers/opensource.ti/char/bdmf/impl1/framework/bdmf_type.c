@@ -93,6 +93,8 @@ static void _bdmf_type_dec_inuse(struct bdmf_type *drv)
         }
     }
 
+    _bdmf_type_priv_exit(drv);
+
     if (drv->po)
         _bdmf_type_dec_inuse(drv->po);
 }
@@ -157,6 +159,7 @@ int bdmf_type_register_ext(struct bdmf_type *root, struct bdmf_type *drv)
     drv->seg_size[0] = drv->extra_size;
     DLIST_INIT(&drv->obj_list);
     bdmf_fastlock_init(&drv->lock);
+    _bdmf_type_priv_init(drv);
 
     bdmf_fastlock_lock(&drv_lock);
     TAILQ_INSERT_TAIL(&bdmf_drv_list, drv, types_list);
@@ -226,16 +229,18 @@ bdmf_type_handle bdmf_type_get_next(bdmf_type_handle drv)
 
     bdmf_fastlock_lock(&drv_lock);
     if (drv)
-    {
         d = TAILQ_NEXT(drv, types_list);
-        _bdmf_type_dec_inuse(drv);
-    }
     else
         d = TAILQ_FIRST(&bdmf_drv_list);
     while(d && !bdmf_type_check_visibility(d))
         d = TAILQ_NEXT(d, types_list);
     bdmf_fastlock_unlock(&drv_lock);
 
+    /* Release the previous type outside of drv_lock.
+     * The last release destroys type's object cache, which can sleep */
+    if (drv)
+        _bdmf_type_dec_inuse(drv);
+
     if (!d)
         return NULL;
 
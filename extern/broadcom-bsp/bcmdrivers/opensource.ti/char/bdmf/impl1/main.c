@@ -31,6 +31,10 @@
 static int pipe_mode;
 static bdmf_session_handle mon_session;
 
+#ifdef BDMF_SHELL
+extern bdmfmon_handle_t bdmf_bench_mon_init(void);
+#endif
+
 #ifdef BDMF_EDITLINE
 /* editline functionality */
 #include <histedit.h>
@@ -200,6 +204,9 @@ int main(int argc, char **argv)
     bdmfmon_cmd_add(NULL, "quit", bdmf_mon_quit,
                   "Quit simulation",
                   BDMF_ACCESS_GUEST, NULL, NULL);
+#ifdef BDMF_SHELL
+    bdmf_bench_mon_init();
+#endif
 
 
 #ifdef BDMF_EDITLINE
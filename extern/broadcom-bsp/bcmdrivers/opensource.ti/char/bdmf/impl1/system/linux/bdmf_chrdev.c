@@ -37,10 +37,13 @@
 #include <linux/sched.h>
 #include <asm/uaccess.h>
 #include <linux/delay.h>        /* For delay */
+#include <linux/vmalloc.h>
 
 #include "bdmf_system.h"
 #include "bdmf_session.h"
+#include "bdmf_interface.h"
 #include "bdmf_shell.h"
+#include "bdmf_dev.h"
 #include "bdmf_chrdev.h"
 
 int bdmf_chrdev_major = 215; /* Should comply the value in targets/makeDev */
@@ -50,6 +53,7 @@ MODULE_AUTHOR("Broadcom");
 MODULE_LICENSE("GPL");
 
 #define BDMF_CHRDEV_MAX_SESS      16
+#define BDMF_CHRDEV_MAX_HIST_READ (256 * 1024)
 
 /* #define DEBUG */
 
@@ -136,6 +140,183 @@ static int bdmf_chrdev_sess_free(int session_id)
 }
 
 
+/*
+ * Batched attribute operations
+ */
+
+/* Per-operation state kept for roll-back */
+struct bdmf_chrdev_op_state
+{
+    bdmf_object_handle mo;      /* Object the operation applies to */
+    int own_ref;                /* 1 if mo reference has been taken for this operation */
+    int applied;                /* 1 if set operation was applied and can be rolled back */
+    bdmf_number old_num;        /* Value before SET_NUM */
+    char old_str[BDMF_CHRDEV_MAX_ATTR_STR]; /* Value before SET_STR */
+};
+
+/* Execute a single operation. Saves the old value if roll-back is requested */
+static int bdmf_chrdev_op_exec(struct bdmf_chrdev_attr_op *op, struct bdmf_chrdev_op_state *st, int atomic)
+{
+    bdmf_index index = (bdmf_index)op->index;
+    int rc;
+
+    switch (op->oper)
+    {
+    case BDMF_CHRDEV_ATTR_SET_NUM:
+        if (atomic)
+        {
+            rc = bdmf_attrelem_get_as_num(st->mo, op->aid, index, &st->old_num);
+            if (rc)
+                return rc;
+        }
+        rc = bdmf_attrelem_set_as_num(st->mo, op->aid, index, op->num);
+        break;
+
+    case BDMF_CHRDEV_ATTR_SET_STR:
+        op->str[sizeof(op->str) - 1] = 0;
+        if (atomic)
+        {
+            rc = bdmf_attrelem_get_as_string(st->mo, op->aid, index, st->old_str, sizeof(st->old_str));
+            if (rc)
+                return rc;
+        }
+        rc = bdmf_attrelem_set_as_string(st->mo, op->aid, index, op->str);
+        break;
+
+    case BDMF_CHRDEV_ATTR_GET_NUM:
+        return bdmf_attrelem_get_as_num(st->mo, op->aid, index, &op->num);
+
+    case BDMF_CHRDEV_ATTR_GET_STR:
+        return bdmf_attrelem_get_as_string(st->mo, op->aid, index, op->str, sizeof(op->str));
+
+    default:
+        return BDMF_ERR_PARM;
+    }
+    st->applied = !rc;
+    return rc;
+}
+
+/* Undo a set operation applied by bdmf_chrdev_op_exec() */
+static void bdmf_chrdev_op_rollback(struct bdmf_chrdev_attr_op *op, struct bdmf_chrdev_op_state *st)
+{
+    bdmf_index index = (bdmf_index)op->index;
+    int rc;
+
+    if (!st->applied)
+        return;
+    if (op->oper == BDMF_CHRDEV_ATTR_SET_NUM)
+        rc = bdmf_attrelem_set_as_num(st->mo, op->aid, index, st->old_num);
+    else
+        rc = bdmf_attrelem_set_as_string(st->mo, op->aid, index, st->old_str);
+    if (rc)
+    {
+        bdmf_print("BDMF SHELL: failed to roll back attribute %u of %s: %s\n",
+            op->aid, bdmf_object_name(st->mo), bdmf_strerror(rc));
+    }
+    st->applied = 0;
+}
+
+/* Apply a batch of attribute operations under a single global lock acquisition.
+ * Object lookup is done once per run of operations addressing the same object.
+ */
+static int bdmf_chrdev_batch(struct bdmf_chrdev_batch *batch, struct bdmf_chrdev_attr_op *ops)
+{
+    struct bdmf_chrdev_op_state *state;
+    bdmf_object_handle mo = NULL;
+    int atomic = (batch->flags & BDMF_CHRDEV_BATCH_ATOMIC) != 0;
+    int i;
+
+    state = vmalloc(sizeof(*state) * batch->nops);
+    if (!state)
+        return -ENOMEM;
+    memset(state, 0, sizeof(*state) * batch->nops);
+
+    batch->rc = 0;
+    batch->nfailed = 0;
+
+    bdmf_lock();
+    for (i = 0; i < batch->nops; i++)
+    {
+        struct bdmf_chrdev_attr_op *op = &ops[i];
+        struct bdmf_chrdev_op_state *st = &state[i];
+
+        op->obj[sizeof(op->obj) - 1] = 0;
+        if (op->obj[0])
+        {
+            op->rc = bdmf_find_get_by_name(op->obj, &mo);
+            if (op->rc)
+                mo = NULL;
+            else
+                st->own_ref = 1;
+        }
+        else if (!mo)
+            op->rc = BDMF_ERR_NOENT;
+        st->mo = mo;
+        if (mo)
+            op->rc = bdmf_chrdev_op_exec(op, st, atomic);
+        if (op->rc)
+        {
+            if (!batch->rc)
+                batch->rc = op->rc;
+            ++batch->nfailed;
+            if (atomic)
+                break;
+        }
+    }
+
+    /* All or nothing: undo applied operations in reverse order */
+    if (atomic && batch->rc)
+    {
+        for (--i; i >= 0; i--)
+            bdmf_chrdev_op_rollback(&ops[i], &state[i]);
+    }
+    bdmf_unlock();
+
+    for (i = 0; i < batch->nops; i++)
+    {
+        if (state[i].own_ref)
+            bdmf_put(state[i].mo);
+    }
+    vfree(state);
+
+    return 0;
+}
+
+static int bdmf_chrdev_batch_ioctl(unsigned long arg)
+{
+    struct bdmf_chrdev_batch batch;
+    struct bdmf_chrdev_attr_op *ops;
+    void __user *uops;
+    uint32_t ops_size;
+    int rc;
+
+    if (copy_from_user(&batch, (void __user *)arg, sizeof(batch)))
+        return -EFAULT;
+    if (!batch.nops || batch.nops > BDMF_CHRDEV_MAX_BATCH_OPS)
+        return -EINVAL;
+    uops = (void __user *)(unsigned long)batch.ops;
+    ops_size = sizeof(*ops) * batch.nops;
+    ops = vmalloc(ops_size);
+    if (!ops)
+        return -ENOMEM;
+    if (copy_from_user(ops, uops, ops_size))
+    {
+        vfree(ops);
+        return -EFAULT;
+    }
+
+    rc = bdmf_chrdev_batch(&batch, ops);
+
+    if (!rc && (copy_to_user(uops, ops, ops_size) ||
+                copy_to_user((void __user *)arg, &batch, sizeof(batch))))
+    {
+        rc = -EFAULT;
+    }
+    vfree(ops);
+
+    return rc;
+}
+
 /*
  * Open and close
  */
@@ -152,6 +333,36 @@ int bdmf_chrdev_release(struct inode *inode, struct file *filp)
     return 0;
 }
 
+/*
+ * Binary history stream.
+ * Returns records recorded since the previous read, 0 if there are none.
+ */
+ssize_t bdmf_chrdev_read(struct file *filp, char __user *buf,
+    size_t count, loff_t *f_pos)
+{
+    void *hbuf;
+    int rc;
+
+    dprintk("%s:%d\n", __FUNCTION__, __LINE__);
+    if (count < BDMF_HISTORY_READ_MIN_SIZE)
+        return -EINVAL;
+    if (count > BDMF_CHRDEV_MAX_HIST_READ)
+        count = BDMF_CHRDEV_MAX_HIST_READ;
+    hbuf = vmalloc(count);
+    if (!hbuf)
+        return -ENOMEM;
+    rc = bdmf_history_stream_read(hbuf, count);
+    if (rc == BDMF_ERR_NOT_SUPPORTED)
+        rc = -EOPNOTSUPP;
+    else if (rc < 0)
+        rc = -EINVAL;
+    else if (rc && copy_to_user(buf, hbuf, rc))
+        rc = -EFAULT;
+    vfree(hbuf);
+
+    return rc;
+}
+
 ssize_t bdmf_chrdev_write(struct file *filp, const char __user *buf,
     size_t count, loff_t *f_pos)
 {
@@ -186,6 +397,10 @@ long bdmf_chrdev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
     if (rc)
         return -EFAULT;
 
+    /* Batch doesn't use shell session. It is serialized by the BDMF global lock */
+    if (cmd == BDMF_CHRDEV_ATTR_BATCH)
+        return bdmf_chrdev_batch_ioctl(arg);
+
     shell_io_param = kmalloc(sizeof(*shell_io_param), GFP_KERNEL);
     if (!shell_io_param)
         return -ENOMEM;
@@ -247,6 +462,7 @@ struct file_operations bdmf_chrdev_fops = {
     .owner = THIS_MODULE,
     .open = bdmf_chrdev_open,
     .release = bdmf_chrdev_release,
+    .read = bdmf_chrdev_read,
     .write = bdmf_chrdev_write,
     .unlocked_ioctl = bdmf_chrdev_ioctl
 };
@@ -33,10 +33,15 @@
 #define BDMF_CHRDEV_SESSION_INIT  _IOW(BDMF_CHRDEV_IOC_MAGIC, 1, int)
 #define BDMF_CHRDEV_SESSION_SEND  _IOW(BDMF_CHRDEV_IOC_MAGIC, 2, int)
 #define BDMF_CHRDEV_SESSION_CLOSE _IOW(BDMF_CHRDEV_IOC_MAGIC, 3, int)
+#define BDMF_CHRDEV_ATTR_BATCH    _IOWR(BDMF_CHRDEV_IOC_MAGIC, 4, struct bdmf_chrdev_batch)
 
-#define BDMF_CHRDEV_MAX_NR            3
+#define BDMF_CHRDEV_MAX_NR            4
 #define BDMF_CHRDEV_MAX_CMD_LENGTH    2048
 
+#define BDMF_CHRDEV_MAX_OBJ_LENGTH    64    /* Max object discriminator length, including 0 terminator */
+#define BDMF_CHRDEV_MAX_ATTR_STR      128   /* Max attribute string value length, including 0 terminator */
+#define BDMF_CHRDEV_MAX_BATCH_OPS     256   /* Max number of operations in a batch */
+
 struct io_param
 {
     int     session_id;                                 /* session id */
@@ -44,4 +49,36 @@ struct io_param
     char    command[BDMF_CHRDEV_MAX_CMD_LENGTH];          /* Input command as one string */
 };
 
+/* Batched attribute operation */
+enum bdmf_chrdev_attr_oper
+{
+    BDMF_CHRDEV_ATTR_SET_NUM,   /* bdmf_attrelem_set_as_num(): value in num */
+    BDMF_CHRDEV_ATTR_SET_STR,   /* bdmf_attrelem_set_as_string(): value in str */
+    BDMF_CHRDEV_ATTR_GET_NUM,   /* bdmf_attrelem_get_as_num(): value returned in num */
+    BDMF_CHRDEV_ATTR_GET_STR,   /* bdmf_attrelem_get_as_string(): value returned in str */
+};
+
+struct bdmf_chrdev_attr_op
+{
+    char        obj[BDMF_CHRDEV_MAX_OBJ_LENGTH]; /* Object discriminator "type/attrs" as in bdmf_find_get_by_name().
+                                                    Empty string - the same object as in the previous operation */
+    uint16_t    oper;                           /* enum bdmf_chrdev_attr_oper */
+    uint16_t    aid;                            /* Attribute id */
+    int32_t     rc;                             /* Out: operation status */
+    int64_t     index;                          /* Attribute array index. -1 for scalar attributes */
+    int64_t     num;                            /* Numeric value */
+    char        str[BDMF_CHRDEV_MAX_ATTR_STR];  /* String value */
+};
+
+#define BDMF_CHRDEV_BATCH_ATOMIC      0x0001  /* All or nothing: roll back applied operations if any fails */
+
+struct bdmf_chrdev_batch
+{
+    uint32_t    flags;                          /* BDMF_CHRDEV_BATCH_XX flags */
+    uint32_t    nops;                           /* Number of operations */
+    int32_t     rc;                             /* Out: 0 if all operations succeeded, otherwise the first error */
+    int32_t     nfailed;                        /* Out: number of failed operations */
+    uint64_t    ops;                            /* User pointer to array of struct bdmf_chrdev_attr_op */
+};
+
 #endif /* BDMF_CHRDEV_H_ */
@@ -105,6 +105,26 @@ void bdmf_free(void *p)
 	vfree(p);
 }
 
+bdmf_mem_cache *bdmf_mem_cache_create(const char *name, size_t size)
+{
+    return kmem_cache_create(name, size, 0, SLAB_HWCACHE_ALIGN, NULL);
+}
+
+void *bdmf_mem_cache_alloc(bdmf_mem_cache *cache)
+{
+    return kmem_cache_zalloc(cache, GFP_KERNEL);
+}
+
+void bdmf_mem_cache_free(bdmf_mem_cache *cache, void *p)
+{
+    kmem_cache_free(cache, p);
+}
+
+void bdmf_mem_cache_destroy(bdmf_mem_cache *cache)
+{
+    kmem_cache_destroy(cache);
+}
+
 /*
  * Tasks
  */
@@ -655,6 +675,10 @@ void bdmf_semaphore_take(bdmf_semaphore_t *sem)
 EXPORT_SYMBOL(bdmf_alloc);
 EXPORT_SYMBOL(bdmf_calloc);
 EXPORT_SYMBOL(bdmf_free);
+EXPORT_SYMBOL(bdmf_mem_cache_create);
+EXPORT_SYMBOL(bdmf_mem_cache_alloc);
+EXPORT_SYMBOL(bdmf_mem_cache_free);
+EXPORT_SYMBOL(bdmf_mem_cache_destroy);
 EXPORT_SYMBOL(bdmf_task_create);
 EXPORT_SYMBOL(bdmf_task_destroy);
 EXPORT_SYMBOL(bdmf_task_get_name);
@@ -96,6 +96,33 @@ static inline void *bdmf_calloc(size_t size)
  */
 void bdmf_free(void *p);
 
+/** Fixed-size object cache */
+typedef struct kmem_cache bdmf_mem_cache;
+
+/** Create fixed-size object cache
+ * \param[in]   name    cache name
+ * \param[in]   size    object size
+ * \returns cache handle or NULL
+ */
+bdmf_mem_cache *bdmf_mem_cache_create(const char *name, size_t size);
+
+/** Allocate zeroed object from cache
+ * \param[in]   cache   cache handle
+ * \returns memory block pointer or NULL
+ */
+void *bdmf_mem_cache_alloc(bdmf_mem_cache *cache);
+
+/** Release object allocated by bdmf_mem_cache_alloc()
+ * \param[in]   cache   cache handle
+ * \param[in]   p       memory block pointer
+ */
+void bdmf_mem_cache_free(bdmf_mem_cache *cache, void *p);
+
+/** Destroy object cache. All objects must be released
+ * \param[in]   cache   cache handle
+ */
+void bdmf_mem_cache_destroy(bdmf_mem_cache *cache);
+
 /** @} end of bdmf_system_mem group */
 
 /** \defgroup bdmf_system_bin_mutex Binary mutex
@@ -224,6 +251,21 @@ typedef spinlock_t bdmf_fastlock;
 
 /** @} */
 
+/** \defgroup bdmf_system_atomic Atomic counter
+ * \ingroup bdmf_system
+ * @{
+ */
+typedef atomic_t bdmf_atomic_t;
+#define bdmf_atomic_init(patomic, val)  atomic_set(patomic, val)
+#define bdmf_atomic_read(patomic)       atomic_read(patomic)
+#define bdmf_atomic_inc(patomic)        atomic_inc(patomic)
+#define bdmf_atomic_dec(patomic)        atomic_dec(patomic)
+
+/** Full memory barrier */
+#define bdmf_smp_mb()   smp_mb()
+
+/** @} */
+
 /* Tasks */
 typedef struct task_struct *bdmf_task;
 int bdmf_task_create(const char *name, int priority, int stack,
@@ -232,6 +274,7 @@ int bdmf_task_create(const char *name, int priority, int stack,
 #define BDMFSYS_DEFAULT_TASK_STACK        (-1)
 int bdmf_task_destroy(bdmf_task task);
 #define bdmf_usleep(_us)       usleep(_us)
+#define bdmf_yield()           yield()
 
 const char *bdmf_task_get_name(bdmf_task task, char *name);
 const bdmf_task bdmf_task_get_current(void);
@@ -0,0 +1,551 @@
+/*
+* <:copyright-BRCM:2013:GPL/GPL:standard
+* 
+*    Copyright (c) 2013 Broadcom Corporation
+*    All Rights Reserved
+* 
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License, version 2, as published by
+* the Free Software Foundation (the "GPL").
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+* 
+* 
+* A copy of the GPL is available at http://www.broadcom.com/licenses/GPLv2.php, or by
+* writing to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+* Boston, MA 02111-1307, USA.
+* 
+* :> 
+*/
+
+
+
+/*******************************************************************
+ * bdmf_bench.c
+ *
+ * bdmf - framework micro-benchmarks for the simulation build
+ *
+ *******************************************************************/
+
+#include <time.h>
+#include "bdmf_dev.h"
+#include "bdmf_shell.h"
+#ifdef BDMF_DB_ENGINE
+#include <db_engine.h>
+#endif
+
+/* Get monotonic time in nanoseconds */
+static uint64_t bdmf_bench_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Object lookup benchmark.
+ * Creates a growing number of objects with numeric key and measures
+ * bdmf_find_get() against the string-compare scan done by filtered bdmf_get_next()
+ */
+
+struct bench_obj_priv
+{
+    uint32_t index;
+    uint32_t cfg;
+};
+
+static int bench_obj_post_init(struct bdmf_object *mo)
+{
+    struct bench_obj_priv *priv = (struct bench_obj_priv *)bdmf_obj_data(mo);
+    snprintf(mo->name, sizeof(mo->name), "bench_obj/index=%u", priv->index);
+    return 0;
+}
+
+static struct bdmf_attr bench_obj_attrs[] = {
+    { .name="index", .help="Object index",
+      .type=bdmf_attr_number,
+      .flags=BDMF_ATTR_READ | BDMF_ATTR_WRITE_INIT | BDMF_ATTR_MANDATORY | BDMF_ATTR_KEY | BDMF_ATTR_CONFIG,
+      .size=sizeof(uint32_t), .offset=offsetof(struct bench_obj_priv, index)
+    },
+    { .name="cfg", .help="Dummy configuration",
+      .type=bdmf_attr_number,
+      .flags=BDMF_ATTR_READ | BDMF_ATTR_WRITE | BDMF_ATTR_CONFIG,
+      .size=sizeof(uint32_t), .offset=offsetof(struct bench_obj_priv, cfg)
+    },
+    BDMF_ATTR_LAST
+};
+
+static struct bdmf_type bench_obj_drv = {
+    .name = "bench_obj",
+    .description = "Lookup benchmark object",
+    .extra_size = sizeof(struct bench_obj_priv),
+    .post_init = bench_obj_post_init,
+    .aattr = bench_obj_attrs,
+};
+
+/* Measure average time of lookup by key. Returns nsec per lookup or 0 if lookup failed */
+static uint32_t bdmf_bench_find(bdmf_session_handle session, uint32_t nobjs, uint32_t niter, int scan)
+{
+    char discr[32];
+    uint64_t start, end;
+    uint32_t i;
+
+    start = bdmf_bench_ns();
+    for (i = 0; i < niter; i++)
+    {
+        bdmf_object_handle mo;
+        snprintf(discr, sizeof(discr), "index=%u", (uint32_t)rand() % nobjs);
+        if (scan)
+            mo = bdmf_get_next(&bench_obj_drv, NULL, discr);
+        else if (bdmf_find_get(&bench_obj_drv, NULL, discr, &mo))
+            mo = NULL;
+        if (!mo)
+        {
+            bdmf_session_print(session, "lookup %s failed\n", discr);
+            return 0;
+        }
+        bdmf_put(mo);
+    }
+    end = bdmf_bench_ns();
+    return (uint32_t)((end - start) / niter);
+}
+
+/* bench/find command handler */
+static int bdmf_bench_mon_find(bdmf_session_handle session, const bdmfmon_cmd_parm_t parm[], uint16_t n_parms)
+{
+    uint32_t max_objs = (uint32_t)parm[0].value.unumber;
+    uint32_t niter = (uint32_t)parm[1].value.unumber;
+    bdmf_object_handle mo, mo_tmp;
+    uint32_t nobjs = 0;
+    uint32_t n;
+    int rc;
+
+    rc = bdmf_type_register(&bench_obj_drv);
+    if (rc)
+        return rc;
+    srand(1);
+
+    bdmf_session_print(session, "%10s %14s %14s\n", "objects", "find_get(ns)", "scan(ns)");
+    for (n = 16; n <= max_objs; n *= 2)
+    {
+        for (; nobjs < n; nobjs++)
+        {
+            char attrs[32];
+            snprintf(attrs, sizeof(attrs), "index=%u", nobjs);
+            rc = bdmf_new_and_configure(&bench_obj_drv, NULL, attrs, &mo);
+            if (rc)
+                goto done;
+        }
+        bdmf_session_print(session, "%10u %14u %14u\n", nobjs,
+            bdmf_bench_find(session, nobjs, niter, 0),
+            bdmf_bench_find(session, nobjs, niter, 1));
+    }
+
+done:
+    DLIST_FOREACH_SAFE(mo, &bench_obj_drv.obj_list, siblings, mo_tmp)
+        bdmf_destroy(mo);
+    bdmf_type_unregister(&bench_obj_drv);
+    return rc;
+}
+
+/*
+ * Object churn benchmark.
+ * Measures create + lookup + destroy cycle time on top of a steady population
+ */
+
+/* bench/churn command handler */
+static int bdmf_bench_mon_churn(bdmf_session_handle session, const bdmfmon_cmd_parm_t parm[], uint16_t n_parms)
+{
+    uint32_t nobjs = (uint32_t)parm[0].value.unumber;
+    uint32_t count = (uint32_t)parm[1].value.unumber;
+    struct bdmf_type_alloc_stat stat = {};
+    int obj_cache = 0;
+    bdmf_object_handle mo, mo_tmp;
+    uint64_t start, end;
+    char attrs[32];
+    uint32_t i;
+    int rc;
+
+    rc = bdmf_type_register(&bench_obj_drv);
+    if (rc)
+        return rc;
+    for (i = 0; i < nobjs && !rc; i++)
+    {
+        snprintf(attrs, sizeof(attrs), "index=%u", i);
+        rc = bdmf_new_and_configure(&bench_obj_drv, NULL, attrs, &mo);
+    }
+    start = bdmf_bench_ns();
+    for (i = 0; i < count && !rc; i++)
+    {
+        snprintf(attrs, sizeof(attrs), "index=%u", nobjs + i);
+        rc = bdmf_new_and_configure(&bench_obj_drv, NULL, attrs, &mo);
+        if (rc)
+            break;
+        rc = bdmf_find_get(&bench_obj_drv, NULL, attrs, &mo);
+        if (rc)
+            break;
+        bdmf_put(mo);
+        bdmf_destroy(mo);
+    }
+    end = bdmf_bench_ns();
+    bdmf_session_print(session, "create/find/destroy: %u ns/op %s\n",
+        (uint32_t)((end - start) / (count ? count : 1)), rc ? bdmf_strerror(rc) : "");
+    _bdmf_type_alloc_stat_get(&bench_obj_drv, &stat, &obj_cache);
+    bdmf_session_print(session, "obj_alloc=%u obj_free=%u uncached=%u alloc_fail=%u cache=%s\n",
+        stat.obj_alloc, stat.obj_free, stat.obj_uncached, stat.obj_alloc_fail,
+        obj_cache ? "yes" : "no");
+
+    DLIST_FOREACH_SAFE(mo, &bench_obj_drv.obj_list, siblings, mo_tmp)
+        bdmf_destroy(mo);
+    bdmf_type_unregister(&bench_obj_drv);
+    return rc;
+}
+
+#ifdef BDMF_HISTORY
+
+/*
+ * History benchmark.
+ * Measures history recording overhead of bdmf_attrelem_set_as_num()
+ * and play-back time in text and binary formats
+ */
+
+#define BENCH_HIST_NOBJS        16
+#define BENCH_HIST_TEXT_FILE    "/tmp/bdmf_bench_hist.txt"
+#define BENCH_HIST_BIN_FILE     "/tmp/bdmf_bench_hist.bin"
+
+/* Create objects, update them count times and destroy. Returns nsec per update */
+static uint32_t bdmf_bench_hist_run(uint32_t count)
+{
+    bdmf_object_handle mo[BENCH_HIST_NOBJS] = {};
+    uint64_t start, end;
+    uint32_t i;
+    bdmf_attr_id cfg_aid;
+    int rc = 0;
+
+    bdmf_attr_by_name(&bench_obj_drv, "cfg", &cfg_aid);
+    for (i = 0; i < BENCH_HIST_NOBJS && !rc; i++)
+    {
+        char attrs[32];
+        snprintf(attrs, sizeof(attrs), "index=%u", i);
+        rc = bdmf_new_and_configure(&bench_obj_drv, NULL, attrs, &mo[i]);
+    }
+    start = bdmf_bench_ns();
+    for (i = 0; i < count && !rc; i++)
+        rc = bdmf_attrelem_set_as_num(mo[i % BENCH_HIST_NOBJS], cfg_aid, BDMF_INDEX_UNASSIGNED, i);
+    end = bdmf_bench_ns();
+    for (i = 0; i < BENCH_HIST_NOBJS; i++)
+    {
+        if (mo[i])
+            bdmf_destroy(mo[i]);
+    }
+    return rc ? 0 : (uint32_t)((end - start) / (count ? count : 1));
+}
+
+/* Record in the given format, save and play-back */
+static int bdmf_bench_hist_format(bdmf_session_handle session, uint32_t count, bdmf_history_format_t format)
+{
+    const char *fname = (format == bdmf_hist_format_binary) ? BENCH_HIST_BIN_FILE : BENCH_HIST_TEXT_FILE;
+    bdmf_history_info_t info;
+    uint32_t size, rec_ns;
+    uint64_t start, end;
+    int rc;
+
+    if (format == bdmf_hist_format_binary)
+    {
+        /* Ring buffer must fit the whole run */
+        for (size = 64 * 1024; size < count * 32; size *= 2)
+            ;
+    }
+    else
+        size = count * 96 + 64 * 1024;
+    rc = bdmf_history_init_format(size, 1, format);
+    if (rc)
+        return rc;
+    rec_ns = bdmf_bench_hist_run(count);
+    bdmf_history_stop();
+    rc = bdmf_history_info(&info);
+    rc = rc ? rc : bdmf_history_save(fname);
+    bdmf_history_free();
+    if (rc)
+        return rc;
+
+    start = bdmf_bench_ns();
+    rc = bdmf_history_play(fname, 1);
+    end = bdmf_bench_ns();
+    bdmf_session_print(session, "%8s %14u %12u %12u %s\n",
+        (format == bdmf_hist_format_binary) ? "binary" : "text",
+        rec_ns, info.used, (uint32_t)((end - start) / 1000000), rc ? bdmf_strerror(rc) : "");
+    return rc;
+}
+
+/* bench/history command handler */
+static int bdmf_bench_mon_history(bdmf_session_handle session, const bdmfmon_cmd_parm_t parm[], uint16_t n_parms)
+{
+    uint32_t count = (uint32_t)parm[0].value.unumber;
+    void *buf;
+    uint32_t size, rec_size;
+    int rc;
+
+    /* Don't interfere with history that is being recorded */
+    bdmf_history_get(&buf, &size, &rec_size);
+    if (buf)
+    {
+        bdmf_session_print(session, "History is already initialized\n");
+        return BDMF_ERR_STATE;
+    }
+    rc = bdmf_type_register(&bench_obj_drv);
+    if (rc)
+        return rc;
+
+    bdmf_session_print(session, "%8s %14s %12s %12s\n", "format", "record(ns/op)", "size", "play(ms)");
+    bdmf_session_print(session, "%8s %14u\n", "off", bdmf_bench_hist_run(count));
+    rc = bdmf_bench_hist_format(session, count, bdmf_hist_format_text);
+    rc = rc ? rc : bdmf_bench_hist_format(session, count, bdmf_hist_format_binary);
+
+    bdmf_type_unregister(&bench_obj_drv);
+    return rc;
+}
+
+#endif /* #ifdef BDMF_HISTORY */
+
+#ifdef BDMF_DB_ENGINE
+
+/*
+ * Data base record read benchmark.
+ * 1..BENCH_DB_MAX_READERS reader threads read random records while a writer
+ * keeps updating them. Measured for every record locking policy.
+ * Readers also verify that the record they see is consistent.
+ */
+
+#define BENCH_DB_RECORDS        64
+#define BENCH_DB_MAX_READERS    4
+
+struct bench_db_rec
+{
+    uint32_t gen;
+    uint32_t val[15];
+};
+
+struct bench_db_ctx
+{
+    bdmf_dbset_handle_t sor;
+    volatile int stop;
+    uint32_t writer_us;
+};
+
+struct bench_db_thread
+{
+    struct bench_db_ctx *ctx;
+    pthread_t thread;
+    unsigned int seed;
+    uint64_t nops;
+    uint64_t ntorn;
+};
+
+static struct
+{
+    bdmf_db_lock_policy_t policy;
+    const char *name;
+    bdmf_dbset_handle_t sor;
+} bench_db_policies[] = {
+    { .policy = BDMF_DB_LOCK_SEM_READ_SEM_WRITE, .name = "sem_read_sem_write" },
+    { .policy = BDMF_DB_LOCK_NB_READ_SHADOW_WRITE, .name = "nb_read_shadow_write" },
+    { .policy = BDMF_DB_LOCK_WF_READ_RCU_WRITE, .name = "wf_read_rcu_write" },
+};
+
+static void *bench_db_reader(void *arg)
+{
+    struct bench_db_thread *t = arg;
+    bdmf_dbset_handle_t sor = t->ctx->sor;
+    const struct bench_db_rec *rec;
+    bdmf_db_key_t key;
+    int i;
+
+    while (!t->ctx->stop)
+    {
+        key = rand_r(&t->seed) % BENCH_DB_RECORDS;
+        rec = bdmf_dbrecord_get_read(sor, key, struct bench_db_rec);
+        if (!rec)
+            continue;
+        for (i = 0; i < sizeof(rec->val)/sizeof(rec->val[0]); i++)
+        {
+            if (rec->val[i] != rec->gen)
+            {
+                ++t->ntorn;
+                break;
+            }
+        }
+        bdmf_dbrecord_unlock_read(sor, key);
+        ++t->nops;
+    }
+    return NULL;
+}
+
+static void *bench_db_writer(void *arg)
+{
+    struct bench_db_thread *t = arg;
+    bdmf_dbset_handle_t sor = t->ctx->sor;
+    struct bench_db_rec *rec;
+    bdmf_db_key_t key;
+    int i;
+
+    while (!t->ctx->stop)
+    {
+        key = rand_r(&t->seed) % BENCH_DB_RECORDS;
+        rec = bdmf_dbrecord_get_write(sor, key, struct bench_db_rec);
+        if (rec)
+        {
+            ++rec->gen;
+            for (i = 0; i < sizeof(rec->val)/sizeof(rec->val[0]); i++)
+                rec->val[i] = rec->gen;
+            bdmf_dbrecord_unlock_write(sor, key);
+            ++t->nops;
+        }
+        if (t->ctx->writer_us)
+            bdmf_usleep(t->ctx->writer_us);
+    }
+    return NULL;
+}
+
+/* Create set of records for the benchmark. The set is kept for subsequent runs */
+static int bench_db_set_get(int p, bdmf_dbset_handle_t *psor)
+{
+    bdmf_dbset_handle_t sor;
+    struct bench_db_rec rec = {};
+    bdmf_db_key_t key;
+    int rc;
+
+    if (bench_db_policies[p].sor)
+    {
+        *psor = bench_db_policies[p].sor;
+        return 0;
+    }
+    BDMF_DB_MAKE_SOR(bench_db_policies[p].name, BDMF_DB_BACKEND_ARRAY, bench_db_policies[p].policy,
+        BENCH_DB_RECORDS, sizeof(struct bench_db_rec), 1, NULL, &sor, rc, out);
+    for (key = 0; key < BENCH_DB_RECORDS; key++)
+    {
+        rc = bdmf_dbrecord_add(sor, key, &rec);
+        if (rc)
+            goto out;
+    }
+    bench_db_policies[p].sor = sor;
+    *psor = sor;
+out:
+    return rc;
+}
+
+/* bench/db command handler */
+static int bdmf_bench_mon_db(bdmf_session_handle session, const bdmfmon_cmd_parm_t parm[], uint16_t n_parms)
+{
+    uint32_t duration_ms = (uint32_t)parm[0].value.unumber;
+    struct bench_db_thread readers[BENCH_DB_MAX_READERS];
+    struct bench_db_thread writer;
+    struct bench_db_ctx ctx;
+    uint64_t start, elapsed, nreads, ntorn;
+    int p, nr, nstarted, i;
+    int rc;
+
+    bdmf_session_print(session, "%-22s %8s %14s %12s %8s\n", "policy", "readers", "reads/s", "writes/s", "torn");
+    for (p = 0; p < sizeof(bench_db_policies)/sizeof(bench_db_policies[0]); p++)
+    {
+        rc = bench_db_set_get(p, &ctx.sor);
+        if (rc)
+            return rc;
+        ctx.writer_us = (uint32_t)parm[1].value.unumber;
+        for (nr = 1; nr <= BENCH_DB_MAX_READERS; nr++)
+        {
+            memset(readers, 0, sizeof(readers));
+            memset(&writer, 0, sizeof(writer));
+            ctx.stop = 0;
+            writer.ctx = &ctx;
+            writer.seed = 1;
+            start = bdmf_bench_ns();
+            if (pthread_create(&writer.thread, NULL, bench_db_writer, &writer))
+                return BDMF_ERR_NORES;
+            for (nstarted = 0; nstarted < nr; nstarted++)
+            {
+                readers[nstarted].ctx = &ctx;
+                readers[nstarted].seed = nstarted + 2;
+                if (pthread_create(&readers[nstarted].thread, NULL, bench_db_reader, &readers[nstarted]))
+                    break;
+            }
+            bdmf_usleep(duration_ms * 1000);
+            ctx.stop = 1;
+            pthread_join(writer.thread, NULL);
+            nreads = ntorn = 0;
+            for (i = 0; i < nstarted; i++)
+            {
+                pthread_join(readers[i].thread, NULL);
+                nreads += readers[i].nops;
+                ntorn += readers[i].ntorn;
+            }
+            elapsed = bdmf_bench_ns() - start;
+            bdmf_session_print(session, "%-22s %8d %14llu %12llu %8llu\n", bench_db_policies[p].name, nstarted,
+                (unsigned long long)(nreads * 1000000000ULL / elapsed),
+                (unsigned long long)(writer.nops * 1000000000ULL / elapsed),
+                (unsigned long long)ntorn);
+        }
+    }
+    return 0;
+}
+
+#endif /* #ifdef BDMF_DB_ENGINE */
+
+bdmfmon_handle_t bdmf_bench_mon_init(void)
+{
+    bdmfmon_handle_t bench_dir;
+
+    if ((bench_dir=bdmfmon_dir_find(NULL, "bench"))!=NULL)
+        return bench_dir;
+
+    bench_dir = bdmfmon_dir_add(NULL, "bench",
+                             "Framework micro-benchmarks",
+                             BDMF_ACCESS_ADMIN, NULL);
+    {
+        static bdmfmon_cmd_parm_t parms[]={
+            BDMFMON_MAKE_PARM_DEFVAL("max_objs", "Max number of objects", BDMFMON_PARM_UDECIMAL, 0, 16384),
+            BDMFMON_MAKE_PARM_DEFVAL("iterations", "Lookups per measurement", BDMFMON_PARM_UDECIMAL, 0, 1000),
+            BDMFMON_PARM_LIST_TERMINATOR
+        };
+        bdmfmon_cmd_add(bench_dir, "find", bdmf_bench_mon_find,
+                      "Object lookup time vs number of objects",
+                      BDMF_ACCESS_ADMIN, NULL, parms);
+    }
+    {
+        static bdmfmon_cmd_parm_t parms[]={
+            BDMFMON_MAKE_PARM_DEFVAL("nobjs", "Number of steady objects", BDMFMON_PARM_UDECIMAL, 0, 1024),
+            BDMFMON_MAKE_PARM_DEFVAL("count", "Number of create/destroy cycles", BDMFMON_PARM_UDECIMAL, 0, 100000),
+            BDMFMON_PARM_LIST_TERMINATOR
+        };
+        bdmfmon_cmd_add(bench_dir, "churn", bdmf_bench_mon_churn,
+                      "Object create/find/destroy cycle time",
+                      BDMF_ACCESS_ADMIN, NULL, parms);
+    }
+#ifdef BDMF_HISTORY
+    {
+        static bdmfmon_cmd_parm_t parms[]={
+            BDMFMON_MAKE_PARM_DEFVAL("count", "Number of recorded updates", BDMFMON_PARM_UDECIMAL, 0, 100000),
+            BDMFMON_PARM_LIST_TERMINATOR
+        };
+        bdmfmon_cmd_add(bench_dir, "history", bdmf_bench_mon_history,
+                      "History recording overhead and play-back time",
+                      BDMF_ACCESS_ADMIN, NULL, parms);
+    }
+#endif
+#ifdef BDMF_DB_ENGINE
+    {
+        static bdmfmon_cmd_parm_t parms[]={
+            BDMFMON_MAKE_PARM_DEFVAL("duration", "Measurement time per run (ms)", BDMFMON_PARM_UDECIMAL, 0, 1000),
+            BDMFMON_MAKE_PARM_DEFVAL("writer_delay", "Delay between writer updates (us)", BDMFMON_PARM_UDECIMAL, 0, 10),
+            BDMFMON_PARM_LIST_TERMINATOR
+        };
+        bdmfmon_cmd_add(bench_dir, "db", bdmf_bench_mon_db,
+                      "Data base record read throughput vs number of readers",
+                      BDMF_ACCESS_ADMIN, NULL, parms);
+    }
+#endif
+    return bench_dir;
+}
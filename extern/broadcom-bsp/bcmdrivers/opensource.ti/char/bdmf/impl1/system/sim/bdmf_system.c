@@ -43,6 +43,66 @@ int bdmf_task_destroy(bdmf_task task)
     return (rc || (res != PTHREAD_CANCELED)) ? BDMF_ERR_SYSCALL_ERR : 0;
 }
 
+/*
+ * Fixed-size object cache
+ */
+
+struct bdmf_mem_cache
+{
+    pthread_mutex_t lock;
+    size_t size;
+    void *free_list;            /* Singly-linked list of released blocks */
+};
+
+bdmf_mem_cache *bdmf_mem_cache_create(const char *name, size_t size)
+{
+    bdmf_mem_cache *cache;
+
+    cache = bdmf_calloc(sizeof(*cache));
+    if (!cache)
+        return NULL;
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->size = (size < sizeof(void *)) ? sizeof(void *) : size;
+    return cache;
+}
+
+void *bdmf_mem_cache_alloc(bdmf_mem_cache *cache)
+{
+    void *p;
+
+    pthread_mutex_lock(&cache->lock);
+    p = cache->free_list;
+    if (p)
+        cache->free_list = *(void **)p;
+    pthread_mutex_unlock(&cache->lock);
+    if (!p)
+        p = bdmf_alloc(cache->size);
+    if (p)
+        memset(p, 0, cache->size);
+    return p;
+}
+
+void bdmf_mem_cache_free(bdmf_mem_cache *cache, void *p)
+{
+    pthread_mutex_lock(&cache->lock);
+    *(void **)p = cache->free_list;
+    cache->free_list = p;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void bdmf_mem_cache_destroy(bdmf_mem_cache *cache)
+{
+    void *p;
+
+    while ((p = cache->free_list))
+    {
+        cache->free_list = *(void **)p;
+        bdmf_free(p);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    bdmf_free(cache);
+}
+
 /*
  * Shared memory mapping
  */
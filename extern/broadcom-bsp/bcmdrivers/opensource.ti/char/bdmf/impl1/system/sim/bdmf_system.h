@@ -82,6 +82,15 @@ static inline void bdmf_free(void *p)
     free(p);
 }
 
+/* Fixed-size object cache.
+ * Released blocks are kept in a free list and reused by subsequent allocations
+ */
+typedef struct bdmf_mem_cache bdmf_mem_cache;
+bdmf_mem_cache *bdmf_mem_cache_create(const char *name, size_t size);
+void *bdmf_mem_cache_alloc(bdmf_mem_cache *cache);
+void bdmf_mem_cache_free(bdmf_mem_cache *cache, void *p);
+void bdmf_mem_cache_destroy(bdmf_mem_cache *cache);
+
 /* Input/Output */
 #define bdmf_print(format,args...)             printf(format, ## args)
 #define bdmf_vprint(format,ap)                 vprintf(format, ap)
@@ -116,10 +125,14 @@ typedef bdmf_ta_mutex bdmf_reent_fastlock;
 #define bdmf_reent_fastlock_lock(plock)  bdmf_ta_mutex_lock(plock)
 #define bdmf_reent_fastlock_unlock(plock) bdmf_ta_mutex_unlock(plock)
 
-typedef struct { int initialized; int locked; } bdmf_simple_mutex;
+/* Simple spinning mutex.
+ * Re-entrant lock by the same thread is reported and ignored
+ */
+typedef struct { int initialized; volatile int locked; pthread_t owner; } bdmf_simple_mutex;
 static inline void bdmf_simple_mutex_init(bdmf_simple_mutex *pmutex)
 {
     pmutex->locked = 0;
+    pmutex->owner = (pthread_t)0;
     pmutex->initialized = 1;    
 }
 
@@ -127,10 +140,15 @@ static inline int bdmf_simple_mutex_lock(const char *func, int line, bdmf_simple
 {
     if (!pmutex->initialized)
         bdmf_simple_mutex_init(pmutex);
-    if (pmutex->locked)
+    if (pmutex->locked && pthread_equal(pmutex->owner, pthread_self()))
+    {
         bdmf_print("%s:%d> LOCK APPLIED WHEN INTERRUPTS LOCKED (expect re-entrant?)!!!\n", func, line);
+        return 0;
+    }
 
-    pmutex->locked = 1;
+    while (__sync_lock_test_and_set(&pmutex->locked, 1))
+        sched_yield();
+    pmutex->owner = pthread_self();
 
     return 0;
 }
@@ -141,9 +159,13 @@ static inline void bdmf_simple_mutex_unlock(const char *func, int line, bdmf_sim
         bdmf_simple_mutex_init(pmutex);
 
     if (!pmutex->locked)
+    {
         bdmf_print("%s:%d> UNLOCK APPLIED WHEN INTERRUPTS UNLOCKED!!!\n", func, line);
+        return;
+    }
 
-    pmutex->locked = 0;
+    pmutex->owner = (pthread_t)0;
+    __sync_lock_release(&pmutex->locked);
 }
 
 static inline void bdmf_simple_mutex_delete(bdmf_simple_mutex *pmutex)
@@ -167,6 +189,16 @@ typedef bdmf_simple_mutex bdmf_fastlock;
     } while (flags)
 #define bdmf_fastlock_unlock_irq(plock, flags)  bdmf_simple_mutex_unlock(__FUNCTION__, __LINE__, plock)
 
+/* Atomic counter */
+typedef struct { volatile int counter; } bdmf_atomic_t;
+#define bdmf_atomic_init(patomic, val)  ((patomic)->counter = (val))
+#define bdmf_atomic_read(patomic)       ((patomic)->counter)
+#define bdmf_atomic_inc(patomic)        ((void)__sync_add_and_fetch(&(patomic)->counter, 1))
+#define bdmf_atomic_dec(patomic)        ((void)__sync_sub_and_fetch(&(patomic)->counter, 1))
+
+/* Full memory barrier */
+#define bdmf_smp_mb()   __sync_synchronize()
+
 /* Tasks */
 typedef pthread_t bdmf_task;
 int bdmf_task_create(const char *name, int priority, int stack,
@@ -177,6 +209,7 @@ int bdmf_task_destroy(bdmf_task task);
 #define bdmf_task_wait(kick)   bdmf_mutex_lock(kick)
 #define bdmf_task_kick(kick)   bdmf_mutex_unlock(kick)
 #define bdmf_usleep(_us)       usleep(_us)
+#define bdmf_yield()           sched_yield()
 #define likely(x) (x)
 #define unlikely(x) (x)
 #define in_irq() (0)
@@ -45,6 +45,7 @@
 #include <linux/module.h>
 #include <linux/jiffies.h>
 #include <linux/delay.h>
+#include <linux/jhash.h>
 #include <linux/bcm_log.h>
 #include "bcmenet.h"
 #include "bcmtypes.h"
@@ -172,11 +173,246 @@ static bdmf_index ic_get_ingress_port(rdpactl_classification_rule_t *rule)
     return rdpa_if_wan0;
 }
 	
+/*******************************************************************************/
+/* Host-side flow index                                                        */
+/*******************************************************************************/
+
+/* Flows of every ingress_class object used through this interface are mirrored
+ * in a hash on the flow key, so that a flow can be looked up without walking
+ * the classifier. The mirror is verified against RDPA on every hit and
+ * re-read from RDPA if it is found stale.
+ */
+#define IC_FLOW_HASH_SIZE       256     /* Power of 2 */
+#define IC_RULESET_MAX_RULES    1024
+
+typedef struct ic_flow_node {
+    struct ic_flow_node *next;
+    bdmf_index          flow_idx;
+    uint32_t            gen;            /* Last rule set generation that claimed the flow */
+    rdpa_ic_info_t      flow;
+} ic_flow_node_t;
+
+typedef struct ic_db {
+    struct ic_db        *next;
+    rdpa_traffic_dir    dir;
+    bdmf_number         ic_idx;
+    rdpa_ic_cfg_t       cfg;
+    uint32_t            nflows;
+    ic_flow_node_t      *hash[IC_FLOW_HASH_SIZE];
+} ic_db_t;
+
+static ic_db_t *ic_db_list;
+static uint32_t ic_ruleset_gen;
+
+static uint32_t ic_flow_key_hash(const rdpa_ic_key_t *key)
+{
+    uint32_t h;
+
+    h = jhash_3words(key->src_port | (key->dst_port << 16),
+                     key->outer_vid | (key->inner_vid << 16),
+                     key->etype | (key->protocol << 16) | (key->dscp << 24), 0);
+    h = jhash_3words((uint32_t)key->ingress_port, key->generic_key_1, key->generic_key_2, h);
+    h = jhash_3words(key->ipv6_flow_label,
+                     key->outer_pbits | (key->inner_pbits << 8) | (key->number_of_vlans << 16) | (key->ssid << 24),
+                     key->outer_tpid | (key->inner_tpid << 16), h);
+    h = jhash_2words(key->l3_protocol, key->src_ip.family | (key->dst_ip.family << 8), h);
+    h = jhash(&key->dst_mac, sizeof(key->dst_mac), h);
+    h = jhash(&key->src_mac, sizeof(key->src_mac), h);
+
+    if (key->src_ip.family == bdmf_ip_family_ipv4)
+        h = jhash_1word(key->src_ip.addr.ipv4, h);
+    else if (key->src_ip.family == bdmf_ip_family_ipv6)
+        h = jhash(key->src_ip.addr.ipv6.data, sizeof(key->src_ip.addr.ipv6.data), h);
+
+    if (key->dst_ip.family == bdmf_ip_family_ipv4)
+        h = jhash_1word(key->dst_ip.addr.ipv4, h);
+    else if (key->dst_ip.family == bdmf_ip_family_ipv6)
+        h = jhash(key->dst_ip.addr.ipv6.data, sizeof(key->dst_ip.addr.ipv6.data), h);
+
+    return h & (IC_FLOW_HASH_SIZE - 1);
+}
+
+static ic_db_t *ic_db_get(rdpa_traffic_dir dir, bdmf_number ic_idx)
+{
+    ic_db_t *db;
+
+    for (db = ic_db_list; db; db = db->next) {
+        if (db->dir == dir && db->ic_idx == ic_idx)
+            return db;
+    }
+
+    return NULL;
+}
+
+static int ic_db_flow_add(ic_db_t *db, bdmf_index flow_idx, rdpa_ic_info_t *flow, uint32_t gen)
+{
+    ic_flow_node_t *node;
+    uint32_t h;
+
+    node = bdmf_alloc(sizeof(ic_flow_node_t));
+    if (!node)
+        return BDMF_ERR_NOMEM;
+
+    node->flow_idx = flow_idx;
+    node->gen      = gen;
+    node->flow     = *flow;
+
+    h = ic_flow_key_hash(&flow->key);
+    node->next   = db->hash[h];
+    db->hash[h]  = node;
+    db->nflows++;
+
+    return 0;
+}
+
+static void ic_db_flow_remove(ic_db_t *db, bdmf_index flow_idx, rdpa_ic_info_t *flow)
+{
+    ic_flow_node_t **pnode = &db->hash[ic_flow_key_hash(&flow->key)];
+
+    for (; *pnode; pnode = &(*pnode)->next) {
+        ic_flow_node_t *node = *pnode;
+
+        if (node->flow_idx == flow_idx) {
+            *pnode = node->next;
+            bdmf_free(node);
+            db->nflows--;
+            return;
+        }
+    }
+}
+
+static void ic_flow_hash_free(ic_flow_node_t **hash)
+{
+    int i;
+
+    for (i = 0; i < IC_FLOW_HASH_SIZE; i++) {
+        while (hash[i]) {
+            ic_flow_node_t *node = hash[i];
+
+            hash[i] = node->next;
+            bdmf_free(node);
+        }
+    }
+}
+
+static void ic_db_flush(ic_db_t *db)
+{
+    ic_flow_hash_free(db->hash);
+    db->nflows = 0;
+}
+
+static int rdpactl_compare_ic_flows(rdpa_ic_info_t *a, rdpa_ic_info_t *b);
+
+/* Re-read all the flows of the classifier.
+ * A flow that is still in RDPA as recorded keeps the rule set generation that
+ * claimed it, so that a sync in the middle of a rule set replace doesn't make
+ * the sweep remove the flows claimed before it.
+ */
+static int ic_db_sync(ic_db_t *db, bdmf_object_handle ingress_class_obj)
+{
+    bdmf_index flow_idx = BDMF_INDEX_UNASSIGNED;
+    ic_flow_node_t **old_hash;
+    ic_flow_node_t *node;
+    rdpa_ic_info_t flow;
+    uint32_t gen;
+    int rc = 0;
+
+    CMD_IC_LOG_DEBUG("sync ic(%d) dir(%d)", (int)db->ic_idx, db->dir);
+
+    old_hash = bdmf_alloc(sizeof(db->hash));
+    if (!old_hash)
+        return BDMF_ERR_NOMEM;
+    memcpy(old_hash, db->hash, sizeof(db->hash));
+    memset(db->hash, 0, sizeof(db->hash));
+    db->nflows = 0;
+
+    while (rdpa_ingress_class_flow_get_next(ingress_class_obj, &flow_idx) != BDMF_ERR_NO_MORE)
+    {
+        if (rdpa_ingress_class_flow_get(ingress_class_obj, flow_idx, &flow))
+            continue;
+
+        gen = 0;
+        for (node = old_hash[ic_flow_key_hash(&flow.key)]; node; node = node->next) {
+            if (node->flow_idx == flow_idx && !rdpactl_compare_ic_flows(&node->flow, &flow)) {
+                gen = node->gen;
+                break;
+            }
+        }
+
+        if ((rc = ic_db_flow_add(db, flow_idx, &flow, gen)))
+            break;
+    }
+
+    ic_flow_hash_free(old_hash);
+    bdmf_free(old_hash);
+
+    return rc;
+}
+
+static void ic_db_destroy(ic_db_t *db)
+{
+    ic_db_t **pdb;
+
+    for (pdb = &ic_db_list; *pdb; pdb = &(*pdb)->next) {
+        if (*pdb == db) {
+            *pdb = db->next;
+            break;
+        }
+    }
+
+    ic_db_flush(db);
+    bdmf_free(db);
+}
+
+/* Get the flow index of the classifier, creating it if needed.
+ * Returns NULL if there is no memory. Callers then fall back to walking the classifier.
+ */
+static ic_db_t *ic_db_lookup(bdmf_object_handle ingress_class_obj)
+{
+    rdpa_traffic_dir dir;
+    bdmf_number ic_idx;
+    ic_db_t *db;
+
+    rdpa_ingress_class_dir_get(ingress_class_obj, &dir);
+    rdpa_ingress_class_index_get(ingress_class_obj, &ic_idx);
+
+    db = ic_db_get(dir, ic_idx);
+    if (db)
+        return db;
+
+    db = bdmf_calloc(sizeof(ic_db_t));
+    if (!db) {
+        CMD_IC_LOG_ERROR("no memory for ic(%d) flow index", (int)ic_idx);
+        return NULL;
+    }
+
+    db->dir    = dir;
+    db->ic_idx = ic_idx;
+    rdpa_ingress_class_cfg_get(ingress_class_obj, &db->cfg);
+    db->next   = ic_db_list;
+    ic_db_list = db;
+
+    if (ic_db_sync(db, ingress_class_obj)) {
+        ic_db_destroy(db);
+        return NULL;
+    }
+
+    return db;
+}
+
 static int delete_ic(bdmf_object_handle ingress_class_obj)
 {
     bdmf_error_t rc;
+    rdpa_traffic_dir dir;
+    bdmf_number ic_idx;
+    ic_db_t *db;
 	
     CMD_IC_LOG_INFO("delete_ic");
+
+    rdpa_ingress_class_dir_get(ingress_class_obj, &dir);
+    rdpa_ingress_class_index_get(ingress_class_obj, &ic_idx);
+    if ((db = ic_db_get(dir, ic_idx)))
+        ic_db_destroy(db);
 	
     if ((rc = bdmf_destroy(ingress_class_obj))) {
        CMD_IC_LOG_ERROR("bdmf_destroy() failed:rc(%d)", rc);
@@ -186,15 +422,64 @@ static int delete_ic(bdmf_object_handle ingress_class_obj)
     return 0;
 }
 
+static int ic_cfg_match(rdpa_ic_cfg_t *cfg, rdpactl_classification_rule_t *rule, uint32_t field_mask)
+{
+    if (cfg->type != (rdpa_ic_type)rule->type || cfg->field_mask != field_mask)
+        return 0;
+
+    if (cfg->gen_rule_cfg1.type != rule->gen_rule_cfg1.type ||
+        cfg->gen_rule_cfg1.offset != rule->gen_rule_cfg1.offset ||
+        cfg->gen_rule_cfg1.mask != rule->gen_rule_cfg1.mask ||
+        cfg->gen_rule_cfg2.type != rule->gen_rule_cfg2.type ||
+        cfg->gen_rule_cfg2.offset != rule->gen_rule_cfg2.offset ||
+        cfg->gen_rule_cfg2.mask != rule->gen_rule_cfg2.mask)
+        return 0;
+
+    return 1;
+}
+
 static int find_ic(rdpactl_classification_rule_t *rule, bdmf_object_handle *ingress_class_obj, bdmf_number *ic_idx, uint8_t *prty)
 {
     bdmf_object_handle obj = NULL;
     rdpa_ic_cfg_t  cfg;
     rdpa_traffic_dir dir;
     uint32_t field_mask;
+    ic_db_t *db, *db_next;
 	
     *ingress_class_obj = NULL;
     ic_get_fieldmask(rule, &field_mask, NULL);
+
+    /* Classifiers already known to the flow index are found by key */
+    for (db = ic_db_list; db; db = db_next)
+    {
+        rdpa_ingress_class_key_t key = {};
+
+        db_next = db->next;
+        if (db->dir != (rdpa_traffic_dir)(rule->dir) || !ic_cfg_match(&db->cfg, rule, field_mask))
+            continue;
+
+        key.dir   = db->dir;
+        key.index = db->ic_idx;
+        if (rdpa_ingress_class_get(&key, &obj) ||
+            rdpa_ingress_class_cfg_get(obj, &cfg) ||
+            !ic_cfg_match(&cfg, rule, field_mask))
+        {
+            /* Destroyed or replaced behind our back */
+            if (obj)
+                bdmf_put(obj);
+            obj = NULL;
+            ic_db_destroy(db);
+            continue;
+        }
+
+        *prty = cfg.prty;
+        if (cfg.prty != rule->prty)
+            CMD_IC_LOG_ERROR("rule priority %d ignored, using %d instead", rule->prty, cfg.prty);
+
+        *ic_idx = db->ic_idx;
+        *ingress_class_obj = obj;
+        return 1;
+    }
 	
     while ((obj = bdmf_get_next(rdpa_ingress_class_drv(), obj, NULL)))
     {
@@ -202,15 +487,8 @@ static int find_ic(rdpactl_classification_rule_t *rule, bdmf_object_handle *ingr
         if (dir != (rdpa_traffic_dir)(rule->dir))  continue;
 
         rdpa_ingress_class_cfg_get(obj, &cfg);
-	 if (cfg.type != (rdpa_ic_type)rule->type || cfg.field_mask != field_mask) continue;
-
-     if (cfg.gen_rule_cfg1.type != rule->gen_rule_cfg1.type ||
-         cfg.gen_rule_cfg1.offset != rule->gen_rule_cfg1.offset ||
-         cfg.gen_rule_cfg1.mask != rule->gen_rule_cfg1.mask ||
-         cfg.gen_rule_cfg2.type != rule->gen_rule_cfg2.type ||
-         cfg.gen_rule_cfg2.offset != rule->gen_rule_cfg2.offset ||
-         cfg.gen_rule_cfg2.mask != rule->gen_rule_cfg2.mask) 
-         continue;
+        if (!ic_cfg_match(&cfg, rule, field_mask))
+            continue;
      
          *prty = cfg.prty;
 	 if (cfg.prty != rule->prty)
@@ -447,8 +725,8 @@ static int create_ic_flow(uint8_t action, rdpactl_classification_rule_t *rule, r
     return create_ic_flow_result(action, rule, flow, dir);
 }
 
-/* Compare ALL ic flow fields */
-static int rdpactl_compare_ic_flows(rdpa_ic_info_t *a, rdpa_ic_info_t *b)
+/* Compare ic flow keys */
+static int rdpactl_compare_ic_flow_keys(rdpa_ic_info_t *a, rdpa_ic_info_t *b)
 {
 #define COMPARE(field) do \
     { \
@@ -486,6 +764,15 @@ static int rdpactl_compare_ic_flows(rdpa_ic_info_t *a, rdpa_ic_info_t *b)
     COMPARE(key.l3_protocol);
     COMPARE(key.generic_key_1);
     COMPARE(key.generic_key_2);    
+
+    return 0;
+}
+
+/* Compare ALL ic flow fields */
+static int rdpactl_compare_ic_flows(rdpa_ic_info_t *a, rdpa_ic_info_t *b)
+{
+    if (rdpactl_compare_ic_flow_keys(a, b))
+        return -1;
     COMPARE(result.qos_method);
     COMPARE(result.wan_flow);
     COMPARE(result.action);
@@ -507,13 +794,66 @@ static int rdpactl_compare_ic_flows(rdpa_ic_info_t *a, rdpa_ic_info_t *b)
 }
 
 
+static ic_flow_node_t *ic_db_flow_find_key(ic_db_t *db, rdpa_ic_info_t *flow)
+{
+    ic_flow_node_t *node;
+
+    for (node = db->hash[ic_flow_key_hash(&flow->key)]; node; node = node->next) {
+        if (!rdpactl_compare_ic_flow_keys(&node->flow, flow))
+            return node;
+    }
+
+    return NULL;
+}
+
+/* Check that the flow is still in the classifier as recorded */
+static int ic_db_flow_verify(bdmf_object_handle ingress_class_obj, ic_flow_node_t *node)
+{
+    rdpa_ic_info_t flow_tmp;
+
+    if (rdpa_ingress_class_flow_get(ingress_class_obj, node->flow_idx, &flow_tmp))
+        return -1;
+
+    return rdpactl_compare_ic_flows(&flow_tmp, &node->flow);
+}
+
 /* lookup if we have an existing flow with the same key/result besides vlan_action. Assume vlan_action in flow is not
    set */
-static void rdpactl_match_ic_flow(bdmf_object_handle ingress_class_obj, rdpa_ic_info_t *flow, bdmf_index *flow_idx)
+static void rdpactl_match_ic_flow(bdmf_object_handle ingress_class_obj, ic_db_t *db, rdpa_ic_info_t *flow, bdmf_index *flow_idx)
 {
     rdpa_ic_info_t flow_tmp;
 
     *flow_idx = BDMF_INDEX_UNASSIGNED;
+
+    if (db)
+    {
+        ic_flow_node_t *node = ic_db_flow_find_key(db, flow);
+
+        if (node && ic_db_flow_verify(ingress_class_obj, node))
+        {
+            CMD_IC_LOG_DEBUG("IC flow index of ic(%d) is stale", (int)db->ic_idx);
+            if (ic_db_sync(db, ingress_class_obj))
+                goto scan;
+            node = ic_db_flow_find_key(db, flow);
+        }
+
+        if (node)
+        {
+            flow_tmp = node->flow;
+            flow_tmp.result.vlan_action = NULL;
+            if (!rdpactl_compare_ic_flows(&flow_tmp, flow))
+            {
+                CMD_IC_LOG_DEBUG("IC flow match found idx(%d)", (int)node->flow_idx);
+                *flow_idx = node->flow_idx;
+                return;
+            }
+        }
+
+        CMD_IC_LOG_DEBUG("IC flow no match found");
+        return;
+    }
+
+scan:
     while (rdpa_ingress_class_flow_get_next(ingress_class_obj, flow_idx) != BDMF_ERR_NO_MORE)
     {
         rdpa_ingress_class_flow_get(ingress_class_obj, *flow_idx, &flow_tmp);
@@ -530,6 +870,256 @@ static void rdpactl_match_ic_flow(bdmf_object_handle ingress_class_obj, rdpa_ic_
 }
 
 
+/*******************************************************************************/
+/* Rule set replace                                                            */
+/*******************************************************************************/
+
+static int ic_ruleset_rule_apply(rdpa_drv_ioctl_ic_ruleset_t *rs, rdpactl_classification_rule_t *rule, uint32_t gen)
+{
+    bdmf_object_handle ingress_class_obj = NULL;
+    bdmf_number ic_idx = 0;
+    bdmf_index ic_flow_idx;
+    rdpa_ic_info_t ic_flow;
+    ic_flow_node_t *node;
+    uint8_t prty = 0xFF;
+    ic_db_t *db;
+    int icAdd = 0;
+    int rc;
+    int ret = 0;
+
+    if (rule->dir != rs->dir)
+    {
+        CMD_IC_LOG_ERROR("rule dir %d does not match rule set dir %d", rule->dir, rs->dir);
+        return RDPA_DRV_IC_ERROR;
+    }
+
+    if (!find_ic(rule, &ingress_class_obj, &ic_idx, &prty))
+    {
+        if (add_ic(rule, &ingress_class_obj))
+        {
+            CMD_IC_LOG_ERROR("add  ic rule fail for field 0x%x", rule->field_mask);
+            return RDPA_DRV_IC_ERROR;
+        }
+        icAdd = 1;
+    }
+
+    db = ic_db_lookup(ingress_class_obj);
+    if (!db)
+    {
+        ret = RDPA_DRV_IC_ERROR;
+        goto rule_exit;
+    }
+
+    if (create_ic_flow(1, rule, &ic_flow, rule->dir))
+    {
+        CMD_IC_LOG_ERROR("create ic flow fail");
+        ret = RDPA_DRV_IC_ERROR;
+        goto rule_exit;
+    }
+
+    node = ic_db_flow_find_key(db, &ic_flow);
+    if (node && ic_db_flow_verify(ingress_class_obj, node))
+    {
+        CMD_IC_LOG_DEBUG("IC flow index of ic(%d) is stale", (int)db->ic_idx);
+        if (ic_db_sync(db, ingress_class_obj))
+            goto rule_db_error;
+        node = ic_db_flow_find_key(db, &ic_flow);
+    }
+
+    if (node && !rdpactl_compare_ic_flows(&node->flow, &ic_flow))
+    {
+        node->gen = gen;
+        rs->n_kept++;
+        goto rule_exit;
+    }
+
+    if (node)
+    {
+        /* Same key, different result */
+        if ((rc = rdpa_ingress_class_flow_delete(ingress_class_obj, node->flow_idx)))
+        {
+            CMD_IC_LOG_ERROR("Cannot delete ingress_class flow: ic_idx %d, flow_idx %d, rc=%d",
+                (int)ic_idx, (int)node->flow_idx, rc);
+            ret = RDPA_DRV_IC_FLOW_ERROR;
+            goto rule_exit;
+        }
+        ic_db_flow_remove(db, node->flow_idx, &node->flow);
+        rs->n_removed++;
+    }
+
+    rc = rdpa_ingress_class_flow_add(ingress_class_obj, &ic_flow_idx, &ic_flow);
+    if (rc == BDMF_ERR_ALREADY)
+    {
+        /* Added by someone else: the flow index missed it */
+        if (ic_db_sync(db, ingress_class_obj))
+            goto rule_db_error;
+        node = ic_db_flow_find_key(db, &ic_flow);
+        if (node && !rdpactl_compare_ic_flows(&node->flow, &ic_flow))
+        {
+            node->gen = gen;
+            rs->n_kept++;
+            goto rule_exit;
+        }
+    }
+    if (rc)
+    {
+        CMD_IC_LOG_ERROR("add  ic flow error, rc=%d", rc);
+        ret = RDPA_DRV_IC_FLOW_ERROR;
+        goto rule_exit;
+    }
+    rs->n_added++;
+
+    if (ic_db_flow_add(db, ic_flow_idx, &ic_flow, gen))
+        goto rule_db_error;
+
+    goto rule_exit;
+
+rule_db_error:
+    /* The sweep would trust a partial index: stop the rule set */
+    ic_db_destroy(db);
+    db = NULL;
+    ret = RDPA_DRV_IC_ERROR;
+
+rule_exit:
+    /* A classifier created for this rule is dropped if it got no flow */
+    if (icAdd)
+    {
+        if (ret && (!db || !db->nflows))
+            delete_ic(ingress_class_obj);
+    }
+    else
+        bdmf_put(ingress_class_obj);
+
+    return ret;
+}
+
+/* Remove the flows of the direction that are not in the rule set */
+static int ic_ruleset_sweep(rdpa_drv_ioctl_ic_ruleset_t *rs, uint32_t gen)
+{
+    ic_db_t *db, *db_next;
+    int i;
+    int ret = 0;
+
+    for (db = ic_db_list; db && !ret; db = db_next)
+    {
+        rdpa_ingress_class_key_t key = {};
+        bdmf_object_handle ingress_class_obj = NULL;
+
+        db_next = db->next;
+        if (db->dir != (rdpa_traffic_dir)rs->dir)
+            continue;
+
+        key.dir   = db->dir;
+        key.index = db->ic_idx;
+        if (rdpa_ingress_class_get(&key, &ingress_class_obj))
+        {
+            ic_db_destroy(db);
+            continue;
+        }
+
+        for (i = 0; i < IC_FLOW_HASH_SIZE && !ret; i++)
+        {
+            ic_flow_node_t **pnode = &db->hash[i];
+
+            while (*pnode)
+            {
+                ic_flow_node_t *node = *pnode;
+                int rc;
+
+                if (node->gen == gen)
+                {
+                    pnode = &node->next;
+                    continue;
+                }
+
+                if ((rc = rdpa_ingress_class_flow_delete(ingress_class_obj, node->flow_idx)))
+                {
+                    CMD_IC_LOG_ERROR("Cannot delete ingress_class flow: ic_idx %d, flow_idx %d, rc=%d",
+                        (int)db->ic_idx, (int)node->flow_idx, rc);
+                    ret = RDPA_DRV_IC_FLOW_ERROR;
+                    break;
+                }
+
+                *pnode = node->next;
+                bdmf_free(node);
+                db->nflows--;
+                rs->n_removed++;
+            }
+        }
+
+        bdmf_put(ingress_class_obj);
+        if (!ret && !db->nflows)
+            delete_ic(ingress_class_obj);
+    }
+
+    return ret;
+}
+
+static int ic_ruleset_apply(rdpa_drv_ioctl_ic_ruleset_t *rs, rdpactl_classification_rule_t *rules)
+{
+    uint32_t gen = ++ic_ruleset_gen;
+    uint32_t i;
+    int ret = 0;
+
+    rs->n_added   = 0;
+    rs->n_removed = 0;
+    rs->n_kept    = 0;
+    rs->failed_rule = -1;
+
+    for (i = 0; i < rs->n_rules; i++)
+    {
+        if ((ret = ic_ruleset_rule_apply(rs, &rules[i], gen)))
+        {
+            rs->failed_rule = i;
+            return ret;
+        }
+    }
+
+    return ic_ruleset_sweep(rs, gen);
+}
+
+static int ic_ruleset_ioctl(unsigned long arg)
+{
+    rdpa_drv_ioctl_ic_ruleset_t *userRs_p = (rdpa_drv_ioctl_ic_ruleset_t *)arg;
+    rdpa_drv_ioctl_ic_ruleset_t rs;
+    rdpactl_classification_rule_t *rules = NULL;
+    int ret;
+
+    copy_from_user(&rs, userRs_p, sizeof(rdpa_drv_ioctl_ic_ruleset_t));
+
+    CMD_IC_LOG_INFO("RDPA_IOCTL_IC_CMD_REPLACE_RULESET: dir(%d) rules(%u)", rs.dir, rs.n_rules);
+
+    if (rs.n_rules > IC_RULESET_MAX_RULES)
+    {
+        CMD_IC_LOG_ERROR("too many rules %u, max %d", rs.n_rules, IC_RULESET_MAX_RULES);
+        return RDPA_DRV_ERROR;
+    }
+
+    if (rs.n_rules)
+    {
+        rules = bdmf_alloc(rs.n_rules * sizeof(rdpactl_classification_rule_t));
+        if (!rules)
+            return RDPA_DRV_ERROR;
+        copy_from_user(rules, rs.rules, rs.n_rules * sizeof(rdpactl_classification_rule_t));
+    }
+
+    bdmf_lock();
+    ret = ic_ruleset_apply(&rs, rules);
+    bdmf_unlock();
+
+    if (ret)
+    {
+        CMD_IC_LOG_ERROR("ic_ruleset_apply() FAILED: rule(%d) ret(%d)", rs.failed_rule, ret);
+    }
+
+    copy_to_user(userRs_p, &rs, sizeof(rdpa_drv_ioctl_ic_ruleset_t));
+
+    if (rules)
+        bdmf_free(rules);
+
+    return ret;
+}
+
 /*******************************************************************************/
 /* global routines                                                             */
 /*******************************************************************************/
@@ -551,6 +1141,10 @@ int rdpa_cmd_ic_ioctl(unsigned long arg)
     uint8_t prty = 0xFF;
 
     copy_from_user(&ic, userIc_p, sizeof(rdpa_drv_ioctl_ic_t));
+
+    if ((uint32_t)ic.cmd == RDPA_IOCTL_IC_CMD_REPLACE_RULESET)
+        return ic_ruleset_ioctl(arg);
+
     copy_from_user(&rule, ic.param.rule, sizeof(rdpactl_classification_rule_t));
 
     CMD_IC_LOG_DEBUG("RDPA IC CMD(%d)", ic.cmd);
@@ -566,6 +1160,7 @@ int rdpa_cmd_ic_ioctl(unsigned long arg)
           bdmf_index ic_flow_idx;
           rdpa_ic_info_t  ic_flow;
           bdmf_index flow_idx = BDMF_INDEX_UNASSIGNED;
+          ic_db_t *db;
       
           CMD_IC_LOG_DEBUG("RDPA_IOCTL_IC_CMD_ADD_CLASSIFICATION_RULE: field(0x%x) port_id(%d)", rule.field_mask, rule.ingress_port_id);
    
@@ -596,7 +1191,8 @@ int rdpa_cmd_ic_ioctl(unsigned long arg)
                 goto ioctl_exit;
              }
 
-          rdpactl_match_ic_flow(ingress_class_obj, &ic_flow, &flow_idx);
+          db = ic_db_lookup(ingress_class_obj);
+          rdpactl_match_ic_flow(ingress_class_obj, db, &ic_flow, &flow_idx);
           if (flow_idx != BDMF_INDEX_UNASSIGNED)
              break;
           
@@ -608,7 +1204,12 @@ int rdpa_cmd_ic_ioctl(unsigned long arg)
               if (icAdd) 
                  delete_ic(ingress_class_obj);
               else
+              {
+                 /* Added by someone else: the flow index missed it */
+                 if (rc == BDMF_ERR_ALREADY && db && ic_db_sync(db, ingress_class_obj))
+                    ic_db_destroy(db);
                  bdmf_put(ingress_class_obj);
+              }
 
              ret = (rc == BDMF_ERR_ALREADY ? 0 : RDPA_DRV_IC_FLOW_ERROR);
              goto ioctl_exit;
@@ -616,6 +1217,9 @@ int rdpa_cmd_ic_ioctl(unsigned long arg)
           else
               CMD_IC_LOG_INFO("Created ic flow: ic_idx %d, flow_idx %d", (int)ic_idx, (int)ic_flow_idx);
 
+          if (db && ic_db_flow_add(db, ic_flow_idx, &ic_flow, 0))
+              ic_db_destroy(db);
+
           if (!icAdd) bdmf_put(ingress_class_obj);
           
           copy_to_user(&(userIc_p->param.prty), &prty, sizeof(uint8_t));
@@ -629,6 +1233,7 @@ int rdpa_cmd_ic_ioctl(unsigned long arg)
           bdmf_number ic_idx;
           int rc;
           bdmf_number nflows;
+          ic_db_t *db;
           
           CMD_IC_LOG_DEBUG("RDPA_IOCTL_IC_CMD_DEL_CLASSIFICATION_RULE: field(0x%x) port_id(%d)", rule.field_mask, rule.ingress_port_id);
           
@@ -658,6 +1263,9 @@ int rdpa_cmd_ic_ioctl(unsigned long arg)
               goto ioctl_exit;
           }
 
+          if ((db = ic_db_get((rdpa_traffic_dir)rule.dir, ic_idx)))
+              ic_db_flow_remove(db, ic_flow_idx, &ic_flow);
+
           rdpa_ingress_class_nflow_get(ingress_class_obj, &nflows);
           if (nflows == 0) 
            {
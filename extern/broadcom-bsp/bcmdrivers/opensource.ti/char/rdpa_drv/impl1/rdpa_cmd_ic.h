@@ -32,6 +32,26 @@
  *
  *******************************************************************************
  */
+
+/* Rule set replace.
+ * Replaces all the flows of the given direction in the classifiers used
+ * through this interface with the rule set, in one RDPA_IOC_IC ioctl.
+ * Flows that are already in place are left untouched.
+ * Must be included after rdpa_drv.h.
+ */
+#define RDPA_IOCTL_IC_CMD_REPLACE_RULESET  0x100 /* ic.cmd value, outside of the RDPA_IOCTL_IC_CMD_xx range */
+
+typedef struct {
+    rdpa_drv_ioctl_ic_t ic;     /* cmd = RDPA_IOCTL_IC_CMD_REPLACE_RULESET */
+    uint32_t dir;               /* rdpactl_dir_ds / rdpactl_dir_us. All the rules must be of this dir */
+    uint32_t n_rules;
+    rdpactl_classification_rule_t *rules; /* User array of n_rules rules */
+    uint32_t n_added;           /* Out: flows added */
+    uint32_t n_removed;         /* Out: flows removed */
+    uint32_t n_kept;            /* Out: flows left in place */
+    int32_t  failed_rule;       /* Out: index of the rule that failed, -1 if none */
+} rdpa_drv_ioctl_ic_ruleset_t;
+
 int rdpa_cmd_ic_ioctl(unsigned long arg);
 void rdpa_cmd_ic_init(void);
 
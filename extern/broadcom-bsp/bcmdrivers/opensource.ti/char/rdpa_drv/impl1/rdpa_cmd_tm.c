@@ -45,6 +45,7 @@
 #include <linux/module.h>
 #include <linux/jiffies.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
 #include <linux/bcm_log.h>
 #include "bcmenet.h"
 #include "bcmtypes.h"
@@ -106,6 +107,11 @@ typedef struct {
     bdmf_number qid;
     int         q_index;
     uint32_t    weight;
+    BOOL        tree;           /* set by desired-state tree apply. Fields below are valid */
+    int         sub_index;      /* root subsidiary index (root level egress_tm) */
+    uint32_t    qsize;
+    uint32_t    shaping_rate;
+    uint32_t    burst;
 } queue_st;
 
 typedef struct {
@@ -117,6 +123,8 @@ typedef struct {
     BOOL               orl_linked;
     rdpa_if            port_id;
     rdpa_tm_sched_mode arbiter_mode;    /* root TM arbiter mode */
+    rdpa_tm_level_type root_level;      /* root TM level */
+    rdpa_traffic_dir   root_dir;        /* root TM direction */
     queue_st           queue_list[MAX_Q_PER_TM];
     int                queue_alloc_cnt;
 } port_st;
@@ -292,7 +300,9 @@ static int add_root_tm_to_virt_port(
     uint32_t dev_type,
     uint32_t port_id,
     uint32_t tm_id,
-    uint32_t arbiter_mode)
+    uint32_t arbiter_mode,
+    uint32_t level,
+    uint32_t dir)
 {
     port_st    *pport = NULL;
 
@@ -314,6 +324,8 @@ static int add_root_tm_to_virt_port(
     pport->root_tm_id   = tm_id;
     pport->port_id      = port_id;
     pport->arbiter_mode = arbiter_mode;
+    pport->root_level   = level;
+    pport->root_dir     = dir;
 
     return 0;
 }
@@ -435,6 +447,7 @@ static int add_q_to_virt_port(
     pq->weight = weight;
 
     pq->q_index = q_index;
+    pq->tree    = FALSE;
 
     if (!pq->alloc)
     {
@@ -481,6 +494,7 @@ static int remove_q_from_virt_port(
     pq->tm_id  = INVALID_ID;
     pq->qid    = q_id;
     pq->weight = 0;
+    pq->tree   = FALSE;
 
     pport->queue_alloc_cnt--;
     CMD_TM_LOG_DEBUG("OUT: dev_type(%u) port_id(%u) q_id(%u)",
@@ -752,6 +766,36 @@ static int get_q_cfg(
     return ret;
 }
 
+static void get_q_stats_index(
+    uint32_t dev_type,
+    uint32_t dev_id,
+    uint32_t q_id,
+    uint32_t dir,
+    rdpa_tm_queue_index_t *pq_index)
+{
+    if (dev_type == RDPA_IOCTL_DEV_TCONT || dev_type == RDPA_IOCTL_DEV_LLID) {
+        /* TCONT/LLID channel id is the TCONT/LLID index */
+        pq_index->channel = dev_id;
+    }
+    else if (dir == rdpa_dir_us) {
+        if (dev_id == rdpa_if_wan1)
+            /* For xtmWan, the queue's channel id is q_id. See xtmrt_runner.c. */
+            pq_index->channel = q_id;
+        else
+            /* ethWan channel id = RDD_WAN_CHANNEL_0 (0) */
+            pq_index->channel = rdpa_if_wan0;
+    }
+    else {
+        /* ethLan channel id is its emac id.
+         * lan0 channel id = BL_LILAC_RDD_EMAC_ID_0 (1) = rdpa_if_lan0 - rdpa_if_wan1
+         * lan1 channel id = BL_LILAC_RDD_EMAC_ID_1 (2) = rdpa_if_lan1 - rdpa_if_wan1
+         * etc....
+         */
+        pq_index->channel = dev_id - rdpa_if_wan1;
+    }
+
+    pq_index->queue_id = q_id;
+}
 
 static int get_q_stats(
     uint32_t dev_type,
@@ -824,24 +868,7 @@ static int get_q_stats(
         return RDPA_DRV_TM_GET;
     }
 
-    if (dir == rdpa_dir_us) {
-        if (dev_id == rdpa_if_wan1)
-            /* For xtmWan, the queue's channel id is q_id. See xtmrt_runner.c. */
-            q_index.channel = q_id;
-        else
-            /* ethWan channel id = RDD_WAN_CHANNEL_0 (0) */
-            q_index.channel = rdpa_if_wan0;
-    }
-    else {
-        /* ethLan channel id is its emac id.
-         * lan0 channel id = BL_LILAC_RDD_EMAC_ID_0 (1) = rdpa_if_lan0 - rdpa_if_wan1
-         * lan1 channel id = BL_LILAC_RDD_EMAC_ID_1 (2) = rdpa_if_lan1 - rdpa_if_wan1
-         * etc....
-         */
-        q_index.channel = dev_id - rdpa_if_wan1;
-    }
-
-    q_index.queue_id = q_id;
+    get_q_stats_index(dev_type, dev_id, q_id, dir, &q_index);
 
     /* get queue statistics */
     if ((rc = rdpa_egress_tm_queue_statistics_get(sched, &q_index, pstats))) {
@@ -1470,7 +1497,8 @@ static int root_tm_config(
 
         *psched = tmp_psched;
         if ((ret = add_root_tm_to_virt_port(ptm->dev_type, ptm->dev_id,
-                                            ptm->root_tm_id, ptm->arbiter_mode))) {
+                                            ptm->root_tm_id, ptm->arbiter_mode, ptm->level,
+                                            ptm->dir))) {
             CMD_TM_LOG_ERROR("add_root_tm_to_port() failed: ROOT_tm(%u) ret(%d)", ptm->root_tm_id, ret);
             goto root_tm_cfg_exit;
         }
@@ -1501,7 +1529,8 @@ static int root_tm_config(
         *psched = tmp_psched;
 
         if ((ret = add_root_tm_to_virt_port(ptm->dev_type, ptm->dev_id,
-                                            ptm->root_tm_id, ptm->arbiter_mode))) {
+                                            ptm->root_tm_id, ptm->arbiter_mode, ptm->level,
+                                            ptm->dir))) {
             CMD_TM_LOG_ERROR("add_root_tm_to_port() failed: ROOT_tm(%u) ret(%d)", ptm->root_tm_id, ret);
             goto root_tm_cfg_exit;
         }
@@ -1531,7 +1560,8 @@ static int root_tm_config(
         }
         *psched = tmp_psched;
         if ((ret = add_root_tm_to_virt_port(ptm->dev_type, ptm->dev_id,
-                                            ptm->root_tm_id, ptm->arbiter_mode))) {
+                                            ptm->root_tm_id, ptm->arbiter_mode, ptm->level,
+                                            ptm->dir))) {
             CMD_TM_LOG_ERROR("add_root_tm_to_virt_port() failed: ROOT_tm(%u) ret(%d)",
                              ptm->root_tm_id, ret);
             goto root_tm_cfg_exit;
@@ -2000,12 +2030,16 @@ int port_root_tm_get(uint32_t dev_type, uint32_t port_id, uint32_t *proot_tm_id,
         else
         {
             rdpa_tm_sched_mode mode;
+            rdpa_tm_level_type level;
+            rdpa_traffic_dir dir;
 
             *found = TRUE;
             *proot_tm_id = root_tm_id;
             CMD_TM_LOG_INFO("**: RDPA_IOCTL_TM_CMD_GET_ROOT_TM: ROOT TM id=[%u]", *proot_tm_id);
             rdpa_egress_tm_mode_get(tm_cfg.sched, &mode);
-            ret = add_root_tm_to_virt_port(dev_type, port_id, *proot_tm_id, mode);
+            rdpa_egress_tm_level_get(tm_cfg.sched, &level);
+            rdpa_egress_tm_dir_get(tm_cfg.sched, &dir);
+            ret = add_root_tm_to_virt_port(dev_type, port_id, *proot_tm_id, mode, level, dir);
         }
 
 port_root_tm_exit:
@@ -2214,6 +2248,666 @@ get_tm_config_exit:
     return ret;
 }
 
+/*******************************************************************************/
+/* Desired-state tree                                                          */
+/*******************************************************************************/
+
+static int tree_validate(
+    rdpa_drv_ioctl_tm_tree_t *tree)
+{
+    rdpa_drv_ioctl_tm_t *ptm = &tree->tm;
+    uint32_t index_mask = 0;
+    uint32_t q_id;
+
+    switch (ptm->dev_type)
+    {
+    case RDPA_IOCTL_DEV_PORT:
+        break;
+    case RDPA_IOCTL_DEV_LLID:
+    case RDPA_IOCTL_DEV_TCONT:
+        if (tree->orl_rate) {
+            CMD_TM_LOG_ERROR("FAIL: ORL is supported on port only: dev_type(%u)", ptm->dev_type);
+            return RDPA_DRV_ERROR;
+        }
+        break;
+    default:
+        CMD_TM_LOG_ERROR("FAIL: Invalid dev_type(%u)", ptm->dev_type);
+        return RDPA_DRV_ERROR;
+    }
+
+    if (ptm->arbiter_mode != rdpa_tm_sched_sp && ptm->arbiter_mode != rdpa_tm_sched_wrr) {
+        CMD_TM_LOG_ERROR("FAIL: Invalid root arbiter mode(%u)", ptm->arbiter_mode);
+        return RDPA_DRV_ERROR;
+    }
+
+    if (ptm->level != rdpa_tm_level_queue && ptm->level != rdpa_tm_level_egress_tm) {
+        CMD_TM_LOG_ERROR("FAIL: Invalid root level(%u)", ptm->level);
+        return RDPA_DRV_ERROR;
+    }
+
+    for (q_id = 0; q_id < RDPA_CMD_TM_TREE_MAX_Q; q_id++) {
+        rdpa_cmd_tm_tree_queue_t *tq = &tree->queue[q_id];
+
+        if (!tq->valid)
+            continue;
+
+        if (tq->index >= MAX_Q_PER_TM) {
+            CMD_TM_LOG_ERROR("FAIL: q_id(%u) invalid index(%u)", q_id, tq->index);
+            return RDPA_DRV_Q_ID_NOT_VALID;
+        }
+        if (index_mask & (1 << tq->index)) {
+            CMD_TM_LOG_ERROR("FAIL: q_id(%u) index(%u) is used by another queue", q_id, tq->index);
+            return RDPA_DRV_Q_ID_NOT_VALID;
+        }
+        if (!tq->qsize) {
+            CMD_TM_LOG_ERROR("FAIL: q_id(%u) qsize is 0", q_id);
+            return RDPA_DRV_ERROR;
+        }
+        index_mask |= 1 << tq->index;
+    }
+
+    return 0;
+}
+
+/* Root level queue: queue q_id is a queue of the root TM */
+static int tree_root_q_set(
+    bdmf_object_handle root_sched,
+    uint32_t q_id,
+    uint32_t index,
+    uint32_t qsize,
+    uint32_t weight)
+{
+    rdpa_tm_queue_cfg_t queue_cfg = {};
+    bdmf_error_t rc = BDMF_ERR_OK;
+
+    queue_cfg.queue_id       = q_id;
+    queue_cfg.drop_alg       = rdpa_tm_drop_alg_dt;
+    queue_cfg.drop_threshold = qsize;   /* 0 = release the queue */
+    queue_cfg.weight         = weight;
+
+    CMD_TM_LOG_DEBUG("rdpa_egress_tm_queue_cfg_set(): q_id(%u) index(%u) qsize(%u) weight(%u)",
+                     q_id, index, qsize, weight);
+
+    if ((rc = rdpa_egress_tm_queue_cfg_set(root_sched, index, &queue_cfg))) {
+        CMD_TM_LOG_ERROR("rdpa_egress_tm_queue_cfg_set() failed: q_id(%u) index(%u) rc(%d)",
+                         q_id, index, rc);
+        return RDPA_DRV_Q_CFG_SET;
+    }
+
+    return 0;
+}
+
+/* Root level egress_tm: queue q_id is the single queue of a rate limiter
+ * TM attached to root subsidiary tq->index.
+ * Only the settings that differ from pq are applied. pq == NULL creates the TM.
+ */
+static int tree_sub_tm_set(
+    rdpa_drv_ioctl_tm_tree_t *tree,
+    bdmf_object_handle root_sched,
+    uint32_t q_id,
+    queue_st *pq,
+    uint32_t *ptm_id)
+{
+    BDMF_MATTR(sched_attrs, rdpa_egress_tm_drv());
+    rdpa_cmd_tm_tree_queue_t *tq = &tree->queue[q_id];
+    rdpa_drv_ioctl_tm_t tm = tree->tm;
+    rdpa_egress_tm_key_t tm_key = {};
+    rdpa_tm_queue_cfg_t queue_cfg = {};
+    bdmf_object_handle sched = NULL;
+    bdmf_error_t rc = BDMF_ERR_OK;
+    int ret = 0;
+
+    if (pq == NULL) {
+        tm.level        = rdpa_tm_level_queue;
+        tm.arbiter_mode = rdpa_tm_sched_disabled;
+        tm.service_queue = 0;
+
+        if ((ret = tm_set(sched_attrs, &tm, ptm_id, root_sched, &sched))) {
+            CMD_TM_LOG_ERROR("tm_set() failed: q_id(%u) ret(%d)", q_id, ret);
+            return ret;
+        }
+    }
+    else {
+        *ptm_id = pq->tm_id;
+        tm_key.dir   = tm.dir;
+        tm_key.index = pq->tm_id;
+
+        if ((rc = rdpa_egress_tm_get(&tm_key, &sched))) {
+            CMD_TM_LOG_ERROR("rdpa_egress_tm_get() failed: tm(%u) rc(%d)", pq->tm_id, rc);
+            return RDPA_DRV_TM_GET;
+        }
+    }
+
+    if (pq == NULL || pq->weight != tq->weight) {
+        if ((rc = rdpa_egress_tm_weight_set(sched, tq->weight))) {
+            CMD_TM_LOG_ERROR("rdpa_egress_tm_weight_set() failed: tm(%u) rc(%d)", *ptm_id, rc);
+            ret = RDPA_DRV_TM_CFG_SET;
+            goto sub_tm_set_exit;
+        }
+    }
+
+    if ((pq == NULL && (tq->shaping_rate || tq->burst)) ||
+        (pq != NULL && (pq->shaping_rate != tq->shaping_rate || pq->burst != tq->burst))) {
+        rdpa_tm_rl_cfg_t rl_cfg = {};
+
+        rl_cfg.af_rate    = tq->shaping_rate * 1000;
+        rl_cfg.burst_size = tq->burst;
+
+        if ((rc = rdpa_egress_tm_rl_set(sched, &rl_cfg))) {
+            CMD_TM_LOG_ERROR("rdpa_egress_tm_rl_set() failed: tm(%u) af(%u) rc(%d)",
+                             *ptm_id, rl_cfg.af_rate, rc);
+            ret = RDPA_DRV_TM_CFG_SET;
+            goto sub_tm_set_exit;
+        }
+    }
+
+    if (pq == NULL) {
+        if ((rc = rdpa_egress_tm_subsidiary_set(root_sched, tq->index, sched))) {
+            CMD_TM_LOG_ERROR("rdpa_egress_tm_subsidiary_set() failed: index(%u) tm(%u) rc(%d)",
+                             tq->index, *ptm_id, rc);
+            ret = RDPA_DRV_SUBS_SET;
+            goto sub_tm_set_exit;
+        }
+    }
+
+    if (pq == NULL || pq->qsize != tq->qsize) {
+        queue_cfg.queue_id       = q_id;
+        queue_cfg.drop_alg       = rdpa_tm_drop_alg_dt;
+        queue_cfg.drop_threshold = tq->qsize;
+
+        if ((rc = rdpa_egress_tm_queue_cfg_set(sched, 0, &queue_cfg))) {
+            CMD_TM_LOG_ERROR("rdpa_egress_tm_queue_cfg_set() failed: tm(%u) rc(%d)", *ptm_id, rc);
+            ret = RDPA_DRV_Q_CFG_SET;
+            goto sub_tm_set_exit;
+        }
+    }
+
+sub_tm_set_exit:
+    if (pq == NULL) {
+        /* A new TM is owned by the root. Drop it if it could not be attached */
+        if (ret)
+            bdmf_destroy(sched);
+    }
+    else
+        bdmf_put(sched);
+
+    return ret;
+}
+
+static int tree_sub_tm_remove(
+    rdpa_drv_ioctl_tm_tree_t *tree,
+    queue_st *pq)
+{
+    rdpa_egress_tm_key_t tm_key = {};
+    bdmf_object_handle sched = NULL;
+    bdmf_error_t rc = BDMF_ERR_OK;
+
+    tm_key.dir   = tree->tm.dir;
+    tm_key.index = pq->tm_id;
+
+    if ((rc = rdpa_egress_tm_get(&tm_key, &sched))) {
+        CMD_TM_LOG_ERROR("rdpa_egress_tm_get() failed: tm(%u) rc(%d)", pq->tm_id, rc);
+        return RDPA_DRV_TM_GET;
+    }
+
+    bdmf_put(sched);
+    if ((rc = bdmf_destroy(sched))) {
+        CMD_TM_LOG_ERROR("bdmf_destroy() failed: tm(%u) rc(%d)", pq->tm_id, rc);
+        return RDPA_DRV_SH_DESTROY;
+    }
+
+    return 0;
+}
+
+/* Releases the queues that are gone from the tree or moved to another index.
+ * Done for all the queues before any queue is added, so that an index released
+ * by one queue can be taken by another one in the same tree.
+ */
+static int tree_q_release(
+    rdpa_drv_ioctl_tm_tree_t *tree,
+    port_st *pport,
+    bdmf_object_handle root_sched,
+    uint32_t q_id)
+{
+    rdpa_drv_ioctl_tm_t *ptm = &tree->tm;
+    rdpa_cmd_tm_tree_queue_t *tq = &tree->queue[q_id];
+    queue_st *pq = &pport->queue_list[q_id];
+    int ret = 0;
+
+    if (pq->tm_id == INVALID_ID)
+        return 0;
+
+    if (ptm->level == rdpa_tm_level_queue) {
+        if (tq->valid && pq->q_index == tq->index)
+            return 0;
+        ret = tree_root_q_set(root_sched, q_id, pq->q_index, 0, 0);
+    }
+    else {
+        if (tq->valid && pq->sub_index == tq->index)
+            return 0;
+        ret = tree_sub_tm_remove(tree, pq);
+    }
+
+    if (!ret)
+        ret = remove_q_from_virt_port(ptm->dev_type, ptm->dev_id, q_id);
+    if (!ret)
+        ++tree->n_ops;
+
+    return ret;
+}
+
+static int tree_q_config(
+    rdpa_drv_ioctl_tm_tree_t *tree,
+    port_st *pport,
+    bdmf_object_handle root_sched,
+    uint32_t q_id)
+{
+    rdpa_drv_ioctl_tm_t *ptm = &tree->tm;
+    rdpa_cmd_tm_tree_queue_t *tq = &tree->queue[q_id];
+    queue_st *pq = &pport->queue_list[q_id];
+    BOOL exists = (pq->tm_id != INVALID_ID);
+    uint32_t tm_id;
+    int q_index;
+    int ret = 0;
+
+    if (!tq->valid)
+        return 0;
+
+    if (ptm->level == rdpa_tm_level_queue) {
+        if (exists && pq->qsize == tq->qsize && pq->weight == tq->weight)
+            return 0;
+
+        if ((ret = tree_root_q_set(root_sched, q_id, tq->index, tq->qsize, tq->weight)))
+            return ret;
+
+        tm_id   = pport->root_tm_id;
+        q_index = tq->index;
+    }
+    else {
+        if (exists && pq->qsize == tq->qsize && pq->weight == tq->weight &&
+            pq->shaping_rate == tq->shaping_rate && pq->burst == tq->burst)
+            return 0;
+
+        if ((ret = tree_sub_tm_set(tree, root_sched, q_id, exists ? pq : NULL, &tm_id)))
+            return ret;
+
+        q_index = 0;    /* rate limiter has only one queue */
+    }
+
+    if ((ret = add_q_to_virt_port(ptm->dev_type, ptm->dev_id, tm_id,
+                                  q_id, q_index, tq->weight))) {
+        CMD_TM_LOG_ERROR("add_q_to_virt_port() failed: dev_id(%u) tm_id(%u) q_id(%u) ret(%d)",
+                         ptm->dev_id, tm_id, q_id, ret);
+        return ret;
+    }
+
+    pq->tree         = TRUE;
+    pq->sub_index    = tq->index;
+    pq->qsize        = tq->qsize;
+    pq->shaping_rate = tq->shaping_rate;
+    pq->burst        = tq->burst;
+    ++tree->n_ops;
+
+    return 0;
+}
+
+static int tree_orl_config(
+    rdpa_drv_ioctl_tm_tree_t *tree,
+    port_st *pport)
+{
+    rdpa_drv_ioctl_tm_t tm = tree->tm;
+    uint32_t orl_id       = INVALID_ID;
+    uint32_t shaping_rate = 0;
+    BOOL     orl_linked   = FALSE;
+    int ret = 0;
+
+    if (tm.dev_type != RDPA_IOCTL_DEV_PORT)
+        return 0;
+
+    if ((ret = get_orl(tm.dev_type, tm.dev_id, tm.dir,
+                       &orl_id, &shaping_rate, &orl_linked))) {
+        CMD_TM_LOG_ERROR("get_orl() failed: port_id(%u) ret(%d)", tm.dev_id, ret);
+        return ret;
+    }
+
+    if (!tree->orl_rate) {
+        if (orl_id == INVALID_ID)
+            return 0;
+        if ((ret = orl_remove(tm.dev_type, tm.dev_id, tm.dir)))
+            return ret;
+        ++tree->n_ops;
+        return 0;
+    }
+
+    if (orl_id == INVALID_ID) {
+        if ((ret = orl_config(&tm))) {
+            CMD_TM_LOG_ERROR("orl_config() failed: port_id(%u) ret(%d)", tm.dev_id, ret);
+            return ret;
+        }
+    }
+    else if (orl_linked && shaping_rate == tree->orl_rate)
+        return 0;
+
+    tm.tm_id        = pport->orl_id;
+    tm.shaping_rate = tree->orl_rate;
+    if ((ret = orl_link(&tm)))
+        return ret;
+    ++tree->n_ops;
+
+    return 0;
+}
+
+/* Brings the TM tree of the device to the state described by tree.
+ * On failure the operation stops at the failed step, which is reported in
+ * tree->failed_step/failed_q_id. The steps applied before it are not undone,
+ * port_list[] reflects them and the same tree can simply be applied again.
+ */
+static int tm_tree_apply(
+    rdpa_drv_ioctl_tm_tree_t *tree)
+{
+    rdpa_drv_ioctl_tm_t *ptm = &tree->tm;
+    rdpa_egress_tm_key_t tm_key = {};
+    bdmf_object_handle root_sched = NULL;
+    bdmf_error_t rc = BDMF_ERR_OK;
+    port_st *pport;
+    BOOL rebuild;
+    uint32_t q_id;
+    int ret = 0;
+
+    tree->n_ops       = 0;
+    tree->rebuilt     = 0;
+    tree->failed_step = RDPA_CMD_TM_TREE_STEP_VALIDATE;
+    tree->failed_q_id = 0;
+
+    if ((ret = tree_validate(tree)))
+        return ret;
+
+    pport = get_virt_port(ptm->dev_type, ptm->dev_id);
+    if (pport == NULL) {
+        CMD_TM_LOG_ERROR("Invalid devtype(%u) dev_id(%u)", ptm->dev_type, ptm->dev_id);
+        return RDPA_DRV_PORT_ID_NOT_VALID;
+    }
+
+    /* The root TM is re-created only if its mode or level changes. Queues set up by
+     * the per-queue commands are not known in enough detail to be compared, so the
+     * first tree applied on top of them re-creates the root as well.
+     */
+    rebuild = !pport->alloc ||
+              pport->arbiter_mode != ptm->arbiter_mode ||
+              pport->root_level != ptm->level;
+    for (q_id = 0; q_id < MAX_Q_PER_TM && !rebuild; q_id++) {
+        queue_st *pq = &pport->queue_list[q_id];
+
+        if (pq->tm_id != INVALID_ID && !pq->tree)
+            rebuild = TRUE;
+    }
+
+    tree->failed_step = RDPA_CMD_TM_TREE_STEP_ROOT;
+    if (rebuild) {
+        if (pport->alloc) {
+            if ((ret = root_tm_remove(ptm->dev_type, ptm->dev_id, pport->root_tm_id, ptm->dir))) {
+                CMD_TM_LOG_ERROR("root_tm_remove() failed: dev_id(%u) ret(%d)", ptm->dev_id, ret);
+                return ret;
+            }
+            ++tree->n_ops;
+        }
+
+        ptm->service_queue = 0;
+        if ((ret = root_tm_config(ptm, &root_sched))) {
+            CMD_TM_LOG_ERROR("root_tm_config() failed: dev_id(%u) ret(%d)", ptm->dev_id, ret);
+            return ret;
+        }
+        ++tree->n_ops;
+        tree->rebuilt = 1;
+        root_sched = NULL;
+    }
+
+    ptm->root_tm_id = pport->root_tm_id;
+
+    tm_key.dir   = ptm->dir;
+    tm_key.index = pport->root_tm_id;
+
+    if ((rc = rdpa_egress_tm_get(&tm_key, &root_sched))) {
+        CMD_TM_LOG_ERROR("rdpa_egress_tm_get() failed: ROOT_tm(%u) rc(%d)", pport->root_tm_id, rc);
+        return RDPA_DRV_TM_GET;
+    }
+
+    tree->failed_step = RDPA_CMD_TM_TREE_STEP_RELEASE;
+    for (q_id = 0; q_id < RDPA_CMD_TM_TREE_MAX_Q; q_id++) {
+        if ((ret = tree_q_release(tree, pport, root_sched, q_id)))
+            goto tree_apply_exit;
+    }
+
+    tree->failed_step = RDPA_CMD_TM_TREE_STEP_CONFIG;
+    for (q_id = 0; q_id < RDPA_CMD_TM_TREE_MAX_Q; q_id++) {
+        if ((ret = tree_q_config(tree, pport, root_sched, q_id)))
+            goto tree_apply_exit;
+    }
+
+    tree->failed_step = RDPA_CMD_TM_TREE_STEP_ORL;
+    q_id = 0;
+    if ((ret = tree_orl_config(tree, pport)))
+        goto tree_apply_exit;
+
+    tree->failed_step = RDPA_CMD_TM_TREE_STEP_NONE;
+
+tree_apply_exit:
+    if (ret)
+        tree->failed_q_id = q_id;
+
+    bdmf_put(root_sched);
+
+    CMD_TM_LOG_DEBUG("OUT: dev_type(%u) dev_id(%u) root_tm(%u) rebuilt(%u) ops(%u) ret(%d)",
+                     ptm->dev_type, ptm->dev_id, ptm->root_tm_id, tree->rebuilt, tree->n_ops, ret);
+
+    return ret;
+}
+
+static int tm_tree_ioctl(unsigned long arg)
+{
+    rdpa_drv_ioctl_tm_tree_t *userTree_p = (rdpa_drv_ioctl_tm_tree_t *)arg;
+    rdpa_drv_ioctl_tm_tree_t tree;
+    int ret;
+
+    copy_from_user(&tree, userTree_p, sizeof(rdpa_drv_ioctl_tm_tree_t));
+
+    CMD_TM_LOG_INFO("RDPA_IOCTL_TM_CMD_TREE_APPLY: dev_type(%u) dev_id(%u) dir(%s) mode(%u) level(%u)",
+                    tree.tm.dev_type, tree.tm.dev_id, (tree.tm.dir == rdpa_dir_us)?"US":"DS",
+                    tree.tm.arbiter_mode, tree.tm.level);
+
+    bdmf_lock();
+    ret = tm_tree_apply(&tree);
+    bdmf_unlock();
+
+    if (ret) {
+        CMD_TM_LOG_ERROR("tm_tree_apply() FAILED: dev_id(%u) step(%u) q_id(%u) ops(%u) ret(%d)",
+                         tree.tm.dev_id, tree.failed_step, tree.failed_q_id, tree.n_ops, ret);
+    }
+
+    copy_to_user(userTree_p, &tree, sizeof(rdpa_drv_ioctl_tm_tree_t));
+
+    return ret;
+}
+
+/*******************************************************************************/
+/* Bulk queue statistics                                                       */
+/*******************************************************************************/
+
+#define STATS_SNAPSHOT_MAX_ENTRIES  (MAX_VIRT_TM_PORTS * MAX_Q_PER_TM)
+
+static uint32_t stats_snapshot_seq[2];
+/* Counters returned by the last snapshot, per direction. Used by delta mode.
+ * There is one baseline per direction, not per caller. See rdpa_cmd_tm.h.
+ */
+static rdpa_stat_1way_t stats_snapshot_last[2][MAX_VIRT_TM_PORTS][MAX_Q_PER_TM];
+
+static void stats_snapshot_q(
+    rdpa_drv_ioctl_tm_stats_t *psnap,
+    rdpa_cmd_tm_q_stats_t *entries,
+    bdmf_object_handle sched,
+    uint32_t vp_offset,
+    uint32_t dev_type,
+    uint32_t dev_id,
+    uint32_t q_id)
+{
+    rdpa_stat_1way_t *plast = &stats_snapshot_last[psnap->tm.dir][vp_offset][q_id];
+    rdpa_tm_queue_index_t q_index = {};
+    rdpa_stat_1way_t qstats = {};
+    bdmf_error_t rc = BDMF_ERR_OK;
+
+    get_q_stats_index(dev_type, dev_id, q_id, psnap->tm.dir, &q_index);
+
+    if ((rc = rdpa_egress_tm_queue_statistics_get(sched, &q_index, &qstats))) {
+        CMD_TM_LOG_ERROR("rdpa_egress_tm_queue_statistics_get() failed: dev_type(%u) dev_id(%u) q_id(%u) rc(%d)",
+                         dev_type, dev_id, q_id, rc);
+        psnap->n_errors++;
+        return;
+    }
+
+    psnap->n_queues++;
+
+    if ((psnap->flags & RDPA_CMD_TM_STATS_DELTA) && !memcmp(&qstats, plast, sizeof(qstats)))
+        return;
+
+    /* Entries that don't fit are only counted, and stay pending for the next delta */
+    if (psnap->n_entries < psnap->max_entries) {
+        rdpa_cmd_tm_q_stats_t *pentry = &entries[psnap->n_entries];
+
+        pentry->dev_type = dev_type;
+        pentry->dev_id   = dev_id;
+        pentry->q_id     = q_id;
+        pentry->qstats   = qstats;
+        *plast = qstats;
+    }
+    psnap->n_entries++;
+}
+
+static int stats_snapshot(
+    rdpa_drv_ioctl_tm_stats_t *psnap,
+    rdpa_cmd_tm_q_stats_t *entries)
+{
+    rdpa_wan_type wan_type = rdpa_wan_none;
+    rdpa_egress_tm_key_t tm_key = {};
+    bdmf_object_handle sched = NULL;
+    uint32_t vp_offset;
+    uint32_t q_id;
+    int ret = 0;
+
+    if ((ret = get_rdpa_wan_type(&wan_type)))
+        return ret;
+
+    /* The caller's delta baseline is stale if someone else took a snapshot since */
+    if (psnap->seq != stats_snapshot_seq[psnap->tm.dir])
+        psnap->flags &= ~RDPA_CMD_TM_STATS_DELTA;
+
+    psnap->n_entries    = 0;
+    psnap->n_queues     = 0;
+    psnap->n_errors     = 0;
+    psnap->seq          = ++stats_snapshot_seq[psnap->tm.dir];
+    psnap->timestamp_ns = ktime_to_ns(ktime_get());
+
+    tm_key.dir = psnap->tm.dir;
+
+    for (vp_offset = 0; vp_offset < MAX_VIRT_TM_PORTS; vp_offset++) {
+        port_st *pport = &port_list[vp_offset];
+        uint32_t dev_type = RDPA_IOCTL_DEV_PORT;
+        uint32_t dev_id = vp_offset;
+
+        if (vp_offset >= MAX_RUT_QOS_PORTS) {
+            dev_type = (wan_type == rdpa_wan_epon) ? RDPA_IOCTL_DEV_LLID : RDPA_IOCTL_DEV_TCONT;
+            dev_id   = vp_offset - MAX_RUT_QOS_PORTS;
+        }
+
+        if (dev_type == RDPA_IOCTL_DEV_PORT && dev_id == rdpa_if_wan1) {
+            /* xtm wan queues are US only and not tracked in port_list[].
+             * The queue's root tm index is q_id. See xtmrt_runner.c.
+             */
+            if (psnap->tm.dir != rdpa_dir_us)
+                continue;
+            for (q_id = 0; q_id < MAX_Q_PER_TM; q_id++) {
+                tm_key.index = q_id;
+                if (rdpa_egress_tm_get(&tm_key, &sched))
+                    continue;
+                stats_snapshot_q(psnap, entries, sched, vp_offset, dev_type, dev_id, q_id);
+                bdmf_put(sched);
+            }
+            continue;
+        }
+
+        if (!pport->alloc || pport->root_dir != psnap->tm.dir)
+            continue;
+
+        tm_key.index = pport->root_tm_id;
+        if (rdpa_egress_tm_get(&tm_key, &sched)) {
+            CMD_TM_LOG_ERROR("rdpa_egress_tm_get() failed: ROOT_tm(%u) dev_type(%u) dev_id(%u)",
+                             pport->root_tm_id, dev_type, dev_id);
+            sched = NULL;
+        }
+
+        for (q_id = 0; q_id < MAX_Q_PER_TM; q_id++) {
+            if (pport->queue_list[q_id].tm_id == INVALID_ID)
+                continue;
+            if (sched == NULL)
+                psnap->n_errors++;
+            else
+                stats_snapshot_q(psnap, entries, sched, vp_offset, dev_type, dev_id, q_id);
+        }
+
+        if (sched)
+            bdmf_put(sched);
+    }
+
+    return ret;
+}
+
+static int tm_stats_ioctl(unsigned long arg)
+{
+    rdpa_drv_ioctl_tm_stats_t *userSnap_p = (rdpa_drv_ioctl_tm_stats_t *)arg;
+    rdpa_drv_ioctl_tm_stats_t snap;
+    rdpa_cmd_tm_q_stats_t *entries = NULL;
+    uint32_t n_copy;
+    int ret;
+
+    copy_from_user(&snap, userSnap_p, sizeof(rdpa_drv_ioctl_tm_stats_t));
+
+    CMD_TM_LOG_DEBUG("RDPA_IOCTL_TM_CMD_STATS_SNAPSHOT: dir(%s) flags(0x%x) max(%u)",
+                     (snap.tm.dir == rdpa_dir_us)?"US":"DS", snap.flags, snap.max_entries);
+
+    if (snap.tm.dir != rdpa_dir_ds && snap.tm.dir != rdpa_dir_us) {
+        CMD_TM_LOG_ERROR("Invalid dir(%u)", snap.tm.dir);
+        return RDPA_DRV_ERROR;
+    }
+
+    if (snap.max_entries > STATS_SNAPSHOT_MAX_ENTRIES)
+        snap.max_entries = STATS_SNAPSHOT_MAX_ENTRIES;
+
+    if (snap.max_entries) {
+        entries = bdmf_alloc(snap.max_entries * sizeof(rdpa_cmd_tm_q_stats_t));
+        if (entries == NULL)
+            return RDPA_DRV_ERROR;
+    }
+
+    bdmf_lock();
+    ret = stats_snapshot(&snap, entries);
+    bdmf_unlock();
+
+    if (ret) {
+        CMD_TM_LOG_ERROR("stats_snapshot() FAILED: dir(%u) ret(%d)", snap.tm.dir, ret);
+    }
+    else {
+        n_copy = (snap.n_entries < snap.max_entries) ? snap.n_entries : snap.max_entries;
+        if (n_copy)
+            copy_to_user(snap.entries, entries, n_copy * sizeof(rdpa_cmd_tm_q_stats_t));
+    }
+
+    copy_to_user(userSnap_p, &snap, sizeof(rdpa_drv_ioctl_tm_stats_t));
+
+    if (entries)
+        bdmf_free(entries);
+
+    return ret;
+}
+
 /*******************************************************************************/
 /* global routines                                                             */
 /*******************************************************************************/
@@ -2240,6 +2934,11 @@ int rdpa_cmd_tm_ioctl(unsigned long arg)
 
     CMD_TM_LOG_DEBUG("RDPA TM CMD(%d)", tm.cmd);
 
+    if ((uint32_t)tm.cmd == RDPA_IOCTL_TM_CMD_TREE_APPLY)
+        return tm_tree_ioctl(arg);
+    if ((uint32_t)tm.cmd == RDPA_IOCTL_TM_CMD_STATS_SNAPSHOT)
+        return tm_stats_ioctl(arg);
+
     bdmf_lock();
 
     switch(tm.cmd)
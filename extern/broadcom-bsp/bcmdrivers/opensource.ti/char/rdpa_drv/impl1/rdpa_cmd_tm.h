@@ -32,6 +32,83 @@
  *
  *******************************************************************************
  */
+
+/* Desired-state TM tree.
+ * User space submits the complete queue tree of a port/TCONT/LLID in one
+ * RDPA_IOC_TM ioctl. The driver compares it with its current configuration
+ * and applies only the queues, subsidiaries and ORL settings that differ.
+ * Must be included after rdpa_drv.h.
+ */
+#define RDPA_IOCTL_TM_CMD_TREE_APPLY  0x100 /* tm.cmd value, outside of the RDPA_IOCTL_TM_CMD_xx range */
+#define RDPA_CMD_TM_TREE_MAX_Q        8
+
+/* rdpa_drv_ioctl_tm_tree_t.failed_step */
+#define RDPA_CMD_TM_TREE_STEP_NONE     0
+#define RDPA_CMD_TM_TREE_STEP_VALIDATE 1    /* The tree was rejected, nothing was applied */
+#define RDPA_CMD_TM_TREE_STEP_ROOT     2    /* Removing or re-creating the root TM */
+#define RDPA_CMD_TM_TREE_STEP_RELEASE  3    /* Releasing queue failed_q_id */
+#define RDPA_CMD_TM_TREE_STEP_CONFIG   4    /* Configuring queue failed_q_id */
+#define RDPA_CMD_TM_TREE_STEP_ORL      5    /* Updating the ORL */
+
+typedef struct {
+    uint32_t valid;          /* 1 = queue is present in the tree */
+    uint32_t index;          /* Queue index in root TM (root level queue) or
+                                root subsidiary index (root level egress_tm) */
+    uint32_t qsize;          /* Queue drop threshold. Must be non-zero */
+    uint32_t weight;         /* WRR weight. 0 for SP queue */
+    uint32_t shaping_rate;   /* kbit/s, 0 = unlimited. Root level egress_tm only */
+    uint32_t burst;          /* Burst size. Root level egress_tm only */
+} rdpa_cmd_tm_tree_queue_t;
+
+typedef struct {
+    rdpa_drv_ioctl_tm_t tm;  /* cmd = RDPA_IOCTL_TM_CMD_TREE_APPLY. dev_type, dev_id, dir,
+                                arbiter_mode and level of the root TM. root_tm_id is returned */
+    uint32_t orl_rate;       /* Overall rate limit, kbit/s. 0 = no ORL. Port only */
+    rdpa_cmd_tm_tree_queue_t queue[RDPA_CMD_TM_TREE_MAX_Q]; /* Indexed by q_id */
+    uint32_t n_ops;          /* Out: number of steps applied. A step is the removal or the
+                                creation of the root TM, the release or the configuration
+                                of one queue, or the ORL update */
+    uint32_t rebuilt;        /* Out: 1 = root TM was re-created */
+    uint32_t failed_step;    /* Out: RDPA_CMD_TM_TREE_STEP_xx that failed. The steps applied
+                                before it are not rolled back and stay in effect */
+    uint32_t failed_q_id;    /* Out: queue of the failed RELEASE/CONFIG step */
+} rdpa_drv_ioctl_tm_tree_t;
+
+/* Bulk queue statistics.
+ * Returns the statistics of all the configured queues of all ports, TCONTs and
+ * LLIDs whose root TM is in direction tm.dir, read in one pass under bdmf_lock.
+ * A queue whose counters can't be read is skipped and counted in n_errors.
+ * In delta mode only the queues whose counters changed since the previous
+ * snapshot of the same direction are returned. The driver keeps a single delta
+ * baseline per direction, so delta mode is meant for one consumer. A delta
+ * request whose seq is not the last one of the direction, e.g. because another
+ * process took a snapshot in between, is served as a full snapshot and
+ * RDPA_CMD_TM_STATS_DELTA is cleared in flags.
+ */
+#define RDPA_IOCTL_TM_CMD_STATS_SNAPSHOT  0x101 /* tm.cmd value, outside of the RDPA_IOCTL_TM_CMD_xx range */
+#define RDPA_CMD_TM_STATS_DELTA           0x1   /* rdpa_drv_ioctl_tm_stats_t.flags */
+
+typedef struct {
+    uint32_t dev_type;       /* RDPA_IOCTL_DEV_PORT/TCONT/LLID */
+    uint32_t dev_id;
+    uint32_t q_id;
+    rdpa_stat_1way_t qstats;
+} rdpa_cmd_tm_q_stats_t;
+
+typedef struct {
+    rdpa_drv_ioctl_tm_t tm;  /* cmd = RDPA_IOCTL_TM_CMD_STATS_SNAPSHOT, dir */
+    uint32_t flags;          /* In/Out: RDPA_CMD_TM_STATS_xx */
+    uint32_t max_entries;    /* Number of entries in the user buffer */
+    rdpa_cmd_tm_q_stats_t *entries; /* User buffer */
+    uint32_t n_entries;      /* Out: number of entries in the snapshot.
+                                If greater than max_entries the snapshot was truncated */
+    uint32_t n_queues;       /* Out: number of queues read */
+    uint32_t n_errors;       /* Out: number of queues skipped because their counters could not be read */
+    uint32_t seq;            /* In: seq of the caller's previous snapshot (delta mode).
+                                Out: snapshot sequence number of the direction */
+    uint64_t timestamp_ns;   /* Out: monotonic time the snapshot was taken at */
+} rdpa_drv_ioctl_tm_stats_t;
+
 int rdpa_cmd_tm_ioctl(unsigned long arg);
 void rdpa_cmd_tm_init(void);
 
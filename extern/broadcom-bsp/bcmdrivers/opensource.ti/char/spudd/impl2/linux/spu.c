@@ -54,8 +54,6 @@ extern int spu_hash_unregister(void);
 extern pspu_dev_ctrl_t pdev_ctrl;
 extern void spu_dump_array(char *msg, unsigned char *buf, uint16 len);
 
-extern int spu_process_ipsec(struct spu_trans_req *trans_req, BCM_CRYPTOOP *op);
-
 struct spu_alg_template
 {
     struct crypto_alg alg;
@@ -559,6 +557,8 @@ static int process_ipsec_esp(struct spu_trans_req *trans_req)
     int ivsize = crypto_aead_ivsize (aead);
     struct scatterlist *sgs = areq->src;
     struct scatterlist *sgd = areq->dst;
+    struct spu_info *spu = pdev_ctrl->spu_linux;
+    int backlogged = 0;
     int ret;
     BCM_CRYPTOOP op;
 
@@ -579,19 +579,33 @@ static int process_ipsec_esp(struct spu_trans_req *trans_req)
         goto bcm_error;
     }
 
-    ret = spu_process_ipsec(trans_req, &op);
-
+    ret = spu_prepare_ipsec(trans_req, &op);
     if(ret != BCM_STATUS_OK)
     {
         ret = -EINVAL;
+        goto bcm_error;
     }
-    else
+
+    /* keep the order of requests already waiting for descriptors */
+    spin_lock_bh(&spu->lock);
+    if (list_empty(&spu->backlog) && (spu_submit_ipsec_chain(trans_req) == 1))
     {
         ret = -EINPROGRESS;
     }
+    else if (areq->base.flags & CRYPTO_TFM_REQ_MAY_BACKLOG)
+    {
+        list_add_tail(&trans_req->entry, &spu->backlog);
+        backlogged = 1;
+        ret = -EBUSY;
+    }
+    else
+    {
+        ret = -EBUSY;
+    }
+    spin_unlock_bh(&spu->lock);
 
 bcm_error:
-    if (ret != -EINPROGRESS)
+    if ((ret != -EINPROGRESS) && !backlogged)
     {
         if((trans_req->dbuf))
         {
@@ -604,6 +618,55 @@ bcm_error:
     return ret;
 } /* process_ipsec_esp */
 
+/*
+ * Post the requests that were backlogged while the rings were full, as one
+ * chain.  Called by the completion tasklet once it has reclaimed
+ * descriptors; completions only run in that tasklet, so a request posted
+ * here stays valid until this returns.
+ */
+void spu_ipsec_drain(void)
+{
+    struct spu_info *spu = pdev_ctrl->spu_linux;
+    struct spu_trans_req *trans_req;
+    struct spu_trans_req *chain = NULL;
+    struct spu_trans_req *prev = NULL;
+    LIST_HEAD(posted);
+    int n;
+
+    if (NULL == spu)
+        return;
+
+    spin_lock_bh(&spu->lock);
+    list_for_each_entry(trans_req, &spu->backlog, entry)
+    {
+        if (prev)
+            prev->next = trans_req;
+        else
+            chain = trans_req;
+        prev = trans_req;
+    }
+    if (NULL == chain)
+    {
+        spin_unlock_bh(&spu->lock);
+        return;
+    }
+    prev->next = NULL;
+
+    n = spu_submit_ipsec_chain(chain);
+    while (n-- > 0)
+    {
+        trans_req = list_first_entry(&spu->backlog, struct spu_trans_req, entry);
+        list_move_tail(&trans_req->entry, &posted);
+    }
+    spin_unlock_bh(&spu->lock);
+
+    /* tell the owners their requests left the backlog */
+    list_for_each_entry(trans_req, &posted, entry)
+    {
+        aead_request_complete(trans_req->context, -EINPROGRESS);
+    }
+} /* spu_ipsec_drain */
+
 static int aead_encrypt (struct aead_request *areq)
 {
     struct spu_trans_req *trans_req = NULL;
@@ -925,6 +988,7 @@ int bcm_crypto_dev_disable(void)
 {
     struct spu_info *spu = pdev_ctrl->spu_linux;
     struct spu_crypto_alg *spu_alg, *temp;
+    struct spu_trans_req *trans_req, *next;
 
     list_for_each_entry_safe(spu_alg, temp, &spu->alg_list, entry) {
         crypto_unregister_alg(&spu_alg->crypto_alg);
@@ -934,8 +998,16 @@ int bcm_crypto_dev_disable(void)
 
     spu_hash_unregister();
 
-    kfree(spu);
+    /* stop the tasklet draining the backlog, then fail what is left */
     pdev_ctrl->spu_linux = NULL;
+    tasklet_kill(&pdev_ctrl->task);
+    list_for_each_entry_safe(trans_req, next, &spu->backlog, entry) {
+        list_del(&trans_req->entry);
+        trans_req->err = -ENODEV;
+        trans_req->callback(trans_req);
+    }
+
+    kfree(spu);
 
     return 0;
 } /* spu_linux_cleanup */
@@ -954,8 +1026,10 @@ int bcm_crypto_dev_init (void)
     if (NULL == spu)
         return -ENOMEM;
 
-    pdev_ctrl->spu_linux = spu;
     INIT_LIST_HEAD (&spu->alg_list);
+    spin_lock_init (&spu->lock);
+    INIT_LIST_HEAD (&spu->backlog);
+    pdev_ctrl->spu_linux = spu;
 
     /* register crypto algorithms the device supports */
     for (i = 0; i < ARRAY_SIZE (spu_algs); i++)
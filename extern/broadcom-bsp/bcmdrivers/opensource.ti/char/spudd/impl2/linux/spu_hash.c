@@ -37,8 +37,6 @@ extern struct spu_trans_req *spu_alloc_trans_req(uint32 cryptoflags);
 extern int spu_get_framgments(struct scatterlist *scatter_list, int nbytes);
 extern void spu_release_frag_list(struct spu_pkt_frag *pkt_frag);
 
-extern int spu_process_ipsec(struct spu_trans_req *trans_req, BCM_CRYPTOOP *op);
-
 static void spu_ah_digest_done (struct spu_trans_req *trans_req)
 {
     struct ahash_request *req = trans_req->context;
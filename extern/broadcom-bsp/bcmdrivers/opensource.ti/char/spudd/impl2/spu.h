@@ -29,6 +29,8 @@ Boston, MA 02111-1307, USA.
 #ifndef __SPU_H__
 #define __SPU_H__
 
+#include "bcmipsec.h"
+
 #define MAX_MSG_LEN     256
 #define MAX_LINE_LEN    16
 #define  SWAP_BLOCK(x,size)
@@ -117,6 +119,9 @@ struct spu_trans_req
     int alloc_buff_spu;
     int headerLen;
     int err;
+    int cmdlen;                      /* message header length */
+    struct spu_trans_req *next;      /* spu_submit_ipsec_chain() */
+    struct list_head entry;          /* spu_info backlog */
 };
 
 struct spu_info
@@ -126,6 +131,10 @@ struct spu_info
 
     /* hwrng device */
     struct hwrng rng;
+
+    /* requests waiting for descriptors, posted by spu_ipsec_drain() */
+    spinlock_t lock;
+    struct list_head backlog;
 };
 
 struct spu_ctx
@@ -140,4 +149,9 @@ struct spu_ctx
     __be32 desc_hdr_template;
 };
 
+int spu_prepare_ipsec(struct spu_trans_req *trans_req, BCM_CRYPTOOP *op);
+int spu_submit_ipsec_chain(struct spu_trans_req *chain);
+int spu_process_ipsec(struct spu_trans_req *trans_req, BCM_CRYPTOOP *op);
+void spu_ipsec_drain(void);
+
 #endif /* __SPU_H__ */
@@ -69,10 +69,11 @@ Boston, MA 02111-1307, USA.
 
 extern int bcm_crypto_dev_disable(void);
 #ifdef CONFIG_BCM_SPU_TEST
-extern int spu_finish_processing (uint8_t *addr, int test_mode);
+extern struct spu_trans_req *spu_get_trans_req (uint8_t *addr, int test_mode);
 #else
-extern int spu_finish_processing (uint8_t *addr);
+extern struct spu_trans_req *spu_get_trans_req (uint8_t *addr);
 #endif
+extern void spu_finish_processing (struct spu_trans_req *spu_req);
 extern int bcm_crypto_dev_init (void);
 extern void spu_perform_test(uint32 tx_pkt_id, uint32 num_pkts);
 
@@ -149,12 +150,24 @@ void spu_dump_array(char *msg, unsigned char *buf, uint16 len)
 
 /*
  * process completed requests for channels that have done status
+ *
+ * Runs with the done interrupt masked by spu_isr.  Up to SPU_POLL_BUDGET
+ * packets are taken off the Rx ring under one lock and their Tx
+ * descriptors reclaimed under the same lock, so the backlog drained
+ * next and any request a callback submits can use them.  The callbacks
+ * then run without the lock.  The interrupt is unmasked only once a run
+ * finds the ring drained; otherwise the tasklet is rescheduled so other
+ * softirqs get a chance to run.
  */
 static void spu_done (unsigned long data)
 {
     unsigned long irq_flags;
+    struct spu_trans_req *req[SPU_POLL_BUDGET];
     uint32 address;
+    int npkts = 0;
+    int nreqs = 0;
     int numbds = 0;
+    int i;
 
     spin_lock_irqsave (&pdev_ctrl->spin_lock, irq_flags);
     while( pdev_ctrl->rx_free_bds < NR_RX_BDS )
@@ -166,11 +179,26 @@ static void spu_done (unsigned long data)
 
         if(pdev_ctrl->rx_bds[pdev_ctrl->rx_head].status & DMA_SOP)
         {
+            /* stop at a packet boundary once the budget is used */
+            if (npkts == SPU_POLL_BUDGET)
+            {
+                break;
+            }
+            npkts++;
             address = pdev_ctrl->rx_bds[pdev_ctrl->rx_head].address;
-        }
-        else
-        {
-            address = 0;
+            if ( address )
+            {
+#ifdef CONFIG_BCM_SPU_TEST
+                req[nreqs] = spu_get_trans_req((uint8_t *)address, pdev_ctrl->test_mode);
+#else
+                req[nreqs] = spu_get_trans_req((uint8_t *)address);
+#endif
+                if ( req[nreqs] )
+                {
+                    numbds += req[nreqs]->numtxbds;
+                    nreqs++;
+                }
+            }
         }
 
         pdev_ctrl->rx_bds[pdev_ctrl->rx_head].address = 0;
@@ -182,17 +210,31 @@ static void spu_done (unsigned long data)
         {
             pdev_ctrl->rx_head = 0;
         }
-        spin_unlock_irqrestore (&pdev_ctrl->spin_lock, irq_flags);
-        if ( address )
-        {
-#ifdef CONFIG_BCM_SPU_TEST
-            numbds = spu_finish_processing((uint8_t *)address, pdev_ctrl->test_mode);
-#else
-            numbds = spu_finish_processing((uint8_t *)address);
-#endif
-        }
-        spin_lock_irqsave (&pdev_ctrl->spin_lock, irq_flags);
-        spu_reclaim_tx_descriptors( numbds );
+    }
+    spu_reclaim_tx_descriptors( numbds );
+    spin_unlock_irqrestore (&pdev_ctrl->spin_lock, irq_flags);
+
+    /* post what waited for the descriptors before new requests take them */
+    spu_ipsec_drain();
+
+    /* callbacks may submit new requests, so run them unlocked */
+    for (i = 0; i < nreqs; i++)
+    {
+        spu_finish_processing(req[i]);
+    }
+
+    spin_lock_irqsave (&pdev_ctrl->spin_lock, irq_flags);
+    if (npkts == SPU_POLL_BUDGET)
+    {
+        /* more may be pending, keep polling */
+        tasklet_schedule (&pdev_ctrl->task);
+    }
+    else
+    {
+        /* drained; a completion since the ring was read is still latched
+         * in intStat and raises the interrupt as soon as it is unmasked */
+        pdev_ctrl->polling = 0;
+        BcmHalInterruptEnable (pdev_ctrl->rx_irq);
     }
     spin_unlock_irqrestore (&pdev_ctrl->spin_lock, irq_flags);
 } /* spu_done */
@@ -220,6 +262,21 @@ static void spu_reclaim_tx_descriptors( int numbds )
     }
 }
 
+/*
+ * Doorbell for descriptors posted by spu_submit_ipsec_chain; called with
+ * spin_lock held.  The done interrupt is left masked while spu_done is
+ * polling, it unmasks it when the ring is drained.
+ */
+void spu_dma_enable (void)
+{
+    if (!pdev_ctrl->polling)
+    {
+        BcmHalInterruptEnable (pdev_ctrl->rx_irq);
+    }
+    pdev_ctrl->tx_dma->cfg |= DMA_ENABLE;
+    pdev_ctrl->rx_dma->cfg |= DMA_ENABLE;
+} /* spu_dma_enable */
+
 void spu_assign_output_desc (unsigned char *buf, uint16 len, uint16 flags)
 {
     SPU_TRACE (("IPSEC SPU: buf %p len %d\n", buf, len));
@@ -659,6 +716,10 @@ static irqreturn_t spu_isr (int irq, void *dev_id, struct pt_regs *regs)
         pdev_ctrl->rx_dma->intStat = DMA_DONE;
 
         /* task will unmask done interrupts at exit */
+        spin_lock (&pdev_ctrl->spin_lock);
+        pdev_ctrl->polling = 1;
+        BcmHalInterruptDisable (pdev_ctrl->rx_irq);
+        spin_unlock (&pdev_ctrl->spin_lock);
         tasklet_schedule (&pdev_ctrl->task);
     }
 
@@ -60,6 +60,7 @@ Boston, MA 02111-1307, USA.
 #define NR_XMIT_BDS             512
 #define NR_RX_BDS               128
 #define RX_BUF_SIZE             8192
+#define SPU_POLL_BUDGET         32   /* packets completed per tasklet run */
 #define CACHE_TO_NONCACHE(x)    KSEG1ADDR(x)
 #define NONCACHE_TO_CACHE(x)    KSEG0ADDR(x)
 
@@ -89,6 +90,7 @@ typedef struct spu_dev_ctrl_s
     int        rx_head;
     int        rx_tail;
     int        rx_irq;
+    int        polling;     /* done irq masked, tasklet owns completions */
 
     unsigned int     *txBdsBase;
     unsigned int     *rxBdsBase;
@@ -912,12 +912,8 @@ static int spu_avail_desc(struct spu_trans_req *trans_req)
     return 1;
 }
 
-static int spu_format_output (struct spu_pkt_frag *frag_list, 
-                              int nfrags,
-                              SACTX * devsa, 
-                              BCM_CRYPTOOP * op)
+static void spu_format_output (struct spu_pkt_frag *frag_list, int nfrags)
 {
-    int status = BCM_STATUS_OK;
     struct spu_pkt_frag *pkt_frags = frag_list;
     uint32_t flags = 0;
     int nchains = 0;
@@ -963,39 +959,25 @@ static int spu_format_output (struct spu_pkt_frag *frag_list,
 
     /* pass SOP to HW now */
     pdev_ctrl->rx_bds[startbd].status |= DMA_OWN;
-
-    /*
-     * If we have auth data add an extra descriptor to hold
-     * the auth data.
-     */
-
-    SPU_TRACE(("spu_format_output: outputFrags %d authOFrag %d\n",
-                                     devsa->outputFrags, devsa->authOFrag));
-    return status;
 } /* spu_format_output */
 
-static int spu_format_input (u_int8_t * cmd_buf, 
-                             int *offset, 
-                             struct spu_pkt_frag *frag_list, 
-                             int nfrags,
-                             SACTX * devsa)
+static void spu_format_input (u_int8_t * cmd_buf, 
+                              int cmdlen, 
+                              struct spu_pkt_frag *frag_list, 
+                              uint8_t *dmaStatus)
 {
     uint32_t flags = 0;
-    int status = BCM_STATUS_OK;
     struct spu_pkt_frag *pkt_frags = frag_list;
     int startbd;
 
-    SPU_TRACE(("spu_format_input: Descriptors available dmactx %p "
-              "phys %lx \n", devsa->dmactx, VIRT_TO_PHY (devsa->dmactx)));
-
-    SPU_DATA_DUMP("cmd buf", cmd_buf, *offset);
+    SPU_DATA_DUMP("cmd buf", cmd_buf, cmdlen);
 
     /*
      * Assign the first buffer descriptor for the message header.
      */
     flags = DMA_SOP;
     startbd = pdev_ctrl->tx_tail;
-    spu_assign_input_desc (cmd_buf, *offset, flags);
+    spu_assign_input_desc (cmd_buf, cmdlen, flags);
 
     flags = DMA_OWN;
     while(pkt_frags)
@@ -1009,18 +991,21 @@ static int spu_format_input (u_int8_t * cmd_buf,
      * Setup the descriptor with the status word.
      */
     flags = DMA_EOP | DMA_OWN;
-    memset(devsa->dmaStatus, 0, sizeof (uint32_t));
+    memset(dmaStatus, 0, sizeof (uint32_t));
     SPU_TRACE(("spu_format_input: Last frag data %p phys %lx\n",
-               devsa->dmaStatus, VIRT_TO_PHY(devsa->dmaStatus)));
-    spu_assign_input_desc (devsa->dmaStatus, sizeof (uint32_t), flags);
+               dmaStatus, VIRT_TO_PHY(dmaStatus)));
+    spu_assign_input_desc (dmaStatus, sizeof (uint32_t), flags);
 
     /* pass SOP to HW now */
     pdev_ctrl->tx_bds[startbd].status |= DMA_OWN;
-
-    return status;
 } /* spu_format_input */
 
-int spu_process_ipsec(struct spu_trans_req *trans_req, BCM_CRYPTOOP *op)
+/*
+ * Build the message header of a request in trans_req->cmd_buf.  No
+ * descriptors are touched; the request is posted by
+ * spu_submit_ipsec_chain().
+ */
+int spu_prepare_ipsec(struct spu_trans_req *trans_req, BCM_CRYPTOOP *op)
 {
     CCH_SCTX cch_sctx;
 #ifdef SPU_DEBUG
@@ -1040,7 +1025,6 @@ int spu_process_ipsec(struct spu_trans_req *trans_req, BCM_CRYPTOOP *op)
     BDESC bufDesc;
     int spu_cmd_offset = 0;
     u_int8_t *spu_cmd_ptr = NULL;
-    unsigned long irq_flags;
     int offset;
 
     SPU_DATA_DUMP("spu_process_ipsec-sbuf", trans_req->sfrags_list->buf, 
@@ -1242,60 +1226,94 @@ int spu_process_ipsec(struct spu_trans_req *trans_req, BCM_CRYPTOOP *op)
     SPU_TRACE(("Message header length %d hdrLen %d\n",
                                 cch_sctx.cch.length, spu_cmd_offset));
 
+    trans_req->cmdlen = spu_cmd_offset;
+    trans_req->next = NULL;
+
+    return status;
+}/* spu_prepare_ipsec */
+
+/*
+ * Post a chain of prepared requests, linked through next, taking the
+ * descriptor lock and ringing the DMA doorbell once for the whole chain.
+ * Returns the number of requests posted.  Posting stops at the first
+ * request the rings cannot take; it and the rest of the chain are left
+ * to the caller.  Posted requests complete through their callback and
+ * must not be touched afterwards.
+ */
+int spu_submit_ipsec_chain(struct spu_trans_req *chain)
+{
+    struct spu_trans_req *trans_req = chain;
+    struct spu_trans_req *next;
+    unsigned long irq_flags;
+    u_int8_t *spu_cmd_ptr;
+    int posted = 0;
+
     spin_lock_irqsave (&pdev_ctrl->spin_lock, irq_flags);
 
-    /* verify there are enough RX and TX descriptors */
-    if ( 0 == spu_avail_desc(trans_req) ) {
-        spin_unlock_irqrestore (&pdev_ctrl->spin_lock, irq_flags);
-        return BCM_STATUS_RESOURCE;
+    while (trans_req)
+    {
+        /* verify there are enough RX and TX descriptors */
+        if ( 0 == spu_avail_desc(trans_req) )
+        {
+            break;
+        }
+
+        next = trans_req->next;
+        spu_cmd_ptr = (u_int8_t *)&trans_req->cmd_buf[0];
+        trans_req->numtxbds = (trans_req->sfrags + 2);
+
+        spu_format_output (trans_req->dfrags_list, trans_req->dfrags);
+        spu_format_input (spu_cmd_ptr, 
+                          trans_req->cmdlen, 
+                          trans_req->sfrags_list,
+                          spu_cmd_ptr + BCM_XTRA_DMA_HDR_SIZE);
+
+        posted++;
+        trans_req = next;
     }
 
-    status = spu_format_output (trans_req->dfrags_list, 
-                                trans_req->dfrags,
-                                devsa, 
-                                op);
-    if(status != BCM_STATUS_OK)
+    if (posted)
     {
-        SPU_TRACE(("spu_format_output error %d\n", status));
-        spin_unlock_irqrestore (&pdev_ctrl->spin_lock, irq_flags);
-        return status;
+        spu_dma_enable();
     }
 
-    status = spu_format_input (spu_cmd_ptr, 
-                               &spu_cmd_offset, 
-                               trans_req->sfrags_list,
-                               trans_req->sfrags,
-                               devsa);
+    spin_unlock_irqrestore (&pdev_ctrl->spin_lock, irq_flags);
+
+    return posted;
+}/* spu_submit_ipsec_chain */
+
+int spu_process_ipsec(struct spu_trans_req *trans_req, BCM_CRYPTOOP *op)
+{
+    int status;
+
+    status = spu_prepare_ipsec(trans_req, op);
     if(status != BCM_STATUS_OK)
     {
-        SPU_TRACE(("spu_format_input error %d\n", status));
-        spin_unlock_irqrestore (&pdev_ctrl->spin_lock, irq_flags);
         return status;
     }
 
-    trans_req->numtxbds = (trans_req->sfrags + 2);
-
-    spin_unlock_irqrestore (&pdev_ctrl->spin_lock, irq_flags);
-
-    BcmHalInterruptEnable(pdev_ctrl->rx_irq);
-    pdev_ctrl->tx_dma->cfg |= DMA_ENABLE;
-    pdev_ctrl->rx_dma->cfg |= DMA_ENABLE;
+    if (spu_submit_ipsec_chain(trans_req) != 1)
+    {
+        return BCM_STATUS_RESOURCE;
+    }
 
-    return status;
-}/* spu_process_ipsec_esp */
+    return BCM_STATUS_OK;
+}/* spu_process_ipsec */
 
+/*
+ * Find the request a completed packet belongs to from the ECH word of
+ * its output.  Called with spin_lock held so the caller can reclaim the
+ * request's Tx descriptors before any callback runs.
+ */
 #ifdef CONFIG_BCM_SPU_TEST
-int spu_finish_processing (uint8_t *addr, int test_mode)
+struct spu_trans_req *spu_get_trans_req (uint8_t *addr, int test_mode)
 #else
-int spu_finish_processing (uint8_t *addr)
+struct spu_trans_req *spu_get_trans_req (uint8_t *addr)
 #endif
 {
     unsigned char *ptr = NULL;
     unsigned char *ptr1 = NULL;
     unsigned char *ptr2 = NULL;
-    struct spu_trans_req *spu_req;
-    unsigned int status;
-    int numbds;
 
     ptr = addr;
     ptr1 = (char *) PHYS_TO_UNCACHED ((uint32) ptr);
@@ -1304,17 +1322,26 @@ int spu_finish_processing (uint8_t *addr)
     if(!ptr2)
     {
         printk(KERN_ERR "Invalid pointer at output DMA\n");
-        return BCM_STATUS_OUTPUT_ERROR;
+        return NULL;
     }
     /* test code */
 #ifdef CONFIG_BCM_SPU_TEST
     if((test_mode) || (!((uint32)ptr2 & 0x0000FFFF))) 
     {
-        return 0;
+        return NULL;
     }
 #endif /* CONFIG_BCM_SPU_TEST */
 
-    spu_req = (struct spu_trans_req *) ptr2;
+    return (struct spu_trans_req *) ptr2;
+}/* spu_get_trans_req */
+
+/*
+ * Check the status of a completed request and hand it to its callback.
+ */
+void spu_finish_processing (struct spu_trans_req *spu_req)
+{
+    unsigned int status;
+
     spu_req->err = 0;
     if ( spu_req->dStatus )
     {
@@ -1327,12 +1354,9 @@ int spu_finish_processing (uint8_t *addr)
         }
     }
 
-    numbds = spu_req->numtxbds;
     /* spu_req is unavailable after this call */
     spu_req->callback (spu_req);
 
-    return numbds;
-
 }/* spu_finish_processing */
 
 
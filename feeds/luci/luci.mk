@@ -82,7 +82,7 @@ PKG_GITBRANCH?=$(if $(DUMP),x,$(strip $(shell \
 PKG_RELEASE?=1
 PKG_INSTALL:=$(if $(realpath src/Makefile),1)
 PKG_BUILD_DEPENDS += lua/host luci-base/host $(LUCI_BUILD_DEPENDS)
-PKG_CONFIG_DEPENDS += CONFIG_LUCI_SRCDIET
+PKG_CONFIG_DEPENDS += CONFIG_LUCI_SRCDIET CONFIG_LUCI_MERGE_LMO
 
 PKG_BUILD_DIR:=$(BUILD_DIR)/$(PKG_NAME)
 
@@ -110,6 +110,10 @@ ifeq ($(PKG_NAME),luci-base)
 	bool "Minify Lua sources"
 	default n
 
+   config LUCI_MERGE_LMO
+	bool "Merge translations into one catalog per language on install"
+	default n
+
    menu "Translations"$(foreach lang,$(LUCI_LANGUAGES),
 
      config LUCI_LANG_$(lang)
@@ -134,7 +138,8 @@ endef
 
 ifneq ($(wildcard ${CURDIR}/src/Makefile),)
  MAKE_PATH := src/
- MAKE_VARS += FPIC="$(FPIC)" LUCI_VERSION="$(PKG_VERSION)" LUCI_GITBRANCH="$(PKG_GITBRANCH)"
+ MAKE_VARS += FPIC="$(FPIC)" LUCI_VERSION="$(PKG_VERSION)" LUCI_GITBRANCH="$(PKG_GITBRANCH)" \
+	LUCI_MERGE_LMO="$(CONFIG_LUCI_MERGE_LMO)"
 
  define Build/Compile
 	$(call Build/Compile/Default,clean compile)
@@ -208,6 +213,8 @@ define LuciTranslation
 	$$(INSTALL_DIR) $$(1)/etc/uci-defaults
 	echo "uci set luci.languages.$(subst -,_,$(1))='$(LUCI_LANG.$(1))'; uci commit luci" \
 		> $$(1)/etc/uci-defaults/luci-i18n-$(LUCI_BASENAME)-$(1)
+	$(if $(CONFIG_LUCI_MERGE_LMO),echo "po2lmo -m $(LUCI_LIBRARYDIR)/i18n/$(1).lmo $(LUCI_LIBRARYDIR)/i18n/*.$(1).lmo || true" \
+		>> $$(1)/etc/uci-defaults/luci-i18n-$(LUCI_BASENAME)-$(1))
 	$$(INSTALL_DIR) $$(1)$(LUCI_LIBRARYDIR)/i18n
 	$(foreach po,$(wildcard ${CURDIR}/po/$(1)/*.po), \
 		po2lmo $(po) \
@@ -16,6 +16,11 @@ module "luci.template"
 config.template = config.template or {}
 viewdir = config.template.viewdir or util.libpath() .. "/view"
 
+-- Compiled views are kept here across requests, see luci.template.parser
+if config.ccache and config.ccache.enable == "1" then
+	cachedir = config.template.cachedir or "/tmp/luci-templatecache"
+end
+
 
 -- Define the namespace for template modules
 context = util.threadlocal()
@@ -63,7 +68,7 @@ function Template.__init__(self, name, template)
 
 		if name then
 			sourcefile = viewdir .. "/" .. name .. ".htm"
-			self.template, _, err = tparser.parse(sourcefile)
+			self.template, _, err = tparser.parse(sourcefile, cachedir)
 		else
 			sourcefile = "[string]"
 			self.template, _, err = tparser.parse_string(template)
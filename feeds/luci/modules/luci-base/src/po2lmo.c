@@ -26,7 +26,9 @@ static void die(const char *msg)
 
 static void usage(const char *name)
 {
-	fprintf(stderr, "Usage: %s input.po output.lmo\n", name);
+	fprintf(stderr, "Usage: %s input.po output.lmo\n"
+	                "       %s -m output.lmo input.lmo [input.lmo ...]\n",
+	                name, name);
 	exit(1);
 }
 
@@ -105,8 +107,6 @@ static void print_index(void *array, int n, FILE *out)
 {
 	lmo_entry_t *e;
 
-	qsort(array, n, sizeof(*e), cmp_index);
-
 	for (e = array; n > 0; n--, e++)
 	{
 		print_uint32(e->key_id, out);
@@ -116,6 +116,268 @@ static void print_index(void *array, int n, FILE *out)
 	}
 }
 
+static const uint32_t *phf_count;
+
+static int cmp_bucket(const void *a, const void *b)
+{
+	uint32_t x = phf_count[*(const uint32_t *)a];
+	uint32_t y = phf_count[*(const uint32_t *)b];
+
+	return (x < y) - (x > y);
+}
+
+/*
+ * Write a minimal perfect hash over the key ids of the sorted index using
+ * the "hash and displace" scheme: keys are grouped into buckets of about
+ * four, then for each bucket, largest first, a displacement is searched
+ * that moves all of its keys into free slots. Each slot holds the position
+ * of its key in the index. Duplicate key ids only get a slot for the first
+ * entry, which is the one a binary search may return as well.
+ *
+ * Returns the number of bytes written.
+ */
+static int print_phf(lmo_entry_t *array, int n, uint32_t id, FILE *out)
+{
+	uint32_t *keys, *pos, *disp, *table, *start, *member, *order, *count, *slot;
+	uint32_t i, j, k, d, u, nb;
+	char *used;
+
+	if (n <= 0)
+		return 0;
+
+	keys   = malloc(n * sizeof(*keys));
+	pos    = malloc(n * sizeof(*pos));
+	member = malloc(n * sizeof(*member));
+	slot   = malloc(n * sizeof(*slot));
+
+	if (!keys || !pos || !member || !slot)
+		die("Out of memory");
+
+	for (i = 0, u = 0; i < n; i++)
+	{
+		if (i > 0 && array[i].key_id == array[i-1].key_id)
+			continue;
+
+		keys[u] = array[i].key_id;
+		pos[u] = i;
+		u++;
+	}
+
+	nb = (u + 3) / 4;
+
+	disp  = calloc(nb, sizeof(*disp));
+	start = calloc(nb + 1, sizeof(*start));
+	count = calloc(nb, sizeof(*count));
+	order = malloc(nb * sizeof(*order));
+	table = malloc(u * sizeof(*table));
+	used  = calloc(u, 1);
+
+	if (!disp || !start || !count || !order || !table || !used)
+		die("Out of memory");
+
+	for (i = 0; i < u; i++)
+		count[keys[i] % nb]++;
+
+	for (i = 0; i < nb; i++)
+	{
+		start[i + 1] = start[i] + count[i];
+		order[i] = i;
+		count[i] = 0;
+	}
+
+	for (i = 0; i < u; i++)
+	{
+		k = keys[i] % nb;
+		member[start[k] + count[k]++] = i;
+	}
+
+	phf_count = count;
+	qsort(order, nb, sizeof(*order), cmp_bucket);
+
+	for (i = 0; i < nb && count[order[i]] > 0; i++)
+	{
+		uint32_t b = order[i];
+
+		for (d = 0; d < (1 << 24); d++)
+		{
+			for (j = 0; j < count[b]; j++)
+			{
+				slot[j] = lmo_phf_hash(keys[member[start[b] + j]], d) % u;
+
+				if (used[slot[j]])
+					break;
+
+				for (k = 0; k < j && slot[k] != slot[j]; k++);
+
+				if (k < j)
+					break;
+			}
+
+			if (j == count[b])
+				break;
+		}
+
+		if (d == (1 << 24))
+			die("Unable to build hash index");
+
+		for (j = 0; j < count[b]; j++)
+		{
+			used[slot[j]] = 1;
+			table[slot[j]] = pos[member[start[b] + j]];
+		}
+
+		disp[b] = d;
+	}
+
+	for (i = 0; i < nb; i++)
+		print_uint32(disp[i], out);
+
+	for (i = 0; i < u; i++)
+		print_uint32(table[i], out);
+
+	print_uint32(id, out);
+	print_uint32(nb, out);
+	print_uint32(u, out);
+	print_uint32(LMO_PHF_MAGIC, out);
+
+	free(keys); free(pos); free(member); free(slot);
+	free(disp); free(start); free(count); free(order); free(table); free(used);
+
+	return (nb + u) * sizeof(uint32_t) + sizeof(struct lmo_phf_trailer);
+}
+
+struct merge_entry {
+	lmo_entry_t e;
+	const char *val;
+	int seq;
+};
+
+static int cmp_merge(const void *a, const void *b)
+{
+	const struct merge_entry *x = a, *y = b;
+	int rv = cmp_index(&x->e, &y->e);
+
+	return rv ? rv : (x->seq - y->seq);
+}
+
+static int cmp_input(const void *a, const void *b)
+{
+	return lmo_archive_name_cmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * Merge several archives into one. For the same key the archive whose file
+ * name sorts first wins, whatever the order of the arguments, like when
+ * lmo_load_catalog() loads the archives one by one. The id of the sources
+ * is recorded so that lmo_load_catalog() can tell whether the result is
+ * still up to date.
+ */
+static int merge(const char *output, char **inputs, int n_inputs)
+{
+	char tmp[PATH_MAX];
+	const char *name;
+	const char zero[4] = { 0 };
+	struct merge_entry *entries = NULL, *m;
+	lmo_archive_t **ar;
+	lmo_entry_t *array;
+	struct stat s;
+	uint32_t id = 0, offset = 0;
+	int i, j, n = 0, u = 0, length, fd;
+	FILE *out;
+
+	if (!(ar = calloc(n_inputs, sizeof(*ar))))
+		die("Out of memory");
+
+	qsort(inputs, n_inputs, sizeof(*inputs), cmp_input);
+
+	for (i = 0; i < n_inputs; i++)
+	{
+		if (stat(inputs[i], &s) || !(ar[i] = lmo_open(inputs[i])))
+		{
+			fprintf(stderr, "Error: Unable to open %s\n", inputs[i]);
+			exit(1);
+		}
+
+		name = strrchr(inputs[i], '/');
+		id ^= lmo_archive_id(name ? name + 1 : inputs[i], &s);
+
+		entries = realloc(entries, (n + ar[i]->length) * sizeof(*entries));
+
+		if (!entries)
+			die("Out of memory");
+
+		for (j = 0; j < ar[i]->length; j++)
+		{
+			m = &entries[n];
+			m->e.key_id = ntohl(ar[i]->index[j].key_id);
+			m->e.val_id = ntohl(ar[i]->index[j].val_id);
+			m->e.length = ntohl(ar[i]->index[j].length);
+			m->val = ar[i]->mmap + ntohl(ar[i]->index[j].offset);
+			m->seq = n;
+
+			if (m->val + m->e.length <= ar[i]->end)
+				n++;
+		}
+	}
+
+	if (!n)
+		die("No translations to merge");
+
+	qsort(entries, n, sizeof(*entries), cmp_merge);
+
+	if (!(array = malloc((n ? n : 1) * sizeof(*array))))
+		die("Out of memory");
+
+	/* the result is mmap()ed by running processes, replace it atomically */
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", output);
+
+	if ((fd = mkstemp(tmp)) < 0 || !(out = fdopen(fd, "w")))
+		die("Unable to create output file");
+
+	for (i = 0; i < n; i++)
+	{
+		if (i > 0 && entries[i].e.key_id == entries[i-1].e.key_id)
+			continue;
+
+		array[u] = entries[i].e;
+		array[u].offset = offset;
+		u++;
+
+		length = (4 - (entries[i].e.length % 4)) % 4;
+
+		print(entries[i].val, entries[i].e.length, 1, out);
+
+		if (length > 0)
+			print(zero, length, 1, out);
+
+		offset += entries[i].e.length + length;
+	}
+
+	offset += print_phf(array, u, id, out);
+	print_index(array, u, out);
+	print_uint32(offset, out);
+
+	fflush(out);
+	fsync(fileno(out));
+	fchmod(fileno(out), 0644);
+	fclose(out);
+
+	if (rename(tmp, output))
+	{
+		unlink(tmp);
+		die("Unable to replace output file");
+	}
+
+	for (i = 0; i < n_inputs; i++)
+		lmo_close(ar[i]);
+
+	free(ar);
+	free(array);
+	free(entries);
+
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	char line[4096];
@@ -133,6 +395,9 @@ int main(int argc, char *argv[])
 	FILE *in;
 	FILE *out;
 
+	if( (argc >= 4) && !strcmp(argv[1], "-m") )
+		return merge(argv[2], &argv[3], argc - 3);
+
 	if( (argc != 3) || ((in = fopen(argv[1], "r")) == NULL) || ((out = fopen(argv[2], "w")) == NULL) )
 		usage(argv[0]);
 
@@ -228,6 +493,9 @@ int main(int argc, char *argv[])
 		memset(line, 0, sizeof(line));
 	}
 
+	qsort(array, n_entries, sizeof(lmo_entry_t), cmp_index);
+
+	offset += print_phf(array, n_entries, 0, out);
 	print_index(array, n_entries, out);
 
 	if( offset > 0 )
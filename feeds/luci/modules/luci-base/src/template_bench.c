@@ -0,0 +1,138 @@
+/*
+ * LuCI Template - Parser benchmark
+ *
+ * Loads every view below a directory the way luci.template does, first
+ * without the compiled template cache, then with a cold and a warm cache.
+ *
+ *   template-bench <viewdir> [cachedir] [i18ndir lang] [iterations]
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <ftw.h>
+#include <time.h>
+
+#include "template_lualib.h"
+
+int template_L_parse(lua_State *L);
+
+static char **views;
+static int nviews;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int add_view(const char *path, const struct stat *s, int type,
+					struct FTW *ftw)
+{
+	size_t len = strlen(path);
+	char **tmp;
+
+	if (type != FTW_F || len < 4 || strcmp(path + len - 4, ".htm"))
+		return 0;
+
+	if (!(tmp = realloc(views, (nviews + 1) * sizeof(*views))))
+		return -1;
+
+	views = tmp;
+	views[nviews++] = strdup(path);
+
+	return 0;
+}
+
+static int clear_entry(const char *path, const struct stat *s, int type,
+					   struct FTW *ftw)
+{
+	return (ftw->level > 0) ? remove(path) : 0;
+}
+
+static double load_views(lua_State *L, const char *cache, int iterations,
+						 int *errors)
+{
+	double start = now();
+	int i, n;
+
+	*errors = 0;
+
+	for (n = 0; n < iterations; n++)
+	{
+		for (i = 0; i < nviews; i++)
+		{
+			lua_settop(L, 0);
+			lua_pushcfunction(L, template_L_parse);
+			lua_pushstring(L, views[i]);
+
+			if (cache)
+				lua_pushstring(L, cache);
+			else
+				lua_pushnil(L);
+
+			lua_call(L, 2, 1);
+			*errors += lua_isnil(L, -1);
+		}
+	}
+
+	return (now() - start) * 1000 / iterations;
+}
+
+int main(int argc, char **argv)
+{
+	const char *cache = (argc > 2) ? argv[2] : "/tmp/luci-templatecache-bench";
+	int iterations = (argc > 5) ? atoi(argv[5]) : 10;
+	double t_parse, t_cold, t_warm;
+	int errors;
+	lua_State *L;
+
+	if (argc < 2 || iterations <= 0)
+	{
+		fprintf(stderr,
+		        "usage: %s <viewdir> [cachedir] [i18ndir lang] [iterations]\n",
+		        argv[0]);
+		return 1;
+	}
+
+	if (nftw(argv[1], add_view, 16, FTW_PHYS) || !nviews)
+	{
+		fprintf(stderr, "no views found in %s\n", argv[1]);
+		return 1;
+	}
+
+	if (argc > 4 && lmo_load_catalog(argv[4], argv[3]))
+	{
+		fprintf(stderr, "unable to load catalog %s from %s\n", argv[4], argv[3]);
+		return 1;
+	}
+
+	if (!(L = luaL_newstate()))
+		return 1;
+
+	t_parse = load_views(L, NULL, iterations, &errors);
+	printf("%d views, %d with syntax errors\n", nviews, errors);
+
+	nftw(cache, clear_entry, 16, FTW_DEPTH | FTW_PHYS);
+	t_cold = load_views(L, cache, 1, &errors);
+	t_warm = load_views(L, cache, iterations, &errors);
+
+	printf("parse      : %8.2f ms\n", t_parse);
+	printf("cold cache : %8.2f ms\n", t_cold);
+	printf("warm cache : %8.2f ms\n", t_warm);
+
+	lua_close(L);
+	return 0;
+}
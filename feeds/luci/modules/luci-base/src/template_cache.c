@@ -0,0 +1,170 @@
+/*
+ * LuCI Template - Compiled template cache
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "template_cache.h"
+#include "template_utils.h"
+#include "template_lmo.h"
+
+/*
+ * Compiled templates are stored as Lua bytecode, one file per template and
+ * language. Since <%: %> strings are translated while parsing, an entry is
+ * only valid for the catalog it was built with; it is also invalidated by
+ * any change of the template file itself.
+ *
+ * Loading bytecode is only safe if nobody else could have written it, so
+ * both the cache directory and its entries must be private to us.
+ */
+
+static int template_cache_private(const struct stat *s, int dir)
+{
+	if (dir ? !S_ISDIR(s->st_mode) : !S_ISREG(s->st_mode))
+		return 0;
+
+	return (s->st_uid == geteuid()) && !(s->st_mode & (dir ? 077 : 022));
+}
+
+static int template_cache_path(char *path, size_t len, const char *dir,
+							   const char *file)
+{
+	struct stat s;
+	const char *lang = _lmo_active_catalog ? _lmo_active_catalog->lang : "C";
+
+	if (mkdir(dir, 0700) && errno != EEXIST)
+		return -1;
+
+	if (lstat(dir, &s) || !template_cache_private(&s, 1))
+		return -1;
+
+	if (snprintf(path, len, "%s/%08x.%s", dir,
+	             sfh_hash(file, strlen(file)), lang) >= len)
+		return -1;
+
+	return 0;
+}
+
+static void template_cache_header(struct template_cache_header *hdr,
+								  const char *file, const struct stat *s)
+{
+	memset(hdr, 0, sizeof(*hdr));
+
+	hdr->magic   = TEMPLATE_CACHE_MAGIC;
+	hdr->catalog = _lmo_active_catalog ? _lmo_active_catalog->id : 0;
+	hdr->mtime   = s->st_mtime;
+	hdr->size    = s->st_size;
+	hdr->inode   = s->st_ino;
+	hdr->namelen = strlen(file);
+}
+
+/* push the cached function for file, returns -1 if there is no valid entry */
+int template_cache_load(lua_State *L, const char *dir, const char *file,
+						const struct stat *s)
+{
+	int fd, rv = -1;
+	char *data = MAP_FAILED;
+	char path[PATH_MAX];
+	struct stat cs;
+	struct template_cache_header hdr, *chdr;
+	size_t off;
+
+	if (template_cache_path(path, sizeof(path), dir, file))
+		return -1;
+
+	if ((fd = open(path, O_RDONLY | O_NOFOLLOW)) < 0)
+		return -1;
+
+	if (fstat(fd, &cs) || !template_cache_private(&cs, 0) ||
+	    cs.st_size <= sizeof(hdr))
+		goto out;
+
+	data = mmap(NULL, cs.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (data == MAP_FAILED)
+		goto out;
+
+	template_cache_header(&hdr, file, s);
+	chdr = (struct template_cache_header *)data;
+	off = sizeof(hdr) + hdr.namelen;
+
+	if (memcmp(chdr, &hdr, sizeof(hdr)) || cs.st_size <= off ||
+	    memcmp(data + sizeof(hdr), file, hdr.namelen))
+		goto out;
+
+	if (luaL_loadbuffer(L, data + off, cs.st_size - off, file))
+	{
+		lua_pop(L, 1);
+		unlink(path);
+		goto out;
+	}
+
+	rv = 0;
+
+out:
+	if (data != MAP_FAILED)
+		munmap(data, cs.st_size);
+
+	close(fd);
+	return rv;
+}
+
+static int template_cache_writer(lua_State *L, const void *p, size_t sz, void *ud)
+{
+	struct template_buffer *buf = ud;
+
+	/* grow geometrically, lua_dump() emits lots of tiny pieces */
+	if ((buf->fill + sz + 1) >= buf->size && !buf_grow(buf, buf->size + sz))
+		return 1;
+
+	return (buf_append(buf, p, sz) != sz);
+}
+
+/* store the function on top of the stack as compiled form of file */
+int template_cache_store(lua_State *L, const char *dir, const char *file,
+						 const struct stat *s)
+{
+	int fd = -1, rv = -1;
+	char path[PATH_MAX], tmp[PATH_MAX];
+	struct template_cache_header hdr;
+	struct template_buffer *buf;
+
+	if (template_cache_path(path, sizeof(path), dir, file) ||
+	    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= sizeof(tmp))
+		return -1;
+
+	if (!(buf = buf_init(16384)))
+		return -1;
+
+	template_cache_header(&hdr, file, s);
+
+	if (!buf_append(buf, (const char *)&hdr, sizeof(hdr)) ||
+	    !buf_append(buf, file, hdr.namelen) ||
+	    lua_dump(L, template_cache_writer, buf))
+		goto out;
+
+	if ((fd = mkstemp(tmp)) < 0)
+		goto out;
+
+	/* the new entry replaces any older one atomically */
+	if (write(fd, buf->data, buf->fill) != buf->fill || rename(tmp, path))
+		unlink(tmp);
+	else
+		rv = 0;
+
+	close(fd);
+
+out:
+	free(buf_destroy(buf));
+	return rv;
+}
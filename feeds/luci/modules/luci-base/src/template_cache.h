@@ -0,0 +1,40 @@
+/*
+ * LuCI Template - Compiled template cache header
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef _TEMPLATE_CACHE_H_
+#define _TEMPLATE_CACHE_H_
+
+#include "template_parser.h"
+
+/* "LTC1" */
+#define TEMPLATE_CACHE_MAGIC	0x4c544331
+
+/* on-disk header, followed by the template path and the Lua bytecode */
+struct template_cache_header {
+	uint32_t magic;
+	uint32_t catalog;
+	uint32_t mtime;
+	uint32_t size;
+	uint32_t inode;
+	uint32_t namelen;
+};
+
+int template_cache_load(lua_State *L, const char *dir, const char *file,
+						const struct stat *s);
+int template_cache_store(lua_State *L, const char *dir, const char *file,
+						 const struct stat *s);
+
+#endif
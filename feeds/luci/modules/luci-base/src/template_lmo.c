@@ -97,6 +97,39 @@ uint32_t lmo_canon_hash(const char *str, int len)
 	return sfh_hash(res, ptr - res);
 }
 
+/* identifies one archive of a catalog, see lmo_load_catalog() */
+uint32_t lmo_archive_id(const char *name, const struct stat *s)
+{
+	return sfh_hash(name, strlen(name)) ^ (uint32_t)s->st_size ^ (uint32_t)s->st_mtime;
+}
+
+static void lmo_open_phf(lmo_archive_t *ar, uint32_t idx_offset)
+{
+	struct lmo_phf_trailer *t;
+	uint32_t size, buckets;
+
+	if (idx_offset < sizeof(*t))
+		return;
+
+	t = (struct lmo_phf_trailer *)(ar->mmap + idx_offset - sizeof(*t));
+
+	if (ntohl(t->magic) != LMO_PHF_MAGIC)
+		return;
+
+	size    = ntohl(t->size);
+	buckets = ntohl(t->buckets);
+
+	if (!size || !buckets || size > ar->length || buckets > size ||
+	    ((uint64_t)size + buckets) * sizeof(uint32_t) > idx_offset - sizeof(*t))
+		return;
+
+	ar->phf_table   = (uint32_t *)t - size;
+	ar->phf_disp    = ar->phf_table - buckets;
+	ar->phf_size    = size;
+	ar->phf_buckets = buckets;
+	ar->id          = ntohl(t->id);
+}
+
 lmo_archive_t * lmo_open(const char *file)
 {
 	int in = -1;
@@ -133,6 +166,9 @@ lmo_archive_t * lmo_open(const char *file)
 		ar->length = (ar->size - idx_offset - sizeof(uint32_t)) / sizeof(lmo_entry_t);
 		ar->end    = ar->mmap + ar->size;
 
+		/* archives written by older po2lmo versions have no hash index */
+		lmo_open_phf(ar, idx_offset);
+
 		return ar;
 	}
 
@@ -169,20 +205,42 @@ void lmo_close(lmo_archive_t *ar)
 lmo_catalog_t *_lmo_catalogs = NULL;
 lmo_catalog_t *_lmo_active_catalog = NULL;
 
+/*
+ * Archives of a catalog are searched in file name order (strcmp), so the
+ * first one defining a msgid wins. "po2lmo -m" resolves duplicates the
+ * same way, a merged archive translates exactly like the split ones.
+ */
+int lmo_archive_name_cmp(const char *a, const char *b)
+{
+	const char *na = strrchr(a, '/');
+	const char *nb = strrchr(b, '/');
+
+	return strcmp(na ? na + 1 : a, nb ? nb + 1 : b);
+}
+
+static int lmo_dirent_cmp(const struct dirent **a, const struct dirent **b)
+{
+	return lmo_archive_name_cmp((*a)->d_name, (*b)->d_name);
+}
+
 int lmo_load_catalog(const char *lang, const char *dir)
 {
-	DIR *dh = NULL;
+	struct dirent **de = NULL;
 	char pattern[16];
 	char path[PATH_MAX];
-	struct dirent *de = NULL;
+	struct stat s;
+	uint32_t id = 0;
+	int merged = 0;
+	int i, n = -1;
 
 	lmo_archive_t *ar = NULL;
+	lmo_archive_t **tail;
 	lmo_catalog_t *cat = NULL;
 
 	if (!lmo_change_catalog(lang))
 		return 0;
 
-	if (!dir || !(dh = opendir(dir)))
+	if (!dir || (n = scandir(dir, &de, NULL, lmo_dirent_cmp)) < 0)
 		goto err;
 
 	if (!(cat = malloc(sizeof(*cat))))
@@ -193,22 +251,58 @@ int lmo_load_catalog(const char *lang, const char *dir)
 	snprintf(cat->lang, sizeof(cat->lang), "%s", lang);
 	snprintf(pattern, sizeof(pattern), "*.%s.lmo", lang);
 
-	while ((de = readdir(dh)) != NULL)
+	for (i = 0; i < n; i++)
 	{
-		if (!fnmatch(pattern, de->d_name, 0))
+		if (!fnmatch(pattern, de[i]->d_name, 0))
 		{
-			snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+			snprintf(path, sizeof(path), "%s/%s", dir, de[i]->d_name);
+
+			if (!stat(path, &s))
+				id ^= lmo_archive_id(de[i]->d_name, &s);
+		}
+	}
+
+	/*
+	 * "po2lmo -m" merges all archives of a language into <lang>.lmo, it
+	 * is only used as long as it was built from exactly the archives
+	 * which are present now
+	 */
+	snprintf(path, sizeof(path), "%s/%s.lmo", dir, lang);
+
+	if (id && (ar = lmo_open(path)) != NULL)
+	{
+		if (ar->id == id)
+		{
+			cat->archives = ar;
+			merged = 1;
+		}
+		else
+		{
+			lmo_close(ar);
+		}
+	}
+
+	for (i = 0, tail = &cat->archives; !merged && i < n; i++)
+	{
+		if (!fnmatch(pattern, de[i]->d_name, 0))
+		{
+			snprintf(path, sizeof(path), "%s/%s", dir, de[i]->d_name);
 			ar = lmo_open(path);
 
 			if (ar)
 			{
-				ar->next = cat->archives;
-				cat->archives = ar;
+				*tail = ar;
+				tail = &ar->next;
 			}
 		}
 	}
 
-	closedir(dh);
+	for (i = 0; i < n; i++)
+		free(de[i]);
+	free(de);
+
+	/* the id changes whenever an archive is added or replaced */
+	cat->id = sfh_hash(cat->lang, strlen(cat->lang)) ^ id;
 
 	cat->next = _lmo_catalogs;
 	_lmo_catalogs = cat;
@@ -219,7 +313,9 @@ int lmo_load_catalog(const char *lang, const char *dir)
 	return 0;
 
 err:
-	if (dh) closedir(dh);
+	for (i = 0; i < n; i++)
+		free(de[i]);
+	if (de) free(de);
 	if (cat) free(cat);
 
 	return -1;
@@ -277,6 +373,19 @@ static lmo_entry_t * lmo_find_entry(lmo_archive_t *ar, uint32_t hash)
 	return NULL;
 }
 
+static lmo_entry_t * lmo_find_phf_entry(lmo_archive_t *ar, uint32_t hash)
+{
+	uint32_t disp, i;
+
+	disp = ntohl(ar->phf_disp[hash % ar->phf_buckets]);
+	i = ntohl(ar->phf_table[lmo_phf_hash(hash, disp) % ar->phf_size]);
+
+	if ((i < ar->length) && (ntohl(ar->index[i].key_id) == hash))
+		return &ar->index[i];
+
+	return NULL;
+}
+
 int lmo_translate(const char *key, int keylen, char **out, int *outlen)
 {
 	uint32_t hash;
@@ -290,7 +399,10 @@ int lmo_translate(const char *key, int keylen, char **out, int *outlen)
 
 	for (ar = _lmo_active_catalog->archives; ar; ar = ar->next)
 	{
-		if ((e = lmo_find_entry(ar, hash)) != NULL)
+		e = ar->phf_size ? lmo_find_phf_entry(ar, hash)
+		                 : lmo_find_entry(ar, hash);
+
+		if (e != NULL)
 		{
 			*out = ar->mmap + ntohl(e->offset);
 			*outlen = ntohl(e->length);
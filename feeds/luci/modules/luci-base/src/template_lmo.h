@@ -42,6 +42,29 @@
 #endif
 
 
+/* trailer of the perfect hash index, stored right before the sorted index */
+#define LMO_PHF_MAGIC	0xff504846	/* "\xffPHF", never part of UTF-8 text */
+
+struct lmo_phf_trailer {
+	uint32_t id;
+	uint32_t buckets;
+	uint32_t size;
+	uint32_t magic;
+} __attribute__((packed));
+
+/* maps a key to its slot given the displacement of its bucket */
+static inline uint32_t lmo_phf_hash(uint32_t key, uint32_t disp)
+{
+	key ^= disp * 0x9e3779b9;
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
+
+	return key;
+}
+
 struct lmo_entry {
 	uint32_t key_id;
 	uint32_t val_id;
@@ -56,7 +79,12 @@ struct lmo_archive {
 	int         fd;
 	int	        length;
 	uint32_t    size;
+	uint32_t    id;
 	lmo_entry_t *index;
+	uint32_t    *phf_disp;
+	uint32_t    *phf_table;
+	uint32_t    phf_buckets;
+	uint32_t    phf_size;
 	char        *mmap;
 	char		*end;
 	struct lmo_archive *next;
@@ -67,6 +95,7 @@ typedef struct lmo_archive lmo_archive_t;
 
 struct lmo_catalog {
 	char lang[6];
+	uint32_t id;
 	struct lmo_archive *archives;
 	struct lmo_catalog *next;
 };
@@ -76,6 +105,8 @@ typedef struct lmo_catalog lmo_catalog_t;
 
 uint32_t sfh_hash(const char *data, int len);
 uint32_t lmo_canon_hash(const char *data, int len);
+uint32_t lmo_archive_id(const char *name, const struct stat *s);
+int lmo_archive_name_cmp(const char *a, const char *b);
 
 lmo_archive_t * lmo_open(const char *file);
 void lmo_close(lmo_archive_t *ar);
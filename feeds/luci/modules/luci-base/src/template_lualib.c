@@ -45,9 +45,24 @@ static int template_L_do_parse(lua_State *L, struct template_parser *parser, con
 int template_L_parse(lua_State *L)
 {
 	const char *file = luaL_checkstring(L, 1);
-	struct template_parser *parser = template_open(file);
+	const char *cache = luaL_optstring(L, 2, NULL);
+	struct template_parser *parser;
+	struct stat s;
+	int rv;
 
-	return template_L_do_parse(L, parser, file);
+	if (cache && stat(file, &s))
+		cache = NULL;
+
+	if (cache && !template_cache_load(L, cache, file, &s))
+		return 1;
+
+	parser = template_open(file);
+	rv = template_L_do_parse(L, parser, file);
+
+	if (cache && rv == 1)
+		template_cache_store(L, cache, file, &s);
+
+	return rv;
 }
 
 int template_L_parse_string(lua_State *L)
@@ -22,6 +22,7 @@
 #include "template_parser.h"
 #include "template_utils.h"
 #include "template_lmo.h"
+#include "template_cache.h"
 
 #define TEMPLATE_LUALIB_META  "template.parser"
 
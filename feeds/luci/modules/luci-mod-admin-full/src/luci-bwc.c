@@ -29,8 +29,15 @@
 
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 #include <arpa/inet.h>
 
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+
 #include <dlfcn.h>
 #include <iwinfo.h>
 
@@ -61,6 +68,27 @@ struct file_map {
 	char *mmap;
 };
 
+/* ring files stay mapped while the daemon runs */
+struct map_entry {
+	struct map_entry *next;
+	struct file_map m;
+	char path[];
+};
+
+static struct map_entry *maps = NULL;
+
+/* netlink sockets, opened on first use */
+static int rtnl_fd = -1;
+static int ctnl_fd = -1;
+static uint32_t nl_seq = 0;
+
+#define NL_BUFSIZE	32768
+
+#define NLA_DATA(a)	((void *)((char *)(a) + NLA_HDRLEN))
+#define NLA_PAYLOAD(a)	((a)->nla_len - NLA_HDRLEN)
+
+#define TCP_CONNTRACK_TIME_WAIT	7
+
 struct traffic_entry {
 	uint32_t time;
 	uint32_t rxb;
@@ -193,46 +221,29 @@ static inline uint32_t timeof(void *entry)
 	return ntohl(((struct traffic_entry *)entry)->time);
 }
 
-static int update_file(const char *path, void *entry, int esize)
+static int update_file(struct file_map *m, void *entry, int esize)
 {
-	int rv = -1;
-	int file;
-	char *map;
+	char *map = m->mmap;
 
-	if ((file = open(path, O_RDWR)) >= 0)
+	if (timeof(entry) > timeof(map + esize * (STEP_COUNT-1)))
 	{
-		map = mmap(NULL, esize * STEP_COUNT, PROT_READ | PROT_WRITE,
-				   MAP_SHARED | MAP_LOCKED, file, 0);
-
-		if ((map != NULL) && (map != MAP_FAILED))
-		{
-			if (timeof(entry) > timeof(map + esize * (STEP_COUNT-1)))
-			{
-				memmove(map, map + esize, esize * (STEP_COUNT-1));
-				memcpy(map + esize * (STEP_COUNT-1), entry, esize);
-			}
-
-			munmap(map, esize * STEP_COUNT);
-
-			rv = 0;
-		}
-
-		close(file);
+		memmove(map, map + esize, esize * (STEP_COUNT-1));
+		memcpy(map + esize * (STEP_COUNT-1), entry, esize);
 	}
 
-	return rv;
+	return 0;
 }
 
-static int mmap_file(const char *path, int esize, struct file_map *m)
+static int mmap_file(const char *path, int esize, struct file_map *m, int rw)
 {
 	m->fd   = -1;
 	m->size = -1;
 	m->mmap = NULL;
 
-	if ((m->fd = open(path, O_RDONLY)) >= 0)
+	if ((m->fd = open(path, rw ? O_RDWR : O_RDONLY)) >= 0)
 	{
 		m->size = STEP_COUNT * esize;
-		m->mmap = mmap(NULL, m->size, PROT_READ,
+		m->mmap = mmap(NULL, m->size, PROT_READ | (rw ? PROT_WRITE : 0),
 					   MAP_SHARED | MAP_LOCKED, m->fd, 0);
 
 		if ((m->mmap != NULL) && (m->mmap != MAP_FAILED))
@@ -251,6 +262,58 @@ static void umap_file(struct file_map *m)
 		close(m->fd);
 }
 
+static struct file_map * get_map(const char *path, int esize)
+{
+	struct stat s;
+	struct map_entry *e;
+
+	for (e = maps; e; e = e->next)
+		if (!strcmp(e->path, path))
+			return &e->m;
+
+	if (stat(path, &s))
+	{
+		if (init_file((char *)path, esize))
+		{
+			fprintf(stderr, "Failed to init %s: %s\n",
+					path, strerror(errno));
+
+			return NULL;
+		}
+	}
+
+	if (!(e = malloc(sizeof(*e) + strlen(path) + 1)))
+		return NULL;
+
+	strcpy(e->path, path);
+
+	if (mmap_file(path, esize, &e->m, 1))
+	{
+		umap_file(&e->m);
+		free(e);
+		return NULL;
+	}
+
+	e->next = maps;
+	maps = e;
+
+	return &e->m;
+}
+
+static void free_maps(void)
+{
+	struct map_entry *e, *next;
+
+	for (e = maps; e; e = next)
+	{
+		next = e->next;
+		umap_file(&e->m);
+		free(e);
+	}
+
+	maps = NULL;
+}
+
 static void * iw_open(void)
 {
 	return dlopen("/usr/lib/libiwinfo.so", RTLD_LAZY);
@@ -300,21 +363,13 @@ static int update_ifstat(
 ) {
 	char path[1024];
 
-	struct stat s;
+	struct file_map *m;
 	struct traffic_entry e;
 
 	snprintf(path, sizeof(path), DB_IF_FILE, ifname);
 
-	if (stat(path, &s))
-	{
-		if (init_file(path, sizeof(struct traffic_entry)))
-		{
-			fprintf(stderr, "Failed to init %s: %s\n",
-					path, strerror(errno));
-
-			return -1;
-		}
-	}
+	if (!(m = get_map(path, sizeof(struct traffic_entry))))
+		return -1;
 
 	e.time = htonl(time(NULL));
 	e.rxb  = htonl(rxb);
@@ -322,7 +377,7 @@ static int update_ifstat(
 	e.txb  = htonl(txb);
 	e.txp  = htonl(txp);
 
-	return update_file(path, &e, sizeof(struct traffic_entry));
+	return update_file(m, &e, sizeof(struct traffic_entry));
 }
 
 static int update_radiostat(
@@ -330,84 +385,287 @@ static int update_radiostat(
 ) {
 	char path[1024];
 
-	struct stat s;
+	struct file_map *m;
 	struct radio_entry e;
 
 	snprintf(path, sizeof(path), DB_RD_FILE, ifname);
 
-	if (stat(path, &s))
-	{
-		if (init_file(path, sizeof(struct radio_entry)))
-		{
-			fprintf(stderr, "Failed to init %s: %s\n",
-					path, strerror(errno));
-
-			return -1;
-		}
-	}
+	if (!(m = get_map(path, sizeof(struct radio_entry))))
+		return -1;
 
 	e.time  = htonl(time(NULL));
 	e.rate  = htons(rate);
 	e.rssi  = rssi;
 	e.noise = noise;
 
-	return update_file(path, &e, sizeof(struct radio_entry));
+	return update_file(m, &e, sizeof(struct radio_entry));
 }
 
 static int update_cnstat(uint32_t udp, uint32_t tcp, uint32_t other)
 {
 	char path[1024];
 
-	struct stat s;
+	struct file_map *m;
 	struct conn_entry e;
 
 	snprintf(path, sizeof(path), DB_CN_FILE);
 
-	if (stat(path, &s))
-	{
-		if (init_file(path, sizeof(struct conn_entry)))
-		{
-			fprintf(stderr, "Failed to init %s: %s\n",
-					path, strerror(errno));
-
-			return -1;
-		}
-	}
+	if (!(m = get_map(path, sizeof(struct conn_entry))))
+		return -1;
 
 	e.time  = htonl(time(NULL));
 	e.udp   = htonl(udp);
 	e.tcp   = htonl(tcp);
 	e.other = htonl(other);
 
-	return update_file(path, &e, sizeof(struct conn_entry));
+	return update_file(m, &e, sizeof(struct conn_entry));
 }
 
 static int update_ldstat(uint16_t load1, uint16_t load5, uint16_t load15)
 {
 	char path[1024];
 
-	struct stat s;
+	struct file_map *m;
 	struct load_entry e;
 
 	snprintf(path, sizeof(path), DB_LD_FILE);
 
-	if (stat(path, &s))
+	if (!(m = get_map(path, sizeof(struct load_entry))))
+		return -1;
+
+	e.time   = htonl(time(NULL));
+	e.load1  = htons(load1);
+	e.load5  = htons(load5);
+	e.load15 = htons(load15);
+
+	return update_file(m, &e, sizeof(struct load_entry));
+}
+
+static void parse_attrs(struct nlattr **tb, int max, struct nlattr *a, int len)
+{
+	int type;
+
+	memset(tb, 0, sizeof(*tb) * (max + 1));
+
+	while (len >= (int)sizeof(*a) && a->nla_len >= sizeof(*a) &&
+	       a->nla_len <= len)
 	{
-		if (init_file(path, sizeof(struct load_entry)))
-		{
-			fprintf(stderr, "Failed to init %s: %s\n",
-					path, strerror(errno));
+		type = a->nla_type & NLA_TYPE_MASK;
+
+		if (type <= max)
+			tb[type] = a;
+
+		len -= NLA_ALIGN(a->nla_len);
+		a = (struct nlattr *)((char *)a + NLA_ALIGN(a->nla_len));
+	}
+}
+
+/* send a dump request and pass every reply message to cb */
+static int nl_dump(int *fd, int proto, struct nlmsghdr *req,
+                   void (*cb)(struct nlmsghdr *, void *), void *arg)
+{
+	static char buf[NL_BUFSIZE];
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+	struct nlmsghdr *nlh;
+	int len;
 
+	if (*fd < 0)
+	{
+		if ((*fd = socket(AF_NETLINK, SOCK_RAW, proto)) < 0)
 			return -1;
+
+		fcntl(*fd, F_SETFD, FD_CLOEXEC);
+	}
+
+	req->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req->nlmsg_seq   = ++nl_seq;
+
+	if (sendto(*fd, req, req->nlmsg_len, 0,
+	           (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		goto error;
+
+	while (1)
+	{
+		if ((len = recv(*fd, buf, sizeof(buf), 0)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			goto error;
+		}
+
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+		     nlh = NLMSG_NEXT(nlh, len))
+		{
+			if (nlh->nlmsg_seq != nl_seq)
+				continue;
+
+			if (nlh->nlmsg_type == NLMSG_DONE)
+				return 0;
+
+			if (nlh->nlmsg_type == NLMSG_ERROR)
+				goto error;
+
+			cb(nlh, arg);
 		}
 	}
 
-	e.time   = htonl(time(NULL));
-	e.load1  = htons(load1);
-	e.load5  = htons(load5);
-	e.load15 = htons(load15);
+error:
+	close(*fd);
+	*fd = -1;
+	return -1;
+}
+
+static void link_cb(struct nlmsghdr *nlh, void *arg)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+	struct nlattr *tb[IFLA_MAX + 1];
+	struct rtnl_link_stats *st;
+	const char *ifname;
 
-	return update_file(path, &e, sizeof(struct load_entry));
+	if (nlh->nlmsg_type != RTM_NEWLINK)
+		return;
+
+	parse_attrs(tb, IFLA_MAX, (struct nlattr *)IFLA_RTA(ifi),
+	            IFLA_PAYLOAD(nlh));
+
+	if (!tb[IFLA_IFNAME] || !tb[IFLA_STATS] ||
+	    NLA_PAYLOAD(tb[IFLA_STATS]) < sizeof(*st))
+		return;
+
+	ifname = NLA_DATA(tb[IFLA_IFNAME]);
+	st = NLA_DATA(tb[IFLA_STATS]);
+
+	if (strcmp(ifname, "lo"))
+		update_ifstat(ifname, st->rx_bytes, st->rx_packets,
+		              st->tx_bytes, st->tx_packets);
+}
+
+/* sample all interfaces with a single RTM_GETLINK dump */
+static int update_ifstats(void)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct ifinfomsg ifi;
+	} req = {
+		.nlh = {
+			.nlmsg_len  = sizeof(req),
+			.nlmsg_type = RTM_GETLINK,
+		},
+		.ifi = {
+			.ifi_family = AF_UNSPEC,
+		},
+	};
+
+	return nl_dump(&rtnl_fd, NETLINK_ROUTE, &req.nlh, link_cb, NULL);
+}
+
+struct conn_count {
+	uint32_t udp;
+	uint32_t tcp;
+	uint32_t other;
+};
+
+static void conn_cb(struct nlmsghdr *nlh, void *arg)
+{
+	struct conn_count *c = arg;
+	struct nlattr *tb[CTA_MAX + 1];
+	struct nlattr *tuple[CTA_TUPLE_MAX + 1];
+	struct nlattr *ip[CTA_IP_MAX + 1];
+	struct nlattr *proto[CTA_PROTO_MAX + 1];
+	struct nlattr *info[CTA_PROTOINFO_MAX + 1];
+	struct nlattr *tcp[CTA_PROTOINFO_TCP_MAX + 1];
+	uint8_t num;
+
+	parse_attrs(tb, CTA_MAX,
+	            (struct nlattr *)((char *)NLMSG_DATA(nlh) +
+	                              NLMSG_ALIGN(sizeof(struct nfgenmsg))),
+	            nlh->nlmsg_len - NLMSG_SPACE(sizeof(struct nfgenmsg)));
+
+	if (!tb[CTA_TUPLE_ORIG])
+		return;
+
+	parse_attrs(tuple, CTA_TUPLE_MAX, NLA_DATA(tb[CTA_TUPLE_ORIG]),
+	            NLA_PAYLOAD(tb[CTA_TUPLE_ORIG]));
+
+	if (!tuple[CTA_TUPLE_PROTO])
+		return;
+
+	/* skip connections from localhost to localhost */
+	if (tuple[CTA_TUPLE_IP])
+	{
+		parse_attrs(ip, CTA_IP_MAX, NLA_DATA(tuple[CTA_TUPLE_IP]),
+		            NLA_PAYLOAD(tuple[CTA_TUPLE_IP]));
+
+		if (ip[CTA_IP_V4_SRC] && ip[CTA_IP_V4_DST] &&
+		    *(uint32_t *)NLA_DATA(ip[CTA_IP_V4_SRC]) == htonl(INADDR_LOOPBACK) &&
+		    *(uint32_t *)NLA_DATA(ip[CTA_IP_V4_DST]) == htonl(INADDR_LOOPBACK))
+			return;
+	}
+
+	parse_attrs(proto, CTA_PROTO_MAX, NLA_DATA(tuple[CTA_TUPLE_PROTO]),
+	            NLA_PAYLOAD(tuple[CTA_TUPLE_PROTO]));
+
+	if (!proto[CTA_PROTO_NUM])
+		return;
+
+	num = *(uint8_t *)NLA_DATA(proto[CTA_PROTO_NUM]);
+
+	if (num == IPPROTO_TCP)
+	{
+		/* skip connections in TIME_WAIT */
+		if (tb[CTA_PROTOINFO])
+		{
+			parse_attrs(info, CTA_PROTOINFO_MAX, NLA_DATA(tb[CTA_PROTOINFO]),
+			            NLA_PAYLOAD(tb[CTA_PROTOINFO]));
+
+			if (info[CTA_PROTOINFO_TCP])
+			{
+				parse_attrs(tcp, CTA_PROTOINFO_TCP_MAX,
+				            NLA_DATA(info[CTA_PROTOINFO_TCP]),
+				            NLA_PAYLOAD(info[CTA_PROTOINFO_TCP]));
+
+				if (tcp[CTA_PROTOINFO_TCP_STATE] &&
+				    *(uint8_t *)NLA_DATA(tcp[CTA_PROTOINFO_TCP_STATE]) ==
+				    TCP_CONNTRACK_TIME_WAIT)
+					return;
+			}
+		}
+
+		c->tcp++;
+	}
+	else if (num == IPPROTO_UDP)
+	{
+		c->udp++;
+	}
+	else
+	{
+		c->other++;
+	}
+}
+
+/* count connections with a binary ctnetlink dump */
+static int update_cnstats(void)
+{
+	struct conn_count c = { 0 };
+	struct {
+		struct nlmsghdr nlh;
+		struct nfgenmsg nfg;
+	} req = {
+		.nlh = {
+			.nlmsg_len  = sizeof(req),
+			.nlmsg_type = (NFNL_SUBSYS_CTNETLINK << 8) | IPCTNL_MSG_CT_GET,
+		},
+		.nfg = {
+			.nfgen_family = AF_UNSPEC,
+			.version      = NFNETLINK_V0,
+		},
+	};
+
+	if (nl_dump(&ctnl_fd, NETLINK_NETFILTER, &req.nlh, conn_cb, &c))
+		return -1;
+
+	return update_cnstat(c.udp, c.tcp, c.other);
 }
 
 static int run_daemon(void)
@@ -473,7 +731,8 @@ static int run_daemon(void)
 		memset(progname, 0, prognamelen);
 		snprintf(progname, prognamelen, "luci-bwc %d", countdown);
 
-		if ((info = fopen("/proc/net/dev", "r")) != NULL)
+		/* fall back to /proc if netlink is not available */
+		if (update_ifstats() && (info = fopen("/proc/net/dev", "r")) != NULL)
 		{
 			while (fgets(line, sizeof(line), info))
 			{
@@ -510,7 +769,7 @@ static int run_daemon(void)
 			}
 		}
 
-		if ((info = fopen(ipc, "r")) != NULL)
+		if (update_cnstats() && (info = fopen(ipc, "r")) != NULL)
 		{
 			udp   = 0;
 			tcp   = 0;
@@ -561,6 +820,14 @@ static int run_daemon(void)
 	if (iw)
 		iw_close(iw);
 
+	if (rtnl_fd > -1)
+		close(rtnl_fd);
+
+	if (ctnl_fd > -1)
+		close(ctnl_fd);
+
+	free_maps();
+
 	return 0;
 }
 
@@ -597,7 +864,7 @@ static int run_dump_ifname(const char *ifname)
 	check_daemon();
 	snprintf(path, sizeof(path), DB_IF_FILE, ifname);
 
-	if (mmap_file(path, sizeof(struct traffic_entry), &m))
+	if (mmap_file(path, sizeof(struct traffic_entry), &m, 0))
 	{
 		fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
 		return 1;
@@ -633,7 +900,7 @@ static int run_dump_radio(const char *ifname)
 	check_daemon();
 	snprintf(path, sizeof(path), DB_RD_FILE, ifname);
 
-	if (mmap_file(path, sizeof(struct radio_entry), &m))
+	if (mmap_file(path, sizeof(struct radio_entry), &m, 0))
 	{
 		fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
 		return 1;
@@ -667,7 +934,7 @@ static int run_dump_conns(void)
 	check_daemon();
 	snprintf(path, sizeof(path), DB_CN_FILE);
 
-	if (mmap_file(path, sizeof(struct conn_entry), &m))
+	if (mmap_file(path, sizeof(struct conn_entry), &m, 0))
 	{
 		fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
 		return 1;
@@ -701,7 +968,7 @@ static int run_dump_load(void)
 	check_daemon();
 	snprintf(path, sizeof(path), DB_LD_FILE);
 
-	if (mmap_file(path, sizeof(struct load_entry), &m))
+	if (mmap_file(path, sizeof(struct load_entry), &m, 0))
 	{
 		fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
 		return 1;
@@ -25,6 +25,7 @@
 #define PROC_BANKMGR_PASSIVEVERSION "passiveversion"
 #define PROC_BANKMGR_ACTIVEOID "bootedoid"
 #define PROC_BANKMGR_PASSIVEOID "notbootedoid"
+#define PROC_BANKMGR_RAWSTORAGE "rawstorage"
 
 #define INFO_BLOCK_ITEM_NAME_VRSS   0x56525353  /* VRSS */
 #define INFO_BLOCK_ITEM_NAME_TOID   0x544f4944  /* TOID */
@@ -239,6 +240,51 @@ static void remove_legacy_upgrade_info(void)
 	return;
 }
 
+static int bankmgr_rawstorage_proc_show(struct seq_file *m, void *v)
+{
+	struct storage_context *ctx = get_storage_ctx();
+	struct storage_stats st;
+
+	if (!ctx || storage_get_stats(ctx, &st))
+		return 0;
+
+	seq_printf(m, "bank: %d\n", st.bank);
+	seq_printf(m, "total_pages: %u\n", st.total_pages);
+	seq_printf(m, "free_pages: %u\n", st.free_pages);
+	seq_printf(m, "live_pages: %u\n", st.live_pages);
+	seq_printf(m, "live_params: %u\n", st.live_params);
+	seq_printf(m, "pages_written: %lu\n", st.pages_written);
+	seq_printf(m, "params_written: %lu\n", st.params_written);
+	seq_printf(m, "batches: %lu\n", st.batches);
+	seq_printf(m, "batches_failed: %lu\n", st.batches_failed);
+	seq_printf(m, "batches_discarded: %lu\n", st.batches_discarded);
+	seq_printf(m, "compactions: %lu\n", st.compactions);
+	seq_printf(m, "erases: %lu %lu\n", st.erases[0], st.erases[1]);
+
+	return 0;
+}
+
+/* writing "compact" copies the live parameters to the other bank */
+static ssize_t bankmgr_rawstorage_proc_write( struct file *filp, const char __user *buff, size_t count, loff_t *ppos )
+{
+	struct storage_context *ctx = get_storage_ctx();
+	char buffer[16];
+
+	if (count >= sizeof(buffer))
+		return -EINVAL;
+	if (copy_from_user(buffer, buff, count))
+		return -EFAULT;
+	buffer[count] = 0;
+
+	if (strncmp(buffer, "compact", strlen("compact")))
+		return -EINVAL;
+
+	if (!ctx || storage_compact(ctx))
+		return -EIO;
+
+	return count;
+}
+
 #ifdef BANKTABLE_DEBUG
 static int bankmgr_debuginfo_proc_show(struct seq_file *m, void *v)
 {
@@ -302,6 +348,7 @@ BANKMGR_SEQ_FOPS(bankmgr_criterion_proc_rw_fops, bankmgr_criterion_proc_show, ba
 BANKMGR_SEQ_FOPS(bankmgr_debuginfo_proc_fops, bankmgr_debuginfo_proc_show, NULL);
 #endif
 BANKMGR_SEQ_FOPS(bankmgr_info_proc_fops, bankmgr_info_proc_show, NULL);
+BANKMGR_SEQ_FOPS(bankmgr_rawstorage_proc_fops, bankmgr_rawstorage_proc_show, bankmgr_rawstorage_proc_write);
 
 int bankmgr_proc_init(void)
 {
@@ -329,6 +376,7 @@ int bankmgr_proc_init(void)
 	entry = proc_create_data(PROC_BANKMGR_PASSIVEVERSION, 0444, bankmgr_proc_dir, &bankmgr_info_proc_fops, &version_inactive);
 	entry = proc_create_data(PROC_BANKMGR_ACTIVEOID, 0444, bankmgr_proc_dir, &bankmgr_info_proc_fops, &oid_booted);
 	entry = proc_create_data(PROC_BANKMGR_PASSIVEOID, 0444, bankmgr_proc_dir, &bankmgr_info_proc_fops, &oid_notbooted);
+	entry = proc_create_data(PROC_BANKMGR_RAWSTORAGE, 0644, bankmgr_proc_dir, &bankmgr_rawstorage_proc_fops, NULL);
 
 	handle_legacy_upgrade_info();
 
@@ -349,6 +397,7 @@ int bankmgr_proc_cleanup(void)
 		remove_proc_entry(PROC_BANKMGR_PASSIVEVERSION, bankmgr_proc_dir);
 		remove_proc_entry(PROC_BANKMGR_ACTIVEOID, bankmgr_proc_dir);
 		remove_proc_entry(PROC_BANKMGR_PASSIVEOID, bankmgr_proc_dir);
+		remove_proc_entry(PROC_BANKMGR_RAWSTORAGE, bankmgr_proc_dir);
 
 		remove_legacy_upgrade_info();
 
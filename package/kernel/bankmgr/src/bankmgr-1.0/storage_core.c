@@ -39,6 +39,14 @@
  *
  * data blocks
  *	- the data blocks.
+ *
+ * A batch of parameters written by storage_set_params() is enclosed by a
+ * begin and a commit record, both with the BLOCK_TRANSACT state:
+ *
+ * [ begin ] [ param ] ... [ param ] [ commit ]
+ *
+ * When the bank is mounted, the parameters of a batch without a valid
+ * commit record are skipped.
  */
 
 #ifdef __KERNEL__
@@ -326,6 +334,91 @@ out:
 	return (ret? -1 : desc.size);
 }
 
+#if RAWSTORAGE_VERSION > 1
+#pragma pack(1)
+struct sfs_txn {
+	unsigned int magic;
+	unsigned short pages;	/* pages between the begin and commit record */
+	unsigned short count;	/* parameters in the batch */
+};
+#pragma pack()
+
+#define SFS_TXN_BEGIN	0x54584e42	/* 'TXNB' */
+#define SFS_TXN_COMMIT	0x54584e43	/* 'TXNC' */
+
+static int set_txn(struct sfs_bank *bank, int idx, unsigned int magic,
+		   int pages, int count)
+{
+	struct sfs_txn disk_txn;
+
+	disk_txn.magic = htonl(magic);
+	disk_txn.pages = htons(pages);
+	disk_txn.count = htons(count);
+
+	return set_data(bank, idx, BLOCK_TRANSACT, &disk_txn, sizeof(disk_txn));
+}
+
+static int get_txn(struct sfs_bank *bank, int idx, struct sfs_txn *txn)
+{
+	struct sfs_desc desc, disk_desc;
+	struct sfs_txn disk_txn;
+
+	if (check_range(bank, idx, 0))
+		return -1;
+
+	if (storage_read(bank->storage, bank->sb.bank,
+			data_block_addr(bank, idx), SFS_DESC_SIZE, &disk_desc))
+		return -1;
+
+	desc.state = ntohs(disk_desc.state);
+	desc.size = ntohs(disk_desc.size);
+	desc.crc32_data = ntohl(disk_desc.crc32_data);
+
+	if (desc.state != BLOCK_TRANSACT || desc.size != sizeof(disk_txn) ||
+	    storage_crc32_desc(&disk_desc, 0))
+		return -1;
+
+	if (storage_read(bank->storage, bank->sb.bank,
+			data_block_addr(bank, idx) + SFS_DESC_SIZE,
+			sizeof(disk_txn), &disk_txn) ||
+	    storage_crc32_data(&disk_txn, sizeof(disk_txn), &desc, 0))
+		return -1;
+
+	txn->magic = ntohl(disk_txn.magic);
+	txn->pages = ntohs(disk_txn.pages);
+	txn->count = ntohs(disk_txn.count);
+
+	return 0;
+}
+
+/*
+ * Called for the BLOCK_TRANSACT record at idx, next is the index following
+ * it. Returns where to continue scanning: right after a begin record when
+ * the batch has been committed, after the batch otherwise.
+ */
+static int check_txn(struct sfs_bank *bank, int idx, int next)
+{
+	struct sfs_txn begin, commit;
+	int commit_idx;
+
+	if (get_txn(bank, idx, &begin) || begin.magic != SFS_TXN_BEGIN)
+		return next;
+
+	commit_idx = next + begin.pages;
+
+	if (get_txn(bank, commit_idx, &commit) == 0 &&
+	    commit.magic == SFS_TXN_COMMIT &&
+	    commit.pages == begin.pages && commit.count == begin.count)
+		return next;
+
+	rs_error("discarding uncommitted batch of %d parameters at %d\r\n",
+		 begin.count, idx);
+	bank->stats.batches_discarded++;
+
+	return commit_idx + 1;
+}
+#endif
+
 /*
  * Reserve space for nr_blocks and allocate a descriptor:
  */
@@ -543,8 +636,11 @@ static int bank_populate_cache(struct sfs_bank *bank)
 		if (idx >= bank->sb.nr_blocks)
 			break;
 
-		if (!desc_is_id(&desc))
+		if (!desc_is_id(&desc)) {
+			if (desc.state == BLOCK_TRANSACT)
+				idx = check_txn(bank, old_idx, idx);
 			continue;
+		}
 
 		if (desc.size > def_size)
 		{
@@ -789,8 +885,9 @@ static inline int check_cache_sanity(struct sfs_bank *bank, unsigned short id, i
 int storage_get_param(struct storage_context *ctx, unsigned short id,
 		      void *data, int count)
 {
-	struct sfs_bank *bank = ctx->opaque;
-	int bytes = -1, idx;
+	struct sfs_bank *bank;
+	unsigned long idx;
+	int bytes = -1;
 
 	/* 
 	 * data == NULL and count == 0 is valid and a size
@@ -798,60 +895,77 @@ int storage_get_param(struct storage_context *ctx, unsigned short id,
 	 */
 	rs_debug("-> id: %d, size: %d\r\n", id, count);
 
-	if (!bank || !is_valid_id(id))
+	if (!is_valid_id(id))
 		return -1;
 
-	if (cache_locate(bank->cache, id, (unsigned long *)&idx) == 0 &&
+	storage_lock(ctx);
+
+	bank = ctx->opaque;
+	if (bank &&
+	    cache_locate(bank->cache, id, &idx) == 0 &&
 	    check_cache_sanity(bank, id, idx) == 0)
 		bytes = get_data(bank, idx, data, count);
 
+	storage_unlock(ctx);
+
 	rs_debug("<- id: %d, bytes: %d\r\n", id, bytes);
 
 	return bytes;
 }
 
-/* 
- * Return values: 0 upon success, 1 - out of space, (-1) - internal problem. 
+/*
+ * Write a parameter to a new location, the cache is not updated.
+ * Return values: 0 upon success, 1 - out of space, (-1) - internal problem.
  */
-static int set_param(struct sfs_bank *bank, unsigned short id,
-		     void *data, int count)
+static int write_param(struct sfs_bank *bank, unsigned short id,
+		       void *data, int count, int *idx)
 {
-	int new_idx, old_idx = -1,
-	    ret = -1;
-
-	if (data) {
-		new_idx = alloc_desc(bank, size2pages(bank, count));
-
-		if (new_idx != -1) {
+	int nr_blocks = size2pages(bank, count);
 #if RAWSTORAGE_VERSION < 2
-			struct sfs_desc desc;
+	struct sfs_desc desc;
 
-			desc.state = id;
-			desc.size = count;
+	desc.state = id;
+	desc.size = count;
 #endif
 
+	*idx = alloc_desc(bank, nr_blocks);
+	if (*idx == -1)
+		return 1; /* Out of space */
+
 #if RAWSTORAGE_VERSION < 2
-			/*
-			 * Write (1) data and then (2) descriptor,
-			 * (3) update the cache and (4) delete the old version:
-			 */
-			if (set_data(bank, new_idx, data, count) == 0)
-				if (set_desc(bank, new_idx, &desc) == 0)
+	/*
+	 * Write (1) data and then (2) descriptor:
+	 */
+	if (set_data(bank, *idx, data, count) ||
+	    set_desc(bank, *idx, &desc))
+		return -1;
 #else
-			/*
-			 * Write (1) data and descriptor,
-			 * (2) update the cache
-			 */
-			if (set_data(bank, new_idx, id, data, count) == 0)
+	/*
+	 * Write data and descriptor
+	 */
+	if (set_data(bank, *idx, id, data, count))
+		return -1;
 #endif
-					ret = cache_update(bank->cache, id,
-							(unsigned long *)new_idx,
-							(unsigned long *)&old_idx);
-		} else
-			ret = 1; /* Out of space */
-		
-	} else
-		ret = cache_del(bank->cache, id, (unsigned long *)&old_idx);
+
+	bank->stats.pages_written += nr_blocks;
+	bank->stats.params_written++;
+
+	return 0;
+}
+
+/*
+ * Point the cache to the new version of a parameter (idx == -1 for a
+ * deletion) and delete the old version.
+ */
+static int cache_param(struct sfs_bank *bank, unsigned short id, int idx)
+{
+	unsigned long old_idx = -1;
+	int ret;
+
+	if (idx != -1)
+		ret = cache_update(bank->cache, id, (unsigned long *)idx, &old_idx);
+	else
+		ret = cache_del(bank->cache, id, &old_idx);
 
 #if RAWSTORAGE_VERSION < 2
 	if (!ret && old_idx != -1) {
@@ -863,11 +977,172 @@ static int set_param(struct sfs_bank *bank, unsigned short id,
 	return ret;
 }
 
+/* 
+ * Return values: 0 upon success, 1 - out of space, (-1) - internal problem. 
+ */
+static int set_param(struct sfs_bank *bank, unsigned short id,
+		     void *data, int count)
+{
+	int idx = -1, ret;
+
+	if (data) {
+		ret = write_param(bank, id, data, count, &idx);
+		if (ret)
+			return ret;
+	}
+
+	return cache_param(bank, id, idx);
+}
+
+/*
+ * Write all parameters and only then update the cache, a batch never
+ * leaves the bank partially updated.
+ * Once the begin record is written, the whole extent up to the commit record
+ * belongs to the batch: on mount an uncommitted batch is skipped as a whole,
+ * so a failed batch must not leave first_free_idx inside its extent.
+ * Return values: 0 upon success, 1 - out of space, (-1) - internal problem.
+ */
+static int set_params(struct sfs_bank *bank, struct storage_param *params,
+		      int nr_params)
+{
+	int i, pages = 0, count = 0, txn_pages = 0, ret = 0;
+	int *new_idx;
+#if RAWSTORAGE_VERSION > 1
+	struct sfs_txn txn;
+	int idx, begin_idx = -1;
+#endif
+
+	for (i = 0; i < nr_params; i++) {
+		if (params[i].data) {
+			pages += size2pages(bank, params[i].count);
+			count++;
+		}
+	}
+
+#if RAWSTORAGE_VERSION > 1
+	/* a single parameter is written atomically anyway */
+	if (count > 1)
+		txn_pages = 2;
+#endif
+
+	if (check_range(bank, bank->first_free_idx, pages + txn_pages))
+		return 1; /* Out of space */
+
+	new_idx = memory_alloc(nr_params * sizeof(*new_idx));
+	if (!new_idx)
+		return -1;
+
+#if RAWSTORAGE_VERSION > 1
+	if (txn_pages) {
+		begin_idx = idx = alloc_desc(bank, 1);
+		if (idx == -1 || set_txn(bank, idx, SFS_TXN_BEGIN, pages, count)) {
+			ret = -1;
+			goto fail;
+		}
+		bank->stats.pages_written++;
+	}
+#endif
+
+	for (i = 0; i < nr_params; i++) {
+		new_idx[i] = -1;
+		if (params[i].data) {
+			ret = write_param(bank, params[i].id, params[i].data,
+					  params[i].count, &new_idx[i]);
+			if (ret)
+				goto fail;
+		}
+	}
+
+#if RAWSTORAGE_VERSION > 1
+	if (txn_pages) {
+		/* The fence: the batch exists once this record is written */
+		idx = alloc_desc(bank, 1);
+		if (idx == -1 || set_txn(bank, idx, SFS_TXN_COMMIT, pages, count)) {
+			ret = -1;
+			goto fail;
+		}
+		bank->stats.pages_written++;
+	}
+#endif
+
+	for (i = 0; i < nr_params; i++) {
+		/* deleting a parameter which does not exist is fine */
+		if (cache_param(bank, params[i].id, new_idx[i]) && new_idx[i] != -1)
+			ret = -1;
+	}
+	goto out;
+
+fail:
+#if RAWSTORAGE_VERSION > 1
+	/*
+	 * Skip the rest of the extent, up to and including the commit slot,
+	 * if the begin record made it to the storage (even from a failed
+	 * write). Otherwise the mount scan steps over the bad record and
+	 * the following pages are used as usual.
+	 */
+	if (begin_idx != -1 && get_txn(bank, begin_idx, &txn) == 0)
+		bank->first_free_idx = begin_idx + 1 + pages + 1;
+#endif
+
+out:
+	memory_free(new_idx);
+
+	return ret;
+}
+
+static int bank_free_pages(struct sfs_bank *bank)
+{
+	int pages = bank->sb.nr_blocks - bank->first_free_idx;
+
+	return (pages > 0? pages : 0);
+}
+
+static int bank_live_pages(struct sfs_bank *bank, unsigned int *nr_params)
+{
+	struct sfs_desc desc;
+	unsigned long idx;
+	void *itr;
+	int pages = 0;
+
+	if (nr_params)
+		*nr_params = 0;
+
+	itr = cache_get_iterator(bank->cache);
+	while ((itr = cache_next_element(bank->cache, itr, &idx))) {
+		if (get_desc(bank, idx, &desc))
+			continue;
+
+		pages += size2pages(bank, desc.size);
+		if (nr_params)
+			(*nr_params)++;
+	}
+
+	return pages;
+}
+
+static inline int below_threshold(struct sfs_bank *bank, int free_pages)
+{
+	return free_pages * 100 < bank->sb.nr_blocks * RAWSTORAGE_COMPACT_THRESHOLD;
+}
+
+/*
+ * Ask for a compaction when a write made the free space drop below the
+ * threshold, free_pages is the free space before the write.
+ */
+static void check_free_space(struct storage_context *ctx,
+			     struct sfs_bank *bank, int free_pages)
+{
+	if (!below_threshold(bank, free_pages) &&
+	    below_threshold(bank, bank_free_pages(bank)))
+		storage_compact_request(ctx);
+}
+
 #ifdef SFS_DUAL_BANK_SUPPORT
 static struct sfs_bank* switch_banks(struct sfs_bank *old_bank)
 {
 	struct sfs_bank *bank;
-	int idx, def_size = 1024, bank_id;
+	unsigned long idx;
+	int def_size = 1024, bank_id;
 	void *buf, *itr;
 
 	rs_debug("switch_banks: starting...\r\n");
@@ -877,15 +1152,17 @@ static struct sfs_bank* switch_banks(struct sfs_bank *old_bank)
 	buf = memory_alloc(def_size);
 
 	if (!bank || !buf || bank_format(bank, bank_id)) {
-		bank_destroy(bank);
+		if (bank)
+			bank_destroy(bank);
 		if (buf)
 			memory_free(buf);
 		return NULL;
 	}
+	bank->stats = old_bank->stats;
 
 	itr = cache_get_iterator(old_bank->cache);
 
-	while ((itr = cache_next_element(old_bank->cache, itr, (unsigned long *)&idx))) {
+	while ((itr = cache_next_element(old_bank->cache, itr, &idx))) {
 		struct sfs_desc desc;
 		unsigned short id, size;
 
@@ -909,11 +1186,18 @@ static struct sfs_bank* switch_banks(struct sfs_bank *old_bank)
 		if (set_param(bank, id, buf, size) != 0)
 			break;
 	}
-	memory_free(buf);
+	if (buf)
+		memory_free(buf);
 
 	if (itr || bank_commit(bank)) {
+		/* the new bank is erased again, keep using the old one */
+		old_bank->stats.erases[bank_id] += 2;
 		old_bank = bank;
 		bank = NULL;
+	} else {
+		bank->stats.erases[bank_id]++;
+		bank->stats.erases[old_bank->sb.bank]++;
+		bank->stats.compactions++;
 	}
 
 	storage_format(old_bank->storage, old_bank->sb.bank);
@@ -929,15 +1213,24 @@ static struct sfs_bank* switch_banks(struct sfs_bank *old_bank)
 int storage_set_param(struct storage_context *ctx, unsigned short id,
 		      void *data, int count)
 {
-	struct sfs_bank *bank = ctx->opaque;
+	struct sfs_bank *bank;
 	int bytes = -1;
-	int ret;
+	int ret, free_pages;
 
 	rs_debug("-> id: %d, size: %d\r\n", id, count);
 
-	if (!bank || !is_valid_id(id))
+	if (!is_valid_id(id))
+		return -1;
+
+	storage_lock(ctx);
+
+	bank = ctx->opaque;
+	if (!bank) {
+		storage_unlock(ctx);
 		return -1;
+	}
 
+	free_pages = bank_free_pages(bank);
 	ret = set_param(bank, id, data, count);
 
 	if (ret == 0)
@@ -947,6 +1240,8 @@ int storage_set_param(struct storage_context *ctx, unsigned short id,
 		struct sfs_bank *new_bank = switch_banks(bank);
 
 		if (new_bank) {
+			bank = new_bank;
+			free_pages = bank_free_pages(bank);
 			ret = set_param(new_bank, id, data, count);
 			if (!ret)
 				bytes = count;
@@ -956,11 +1251,119 @@ int storage_set_param(struct storage_context *ctx, unsigned short id,
 		}
 	}
 #endif
+	if (ret == 0)
+		check_free_space(ctx, bank, free_pages);
+
+	storage_unlock(ctx);
+
 	rs_debug("<- id: %d, bytes: %d\r\n", id, bytes);
 
 	return bytes;
 }
 
+int storage_set_params(struct storage_context *ctx,
+		       struct storage_param *params, int nr_params)
+{
+	struct sfs_bank *bank;
+	int i, ret = -1, free_pages;
+
+	rs_debug("-> %d params\r\n", nr_params);
+
+	if (nr_params <= 0)
+		return (nr_params? -1 : 0);
+
+	for (i = 0; i < nr_params; i++)
+		if (!is_valid_id(params[i].id) ||
+		    (params[i].data && params[i].count < 0))
+			return -1;
+
+	storage_lock(ctx);
+
+	bank = ctx->opaque;
+	if (bank) {
+		free_pages = bank_free_pages(bank);
+		ret = set_params(bank, params, nr_params);
+
+#ifdef SFS_DUAL_BANK_SUPPORT
+		if (ret == 1 /* Out of space */) {
+			struct sfs_bank *new_bank = switch_banks(bank);
+
+			if (new_bank) {
+				bank = new_bank;
+				free_pages = bank_free_pages(bank);
+				ret = set_params(new_bank, params, nr_params);
+
+				/* Update user's context: */
+				ctx->opaque = new_bank;
+			}
+		}
+#endif
+		if (ret == 0) {
+			bank->stats.batches++;
+			check_free_space(ctx, bank, free_pages);
+		} else
+			bank->stats.batches_failed++;
+	}
+
+	storage_unlock(ctx);
+
+	rs_debug("<- %d params, ret: %d\r\n", nr_params, ret);
+
+	return (ret? -1 : 0);
+}
+
+int storage_compact(struct storage_context *ctx)
+{
+	int ret = -1;
+#ifdef SFS_DUAL_BANK_SUPPORT
+	struct sfs_bank *bank, *new_bank;
+	int used;
+
+	storage_lock(ctx);
+
+	bank = ctx->opaque;
+	if (bank) {
+		used = bank->sb.nr_blocks - bank_free_pages(bank);
+
+		/* nothing to gain when all pages hold live data */
+		if (used <= bank_live_pages(bank, NULL)) {
+			ret = 0;
+		} else {
+			new_bank = switch_banks(bank);
+			if (new_bank) {
+				ctx->opaque = new_bank;
+				ret = 0;
+			}
+		}
+	}
+
+	storage_unlock(ctx);
+#endif
+	return ret;
+}
+
+int storage_get_stats(struct storage_context *ctx, struct storage_stats *stats)
+{
+	struct sfs_bank *bank;
+	int ret = -1;
+
+	storage_lock(ctx);
+
+	bank = ctx->opaque;
+	if (bank) {
+		*stats = bank->stats;
+		stats->bank = bank->sb.bank;
+		stats->total_pages = bank->sb.nr_blocks;
+		stats->free_pages = bank_free_pages(bank);
+		stats->live_pages = bank_live_pages(bank, &stats->live_params);
+		ret = 0;
+	}
+
+	storage_unlock(ctx);
+
+	return ret;
+}
+
 int storage_format_bank(void *storage, int bank_id)
 {
 	struct sfs_super_block sb;
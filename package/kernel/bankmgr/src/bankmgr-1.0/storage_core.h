@@ -28,6 +28,51 @@ extern int storage_get_param(struct storage_context *ctx, unsigned short id,
 extern int storage_set_param(struct storage_context *ctx, unsigned short id,
 			void *data, int count);
 
+/*
+ * Batch update: either all parameters are stored or none of them is,
+ * also across a power failure (RAWSTORAGE_VERSION 2 only).
+ */
+struct storage_param {
+	unsigned short id;
+	void *data;		/* NULL deletes the parameter */
+	int count;
+};
+
+extern int storage_set_params(struct storage_context *ctx,
+			struct storage_param *params, int nr_params);
+
+/*
+ * Compaction copies the live parameters into the other bank. It is done
+ * when a write runs out of space, or ahead of time by storage_compact()
+ * once free space drops below RAWSTORAGE_COMPACT_THRESHOLD percent of
+ * the bank (see storage_compact_request()).
+ */
+#define RAWSTORAGE_COMPACT_THRESHOLD	10
+
+extern int storage_compact(struct storage_context *ctx);
+
+struct storage_stats {
+	int bank;
+	unsigned int total_pages;
+	unsigned int free_pages;
+	unsigned int live_pages;
+	unsigned int live_params;
+
+	/* since the storage was opened */
+	unsigned long pages_written;
+	unsigned long params_written;
+	unsigned long batches;
+	unsigned long batches_failed;
+	unsigned long compactions;
+	unsigned long erases[2];
+
+	/* uncommitted batches found when the bank was mounted */
+	unsigned long batches_discarded;
+};
+
+extern int storage_get_stats(struct storage_context *ctx,
+			struct storage_stats *stats);
+
 extern int storage_format_bank(void *storage, int bank_id);
 
 /*
@@ -46,6 +91,14 @@ extern int storage_write(void *obj, int bank, unsigned long off, int len, void *
 extern int storage_format(void *obj, int bank);
 extern int storage_get_config(void *obj, struct storage_media_config *cfg);
 
+/* Serializes all accesses to the storage */
+extern void storage_lock(struct storage_context *ctx);
+extern void storage_unlock(struct storage_context *ctx);
+
+/* Free space is low, storage_compact() should be called from a context
+ * which can afford to wait for it */
+extern void storage_compact_request(struct storage_context *ctx);
+
 /* Memory allocator */
 
 extern void * memory_alloc(int size);
@@ -102,6 +155,8 @@ struct sfs_bank {
 	int first_free_idx;
 
 	unsigned long cache_dblocks;
+
+	struct storage_stats stats;
 };
 
 #define SFS_DESC_SIZE		sizeof(struct sfs_desc)
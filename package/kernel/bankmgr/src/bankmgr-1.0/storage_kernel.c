@@ -12,6 +12,7 @@
 #include <linux/mutex.h>
 #include <linux/sched.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <linux/mtd/mtd.h>
 
 #include <asm/uaccess.h>
@@ -23,6 +24,12 @@ static struct storage_device gdevice;
 static int gdevice_active;
 static DEFINE_MUTEX(glock);
 
+/* Serializes parameter accesses, glock covers open and close */
+static DEFINE_MUTEX(storage_mutex);
+
+static void storage_compact_work(struct work_struct *work);
+static DECLARE_WORK(compact_work, storage_compact_work);
+
 /* Cache */
 
 struct cache_element {
@@ -271,6 +278,29 @@ int storage_get_config(void *obj, struct storage_media_config *cfg)
 	return 0;
 }
 
+void storage_lock(struct storage_context *ctx)
+{
+	mutex_lock(&storage_mutex);
+}
+
+void storage_unlock(struct storage_context *ctx)
+{
+	mutex_unlock(&storage_mutex);
+}
+
+/* Compaction */
+
+static void storage_compact_work(struct work_struct *work)
+{
+	if (storage_compact(&gdevice.ctx))
+		rs_error("compaction failed\n");
+}
+
+void storage_compact_request(struct storage_context *ctx)
+{
+	schedule_work(&compact_work);
+}
+
 struct storage_context * rawstorage_open(void)
 {
 	mutex_lock(&glock);
@@ -325,6 +355,7 @@ void rawstorage_close(void)
 {
 	mutex_lock(&glock);
 	if( gdevice_active ) {
+		cancel_work_sync(&compact_work);
 		if( gdevice.mtd ) {
 			put_mtd_device(gdevice.mtd);
 			gdevice.mtd = 0;
@@ -30,6 +30,9 @@ int storage_read(void *obj, int bank,
 	return 0;
 }
 
+/* Power failure simulation: the write after writes_left writes is torn */
+static int writes_left = -1;
+
 int storage_write(void *obj, int bank,
 		unsigned long off, int len, void *buf)
 {
@@ -40,6 +43,13 @@ int storage_write(void *obj, int bank,
 
 	rs_debug("from %p, to off(%lu), len %d\n", buf, off, len);
 
+	if (writes_left == 0) {
+		memcpy(ptr, buf, len / 2);
+		return -1;
+	}
+	if (writes_left > 0)
+		writes_left--;
+
 	memcpy(ptr, buf, len);
 	return 0;
 }
@@ -63,6 +73,21 @@ int storage_get_config(void *obj, struct storage_media_config *cfg)
 	return 0;
 }
 
+static int compact_requested;
+
+void storage_lock(struct storage_context *ctx)
+{
+}
+
+void storage_unlock(struct storage_context *ctx)
+{
+}
+
+void storage_compact_request(struct storage_context *ctx)
+{
+	compact_requested = 1;
+}
+
 /*************** Cache *****************/
 
 struct list_head {
@@ -312,6 +337,7 @@ void memory_free(void *obj)
 /******************** Test *********************/
 
 struct storage_context ctx;
+static void *storage;
 
 struct foo {
 	int a, b, c;
@@ -395,11 +421,201 @@ static void switch_banks_test(void)
 	printf("Ok.");
 }
 
+static void remount(void)
+{
+	if (storage_ctx_close(&ctx))
+		error("storage_ctx_close failed\n");
+	if (storage_ctx_init(&ctx, storage))
+		error("storage_ctx_init failed");
+}
+
+static void set_batch(int a, struct foo *f, char *str)
+{
+	struct storage_param params[] = {
+		{ ID_TEST_INT, &a, sizeof(a) },
+		{ ID_TEST_STR, str, strlen(str) + 1 },
+		{ ID_TEST_FOO, f, sizeof(*f) },
+	};
+
+	if (storage_set_params(&ctx, params, 3))
+		error("set_params");
+}
+
+/* returns 1 if the batch values are found, 0 for the test values */
+static int check_batch(int a, struct foo *f, char *str)
+{
+	struct foo rf;
+	int ra, old = 0, new = 0;
+	char rstr[256];
+
+	if (storage_get_param(&ctx, ID_TEST_INT, &ra, sizeof(ra)) != sizeof(ra) ||
+	    storage_get_param(&ctx, ID_TEST_FOO, &rf, sizeof(rf)) != sizeof(rf) ||
+	    storage_get_param(&ctx, ID_TEST_STR, rstr, sizeof(rstr)) <= 0)
+		error("get_param for batch");
+
+	new += (ra == a);
+	new += !memcmp(&rf, f, sizeof(rf));
+	new += !strcmp(rstr, str);
+
+	old += (ra == test_int);
+	old += !memcmp(&rf, &test_foo, sizeof(rf));
+	old += !strcmp(rstr, test_str);
+
+	if (new == 3)
+		return 1;
+	if (old == 3)
+		return 0;
+
+	error("batch was partially applied");
+	return -1;
+}
+
+static void batch_test(void)
+{
+	struct foo f = { 1, 2, 3 };
+	char str[] = "A batch of parameters, long enough to span a few pages of the"
+		     " test storage, which are only 64 bytes each.";
+	struct storage_stats st;
+	int writes, ret;
+
+	printf("*** Batch test\n");
+
+	set_batch(222, &f, str);
+	if (check_batch(222, &f, str) != 1)
+		error("batch not applied");
+	remount();
+	if (check_batch(222, &f, str) != 1)
+		error("batch not applied after remount");
+
+	set_batch(test_int, &test_foo, test_str);
+	simple_read_test();
+
+	printf("*** Batch power failure test\n");
+
+	/* fail the n-th write of a batch, until it gets through */
+	for (writes = 0; ; writes++) {
+		writes_left = writes;
+		ret = storage_set_params(&ctx, (struct storage_param[]) {
+				{ ID_TEST_INT, (int[]) { 333 }, sizeof(int) },
+				{ ID_TEST_STR, str, strlen(str) + 1 },
+				{ ID_TEST_FOO, &f, sizeof(f) },
+			}, 3);
+		writes_left = -1;
+
+		if (ret == 0)
+			break;
+
+		/* neither in RAM ... */
+		if (check_batch(333, &f, str) != 0)
+			error("failed batch is visible");
+
+		/* ... and on flash it is all or nothing: a torn commit record
+		 * may still have made it */
+		remount();
+		if (check_batch(333, &f, str) == 1) {
+			set_batch(test_int, &test_foo, test_str);
+			continue;
+		}
+
+		if (writes > 0) {
+			if (storage_get_stats(&ctx, &st) || st.batches_discarded == 0)
+				error("failed batch not discarded");
+		}
+	}
+	printf("batch committed after %d writes\n", writes);
+
+	remount();
+	if (check_batch(333, &f, str) != 1)
+		error("batch not applied after remount");
+
+	set_batch(test_int, &test_foo, test_str);
+	simple_read_test();
+
+	printf("*** Batch failure followed by single writes test\n");
+
+	/* fail each write of a batch, then write a parameter without remounting:
+	 * it must not land in the space reserved for the failed batch */
+	for (writes = 0; ; writes++) {
+		int a = 444 + writes, ra;
+
+		writes_left = writes;
+		ret = storage_set_params(&ctx, (struct storage_param[]) {
+				{ ID_TEST_INT, (int[]) { 333 }, sizeof(int) },
+				{ ID_TEST_STR, str, strlen(str) + 1 },
+				{ ID_TEST_FOO, &f, sizeof(f) },
+			}, 3);
+		writes_left = -1;
+
+		if (ret == 0)
+			break;
+
+		if (storage_set_param(&ctx, ID_TEST_INT, &a, sizeof(a)) != sizeof(a))
+			error("set_param after failed batch");
+
+		remount();
+		if (storage_get_param(&ctx, ID_TEST_INT, &ra, sizeof(ra)) != sizeof(ra) ||
+		    ra != a)
+			error("write after failed batch lost on remount");
+
+		set_batch(test_int, &test_foo, test_str);
+	}
+	printf("batch committed after %d writes\n", writes);
+
+	set_batch(test_int, &test_foo, test_str);
+	simple_read_test();
+
+	printf("Ok.\n");
+}
+
+static void compaction_test(void)
+{
+	struct storage_stats before, after;
+	int i = 0, test;
+
+	printf("*** Compaction test\n");
+
+	compact_requested = 0;
+	while (!compact_requested) {
+		if (storage_set_param(&ctx, ID_FREE_SLOT, &i, sizeof(i)) != sizeof(i))
+			error("set_param for ID_FREE_SLOT");
+		i++;
+	}
+
+	if (storage_get_stats(&ctx, &before))
+		error("get_stats");
+	if (before.free_pages * 100 >= before.total_pages * RAWSTORAGE_COMPACT_THRESHOLD)
+		error("compaction requested too early");
+
+	if (storage_compact(&ctx))
+		error("compact");
+
+	if (storage_get_stats(&ctx, &after))
+		error("get_stats");
+	if (after.bank == before.bank ||
+	    after.compactions != before.compactions + 1 ||
+	    after.free_pages != after.total_pages - after.live_pages ||
+	    after.live_params != 4)
+		error("unexpected stats after compaction");
+
+	printf("free pages %u -> %u, erases %lu/%lu\n", before.free_pages,
+		after.free_pages, after.erases[0], after.erases[1]);
+
+	simple_read_test();
+	remount();
+	simple_read_test();
+
+	if (storage_get_param(&ctx, ID_FREE_SLOT, &test, sizeof(test)) != sizeof(test) ||
+	    test != i - 1)
+		error("ID_FREE_SLOT after compaction");
+
+	printf("Ok.\n");
+}
+
 int main()
 {
 	crc32init_be();
 
-	void *storage = malloc(2 * STORAGE_SIZE);
+	storage = malloc(2 * STORAGE_SIZE);
 	if (!storage)
 		return 1;
 
@@ -429,6 +645,9 @@ int main()
 	switch_banks_test();
 	simple_read_test();
 
+	batch_test();
+	compaction_test();
+
 	printf("Unmounting...\n");
 	if (storage_ctx_close(&ctx))
 		error("storage_ctx_close failed\n");
@@ -223,6 +223,7 @@ static void __exit cryptodev_deregister(void)
 {
 	misc_deregister(&cryptodev);
 	ncr_limits_deinit();
+	ec_curves_free();
 
 #ifdef KEY_PERSISTENCE
 	if (likely(ncr)) {
@@ -7,6 +7,8 @@
 #include <linux/ctype.h>
 #include <linux/nls.h>
 #include <linux/sort.h>
+#include <linux/mutex.h>
+#include <linux/atomic.h>
 
 /* use configuration data */
 #include <tomcrypt_custom.h>
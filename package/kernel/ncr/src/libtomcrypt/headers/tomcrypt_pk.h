@@ -28,6 +28,33 @@ int rand_prime(mp_int * N, long len);
 #define MIN_RSA_SIZE 1024
 #define MAX_RSA_SIZE 8192
 
+/** Montgomery constants of one RSA modulus */
+typedef struct Rsa_mont {
+    /** -1/m mod the digit base, from mp_montgomery_setup() */
+	mp_digit rho;
+    /** R mod m, the Montgomery form of 1 */
+	mp_int one;
+    /** R^2 mod m, converts into Montgomery form */
+	mp_int RR;
+} rsa_mont;
+
+/** Uses of a blinding pair before a fresh one is drawn */
+#define RSA_BLIND_REFRESH 32
+
+/** Per key state of rsa_exptmod(), set up on the first operation */
+typedef struct Rsa_precomp {
+    /** Montgomery constants of N, p and q */
+	rsa_mont mN, mp, mq;
+    /** qP in Montgomery form mod p */
+	mp_int qP;
+    /** The blinding pair r^e and 1/r, in Montgomery form mod N */
+	mp_int blind, unblind;
+    /** Uses of the pair since it was last drawn */
+	int blind_uses;
+    /** Serialises updates of the blinding pair */
+	struct mutex lock;
+} rsa_precomp;
+
 /** RSA LTC_PKCS style key */
 typedef struct Rsa_key {
     /** Type of key, PK_PRIVATE or PK_PUBLIC */
@@ -48,6 +75,8 @@ typedef struct Rsa_key {
 	mp_int dP;
     /** The d mod (q - 1) CRT param */
 	mp_int dQ;
+    /** Cached exponentiation state, NULL until first used */
+	rsa_precomp *pre;
 } rsa_key;
 
 int rsa_make_key(int size, long e, rsa_key * key);
@@ -58,6 +87,12 @@ int rsa_exptmod(const unsigned char *in, unsigned long inlen,
 
 void rsa_free(rsa_key * key);
 
+int rsa_precomp_get(rsa_key * key, rsa_precomp ** pre);
+void rsa_precomp_free(rsa_precomp * pre);
+int rsa_blind_init(rsa_key * key, rsa_precomp * pre);
+int rsa_mont_mul(mp_int * a, mp_int * b, mp_int * m, rsa_mont * mont,
+		 mp_int * c);
+
 /* These use LTC_PKCS #1 v2.0 padding */
 #define rsa_encrypt_key(_in, _inlen, _out, _outlen, _lparam, _lparamlen, _hash, _key) \
   rsa_encrypt_key_ex(_in, _inlen, _out, _outlen, _lparam, _lparamlen, _hash, LTC_LTC_PKCS_1_OAEP, _key)
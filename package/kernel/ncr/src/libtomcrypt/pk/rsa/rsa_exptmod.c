@@ -19,6 +19,71 @@
 
 #ifdef LTC_MRSA
 
+/* tmp = tmp * r^e mod N for the key's current blinding pair, rndi = 1/r in
+ * Montgomery form; then square the pair so the next call gets a fresh one
+ * without an inversion.  Every RSA_BLIND_REFRESH uses a new r is drawn, so
+ * the pairs do not all follow from one secret */
+static int rsa_blind(rsa_key * key, rsa_precomp * pre, mp_int * tmp,
+		     mp_int * rndi)
+{
+	mp_int t1, t2;
+	int err;
+
+	if ((err = mp_init_multi(&t1, &t2, NULL)) != CRYPT_OK) {
+		return err;
+	}
+
+	mutex_lock(&pre->lock);
+
+	if (pre->blind_uses >= RSA_BLIND_REFRESH) {
+		if ((err = rsa_blind_init(key, pre)) != CRYPT_OK) {
+			goto error;
+		}
+	}
+
+	if ((err =
+	     rsa_mont_mul(tmp, &pre->blind, &key->N, &pre->mN,
+			  tmp)) != CRYPT_OK) {
+		goto error;
+	}
+	if ((err = mp_copy(&pre->unblind, rndi)) != CRYPT_OK) {
+		goto error;
+	}
+	if ((err =
+	     rsa_mont_mul(&pre->blind, &pre->blind, &key->N, &pre->mN,
+			  &t1)) != CRYPT_OK) {
+		goto error;
+	}
+	if ((err =
+	     rsa_mont_mul(&pre->unblind, &pre->unblind, &key->N, &pre->mN,
+			  &t2)) != CRYPT_OK) {
+		goto error;
+	}
+	mp_exch(&t1, &pre->blind);
+	mp_exch(&t2, &pre->unblind);
+	pre->blind_uses++;
+
+error:
+	mutex_unlock(&pre->lock);
+	mp_clear_multi(&t1, &t2, NULL);
+	return err;
+}
+
+/* y = x^d mod m through the cached Montgomery constants of m */
+static int rsa_exptmod_crt(mp_int * x, mp_int * d, mp_int * m,
+			   rsa_mont * mont, mp_int * y)
+{
+	int err;
+
+	if ((err = mp_mod(x, m, y)) != CRYPT_OK) {
+		return err;
+	}
+	if ((err = rsa_mont_mul(y, &mont->RR, m, mont, y)) != CRYPT_OK) {
+		return err;
+	}
+	return mp_exptmod_mont(y, d, m, mont->rho, &mont->one, y);
+}
+
 /** 
    Compute an RSA modular exponentiation 
    @param in         The input data to send into RSA
@@ -33,7 +98,8 @@ int rsa_exptmod(const unsigned char *in, unsigned long inlen,
 		unsigned char *out, unsigned long *outlen, int which,
 		rsa_key * key)
 {
-	mp_int tmp, tmpa, tmpb, rnd, rndi /* inverse of rnd */ ;
+	mp_int tmp, tmpa, tmpb, rndi /* inverse of rnd */ ;
+	rsa_precomp *pre;
 	unsigned long x;
 	int err;
 
@@ -52,10 +118,14 @@ int rsa_exptmod(const unsigned char *in, unsigned long inlen,
 		return CRYPT_PK_INVALID_TYPE;
 	}
 
+	/* Montgomery constants and blinding are set up once per key */
+	if ((err = rsa_precomp_get(key, &pre)) != CRYPT_OK) {
+		return err;
+	}
+
 	/* init and copy into tmp */
 	if ((err =
-	     mp_init_multi(&tmp, &tmpa, &tmpb, &rnd, &rndi,
-			   NULL)) != CRYPT_OK) {
+	     mp_init_multi(&tmp, &tmpa, &tmpb, &rndi, NULL)) != CRYPT_OK) {
 		return err;
 	}
 	if ((err =
@@ -70,41 +140,23 @@ int rsa_exptmod(const unsigned char *in, unsigned long inlen,
 		goto error;
 	}
 
-	/* are we using the private exponent and is the key optimized? */
 	if (which == PK_PRIVATE) {
 		/* do blinding */
-		err = mp_rand(&rnd, mp_count_bits(&key->N));
-		if (err != CRYPT_OK) {
-			goto error;
-		}
-
-		/* rndi = 1/rnd mod N */
-		err = mp_invmod(&rnd, &key->N, &rndi);
-		if (err != CRYPT_OK) {
-			goto error;
-		}
-
-		/* rnd = rnd^e */
-		err = mp_exptmod(&rnd, &key->e, &key->N, &rnd);
-		if (err != CRYPT_OK) {
-			goto error;
-		}
-
-		/* tmp = tmp*rnd mod N */
-		err = mp_mulmod(&tmp, &rnd, &key->N, &tmp);
-		if (err != CRYPT_OK) {
+		if ((err = rsa_blind(key, pre, &tmp, &rndi)) != CRYPT_OK) {
 			goto error;
 		}
 
 		/* tmpa = tmp^dP mod p */
 		if ((err =
-		     mp_exptmod(&tmp, &key->dP, &key->p, &tmpa)) != CRYPT_OK) {
+		     rsa_exptmod_crt(&tmp, &key->dP, &key->p, &pre->mp,
+				     &tmpa)) != CRYPT_OK) {
 			goto error;
 		}
 
 		/* tmpb = tmp^dQ mod q */
 		if ((err =
-		     mp_exptmod(&tmp, &key->dQ, &key->q, &tmpb)) != CRYPT_OK) {
+		     rsa_exptmod_crt(&tmp, &key->dQ, &key->q, &pre->mq,
+				     &tmpb)) != CRYPT_OK) {
 			goto error;
 		}
 
@@ -112,8 +164,14 @@ int rsa_exptmod(const unsigned char *in, unsigned long inlen,
 		if ((err = mp_sub(&tmpa, &tmpb, &tmp)) != CRYPT_OK) {
 			goto error;
 		}
+		while (mp_cmp_d(&tmp, 0) == LTC_MP_LT) {
+			if ((err = mp_add(&tmp, &key->p, &tmp)) != CRYPT_OK) {
+				goto error;
+			}
+		}
 		if ((err =
-		     mp_mulmod(&tmp, &key->qP, &key->p, &tmp)) != CRYPT_OK) {
+		     rsa_mont_mul(&tmp, &pre->qP, &key->p, &pre->mp,
+				  &tmp)) != CRYPT_OK) {
 			goto error;
 		}
 
@@ -126,14 +184,20 @@ int rsa_exptmod(const unsigned char *in, unsigned long inlen,
 		}
 
 		/* unblind */
-		err = mp_mulmod(&tmp, &rndi, &key->N, &tmp);
+		err = rsa_mont_mul(&tmp, &rndi, &key->N, &pre->mN, &tmp);
 		if (err != CRYPT_OK) {
 			goto error;
 		}
 	} else {
 		/* exptmod it */
 		if ((err =
-		     mp_exptmod(&tmp, &key->e, &key->N, &tmp)) != CRYPT_OK) {
+		     rsa_mont_mul(&tmp, &pre->mN.RR, &key->N, &pre->mN,
+				  &tmp)) != CRYPT_OK) {
+			goto error;
+		}
+		if ((err =
+		     mp_exptmod_mont(&tmp, &key->e, &key->N, pre->mN.rho,
+				     &pre->mN.one, &tmp)) != CRYPT_OK) {
 			goto error;
 		}
 	}
@@ -165,7 +229,7 @@ int rsa_exptmod(const unsigned char *in, unsigned long inlen,
 	/* clean up and return */
 	err = CRYPT_OK;
 error:
-	mp_clear_multi(&tmp, &tmpa, &tmpb, &rnd, &rndi, NULL);
+	mp_clear_multi(&tmp, &tmpa, &tmpb, &rndi, NULL);
 	return err;
 }
 
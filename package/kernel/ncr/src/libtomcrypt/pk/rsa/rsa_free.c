@@ -26,6 +26,8 @@ void rsa_free(rsa_key * key)
 	LTC_ARGCHKVD(key != NULL);
 	mp_clear_multi(&key->e, &key->d, &key->N, &key->dQ, &key->dP, &key->qP,
 		       &key->p, &key->q, NULL);
+	rsa_precomp_free(key->pre);
+	key->pre = NULL;
 }
 
 #endif
@@ -35,6 +35,7 @@ int rsa_import(const unsigned char *in, unsigned long inlen, rsa_key * key)
 
 	LTC_ARGCHK(in != NULL);
 	LTC_ARGCHK(key != NULL);
+	key->pre = NULL;
 
 	if (algo == NULL) {
 		return CRYPT_INVALID_ARG;
@@ -30,6 +30,7 @@ int rsa_make_key(int size, long e, rsa_key * key)
 	int err;
 
 	LTC_ARGCHK(key != NULL);
+	key->pre = NULL;
 
 	if ((size < (MIN_RSA_SIZE / 8)) || (size > (MAX_RSA_SIZE / 8))) {
 		return CRYPT_INVALID_KEYSIZE;
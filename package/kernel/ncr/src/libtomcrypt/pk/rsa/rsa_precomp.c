@@ -0,0 +1,212 @@
+/* LibTomCrypt, modular cryptographic library -- Tom St Denis
+ *
+ * LibTomCrypt is a library that provides various cryptographic
+ * algorithms in a highly modular and flexible manner.
+ *
+ * The library is free for all purposes without any express
+ * guarantee it works.
+ *
+ * Tom St Denis, tomstdenis@gmail.com, http://libtom.org
+ */
+#include "tomcrypt.h"
+
+/**
+  @file rsa_precomp.c
+  Per key Montgomery constants and blinding for rsa_exptmod()
+*/
+
+#ifdef LTC_MRSA
+
+/**
+  Montgomery multiplication, c = a*b/R mod m
+  @param a      First operand, 0 <= a < m
+  @param b      Second operand, 0 <= b < m
+  @param m      The modulus
+  @param mont   The Montgomery constants of m
+  @param c      [out] The result (may alias a or b)
+  @return CRYPT_OK if successful
+*/
+int rsa_mont_mul(mp_int * a, mp_int * b, mp_int * m, rsa_mont * mont,
+		 mp_int * c)
+{
+	int err;
+
+	if ((err = mp_mul(a, b, c)) != CRYPT_OK) {
+		return err;
+	}
+	return mp_montgomery_reduce(c, m, mont->rho);
+}
+
+static int rsa_mont_init(rsa_mont * mont, mp_int * m)
+{
+	int err;
+
+	if ((err = mp_montgomery_setup(m, &mont->rho)) != CRYPT_OK) {
+		return err;
+	}
+	if ((err = mp_montgomery_calc_normalization(&mont->one, m)) != CRYPT_OK) {
+		return err;
+	}
+	return mp_mulmod(&mont->one, &mont->one, m, &mont->RR);
+}
+
+/**
+  Draw a new blinding pair for a key: a random r mod N, stored as r^e and
+  1/r.  rsa_exptmod() squares the pair after every use and calls this
+  again every RSA_BLIND_REFRESH uses.  The caller serialises the update.
+  @param key    The RSA key
+  @param pre    The key's state
+  @return CRYPT_OK if successful, the old pair is kept otherwise
+*/
+int rsa_blind_init(rsa_key * key, rsa_precomp * pre)
+{
+	unsigned char *buf;
+	unsigned long len;
+	mp_int r, blind, unblind;
+	int err, tries;
+
+	len = mp_unsigned_bin_size(&key->N);
+	buf = XMALLOC(len);
+	if (buf == NULL) {
+		return CRYPT_MEM;
+	}
+	if ((err = mp_init_multi(&r, &blind, &unblind, NULL)) != CRYPT_OK) {
+		XFREE(buf);
+		return err;
+	}
+
+	for (tries = 0;; tries++) {
+		get_random_bytes(buf, len);
+		if ((err = mp_read_unsigned_bin(&r, buf, len)) != CRYPT_OK) {
+			goto error;
+		}
+		if ((err = mp_mod(&r, &key->N, &r)) != CRYPT_OK) {
+			goto error;
+		}
+
+		/* only fails if r shares a factor with N */
+		err = mp_invmod(&r, &key->N, &unblind);
+		if (err == CRYPT_OK && mp_iszero(&r) == MP_NO) {
+			break;
+		}
+		if (err != CRYPT_OK && err != MP_VAL) {
+			goto error;
+		}
+		if (tries == 4) {
+			err = CRYPT_ERROR;
+			goto error;
+		}
+	}
+
+	if ((err = mp_exptmod(&r, &key->e, &key->N, &blind)) != CRYPT_OK) {
+		goto error;
+	}
+
+	/* both are used as Montgomery multipliers mod N */
+	if ((err = rsa_mont_mul(&blind, &pre->mN.RR, &key->N, &pre->mN,
+				&blind)) != CRYPT_OK) {
+		goto error;
+	}
+	if ((err = rsa_mont_mul(&unblind, &pre->mN.RR, &key->N,
+				&pre->mN, &unblind)) != CRYPT_OK) {
+		goto error;
+	}
+
+	mp_exch(&blind, &pre->blind);
+	mp_exch(&unblind, &pre->unblind);
+	pre->blind_uses = 0;
+	err = CRYPT_OK;
+error:
+	zeromem(buf, len);
+	XFREE(buf);
+	mp_clear_multi(&r, &blind, &unblind, NULL);
+	return err;
+}
+
+/**
+  Return the cached exponentiation state of a key, setting it up on the
+  first call.  The state is never modified once published, except for the
+  blinding pair which is protected by its lock.
+  @param key    The RSA key
+  @param pre    [out] The key's state
+  @return CRYPT_OK if successful
+*/
+int rsa_precomp_get(rsa_key * key, rsa_precomp ** pre)
+{
+	rsa_precomp *p, *old;
+	int err;
+
+	LTC_ARGCHK(key != NULL);
+	LTC_ARGCHK(pre != NULL);
+
+	p = ACCESS_ONCE(key->pre);
+	if (p != NULL) {
+		smp_read_barrier_depends();
+		*pre = p;
+		return CRYPT_OK;
+	}
+
+	p = XCALLOC(1, sizeof(*p));
+	if (p == NULL) {
+		return CRYPT_MEM;
+	}
+	if ((err = mp_init_multi(&p->mN.one, &p->mN.RR, &p->mp.one, &p->mp.RR,
+				 &p->mq.one, &p->mq.RR, &p->qP, &p->blind,
+				 &p->unblind, NULL)) != CRYPT_OK) {
+		XFREE(p);
+		return err;
+	}
+	mutex_init(&p->lock);
+
+	if ((err = rsa_mont_init(&p->mN, &key->N)) != CRYPT_OK) {
+		goto error;
+	}
+
+	if (key->type == PK_PRIVATE) {
+		if ((err = rsa_mont_init(&p->mp, &key->p)) != CRYPT_OK) {
+			goto error;
+		}
+		if ((err = rsa_mont_init(&p->mq, &key->q)) != CRYPT_OK) {
+			goto error;
+		}
+		if ((err = rsa_mont_mul(&key->qP, &p->mp.RR, &key->p, &p->mp,
+					&p->qP)) != CRYPT_OK) {
+			goto error;
+		}
+		if ((err = rsa_blind_init(key, p)) != CRYPT_OK) {
+			goto error;
+		}
+	}
+
+	/* two sessions may set up the same key at once; keep the first */
+	old = cmpxchg(&key->pre, NULL, p);
+	if (old != NULL) {
+		rsa_precomp_free(p);
+		p = old;
+	}
+
+	*pre = p;
+	return CRYPT_OK;
+
+error:
+	rsa_precomp_free(p);
+	return err;
+}
+
+/**
+  Free the cached exponentiation state of a key
+  @param pre    The state, may be NULL
+*/
+void rsa_precomp_free(rsa_precomp * pre)
+{
+	if (pre == NULL) {
+		return;
+	}
+
+	mp_clear_multi(&pre->mN.one, &pre->mN.RR, &pre->mp.one, &pre->mp.RR,
+		       &pre->mq.one, &pre->mq.RR, &pre->qP, &pre->blind,
+		       &pre->unblind, NULL);
+	XFREE(pre);
+}
+
+#endif
@@ -0,0 +1,218 @@
+#include <tommath.h>
+#ifdef BN_MP_EXPTMOD_MONT_C
+/* LibTomMath, multiple-precision integer library -- Tom St Denis
+ *
+ * LibTomMath is a library that provides multiple-precision
+ * integer arithmetic as well as number theoretic functionality.
+ *
+ * The library was designed directly after the MPI library by
+ * Michael Fromberger but has been written from scratch with
+ * additional optimizations in place.
+ *
+ * The library is free for all purposes without any express
+ * guarantee it works.
+ *
+ * Tom St Denis, tomstdenis@gmail.com, http://libtom.org
+ */
+
+/* computes Y == G**X mod P for an odd P whose Montgomery constants the
+ * caller keeps: rho from mp_montgomery_setup() and one == R mod P.
+ * G must already be in Montgomery form (G*R mod P, 0 <= G < P); Y is
+ * returned in normal form.
+ *
+ * This is mp_exptmod_fast() without the per call setup, for callers that
+ * exponentiate modulo the same P many times (RSA keys).  The window table
+ * is taken from the heap, so the window is not limited by MP_LOW_MEM.
+ */
+
+#define MONT_MAX_WINSIZE 6
+
+int mp_exptmod_mont(mp_int * G, mp_int * X, mp_int * P, mp_digit rho,
+		    mp_int * one, mp_int * Y)
+{
+	mp_int *M, res;
+	mp_digit buf;
+	int err, bitbuf, bitcpy, bitcnt, mode, digidx, x, y, winsize;
+	int (*redux) (mp_int *, mp_int *, mp_digit);
+
+	/* find window size */
+	x = mp_count_bits(X);
+	if (x <= 7) {
+		winsize = 2;
+	} else if (x <= 36) {
+		winsize = 3;
+	} else if (x <= 140) {
+		winsize = 4;
+	} else if (x <= 450) {
+		winsize = 5;
+	} else {
+		winsize = MONT_MAX_WINSIZE;
+	}
+
+	/* only M[1] and the upper half of the table are used */
+	M = OPT_CAST(mp_int) XMALLOC(sizeof(mp_int) << winsize);
+	if (M == NULL) {
+		return MP_MEM;
+	}
+
+	if ((err = mp_init_copy(&M[1], G)) != MP_OKAY) {
+		goto LBL_FREE;
+	}
+	for (x = 1 << (winsize - 1); x < (1 << winsize); x++) {
+		if ((err = mp_init_size(&M[x], P->used * 2 + 1)) != MP_OKAY) {
+			for (y = 1 << (winsize - 1); y < x; y++) {
+				mp_clear(&M[y]);
+			}
+			mp_clear(&M[1]);
+			goto LBL_FREE;
+		}
+	}
+
+	/* same choice as mp_montgomery_reduce() makes internally */
+	if (((P->used * 2 + 1) < MP_WARRAY) &&
+	    P->used < (1 << ((CHAR_BIT * sizeof(mp_word)) - (2 * DIGIT_BIT)))) {
+		redux = fast_mp_montgomery_reduce;
+	} else {
+		redux = mp_montgomery_reduce;
+	}
+
+	/* res = 1 in Montgomery form */
+	if ((err = mp_init_size(&res, P->used * 2 + 1)) != MP_OKAY) {
+		goto LBL_M;
+	}
+	if ((err = mp_copy(one, &res)) != MP_OKAY) {
+		goto LBL_RES;
+	}
+
+	/* compute the value at M[1<<(winsize-1)] by squaring M[1] (winsize-1) times */
+	if ((err = mp_copy(&M[1], &M[1 << (winsize - 1)])) != MP_OKAY) {
+		goto LBL_RES;
+	}
+
+	for (x = 0; x < (winsize - 1); x++) {
+		if ((err =
+		     mp_sqr(&M[1 << (winsize - 1)],
+			    &M[1 << (winsize - 1)])) != MP_OKAY) {
+			goto LBL_RES;
+		}
+		if ((err = redux(&M[1 << (winsize - 1)], P, rho)) != MP_OKAY) {
+			goto LBL_RES;
+		}
+	}
+
+	/* create upper table */
+	for (x = (1 << (winsize - 1)) + 1; x < (1 << winsize); x++) {
+		if ((err = mp_mul(&M[x - 1], &M[1], &M[x])) != MP_OKAY) {
+			goto LBL_RES;
+		}
+		if ((err = redux(&M[x], P, rho)) != MP_OKAY) {
+			goto LBL_RES;
+		}
+	}
+
+	/* left-to-right sliding window, as in mp_exptmod_fast() */
+	mode = 0;
+	bitcnt = 1;
+	buf = 0;
+	digidx = X->used - 1;
+	bitcpy = 0;
+	bitbuf = 0;
+
+	for (;;) {
+		/* grab next digit as required */
+		if (--bitcnt == 0) {
+			if (digidx == -1) {
+				break;
+			}
+			buf = X->dp[digidx--];
+			bitcnt = (int)DIGIT_BIT;
+		}
+
+		/* grab the next msb from the exponent */
+		y = (mp_digit) (buf >> (DIGIT_BIT - 1)) & 1;
+		buf <<= (mp_digit) 1;
+
+		/* skip leading zero bits */
+		if (mode == 0 && y == 0) {
+			continue;
+		}
+
+		/* a zero bit outside a window is a plain squaring */
+		if (mode == 1 && y == 0) {
+			if ((err = mp_sqr(&res, &res)) != MP_OKAY) {
+				goto LBL_RES;
+			}
+			if ((err = redux(&res, P, rho)) != MP_OKAY) {
+				goto LBL_RES;
+			}
+			continue;
+		}
+
+		/* else we add it to the window */
+		bitbuf |= (y << (winsize - ++bitcpy));
+		mode = 2;
+
+		if (bitcpy == winsize) {
+			for (x = 0; x < winsize; x++) {
+				if ((err = mp_sqr(&res, &res)) != MP_OKAY) {
+					goto LBL_RES;
+				}
+				if ((err = redux(&res, P, rho)) != MP_OKAY) {
+					goto LBL_RES;
+				}
+			}
+
+			if ((err = mp_mul(&res, &M[bitbuf], &res)) != MP_OKAY) {
+				goto LBL_RES;
+			}
+			if ((err = redux(&res, P, rho)) != MP_OKAY) {
+				goto LBL_RES;
+			}
+
+			bitcpy = 0;
+			bitbuf = 0;
+			mode = 1;
+		}
+	}
+
+	/* if bits remain then square/multiply */
+	if (mode == 2 && bitcpy > 0) {
+		for (x = 0; x < bitcpy; x++) {
+			if ((err = mp_sqr(&res, &res)) != MP_OKAY) {
+				goto LBL_RES;
+			}
+			if ((err = redux(&res, P, rho)) != MP_OKAY) {
+				goto LBL_RES;
+			}
+
+			bitbuf <<= 1;
+			if ((bitbuf & (1 << winsize)) != 0) {
+				if ((err =
+				     mp_mul(&res, &M[1], &res)) != MP_OKAY) {
+					goto LBL_RES;
+				}
+				if ((err = redux(&res, P, rho)) != MP_OKAY) {
+					goto LBL_RES;
+				}
+			}
+		}
+	}
+
+	/* leave the Montgomery domain */
+	if ((err = redux(&res, P, rho)) != MP_OKAY) {
+		goto LBL_RES;
+	}
+
+	mp_exch(&res, Y);
+	err = MP_OKAY;
+LBL_RES:mp_clear(&res);
+LBL_M:
+	mp_clear(&M[1]);
+	for (x = 1 << (winsize - 1); x < (1 << winsize); x++) {
+		mp_clear(&M[x]);
+	}
+LBL_FREE:
+	XFREE(M);
+	return err;
+}
+#endif
@@ -426,6 +426,11 @@ int mp_reduce_2k_l(mp_int * a, mp_int * n, mp_int * d);
 /* d = a**b (mod c) */
 int mp_exptmod(mp_int * a, mp_int * b, mp_int * c, mp_int * d);
 
+/* Y = G**X (mod P) with G in Montgomery form and the Montgomery constants
+ * of P (rho, one == R mod P) supplied by the caller */
+int mp_exptmod_mont(mp_int * G, mp_int * X, mp_int * P, mp_digit rho,
+		    mp_int * one, mp_int * Y);
+
 /* ---> Primes <--- */
 
 /* number of primes */
@@ -41,6 +41,7 @@
 #define BN_MP_EXPT_D_C
 #define BN_MP_EXPTMOD_C
 #define BN_MP_EXPTMOD_FAST_C
+#define BN_MP_EXPTMOD_MONT_C
 #define BN_MP_EXTEUCLID_C
 #define BN_MP_FREAD_C
 #define BN_MP_FWRITE_C
@@ -358,6 +359,19 @@
 #define BN_MP_EXCH_C
 #endif
 
+#if defined(BN_MP_EXPTMOD_MONT_C)
+#define BN_MP_COUNT_BITS_C
+#define BN_MP_INIT_COPY_C
+#define BN_MP_INIT_SIZE_C
+#define BN_MP_CLEAR_C
+#define BN_FAST_MP_MONTGOMERY_REDUCE_C
+#define BN_MP_MONTGOMERY_REDUCE_C
+#define BN_MP_COPY_C
+#define BN_MP_SQR_C
+#define BN_MP_MUL_C
+#define BN_MP_EXCH_C
+#endif
+
 #if defined(BN_MP_EXTEUCLID_C)
 #define BN_MP_INIT_MULTI_C
 #define BN_MP_SET_C
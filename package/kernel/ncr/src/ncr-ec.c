@@ -0,0 +1,1339 @@
+/*
+ * New driver for /dev/ncr device (aka NCR)
+ *
+ * ECDSA and ECDH on the NIST P-256 and P-384 curves.
+ *
+ * This file is part of linux cryptodev.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/ioctl.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#include <linux/mutex.h>
+#include <ncr.h>
+#include <ncr-int.h>
+#include <tomcrypt.h>
+#include <ncr-ec.h>
+
+/* Points are kept in Jacobian coordinates, (X, Y, Z) standing for the
+ * affine point (X/Z^2, Y/Z^3), with all coordinates in Montgomery form
+ * so that a field multiplication is mp_mul() + mp_montgomery_reduce().
+ * Z == 0 is the point at infinity.
+ *
+ * The scalar multiplications do not branch on the scalar: the ladder
+ * swaps its two points with masks, and the comb reads every table entry
+ * on every step. The libtommath field arithmetic underneath is not
+ * hardened in the same way.
+ */
+typedef struct {
+	mp_int x, y, z;
+} ec_point;
+
+/* Multiplications by the generator use a fixed-base comb with EC_COMB_W
+ * teeth. Entry j of the table is the sum of 2^(i*d)G over the bits i set
+ * in j, so kG takes d doublings and d mixed additions, d being
+ * ceil(bits/EC_COMB_W), instead of the 'bits' steps of the ladder.
+ */
+#define EC_COMB_W	5
+#define EC_COMB_SIZE	(1 << EC_COMB_W)
+
+#define EC_MAX_SIZE	48
+#define EC_SCRATCH	8
+
+#define EC_CHK(x) do { if ((err = (x)) != MP_OKAY) goto out; } while (0)
+
+struct ec_curve {
+	ncr_ecc_curve_t id;
+	int size;		/* bytes in p and n */
+	const uint8_t *p, *b, *n, *gx, *gy;
+	unsigned long oid[8];
+	unsigned long oid_len;
+
+	/* filled in on first use by ec_curve_get() */
+	int ready;
+	mp_int P, B, N;
+	mp_int one;		/* 1 in Montgomery form */
+	mp_digit mp;
+	int digits;		/* digits in p */
+	int bits;		/* bits in n */
+	int comb_d;
+	mp_digit *comb;		/* affine x, y of each entry, Montgomery form */
+};
+
+static const uint8_t p256_p[] = {
+	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+static const uint8_t p256_b[] = {
+	0x5a, 0xc6, 0x35, 0xd8, 0xaa, 0x3a, 0x93, 0xe7,
+	0xb3, 0xeb, 0xbd, 0x55, 0x76, 0x98, 0x86, 0xbc,
+	0x65, 0x1d, 0x06, 0xb0, 0xcc, 0x53, 0xb0, 0xf6,
+	0x3b, 0xce, 0x3c, 0x3e, 0x27, 0xd2, 0x60, 0x4b,
+};
+
+static const uint8_t p256_n[] = {
+	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xbc, 0xe6, 0xfa, 0xad, 0xa7, 0x17, 0x9e, 0x84,
+	0xf3, 0xb9, 0xca, 0xc2, 0xfc, 0x63, 0x25, 0x51,
+};
+
+static const uint8_t p256_gx[] = {
+	0x6b, 0x17, 0xd1, 0xf2, 0xe1, 0x2c, 0x42, 0x47,
+	0xf8, 0xbc, 0xe6, 0xe5, 0x63, 0xa4, 0x40, 0xf2,
+	0x77, 0x03, 0x7d, 0x81, 0x2d, 0xeb, 0x33, 0xa0,
+	0xf4, 0xa1, 0x39, 0x45, 0xd8, 0x98, 0xc2, 0x96,
+};
+
+static const uint8_t p256_gy[] = {
+	0x4f, 0xe3, 0x42, 0xe2, 0xfe, 0x1a, 0x7f, 0x9b,
+	0x8e, 0xe7, 0xeb, 0x4a, 0x7c, 0x0f, 0x9e, 0x16,
+	0x2b, 0xce, 0x33, 0x57, 0x6b, 0x31, 0x5e, 0xce,
+	0xcb, 0xb6, 0x40, 0x68, 0x37, 0xbf, 0x51, 0xf5,
+};
+
+static const uint8_t p384_p[] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+};
+
+static const uint8_t p384_b[] = {
+	0xb3, 0x31, 0x2f, 0xa7, 0xe2, 0x3e, 0xe7, 0xe4,
+	0x98, 0x8e, 0x05, 0x6b, 0xe3, 0xf8, 0x2d, 0x19,
+	0x18, 0x1d, 0x9c, 0x6e, 0xfe, 0x81, 0x41, 0x12,
+	0x03, 0x14, 0x08, 0x8f, 0x50, 0x13, 0x87, 0x5a,
+	0xc6, 0x56, 0x39, 0x8d, 0x8a, 0x2e, 0xd1, 0x9d,
+	0x2a, 0x85, 0xc8, 0xed, 0xd3, 0xec, 0x2a, 0xef,
+};
+
+static const uint8_t p384_n[] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xc7, 0x63, 0x4d, 0x81, 0xf4, 0x37, 0x2d, 0xdf,
+	0x58, 0x1a, 0x0d, 0xb2, 0x48, 0xb0, 0xa7, 0x7a,
+	0xec, 0xec, 0x19, 0x6a, 0xcc, 0xc5, 0x29, 0x73,
+};
+
+static const uint8_t p384_gx[] = {
+	0xaa, 0x87, 0xca, 0x22, 0xbe, 0x8b, 0x05, 0x37,
+	0x8e, 0xb1, 0xc7, 0x1e, 0xf3, 0x20, 0xad, 0x74,
+	0x6e, 0x1d, 0x3b, 0x62, 0x8b, 0xa7, 0x9b, 0x98,
+	0x59, 0xf7, 0x41, 0xe0, 0x82, 0x54, 0x2a, 0x38,
+	0x55, 0x02, 0xf2, 0x5d, 0xbf, 0x55, 0x29, 0x6c,
+	0x3a, 0x54, 0x5e, 0x38, 0x72, 0x76, 0x0a, 0xb7,
+};
+
+static const uint8_t p384_gy[] = {
+	0x36, 0x17, 0xde, 0x4a, 0x96, 0x26, 0x2c, 0x6f,
+	0x5d, 0x9e, 0x98, 0xbf, 0x92, 0x92, 0xdc, 0x29,
+	0xf8, 0xf4, 0x1d, 0xbd, 0x28, 0x9a, 0x14, 0x7c,
+	0xe9, 0xda, 0x31, 0x13, 0xb5, 0xf0, 0xb8, 0xc0,
+	0x0a, 0x60, 0xb1, 0xce, 0x1d, 0x7e, 0x81, 0x9d,
+	0x7a, 0x43, 0x1d, 0x7c, 0x90, 0xea, 0x0e, 0x5f,
+};
+
+static struct ec_curve ec_curves[] = {
+	{.id = NCR_ECC_CURVE_P256,.size = 32,
+	 .p = p256_p,.b = p256_b,.n = p256_n,.gx = p256_gx,.gy = p256_gy,
+	 .oid = {1, 2, 840, 10045, 3, 1, 7},.oid_len = 7},
+	{.id = NCR_ECC_CURVE_P384,.size = 48,
+	 .p = p384_p,.b = p384_b,.n = p384_n,.gx = p384_gx,.gy = p384_gy,
+	 .oid = {1, 3, 132, 0, 34},.oid_len = 5},
+};
+
+static DEFINE_MUTEX(ec_curves_mutex);
+
+static int ec_mperr(int err)
+{
+	return err == MP_MEM ? -ENOMEM : -EINVAL;
+}
+
+/* field arithmetic, all operands reduced mod p */
+
+static int fe_mul(struct ec_curve *c, mp_int * a, mp_int * b, mp_int * r)
+{
+	int err;
+
+	if ((err = mp_mul(a, b, r)) != MP_OKAY)
+		return err;
+	return mp_montgomery_reduce(r, &c->P, c->mp);
+}
+
+static int fe_sqr(struct ec_curve *c, mp_int * a, mp_int * r)
+{
+	int err;
+
+	if ((err = mp_sqr(a, r)) != MP_OKAY)
+		return err;
+	return mp_montgomery_reduce(r, &c->P, c->mp);
+}
+
+static int fe_add(struct ec_curve *c, mp_int * a, mp_int * b, mp_int * r)
+{
+	int err;
+
+	if ((err = mp_add(a, b, r)) != MP_OKAY)
+		return err;
+	if (mp_cmp(r, &c->P) != MP_LT)
+		return mp_sub(r, &c->P, r);
+	return MP_OKAY;
+}
+
+static int fe_sub(struct ec_curve *c, mp_int * a, mp_int * b, mp_int * r)
+{
+	int err;
+
+	if ((err = mp_sub(a, b, r)) != MP_OKAY)
+		return err;
+	if (r->sign == MP_NEG)
+		return mp_add(r, &c->P, r);
+	return MP_OKAY;
+}
+
+static int fe_to_mont(struct ec_curve *c, mp_int * a, mp_int * r)
+{
+	return mp_mulmod(a, &c->one, &c->P, r);
+}
+
+static int fe_from_mont(struct ec_curve *c, mp_int * a, mp_int * r)
+{
+	int err;
+
+	if ((err = mp_copy(a, r)) != MP_OKAY)
+		return err;
+	return mp_montgomery_reduce(r, &c->P, c->mp);
+}
+
+/* branch free helpers for the scalar multiplications */
+
+static int ec_bit(mp_int * k, int i)
+{
+	return (k->dp[i / DIGIT_BIT] >> (i % DIGIT_BIT)) & 1;
+}
+
+static int ec_nonzero(unsigned int x)
+{
+	return (x | (0U - x)) >> (sizeof(x) * 8 - 1);
+}
+
+/* a = bit ? b : a, over the low 'digits' digits. Both must have at
+ * least that many digits allocated; digits above 'used' are zero. */
+static void ec_mp_cmov(mp_int * a, mp_int * b, int bit, int digits)
+{
+	mp_digit mask = (mp_digit) 0 - (mp_digit) bit;
+	int i;
+
+	for (i = 0; i < digits; i++)
+		a->dp[i] ^= (a->dp[i] ^ b->dp[i]) & mask;
+	a->used ^= (a->used ^ b->used) & -bit;
+}
+
+static void ec_mp_cswap(mp_int * a, mp_int * b, int bit, int digits)
+{
+	mp_digit mask = (mp_digit) 0 - (mp_digit) bit, d;
+	int i, u;
+
+	for (i = 0; i < digits; i++) {
+		d = (a->dp[i] ^ b->dp[i]) & mask;
+		a->dp[i] ^= d;
+		b->dp[i] ^= d;
+	}
+	u = (a->used ^ b->used) & -bit;
+	a->used ^= u;
+	b->used ^= u;
+}
+
+static void ec_point_cmov(struct ec_curve *c, ec_point * a, ec_point * b,
+			  int bit)
+{
+	ec_mp_cmov(&a->x, &b->x, bit, c->digits);
+	ec_mp_cmov(&a->y, &b->y, bit, c->digits);
+	ec_mp_cmov(&a->z, &b->z, bit, c->digits);
+}
+
+static void ec_point_cswap(struct ec_curve *c, ec_point * a, ec_point * b,
+			   int bit)
+{
+	ec_mp_cswap(&a->x, &b->x, bit, c->digits);
+	ec_mp_cswap(&a->y, &b->y, bit, c->digits);
+	ec_mp_cswap(&a->z, &b->z, bit, c->digits);
+}
+
+/* Loads comb entry 'idx' into the affine point q, touching every entry */
+static void ec_comb_select(struct ec_curve *c, ec_point * q, int idx)
+{
+	const mp_digit *e = c->comb;
+	mp_digit mask;
+	int i, j, n = c->digits;
+
+	mp_zero(&q->x);
+	mp_zero(&q->y);
+	for (j = 0; j < EC_COMB_SIZE; j++, e += 2 * n) {
+		mask = (mp_digit) ec_nonzero(j ^ idx) - 1;
+		for (i = 0; i < n; i++) {
+			q->x.dp[i] |= e[i] & mask;
+			q->y.dp[i] |= e[n + i] & mask;
+		}
+	}
+	q->x.used = q->y.used = n;
+	mp_clamp(&q->x);
+	mp_clamp(&q->y);
+}
+
+static int ec_point_init(struct ec_curve *c, ec_point * pt)
+{
+	int err, size = 2 * c->digits + 2;
+
+	if ((err = mp_init_size(&pt->x, size)) != MP_OKAY)
+		return err;
+	if ((err = mp_init_size(&pt->y, size)) != MP_OKAY) {
+		mp_clear(&pt->x);
+		return err;
+	}
+	if ((err = mp_init_size(&pt->z, size)) != MP_OKAY) {
+		mp_clear_multi(&pt->x, &pt->y, NULL);
+		return err;
+	}
+	return MP_OKAY;
+}
+
+static void ec_point_free(ec_point * pt)
+{
+	mp_clear_multi(&pt->x, &pt->y, &pt->z, NULL);
+}
+
+static int ec_point_copy(ec_point * src, ec_point * dst)
+{
+	int err;
+
+	EC_CHK(mp_copy(&src->x, &dst->x));
+	EC_CHK(mp_copy(&src->y, &dst->y));
+	EC_CHK(mp_copy(&src->z, &dst->z));
+out:
+	return err;
+}
+
+/* Sets up an affine point from normal (x, y) */
+static int ec_point_set(struct ec_curve *c, ec_point * pt, mp_int * x,
+			mp_int * y)
+{
+	int err;
+
+	EC_CHK(fe_to_mont(c, x, &pt->x));
+	EC_CHK(fe_to_mont(c, y, &pt->y));
+	EC_CHK(mp_copy(&c->one, &pt->z));
+out:
+	return err;
+}
+
+static int ec_scratch_init(struct ec_curve *c, mp_int * t)
+{
+	int i, err;
+
+	for (i = 0; i < EC_SCRATCH; i++) {
+		if ((err = mp_init_size(&t[i], 2 * c->digits + 2)) != MP_OKAY) {
+			while (--i >= 0)
+				mp_clear(&t[i]);
+			return err;
+		}
+	}
+	return MP_OKAY;
+}
+
+static void ec_scratch_free(mp_int * t)
+{
+	int i;
+
+	for (i = 0; i < EC_SCRATCH; i++)
+		mp_clear(&t[i]);
+}
+
+/* r = 2p, "dbl-2001-b" for a = -3. r may be p. */
+static int ec_dbl(struct ec_curve *c, ec_point * p, ec_point * r, mp_int * t)
+{
+	int err;
+
+	EC_CHK(fe_sqr(c, &p->z, &t[0]));	/* delta = Z1^2 */
+	EC_CHK(fe_sqr(c, &p->y, &t[1]));	/* gamma = Y1^2 */
+	EC_CHK(fe_mul(c, &p->x, &t[1], &t[2]));	/* beta = X1*gamma */
+	EC_CHK(fe_sub(c, &p->x, &t[0], &t[3]));
+	EC_CHK(fe_add(c, &p->x, &t[0], &t[4]));
+	EC_CHK(fe_mul(c, &t[3], &t[4], &t[3]));
+	EC_CHK(fe_add(c, &t[3], &t[3], &t[4]));
+	EC_CHK(fe_add(c, &t[4], &t[3], &t[3]));	/* alpha = 3(X1-delta)(X1+delta) */
+	EC_CHK(fe_add(c, &p->y, &p->z, &t[4]));
+	EC_CHK(fe_sqr(c, &t[4], &t[4]));
+	EC_CHK(fe_sub(c, &t[4], &t[1], &t[4]));
+	EC_CHK(fe_sub(c, &t[4], &t[0], &t[4]));	/* Z3 = (Y1+Z1)^2-gamma-delta */
+	EC_CHK(fe_add(c, &t[2], &t[2], &t[5]));
+	EC_CHK(fe_add(c, &t[5], &t[5], &t[5]));	/* 4beta */
+	EC_CHK(fe_add(c, &t[5], &t[5], &t[6]));	/* 8beta */
+	EC_CHK(fe_sqr(c, &t[3], &t[7]));
+	EC_CHK(fe_sub(c, &t[7], &t[6], &t[7]));	/* X3 = alpha^2-8beta */
+	EC_CHK(fe_sub(c, &t[5], &t[7], &t[5]));
+	EC_CHK(fe_mul(c, &t[5], &t[3], &t[5]));
+	EC_CHK(fe_sqr(c, &t[1], &t[1]));
+	EC_CHK(fe_add(c, &t[1], &t[1], &t[1]));
+	EC_CHK(fe_add(c, &t[1], &t[1], &t[1]));
+	EC_CHK(fe_add(c, &t[1], &t[1], &t[1]));	/* 8gamma^2 */
+	EC_CHK(fe_sub(c, &t[5], &t[1], &t[5]));	/* Y3 = alpha(4beta-X3)-8gamma^2 */
+
+	mp_exch(&r->x, &t[7]);
+	mp_exch(&r->y, &t[5]);
+	mp_exch(&r->z, &t[4]);
+out:
+	return err;
+}
+
+/* r = p + q, q affine (Z2 == 1) when q_affine is set. r may be p or q.
+ * Neither infinity nor p == q is handled; on return t[4] holds H, which
+ * is zero exactly when p == +/-q, for callers that need to check. */
+static int ec_add(struct ec_curve *c, ec_point * p, ec_point * q,
+		  int q_affine, ec_point * r, mp_int * t)
+{
+	int err;
+
+	if (q_affine) {
+		EC_CHK(mp_copy(&p->x, &t[0]));	/* U1 = X1 */
+		EC_CHK(mp_copy(&p->y, &t[1]));	/* S1 = Y1 */
+	} else {
+		EC_CHK(fe_sqr(c, &q->z, &t[6]));
+		EC_CHK(fe_mul(c, &p->x, &t[6], &t[0]));	/* U1 = X1*Z2^2 */
+		EC_CHK(fe_mul(c, &t[6], &q->z, &t[6]));
+		EC_CHK(fe_mul(c, &p->y, &t[6], &t[1]));	/* S1 = Y1*Z2^3 */
+	}
+	EC_CHK(fe_sqr(c, &p->z, &t[6]));
+	EC_CHK(fe_mul(c, &q->x, &t[6], &t[2]));	/* U2 = X2*Z1^2 */
+	EC_CHK(fe_mul(c, &t[6], &p->z, &t[6]));
+	EC_CHK(fe_mul(c, &q->y, &t[6], &t[3]));	/* S2 = Y2*Z1^3 */
+	EC_CHK(fe_sub(c, &t[2], &t[0], &t[4]));	/* H = U2-U1 */
+	EC_CHK(fe_sub(c, &t[3], &t[1], &t[5]));	/* r = S2-S1 */
+	EC_CHK(fe_mul(c, &p->z, &t[4], &t[7]));
+	if (!q_affine)
+		EC_CHK(fe_mul(c, &t[7], &q->z, &t[7]));	/* Z3 = Z1*Z2*H */
+	EC_CHK(fe_sqr(c, &t[4], &t[6]));	/* H^2 */
+	EC_CHK(fe_mul(c, &t[6], &t[4], &t[2]));	/* H^3 */
+	EC_CHK(fe_mul(c, &t[0], &t[6], &t[0]));	/* U1*H^2 */
+	EC_CHK(fe_sqr(c, &t[5], &t[3]));
+	EC_CHK(fe_sub(c, &t[3], &t[2], &t[3]));
+	EC_CHK(fe_sub(c, &t[3], &t[0], &t[3]));
+	EC_CHK(fe_sub(c, &t[3], &t[0], &t[3]));	/* X3 = r^2-H^3-2U1*H^2 */
+	EC_CHK(fe_sub(c, &t[0], &t[3], &t[6]));
+	EC_CHK(fe_mul(c, &t[6], &t[5], &t[6]));
+	EC_CHK(fe_mul(c, &t[1], &t[2], &t[1]));
+	EC_CHK(fe_sub(c, &t[6], &t[1], &t[6]));	/* Y3 = r(U1*H^2-X3)-S1*H^3 */
+
+	mp_exch(&r->x, &t[3]);
+	mp_exch(&r->y, &t[6]);
+	mp_exch(&r->z, &t[7]);
+out:
+	return err;
+}
+
+/* r = p + q for public points, handling all the special cases.
+ * r must be distinct from p and q. */
+static int ec_add_checked(struct ec_curve *c, ec_point * p, ec_point * q,
+			  ec_point * r, mp_int * t)
+{
+	int err;
+
+	if (mp_iszero(&p->z))
+		return ec_point_copy(q, r);
+	if (mp_iszero(&q->z))
+		return ec_point_copy(p, r);
+
+	EC_CHK(ec_add(c, p, q, 0, r, t));
+	if (mp_iszero(&t[4])) {
+		if (mp_iszero(&t[5]))
+			return ec_dbl(c, p, r, t);
+		mp_zero(&r->z);
+	}
+out:
+	return err;
+}
+
+/* random 0 < r < mod */
+static int ec_rand(struct ec_curve *c, mp_int * mod, mp_int * r)
+{
+	uint8_t buf[EC_MAX_SIZE];
+	int err;
+
+	do {
+		get_random_bytes(buf, c->size);
+		EC_CHK(mp_read_unsigned_bin(r, buf, c->size));
+	} while (mp_iszero(r) || mp_cmp(r, mod) != MP_LT);
+
+out:
+	memset(buf, 0, sizeof(buf));
+	return err;
+}
+
+/* Converts pt to normal affine (x, y). The inversion is blinded with a
+ * random factor. Fails with MP_VAL on the point at infinity. */
+static int ec_to_affine(struct ec_curve *c, ec_point * pt, mp_int * x,
+			mp_int * y, mp_int * t)
+{
+	int err;
+
+	EC_CHK(fe_from_mont(c, &pt->z, &t[0]));
+	if (mp_iszero(&t[0]))
+		return MP_VAL;
+
+	EC_CHK(ec_rand(c, &c->P, &t[1]));
+	EC_CHK(mp_mulmod(&t[0], &t[1], &c->P, &t[2]));
+	EC_CHK(mp_invmod(&t[2], &c->P, &t[2]));
+	EC_CHK(mp_mulmod(&t[2], &t[1], &c->P, &t[2]));	/* 1/Z */
+	EC_CHK(mp_sqrmod(&t[2], &c->P, &t[3]));	/* 1/Z^2 */
+	EC_CHK(mp_mulmod(&t[3], &t[2], &c->P, &t[2]));	/* 1/Z^3 */
+
+	EC_CHK(fe_from_mont(c, &pt->x, &t[0]));
+	EC_CHK(mp_mulmod(&t[0], &t[3], &c->P, x));
+	EC_CHK(fe_from_mont(c, &pt->y, &t[0]));
+	EC_CHK(mp_mulmod(&t[0], &t[2], &c->P, y));
+out:
+	return err;
+}
+
+/* r = kG for 0 <= k < n, using the comb table. r must be set up with
+ * ec_point_init(). */
+static int ec_mul_base(struct ec_curve *c, mp_int * k, ec_point * r,
+		       mp_int * t)
+{
+	ec_point q, s;
+	int err, col, i, idx, nz, inf;
+	int d = c->comb_d;
+
+	if ((err = ec_point_init(c, &q)) != MP_OKAY)
+		return err;
+	if ((err = ec_point_init(c, &s)) != MP_OKAY) {
+		ec_point_free(&q);
+		return err;
+	}
+
+	EC_CHK(mp_grow(k, (EC_COMB_W * d) / DIGIT_BIT + 1));
+	EC_CHK(mp_copy(&c->one, &q.z));
+	mp_zero(&r->x);
+	mp_zero(&r->y);
+	mp_zero(&r->z);
+	inf = 1;
+
+	for (col = d - 1; col >= 0; col--) {
+		EC_CHK(ec_dbl(c, r, r, t));
+
+		idx = 0;
+		for (i = 0; i < EC_COMB_W; i++)
+			idx |= ec_bit(k, i * d + col) << i;
+		ec_comb_select(c, &q, idx);
+
+		/* garbage when r is infinity or idx is 0, and unused then */
+		EC_CHK(ec_add(c, r, &q, 1, &s, t));
+
+		nz = ec_nonzero(idx);
+		ec_point_cmov(c, r, &s, nz & (inf ^ 1));
+		ec_point_cmov(c, r, &q, nz & inf);
+		inf &= nz ^ 1;
+	}
+
+out:
+	ec_point_free(&q);
+	ec_point_free(&s);
+	return err;
+}
+
+/* r = kp for 0 <= k < n, p affine, with a Montgomery ladder. The ladder
+ * runs on k + n or k + 2n, whichever has bit 'bits' set, so it always
+ * takes the same number of steps. r must be set up with ec_point_init(). */
+static int ec_mul(struct ec_curve *c, mp_int * k, ec_point * p, ec_point * r,
+		  mp_int * t)
+{
+	ec_point r1;
+	mp_int k1, k2;
+	int err, i, b, swap = 0;
+
+	if ((err = ec_point_init(c, &r1)) != MP_OKAY)
+		return err;
+	if ((err = mp_init_size(&k1, c->digits + 2)) != MP_OKAY) {
+		ec_point_free(&r1);
+		return err;
+	}
+	if ((err = mp_init_size(&k2, c->digits + 2)) != MP_OKAY) {
+		mp_clear(&k1);
+		ec_point_free(&r1);
+		return err;
+	}
+
+	EC_CHK(mp_add(k, &c->N, &k1));
+	EC_CHK(mp_add(&k1, &c->N, &k2));
+	ec_mp_cmov(&k1, &k2, ec_bit(&k1, c->bits) ^ 1, c->digits + 2);
+
+	EC_CHK(ec_point_copy(p, r));
+	EC_CHK(ec_dbl(c, p, &r1, t));
+
+	for (i = c->bits - 1; i >= 0; i--) {
+		b = ec_bit(&k1, i);
+		ec_point_cswap(c, r, &r1, swap ^ b);
+		swap = b;
+
+		EC_CHK(ec_add(c, &r1, r, 0, &r1, t));
+		EC_CHK(ec_dbl(c, r, r, t));
+	}
+	ec_point_cswap(c, r, &r1, swap);
+
+out:
+	mp_clear_multi(&k1, &k2, NULL);
+	ec_point_free(&r1);
+	return err;
+}
+
+/* Fills in the comb table of c */
+static int ec_comb_build(struct ec_curve *c)
+{
+	ec_point *tab;
+	mp_int t[EC_SCRATCH];
+	mp_int x, y;
+	int err, i, j, m, hb, n = c->digits;
+
+	tab = kmalloc(sizeof(ec_point) * EC_COMB_SIZE, GFP_KERNEL);
+	if (tab == NULL)
+		return MP_MEM;
+
+	for (m = 1; m < EC_COMB_SIZE; m++) {
+		if ((err = ec_point_init(c, &tab[m])) != MP_OKAY)
+			goto free_tab;
+	}
+	if ((err = ec_scratch_init(c, t)) != MP_OKAY)
+		goto free_tab;
+	if ((err = mp_init_multi(&x, &y, NULL)) != MP_OKAY)
+		goto free_scratch;
+
+	/* tab[2^i] = 2^(i*d)G */
+	EC_CHK(mp_read_unsigned_bin(&x, (uint8_t *) c->gx, c->size));
+	EC_CHK(mp_read_unsigned_bin(&y, (uint8_t *) c->gy, c->size));
+	EC_CHK(ec_point_set(c, &tab[1], &x, &y));
+	for (i = 1; i < EC_COMB_W; i++) {
+		EC_CHK(ec_point_copy(&tab[1 << (i - 1)], &tab[1 << i]));
+		for (j = 0; j < c->comb_d; j++)
+			EC_CHK(ec_dbl(c, &tab[1 << i], &tab[1 << i], t));
+	}
+
+	/* tab[j] = tab[j - hb] + tab[hb], hb the top bit of j */
+	for (j = 3, hb = 2; j < EC_COMB_SIZE; j++) {
+		if (j == hb << 1) {
+			hb = j;
+			continue;
+		}
+		EC_CHK(ec_add_checked(c, &tab[j - hb], &tab[hb], &tab[j], t));
+	}
+
+	for (j = 1; j < EC_COMB_SIZE; j++) {
+		EC_CHK(ec_to_affine(c, &tab[j], &x, &y, t));
+		EC_CHK(fe_to_mont(c, &x, &x));
+		EC_CHK(fe_to_mont(c, &y, &y));
+		memcpy(c->comb + 2 * j * n, x.dp, x.used * sizeof(mp_digit));
+		memcpy(c->comb + (2 * j + 1) * n, y.dp,
+		       y.used * sizeof(mp_digit));
+	}
+
+out:
+	mp_clear_multi(&x, &y, NULL);
+free_scratch:
+	ec_scratch_free(t);
+free_tab:
+	while (--m >= 1)
+		ec_point_free(&tab[m]);
+	kfree(tab);
+	return err;
+}
+
+static int ec_curve_setup(struct ec_curve *c)
+{
+	int err;
+
+	if ((err = mp_init_multi(&c->P, &c->B, &c->N, &c->one, NULL)) !=
+	    MP_OKAY)
+		return err;
+
+	EC_CHK(mp_read_unsigned_bin(&c->P, (uint8_t *) c->p, c->size));
+	EC_CHK(mp_read_unsigned_bin(&c->B, (uint8_t *) c->b, c->size));
+	EC_CHK(mp_read_unsigned_bin(&c->N, (uint8_t *) c->n, c->size));
+	EC_CHK(mp_montgomery_setup(&c->P, &c->mp));
+	EC_CHK(mp_montgomery_calc_normalization(&c->one, &c->P));
+
+	c->digits = c->P.used;
+	c->bits = mp_count_bits(&c->N);
+	c->comb_d = (c->bits + EC_COMB_W - 1) / EC_COMB_W;
+
+	c->comb = kzalloc(sizeof(mp_digit) * 2 * c->digits * EC_COMB_SIZE,
+			  GFP_KERNEL);
+	if (c->comb == NULL) {
+		err = MP_MEM;
+		goto out;
+	}
+
+	EC_CHK(ec_comb_build(c));
+out:
+	if (err != MP_OKAY) {
+		kfree(c->comb);
+		c->comb = NULL;
+		mp_clear_multi(&c->P, &c->B, &c->N, &c->one, NULL);
+	}
+	return err;
+}
+
+static struct ec_curve *ec_curve_get(int id)
+{
+	struct ec_curve *c;
+
+	for (c = ec_curves; c < ec_curves + ARRAY_SIZE(ec_curves); c++) {
+		if (c->id != id)
+			continue;
+
+		mutex_lock(&ec_curves_mutex);
+		if (!c->ready && ec_curve_setup(c) == MP_OKAY)
+			c->ready = 1;
+		mutex_unlock(&ec_curves_mutex);
+
+		return c->ready ? c : NULL;
+	}
+
+	return NULL;
+}
+
+void ec_curves_free(void)
+{
+	struct ec_curve *c;
+
+	for (c = ec_curves; c < ec_curves + ARRAY_SIZE(ec_curves); c++) {
+		if (!c->ready)
+			continue;
+		kfree(c->comb);
+		c->comb = NULL;
+		mp_clear_multi(&c->P, &c->B, &c->N, &c->one, NULL);
+		c->ready = 0;
+	}
+}
+
+/* point encoding */
+
+static int ec_write_fixed(mp_int * a, uint8_t * out, int size)
+{
+	int len = mp_unsigned_bin_size(a);
+
+	if (len > size)
+		return MP_VAL;
+	memset(out, 0, size - len);
+	return mp_to_unsigned_bin(a, out + size - len);
+}
+
+static int ec_write_point(struct ec_curve *c, mp_int * x, mp_int * y,
+			  uint8_t * out)
+{
+	int err;
+
+	out[0] = 0x04;
+	EC_CHK(ec_write_fixed(x, out + 1, c->size));
+	EC_CHK(ec_write_fixed(y, out + 1 + c->size, c->size));
+out:
+	return err;
+}
+
+/* Reads an uncompressed point and checks that it is on the curve */
+static int ec_read_point(struct ec_curve *c, const uint8_t * in, size_t inlen,
+			 mp_int * x, mp_int * y)
+{
+	mp_int t1, t2;
+	int err;
+
+	if (inlen != 1 + 2 * c->size || in[0] != 0x04)
+		return MP_VAL;
+
+	if ((err = mp_init_multi(&t1, &t2, NULL)) != MP_OKAY)
+		return err;
+
+	EC_CHK(mp_read_unsigned_bin(x, (uint8_t *) in + 1, c->size));
+	EC_CHK(mp_read_unsigned_bin(y, (uint8_t *) in + 1 + c->size, c->size));
+	if (mp_cmp(x, &c->P) != MP_LT || mp_cmp(y, &c->P) != MP_LT) {
+		err = MP_VAL;
+		goto out;
+	}
+
+	/* y^2 = x^3 - 3x + b */
+	EC_CHK(mp_sqrmod(y, &c->P, &t1));
+	EC_CHK(mp_sqrmod(x, &c->P, &t2));
+	EC_CHK(mp_sub_d(&t2, 3, &t2));
+	EC_CHK(mp_mulmod(&t2, x, &c->P, &t2));
+	EC_CHK(mp_addmod(&t2, &c->B, &c->P, &t2));
+	if (mp_cmp(&t1, &t2) != MP_EQ)
+		err = MP_VAL;
+out:
+	mp_clear_multi(&t1, &t2, NULL);
+	return err;
+}
+
+static struct ec_curve *ec_curve_by_point_size(size_t size)
+{
+	struct ec_curve *c;
+
+	for (c = ec_curves; c < ec_curves + ARRAY_SIZE(ec_curves); c++)
+		if (1 + 2 * c->size == size)
+			return ec_curve_get(c->id);
+	return NULL;
+}
+
+/* Computes the public point of a private key */
+static int ec_make_public(ec_key * key)
+{
+	struct ec_curve *c = key->curve;
+	mp_int t[EC_SCRATCH];
+	ec_point r;
+	int err;
+
+	if ((err = ec_scratch_init(c, t)) != MP_OKAY)
+		return err;
+	if ((err = ec_point_init(c, &r)) != MP_OKAY) {
+		ec_scratch_free(t);
+		return err;
+	}
+
+	EC_CHK(ec_mul_base(c, &key->k, &r, t));
+	EC_CHK(ec_to_affine(c, &r, &key->x, &key->y, t));
+out:
+	ec_point_free(&r);
+	ec_scratch_free(t);
+	return err;
+}
+
+void ec_free(ec_key * key)
+{
+	mp_clear_multi(&key->k, &key->x, &key->y, NULL);
+}
+
+int ec_generate_key(ec_key * key, int curve)
+{
+	int err;
+
+	key->curve = ec_curve_get(curve);
+	if (key->curve == NULL) {
+		err();
+		return -EINVAL;
+	}
+
+	if ((err = mp_init_multi(&key->k, &key->x, &key->y, NULL)) != MP_OKAY) {
+		err();
+		return -ENOMEM;
+	}
+
+	EC_CHK(ec_rand(key->curve, &key->curve->N, &key->k));
+	EC_CHK(ec_make_public(key));
+
+	key->type = PK_PRIVATE;
+
+	return 0;
+out:
+	err();
+	ec_free(key);
+	return ec_mperr(err);
+}
+
+int ec_generate_public(ec_key * public, ec_key * private)
+{
+	int err;
+
+	if ((err =
+	     mp_init_multi(&public->k, &public->x, &public->y,
+			   NULL)) != MP_OKAY) {
+		err();
+		return -ENOMEM;
+	}
+
+	EC_CHK(mp_copy(&private->x, &public->x));
+	EC_CHK(mp_copy(&private->y, &public->y));
+
+	public->curve = private->curve;
+	public->type = PK_PUBLIC;
+
+	return 0;
+out:
+	err();
+	ec_free(public);
+	return ec_mperr(err);
+}
+
+/* DER helpers for the ECPrivateKey structure. None of its elements
+ * needs more than a one byte length. */
+
+static unsigned long ec_der_hdr_len(unsigned long len)
+{
+	return len < 0x80 ? 2 : 3;
+}
+
+static unsigned long ec_der_put_hdr(uint8_t * out, int tag, unsigned long len)
+{
+	out[0] = tag;
+	if (len < 0x80) {
+		out[1] = len;
+		return 2;
+	}
+	out[1] = 0x81;
+	out[2] = len;
+	return 3;
+}
+
+static int ec_der_get(const uint8_t ** in, size_t * inlen, int tag,
+		      const uint8_t ** val, size_t * vlen)
+{
+	const uint8_t *p = *in;
+	size_t len, hdr = 2;
+
+	if (*inlen < 2 || p[0] != tag)
+		return MP_VAL;
+
+	len = p[1];
+	if (len == 0x81 && *inlen >= 3) {
+		len = p[2];
+		hdr = 3;
+	} else if (len >= 0x80)
+		return MP_VAL;
+
+	if (len > *inlen - hdr)
+		return MP_VAL;
+
+	*val = p + hdr;
+	*vlen = len;
+	*in = p + hdr + len;
+	*inlen -= hdr + len;
+
+	return MP_OKAY;
+}
+
+/* The private key is exported as an RFC 5915 ECPrivateKey, with the
+ * named curve and the public key:
+ *
+ * ECPrivateKey ::= SEQUENCE {
+ *	version INTEGER { ecPrivkeyVer1(1) },
+ *	privateKey OCTET STRING,
+ *	parameters [0] OBJECT IDENTIFIER,
+ *	publicKey [1] BIT STRING
+ * }
+ *
+ * and the public key as the uncompressed point 04 || X || Y, like the
+ * plain y of DH public keys.
+ */
+int ec_export(uint8_t * out, unsigned long *outlen, int type, ec_key * key)
+{
+	struct ec_curve *c = key->curve;
+	unsigned long oid_len, bit_len, len, pos, point_len = 1 + 2 * c->size;
+	int err;
+
+	if (out == NULL || outlen == NULL) {
+		err();
+		return -EINVAL;
+	}
+
+	if (type == PK_PRIVATE && key->type != PK_PRIVATE) {
+		return -EINVAL;
+	}
+
+	if (type == PK_PUBLIC) {
+		if (*outlen < point_len) {
+			err();
+			return -EOVERFLOW;
+		}
+
+		EC_CHK(ec_write_point(c, &key->x, &key->y, out));
+		*outlen = point_len;
+
+		return 0;
+	} else if (type != PK_PRIVATE) {
+		return -EINVAL;
+	}
+
+	err = der_length_object_identifier(c->oid, c->oid_len, &oid_len);
+	if (err != CRYPT_OK) {
+		err();
+		return _ncr_tomerr(err);
+	}
+
+	bit_len = ec_der_hdr_len(point_len + 1) + point_len + 1;
+	len = 3 + ec_der_hdr_len(c->size) + c->size +
+	    ec_der_hdr_len(oid_len) + oid_len + ec_der_hdr_len(bit_len) + bit_len;
+
+	if (*outlen < ec_der_hdr_len(len) + len) {
+		err();
+		return -EOVERFLOW;
+	}
+
+	pos = ec_der_put_hdr(out, 0x30, len);
+
+	out[pos++] = 0x02;
+	out[pos++] = 0x01;
+	out[pos++] = 0x01;
+
+	pos += ec_der_put_hdr(out + pos, 0x04, c->size);
+	EC_CHK(ec_write_fixed(&key->k, out + pos, c->size));
+	pos += c->size;
+
+	pos += ec_der_put_hdr(out + pos, 0xa0, oid_len);
+	err = der_encode_object_identifier(c->oid, c->oid_len, out + pos,
+					   &oid_len);
+	if (err != CRYPT_OK) {
+		err();
+		return _ncr_tomerr(err);
+	}
+	pos += oid_len;
+
+	pos += ec_der_put_hdr(out + pos, 0xa1, bit_len);
+	pos += ec_der_put_hdr(out + pos, 0x03, point_len + 1);
+	out[pos++] = 0x00;
+	EC_CHK(ec_write_point(c, &key->x, &key->y, out + pos));
+	pos += point_len;
+
+	*outlen = pos;
+
+	return 0;
+out:
+	err();
+	return ec_mperr(err);
+}
+
+static int ec_import_private(const uint8_t * in, size_t inlen, ec_key * key)
+{
+	const uint8_t *seq, *val;
+	size_t seq_len, val_len;
+	unsigned long oid[16], oid_len = ARRAY_SIZE(oid);
+	struct ec_curve *c;
+	const uint8_t *d;
+	size_t d_len;
+	int err;
+
+	EC_CHK(ec_der_get(&in, &inlen, 0x30, &seq, &seq_len));
+
+	EC_CHK(ec_der_get(&seq, &seq_len, 0x02, &val, &val_len));
+	if (val_len != 1 || val[0] != 1)
+		return MP_VAL;
+
+	EC_CHK(ec_der_get(&seq, &seq_len, 0x04, &d, &d_len));
+
+	/* the curve is optional, the key size tells it apart otherwise */
+	c = NULL;
+	if (seq_len > 0 && seq[0] == 0xa0) {
+		EC_CHK(ec_der_get(&seq, &seq_len, 0xa0, &val, &val_len));
+		if (der_decode_object_identifier(val, val_len, oid, &oid_len) !=
+		    CRYPT_OK)
+			return MP_VAL;
+
+		for (c = ec_curves; c < ec_curves + ARRAY_SIZE(ec_curves); c++)
+			if (c->oid_len == oid_len &&
+			    memcmp(c->oid, oid, oid_len * sizeof(oid[0])) == 0)
+				break;
+		if (c == ec_curves + ARRAY_SIZE(ec_curves))
+			return MP_VAL;
+	} else {
+		for (c = ec_curves; c < ec_curves + ARRAY_SIZE(ec_curves); c++)
+			if (c->size == d_len)
+				break;
+		if (c == ec_curves + ARRAY_SIZE(ec_curves))
+			return MP_VAL;
+	}
+
+	key->curve = ec_curve_get(c->id);
+	if (key->curve == NULL || d_len > key->curve->size)
+		return MP_VAL;
+
+	/* the public key, if present, is computed again from k */
+	EC_CHK(mp_read_unsigned_bin(&key->k, (uint8_t *) d, d_len));
+	if (mp_iszero(&key->k) || mp_cmp(&key->k, &key->curve->N) != MP_LT)
+		return MP_VAL;
+
+	EC_CHK(ec_make_public(key));
+	key->type = PK_PRIVATE;
+out:
+	return err;
+}
+
+int ec_import(const uint8_t * in, size_t inlen, ec_key * key)
+{
+	int err;
+
+	if (in == NULL || key == NULL || inlen == 0) {
+		err();
+		return -EINVAL;
+	}
+
+	if (mp_init_multi(&key->k, &key->x, &key->y, NULL) != MP_OKAY) {
+		return -ENOMEM;
+	}
+
+	if (in[0] == 0x04) {
+		key->curve = ec_curve_by_point_size(inlen);
+		if (key->curve == NULL) {
+			err = MP_VAL;
+			goto out;
+		}
+		EC_CHK(ec_read_point(key->curve, in, inlen, &key->x, &key->y));
+		key->type = PK_PUBLIC;
+	} else {
+		EC_CHK(ec_import_private(in, inlen, key));
+	}
+
+	return 0;
+out:
+	err();
+	ec_free(key);
+	return ec_mperr(err);
+}
+
+/* e = leftmost 'bits' bits of the hash */
+static int ec_hash_to_int(struct ec_curve *c, const uint8_t * hash,
+			  size_t hash_size, mp_int * e)
+{
+	int err;
+
+	EC_CHK(mp_read_unsigned_bin(e, (uint8_t *) hash, hash_size));
+	if (hash_size * 8 > c->bits)
+		EC_CHK(mp_div_2d(e, hash_size * 8 - c->bits, e, NULL));
+out:
+	return err;
+}
+
+int ecdsa_sign_hash(const uint8_t * hash, size_t hash_size, uint8_t * sig,
+		    unsigned long *sig_size, ec_key * key)
+{
+	struct ec_curve *c = key->curve;
+	mp_int t[EC_SCRATCH];
+	mp_int e, k, b, r, s;
+	ec_point kg;
+	int err, ret;
+
+	if (key->type != PK_PRIVATE) {
+		err();
+		return -EINVAL;
+	}
+
+	if ((err = ec_scratch_init(c, t)) != MP_OKAY) {
+		err();
+		return -ENOMEM;
+	}
+	if ((err = ec_point_init(c, &kg)) != MP_OKAY) {
+		ec_scratch_free(t);
+		err();
+		return -ENOMEM;
+	}
+	if ((err = mp_init_multi(&e, &k, &b, &r, &s, NULL)) != MP_OKAY) {
+		ec_point_free(&kg);
+		ec_scratch_free(t);
+		err();
+		return -ENOMEM;
+	}
+
+	EC_CHK(ec_hash_to_int(c, hash, hash_size, &e));
+
+	do {
+		EC_CHK(ec_rand(c, &c->N, &k));
+		EC_CHK(ec_mul_base(c, &k, &kg, t));
+		EC_CHK(ec_to_affine(c, &kg, &r, &s, t));
+		EC_CHK(mp_mod(&r, &c->N, &r));
+		if (mp_iszero(&r))
+			continue;
+
+		/* s = (e + r*d)/k, inverting k blinded by a random b */
+		EC_CHK(ec_rand(c, &c->N, &b));
+		EC_CHK(mp_mulmod(&k, &b, &c->N, &s));
+		EC_CHK(mp_invmod(&s, &c->N, &s));
+		EC_CHK(mp_mulmod(&s, &b, &c->N, &k));
+		EC_CHK(mp_mulmod(&r, &key->k, &c->N, &s));
+		EC_CHK(mp_addmod(&s, &e, &c->N, &s));
+		EC_CHK(mp_mulmod(&s, &k, &c->N, &s));
+	} while (mp_iszero(&r) || mp_iszero(&s));
+
+	err = der_encode_sequence_multi(sig, sig_size,
+					LTC_ASN1_INTEGER, 1UL, &r,
+					LTC_ASN1_INTEGER, 1UL, &s,
+					LTC_ASN1_EOL, 0UL, NULL);
+	if (err != CRYPT_OK) {
+		err();
+		ret = _ncr_tomerr(err);
+		goto fail;
+	}
+
+	ret = 0;
+	goto fail;
+out:
+	err();
+	ret = ec_mperr(err);
+fail:
+	mp_clear_multi(&e, &k, &b, &r, &s, NULL);
+	ec_point_free(&kg);
+	ec_scratch_free(t);
+
+	return ret;
+}
+
+int ecdsa_verify_hash(const uint8_t * sig, size_t sig_size,
+		      const uint8_t * hash, size_t hash_size, int *stat,
+		      ec_key * key)
+{
+	struct ec_curve *c = key->curve;
+	mp_int t[EC_SCRATCH];
+	mp_int r, s, u1, u2;
+	ec_point p1, p2, q;
+	int err, ret;
+
+	*stat = 0;
+
+	if ((err = ec_scratch_init(c, t)) != MP_OKAY) {
+		err();
+		return -ENOMEM;
+	}
+	if ((err = mp_init_multi(&r, &s, &u1, &u2, NULL)) != MP_OKAY) {
+		ec_scratch_free(t);
+		err();
+		return -ENOMEM;
+	}
+	ret = -ENOMEM;
+	if (ec_point_init(c, &p1) != MP_OKAY)
+		goto free_mp;
+	if (ec_point_init(c, &p2) != MP_OKAY)
+		goto free_p1;
+	if (ec_point_init(c, &q) != MP_OKAY)
+		goto free_p2;
+
+	err = der_decode_sequence_multi(sig, sig_size,
+					LTC_ASN1_INTEGER, 1UL, &r,
+					LTC_ASN1_INTEGER, 1UL, &s,
+					LTC_ASN1_EOL, 0UL, NULL);
+	if (err != CRYPT_OK) {
+		err();
+		ret = _ncr_tomerr(err);
+		goto fail;
+	}
+
+	ret = 0;
+	if (mp_iszero(&r) || mp_iszero(&s) || mp_cmp(&r, &c->N) != MP_LT ||
+	    mp_cmp(&s, &c->N) != MP_LT)
+		goto fail;
+
+	/* u1 = e/s, u2 = r/s */
+	EC_CHK(ec_hash_to_int(c, hash, hash_size, &u1));
+	EC_CHK(mp_invmod(&s, &c->N, &s));
+	EC_CHK(mp_mulmod(&u1, &s, &c->N, &u1));
+	EC_CHK(mp_mulmod(&r, &s, &c->N, &u2));
+
+	EC_CHK(ec_mul_base(c, &u1, &p1, t));
+	EC_CHK(ec_point_set(c, &q, &key->x, &key->y));
+	EC_CHK(ec_mul(c, &u2, &q, &p2, t));
+	EC_CHK(ec_add_checked(c, &p1, &p2, &q, t));
+	if (mp_iszero(&q.z))
+		goto fail;
+
+	EC_CHK(ec_to_affine(c, &q, &u1, &u2, t));
+	EC_CHK(mp_mod(&u1, &c->N, &u1));
+
+	*stat = (mp_cmp(&u1, &r) == MP_EQ);
+	goto fail;
+
+out:
+	err();
+	ret = ec_mperr(err);
+fail:
+	ec_point_free(&q);
+free_p2:
+	ec_point_free(&p2);
+free_p1:
+	ec_point_free(&p1);
+free_mp:
+	mp_clear_multi(&r, &s, &u1, &u2, NULL);
+	ec_scratch_free(t);
+
+	return ret;
+}
+
+int ecdh_derive_xy(struct key_item_st *newkey, ec_key * key,
+		   void *pk, size_t pk_size)
+{
+	struct ec_curve *c = key->curve;
+	mp_int t[EC_SCRATCH];
+	mp_int x, y;
+	ec_point p, r;
+	int err, ret;
+
+	/* newkey will be a secret key with the x coordinate of kQ
+	 */
+
+	if (key->type != PK_PRIVATE) {
+		err();
+		return -EINVAL;
+	}
+
+	if ((err = ec_scratch_init(c, t)) != MP_OKAY) {
+		err();
+		return -ENOMEM;
+	}
+	if ((err = mp_init_multi(&x, &y, NULL)) != MP_OKAY) {
+		ec_scratch_free(t);
+		err();
+		return -ENOMEM;
+	}
+	if ((err = ec_point_init(c, &p)) != MP_OKAY)
+		goto free_mp;
+	if ((err = ec_point_init(c, &r)) != MP_OKAY)
+		goto free_p;
+
+	EC_CHK(ec_read_point(c, pk, pk_size, &x, &y));
+	EC_CHK(ec_point_set(c, &p, &x, &y));
+	EC_CHK(ec_mul(c, &key->k, &p, &r, t));
+	EC_CHK(ec_to_affine(c, &r, &x, &y, t));
+
+	EC_CHK(ec_write_fixed(&x, newkey->key.secret.data, c->size));
+	newkey->key.secret.size = c->size;
+	newkey->type = NCR_KEY_TYPE_SECRET;
+
+out:
+	ec_point_free(&r);
+free_p:
+	ec_point_free(&p);
+free_mp:
+	mp_clear_multi(&x, &y, NULL);
+	ec_scratch_free(t);
+
+	if (err != MP_OKAY) {
+		err();
+		ret = ec_mperr(err);
+	} else
+		ret = 0;
+
+	return ret;
+}
+
+int ncr_pk_get_ec_size(ec_key * key)
+{
+	if (key->curve == NULL) {
+		err();
+		return -EINVAL;
+	}
+
+	return key->curve->bits;
+}
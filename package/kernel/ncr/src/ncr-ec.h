@@ -0,0 +1,37 @@
+#ifndef NCR_EC_H
+# define NCR_EC_H
+
+#include <tomcrypt.h>
+
+struct ec_curve;
+struct key_item_st;
+
+typedef struct {
+	int type;		/* PK_PRIVATE or PK_PUBLIC */
+	struct ec_curve *curve;
+	mp_int k;		/* private */
+	mp_int x;		/* public: (x,y)=kG */
+	mp_int y;
+} ec_key;
+
+int ec_generate_key(ec_key * key, int curve);
+void ec_free(ec_key * key);
+int ec_generate_public(ec_key * public, ec_key * private);
+
+int ec_export(uint8_t * out, unsigned long *outlen, int type, ec_key * key);
+int ec_import(const uint8_t * in, size_t inlen, ec_key * key);
+
+int ecdsa_sign_hash(const uint8_t * hash, size_t hash_size, uint8_t * sig,
+		    unsigned long *sig_size, ec_key * key);
+int ecdsa_verify_hash(const uint8_t * sig, size_t sig_size,
+		      const uint8_t * hash, size_t hash_size, int *stat,
+		      ec_key * key);
+
+int ecdh_derive_xy(struct key_item_st *newkey, ec_key * key,
+		   void *pk, size_t pk_size);
+
+int ncr_pk_get_ec_size(ec_key * key);
+
+void ec_curves_free(void);
+
+#endif
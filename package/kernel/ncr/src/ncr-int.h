@@ -9,6 +9,7 @@
 #include "cryptodev_int.h"
 #include <ncr-pk.h>
 #include <ncr-dh.h>
+#include <ncr-ec.h>
 
 #define KEY_DATA_MAX_SIZE 3*1024
 #define NCR_CIPHER_MAX_KEY_LEN 1024
@@ -61,6 +62,7 @@ struct key_item_st {
 			rsa_key rsa;
 			dsa_key dsa;
 			dh_key dh;
+			ec_key ec;
 		} pk;
 	} key;
 
@@ -757,6 +757,15 @@ int _ncr_key_get_sec_level(struct key_item_st *item)
 			}
 
 			return dlog_to_bits(bits);
+		case NCR_ALG_ECDSA:
+		case NCR_ALG_ECDH:
+			bits = ncr_pk_get_ec_size(&item->key.pk.ec);
+			if (bits < 0) {
+				err();
+				return bits;
+			}
+
+			return bits / 2;
 		default:
 			return -EINVAL;
 		}
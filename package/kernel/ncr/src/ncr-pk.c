@@ -61,6 +61,10 @@ void ncr_pk_clear(struct key_item_st *key)
 	case NCR_ALG_DH:
 		dh_free(&key->key.pk.dh);
 		break;
+	case NCR_ALG_ECDSA:
+	case NCR_ALG_ECDH:
+		ec_free(&key->key.pk.ec);
+		break;
 	default:
 		return;
 	}
@@ -122,6 +126,21 @@ static int ncr_pk_make_public_and_id(struct key_item_st *private,
 			goto fail;
 		}
 		break;
+	case NCR_ALG_ECDSA:
+	case NCR_ALG_ECDH:
+		ret =
+		    ec_generate_public(&public->key.pk.ec, &private->key.pk.ec);
+		if (ret < 0) {
+			err();
+			goto fail;
+		}
+
+		ret = ec_export(tmp, &max_size, PK_PUBLIC, &public->key.pk.ec);
+		if (ret < 0) {
+			err();
+			goto fail;
+		}
+		break;
 	default:
 		err();
 		ret = -EINVAL;
@@ -188,6 +207,17 @@ int ncr_pk_pack(const struct key_item_st *key, uint8_t * packed,
 			return ret;
 		}
 		break;
+	case NCR_ALG_ECDSA:
+	case NCR_ALG_ECDH:
+		ret =
+		    ec_export(packed, &max_size, key->key.pk.ec.type,
+			      (void *)&key->key.pk.ec);
+		if (ret < 0) {
+			*packed_size = max_size;
+			err();
+			return ret;
+		}
+		break;
 	default:
 		err();
 		return -EINVAL;
@@ -232,6 +262,14 @@ int ncr_pk_unpack(struct key_item_st *key, const void *packed,
 			return ret;
 		}
 		break;
+	case NCR_ALG_ECDSA:
+	case NCR_ALG_ECDH:
+		ret = ec_import(packed, packed_size, (void *)&key->key.pk.ec);
+		if (ret < 0) {
+			err();
+			return ret;
+		}
+		break;
 	default:
 		err();
 		return -EINVAL;
@@ -335,6 +373,23 @@ int ncr_pk_generate(const struct algo_properties_st *algo, struct nlattr *tb[],
 			}
 			break;
 		}
+	case NCR_ALG_ECDSA:
+	case NCR_ALG_ECDH:{
+			u32 curve;
+
+			nla = tb[NCR_ATTR_ECC_CURVE];
+			if (nla != NULL)
+				curve = nla_get_u32(nla);
+			else
+				curve = NCR_ECC_CURVE_P256;
+
+			ret = ec_generate_key(&private->key.pk.ec, curve);
+			if (ret < 0) {
+				err();
+				goto fail;
+			}
+			break;
+		}
 	default:
 		err();
 		return -EINVAL;
@@ -427,6 +482,7 @@ int ncr_pk_cipher_init(const struct algo_properties_st *algo,
 		}
 		break;
 	case NCR_ALG_DSA:
+	case NCR_ALG_ECDSA:
 		break;
 	default:
 		err();
@@ -585,7 +641,7 @@ fail:
 int ncr_pk_cipher_sign(const struct ncr_pk_ctx *ctx, const void *hash,
 		       size_t hash_size, void *sig, size_t * sig_size)
 {
-	int cret;
+	int cret, ret;
 	unsigned long osize = *sig_size;
 
 	switch (ctx->algorithm->algo) {
@@ -614,6 +670,15 @@ int ncr_pk_cipher_sign(const struct ncr_pk_ctx *ctx, const void *hash,
 		}
 		*sig_size = osize;
 		break;
+	case NCR_ALG_ECDSA:
+		ret = ecdsa_sign_hash(hash, hash_size, sig, &osize,
+				      &ctx->key->key.pk.ec);
+		if (ret < 0) {
+			err();
+			return ret;
+		}
+		*sig_size = osize;
+		break;
 	default:
 		err();
 		return -EINVAL;
@@ -656,6 +721,16 @@ int ncr_pk_cipher_verify(const struct ncr_pk_ctx *ctx, const void *sig,
 			goto fail;
 		}
 
+		ret = (stat == 1);
+		break;
+	case NCR_ALG_ECDSA:
+		ret = ecdsa_verify_hash(sig, sig_size, hash, hash_size,
+					&stat, &ctx->key->key.pk.ec);
+		if (ret < 0) {
+			err();
+			goto fail;
+		}
+
 		ret = (stat == 1);
 		break;
 	default:
@@ -697,6 +772,24 @@ int ncr_pk_derive(struct key_item_st *newkey, struct key_item_st *oldkey,
 			err();
 			return ret;
 		}
+	} else if (nla_get_u32(nla) == NCR_DERIVE_ECDH) {
+		if (oldkey->type != NCR_KEY_TYPE_PRIVATE ||
+		    oldkey->algorithm->algo != NCR_ALG_ECDH) {
+			err();
+			return -EINVAL;
+		}
+
+		nla = tb[NCR_ATTR_DH_PUBLIC];
+		if (nla == NULL) {
+			err();
+			return -EINVAL;
+		}
+		ret = ecdh_derive_xy(newkey, &oldkey->key.pk.ec, nla_data(nla),
+				     nla_len(nla));
+		if (ret < 0) {
+			err();
+			return ret;
+		}
 	} else {
 		err();
 		return -EINVAL;
@@ -309,6 +309,20 @@ const static struct algo_oid_st dh_oid[] = {
 	{.key_size = 0}
 };
 
+/* id-ecPublicKey and id-ecDH (RFC 5480), so that wrapped keys unwrap
+ * to the algorithm they were generated for */
+const static struct algo_oid_st ecdsa_oid[] = {
+	{.key_size = -1,
+	 .oid = {{1, 2, 840, 10045, 2, 1}, 6}},
+	{.key_size = 0}
+};
+
+const static struct algo_oid_st ecdh_oid[] = {
+	{.key_size = -1,
+	 .oid = {{1, 3, 132, 1, 12}, 5}},
+	{.key_size = 0}
+};
+
 const static struct algo_oid_st sha1_oid[] = {
 	{.key_size = -1,
 	 .oid = {.OIDlen = 6, .OID = {1, 3, 14, 3, 2, 26}}},
@@ -426,6 +440,12 @@ static const struct algo_properties_st algo_properties[] = {
 	{.algo = NCR_ALG_DH, .is_pk = 1,
 	 .can_kx = 1,.key_type = NCR_KEY_TYPE_PUBLIC,
 	 .oids = dh_oid},
+	{.algo = NCR_ALG_ECDSA, .is_pk = 1,
+	 .can_sign = 1,.key_type = NCR_KEY_TYPE_PUBLIC,
+	 .oids = ecdsa_oid},
+	{.algo = NCR_ALG_ECDH, .is_pk = 1,
+	 .can_kx = 1,.key_type = NCR_KEY_TYPE_PUBLIC,
+	 .oids = ecdh_oid},
 
 #undef KSTR
 };
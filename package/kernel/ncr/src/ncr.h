@@ -43,6 +43,8 @@ typedef enum {
 	NCR_ALG_RSA = 600,
 	NCR_ALG_DSA,
 	NCR_ALG_DH,
+	NCR_ALG_ECDSA,
+	NCR_ALG_ECDH,
 } ncr_algorithm_t;
 
 typedef enum {
@@ -52,8 +54,17 @@ typedef enum {
 
 typedef enum {
        NCR_DERIVE_DH=1,
+       NCR_DERIVE_ECDH, /* peer public point in NCR_ATTR_DH_PUBLIC */
 } ncr_derive_t;
 
+/* curves for NCR_ATTR_ECC_CURVE
+ */
+typedef enum {
+	NCR_ECC_CURVE_NONE,
+	NCR_ECC_CURVE_P256,	/* NIST P-256, secp256r1 */
+	NCR_ECC_CURVE_P384,	/* NIST P-384, secp384r1 */
+} ncr_ecc_curve_t;
+
 /* Serves to make sure the structure is suitably aligned to continue with
    a struct nlattr without external padding.
 
@@ -108,6 +119,7 @@ enum {
 	NCR_ATTR_DH_PUBLIC,	/* NLA_BINARY */
 	NCR_ATTR_WANTED_ATTRS,	/* NLA_BINARY - array of u16 IDs */
 	NCR_ATTR_SESSION_CLONE_FROM,	/* NLA_U32 - ncr_session_t */
+	NCR_ATTR_ECC_CURVE,	/* NLA_U32 - ncr_ecc_curve_t */
 
 	/* Add new attributes here */
 
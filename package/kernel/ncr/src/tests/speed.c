@@ -255,6 +255,245 @@ int encrypt_data_ncr(int cfd, int algo, int chunksize)
 	return 0;
 }
 
+/* RFC 3526 2048-bit MODP group (group 14), generator 2 */
+static const uint8_t dh_prime[] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xc9, 0x0f, 0xda, 0xa2,
+	0x21, 0x68, 0xc2, 0x34, 0xc4, 0xc6, 0x62, 0x8b, 0x80, 0xdc, 0x1c, 0xd1,
+	0x29, 0x02, 0x4e, 0x08, 0x8a, 0x67, 0xcc, 0x74, 0x02, 0x0b, 0xbe, 0xa6,
+	0x3b, 0x13, 0x9b, 0x22, 0x51, 0x4a, 0x08, 0x79, 0x8e, 0x34, 0x04, 0xdd,
+	0xef, 0x95, 0x19, 0xb3, 0xcd, 0x3a, 0x43, 0x1b, 0x30, 0x2b, 0x0a, 0x6d,
+	0xf2, 0x5f, 0x14, 0x37, 0x4f, 0xe1, 0x35, 0x6d, 0x6d, 0x51, 0xc2, 0x45,
+	0xe4, 0x85, 0xb5, 0x76, 0x62, 0x5e, 0x7e, 0xc6, 0xf4, 0x4c, 0x42, 0xe9,
+	0xa6, 0x37, 0xed, 0x6b, 0x0b, 0xff, 0x5c, 0xb6, 0xf4, 0x06, 0xb7, 0xed,
+	0xee, 0x38, 0x6b, 0xfb, 0x5a, 0x89, 0x9f, 0xa5, 0xae, 0x9f, 0x24, 0x11,
+	0x7c, 0x4b, 0x1f, 0xe6, 0x49, 0x28, 0x66, 0x51, 0xec, 0xe4, 0x5b, 0x3d,
+	0xc2, 0x00, 0x7c, 0xb8, 0xa1, 0x63, 0xbf, 0x05, 0x98, 0xda, 0x48, 0x36,
+	0x1c, 0x55, 0xd3, 0x9a, 0x69, 0x16, 0x3f, 0xa8, 0xfd, 0x24, 0xcf, 0x5f,
+	0x83, 0x65, 0x5d, 0x23, 0xdc, 0xa3, 0xad, 0x96, 0x1c, 0x62, 0xf3, 0x56,
+	0x20, 0x85, 0x52, 0xbb, 0x9e, 0xd5, 0x29, 0x07, 0x70, 0x96, 0x96, 0x6d,
+	0x67, 0x0c, 0x35, 0x4e, 0x4a, 0xbc, 0x98, 0x04, 0xf1, 0x74, 0x6c, 0x08,
+	0xca, 0x18, 0x21, 0x7c, 0x32, 0x90, 0x5e, 0x46, 0x2e, 0x36, 0xce, 0x3b,
+	0xe3, 0x9e, 0x77, 0x2c, 0x18, 0x0e, 0x86, 0x03, 0x9b, 0x27, 0x83, 0xa2,
+	0xec, 0x07, 0xa2, 0x8f, 0xb5, 0xc5, 0x5d, 0xf0, 0x6f, 0x4c, 0x52, 0xc9,
+	0xde, 0x2b, 0xcb, 0xf6, 0x95, 0x58, 0x17, 0x18, 0x39, 0x95, 0x49, 0x7c,
+	0xea, 0x95, 0x6a, 0xe5, 0x15, 0xd2, 0x26, 0x18, 0x98, 0xfa, 0x05, 0x10,
+	0x15, 0x72, 0x8e, 0x5a, 0x8a, 0xac, 0xaa, 0x68, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff,
+};
+
+static const uint8_t dh_base[] = { 0x02 };
+
+/* size is the RSA modulus size in bits or the ncr_ecc_curve_t of EC keys */
+static int generate_pair(int cfd, int algo, int size, ncr_key_t *privkey,
+			 ncr_key_t *pubkey)
+{
+	NCR_STRUCT(ncr_key_generate_pair) kgen;
+	struct nlattr *nla;
+
+	*privkey = ioctl(cfd, NCRIO_KEY_INIT);
+	*pubkey = ioctl(cfd, NCRIO_KEY_INIT);
+	if (*privkey == -1 || *pubkey == -1) {
+		fprintf(stderr, "Error: %s:%d\n", __func__, __LINE__);
+		perror("ioctl(NCRIO_KEY_INIT)");
+		return 1;
+	}
+
+	nla = NCR_INIT(kgen);
+	kgen.f.private_key = *privkey;
+	kgen.f.public_key = *pubkey;
+	ncr_put_u32(&nla, NCR_ATTR_ALGORITHM, algo);
+	ncr_put_u32(&nla, NCR_ATTR_KEY_FLAGS, NCR_KEY_FLAG_EXPORTABLE);
+	switch (algo) {
+	case NCR_ALG_RSA:
+		ncr_put_u32(&nla, NCR_ATTR_RSA_MODULUS_BITS, size);
+		break;
+	case NCR_ALG_DH:
+		ncr_put(&nla, NCR_ATTR_DH_PRIME, dh_prime, sizeof(dh_prime));
+		ncr_put(&nla, NCR_ATTR_DH_BASE, dh_base, sizeof(dh_base));
+		break;
+	default:
+		ncr_put_u32(&nla, NCR_ATTR_ECC_CURVE, size);
+		break;
+	}
+	NCR_FINISH(kgen, nla);
+
+	if (ioctl(cfd, NCRIO_KEY_GENERATE_PAIR, &kgen)) {
+		fprintf(stderr, "Error: %s:%d\n", __func__, __LINE__);
+		perror("ioctl(NCRIO_KEY_GENERATE_PAIR)");
+		return 1;
+	}
+
+	return 0;
+}
+
+static void report_ops(const char *what, unsigned long ops,
+		       struct timeval start, struct timeval end)
+{
+	double secs = udifftimeval(start, end) / 1000000.0;
+
+	printf("\t%s: %lu in %.2f secs: %.1f ops/sec, %.3f ms/op\n",
+	       what, ops, secs, ops / secs, secs * 1000 / ops);
+}
+
+/* Key agreement: one NCRIO_KEY_DERIVE against a fixed peer per operation.
+ * The peer's public value goes in NCR_ATTR_DH_PUBLIC for both DH and ECDH.
+ */
+int derive_ncr(int cfd, int algo, int size)
+{
+	NCR_STRUCT(ncr_key_derive) kderive;
+	struct ncr_key_export kexport;
+	struct nlattr *nla;
+	struct timeval start, end;
+	ncr_key_t private1, public1, private2, public2, z;
+	unsigned char peer[1024];
+	ssize_t peer_size;
+	unsigned long ops = 0;
+
+	if (generate_pair(cfd, algo, size, &private1, &public1) ||
+	    generate_pair(cfd, algo, size, &private2, &public2))
+		return 1;
+
+	memset(&kexport, 0, sizeof(kexport));
+	kexport.key = public2;
+	kexport.buffer = peer;
+	kexport.buffer_size = sizeof(peer);
+
+	peer_size = ioctl(cfd, NCRIO_KEY_EXPORT, &kexport);
+	if (peer_size < 0) {
+		fprintf(stderr, "Error: %s:%d\n", __func__, __LINE__);
+		perror("ioctl(NCRIO_KEY_EXPORT)");
+		return 1;
+	}
+
+	must_finish = 0;
+	alarm(5);
+
+	gettimeofday(&start, NULL);
+	do {
+		z = ioctl(cfd, NCRIO_KEY_INIT);
+		if (z == -1) {
+			fprintf(stderr, "Error: %s:%d\n", __func__, __LINE__);
+			perror("ioctl(NCRIO_KEY_INIT)");
+			return 1;
+		}
+
+		nla = NCR_INIT(kderive);
+		kderive.f.input_key = private1;
+		kderive.f.new_key = z;
+		ncr_put_u32(&nla, NCR_ATTR_DERIVATION_ALGORITHM,
+			    algo == NCR_ALG_DH ? NCR_DERIVE_DH : NCR_DERIVE_ECDH);
+		ncr_put_u32(&nla, NCR_ATTR_KEY_FLAGS, NCR_KEY_FLAG_EXPORTABLE);
+		ncr_put(&nla, NCR_ATTR_DH_PUBLIC, peer, peer_size);
+		NCR_FINISH(kderive, nla);
+
+		if (ioctl(cfd, NCRIO_KEY_DERIVE, &kderive)) {
+			fprintf(stderr, "Error: %s:%d\n", __func__, __LINE__);
+			perror("ioctl(NCRIO_KEY_DERIVE)");
+			return 1;
+		}
+
+		ioctl(cfd, NCRIO_KEY_DEINIT, &z);
+		ops++;
+	} while (must_finish == 0);
+	gettimeofday(&end, NULL);
+
+	report_ops("derive", ops, start, end);
+
+	ioctl(cfd, NCRIO_KEY_DEINIT, &private1);
+	ioctl(cfd, NCRIO_KEY_DEINIT, &public1);
+	ioctl(cfd, NCRIO_KEY_DEINIT, &private2);
+	ioctl(cfd, NCRIO_KEY_DEINIT, &public2);
+
+	return 0;
+}
+
+/* Signatures over a short message with SHA-256; RSA uses PKCS #1 v1.5. */
+int sign_ncr(int cfd, int algo, int size)
+{
+	NCR_STRUCT(ncr_session_once) op;
+	struct nlattr *nla;
+	struct timeval start, end;
+	ncr_key_t privkey, pubkey;
+	uint8_t data[64], sig[1024];
+	size_t sig_size;
+	unsigned long ops = 0;
+	int ret;
+
+	if (generate_pair(cfd, algo, size, &privkey, &pubkey))
+		return 1;
+
+	memset(data, 0x3, sizeof(data));
+
+	must_finish = 0;
+	alarm(5);
+
+	gettimeofday(&start, NULL);
+	do {
+		nla = NCR_INIT(op);
+		op.f.op = NCR_OP_SIGN;
+		ncr_put_u32(&nla, NCR_ATTR_ALGORITHM, algo);
+		ncr_put_u32(&nla, NCR_ATTR_KEY, privkey);
+		if (algo == NCR_ALG_RSA)
+			ncr_put_u32(&nla, NCR_ATTR_RSA_ENCODING_METHOD,
+				    RSA_PKCS1_V1_5);
+		ncr_put_u32(&nla, NCR_ATTR_SIGNATURE_HASH_ALGORITHM,
+			    NCR_ALG_SHA2_256);
+		ncr_put_session_input_data(&nla, NCR_ATTR_UPDATE_INPUT_DATA,
+					   data, sizeof(data));
+		ncr_put_session_output_buffer(&nla, NCR_ATTR_FINAL_OUTPUT_BUFFER,
+					      sig, sizeof(sig), &sig_size);
+		NCR_FINISH(op, nla);
+
+		if (ioctl(cfd, NCRIO_SESSION_ONCE, &op)) {
+			fprintf(stderr, "Error: %s:%d\n", __func__, __LINE__);
+			perror("ioctl(NCRIO_SESSION_ONCE)");
+			return 1;
+		}
+		ops++;
+	} while (must_finish == 0);
+	gettimeofday(&end, NULL);
+
+	report_ops("sign", ops, start, end);
+
+	ops = 0;
+	must_finish = 0;
+	alarm(5);
+
+	gettimeofday(&start, NULL);
+	do {
+		nla = NCR_INIT(op);
+		op.f.op = NCR_OP_VERIFY;
+		ncr_put_u32(&nla, NCR_ATTR_ALGORITHM, algo);
+		ncr_put_u32(&nla, NCR_ATTR_KEY, pubkey);
+		if (algo == NCR_ALG_RSA)
+			ncr_put_u32(&nla, NCR_ATTR_RSA_ENCODING_METHOD,
+				    RSA_PKCS1_V1_5);
+		ncr_put_u32(&nla, NCR_ATTR_SIGNATURE_HASH_ALGORITHM,
+			    NCR_ALG_SHA2_256);
+		ncr_put_session_input_data(&nla, NCR_ATTR_UPDATE_INPUT_DATA,
+					   data, sizeof(data));
+		ncr_put_session_input_data(&nla, NCR_ATTR_FINAL_INPUT_DATA,
+					   sig, sig_size);
+		NCR_FINISH(op, nla);
+
+		ret = ioctl(cfd, NCRIO_SESSION_ONCE, &op);
+		if (ret <= 0) {
+			fprintf(stderr, "Error: %s:%d\n", __func__, __LINE__);
+			perror("ioctl(NCRIO_SESSION_ONCE)");
+			return 1;
+		}
+		ops++;
+	} while (must_finish == 0);
+	gettimeofday(&end, NULL);
+
+	report_ops("verify", ops, start, end);
+
+	ioctl(cfd, NCRIO_KEY_DEINIT, &privkey);
+	ioctl(cfd, NCRIO_KEY_DEINIT, &pubkey);
+
+	return 0;
+}
+
 int main(void)
 {
 	int fd, i;
@@ -290,6 +529,26 @@ int main(void)
 			break;
 	}
 
+	fprintf(stderr, "\nTesting NCR with DH-2048 key agreement: \n");
+	derive_ncr(fd, NCR_ALG_DH, 0);
+
+	fprintf(stderr, "\nTesting NCR with ECDH P-256 key agreement: \n");
+	derive_ncr(fd, NCR_ALG_ECDH, NCR_ECC_CURVE_P256);
+
+	fprintf(stderr, "\nTesting NCR with ECDH P-384 key agreement: \n");
+	derive_ncr(fd, NCR_ALG_ECDH, NCR_ECC_CURVE_P384);
+
+	fprintf(stderr, "\nTesting NCR with RSA-1024 signatures: \n");
+	sign_ncr(fd, NCR_ALG_RSA, 1024);
+
+	fprintf(stderr, "\nTesting NCR with RSA-2048 signatures: \n");
+	sign_ncr(fd, NCR_ALG_RSA, 2048);
+
+	fprintf(stderr, "\nTesting NCR with ECDSA P-256 signatures: \n");
+	sign_ncr(fd, NCR_ALG_ECDSA, NCR_ECC_CURVE_P256);
+
+	fprintf(stderr, "\nTesting NCR with ECDSA P-384 signatures: \n");
+	sign_ncr(fd, NCR_ALG_ECDSA, NCR_ECC_CURVE_P384);
 
 	close(fd);
 	return 0;
@@ -17,6 +17,7 @@ enable_testing()
 add_library(unittest_rip SHARED 
     test/unit/rip2lib/main.c 
     test/unit/rip2lib/rip2lib.c
+    test/unit/crc32/crc32.c
 )
 target_link_libraries(unittest_rip riplib)
 
@@ -27,5 +28,9 @@ set_target_properties(
     COMPILE_DEFINITIONS USERSPACE
 )
 
+# host benchmark, not run as part of the tests
+add_executable(crc32bench test/bench/crc32_bench.c)
+target_link_libraries(crc32bench riplib)
+
 add_test (RipUnitTests ${UNITTESTCHECK_BINARY} --nf --nml unittest_rip)
 
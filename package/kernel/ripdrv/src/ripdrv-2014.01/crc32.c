@@ -2,27 +2,22 @@
 
 #ifdef BUILDTYPE_uboot_bootloader
 #include "rip/include/crc.h"
+#include "rip/include/crc32_table.h"
 #else
 #include "crc.h"
+#include "crc32_table.h"
 #endif
 
 
-static unsigned long crc32_table [256];		/* 32-bit CRC lookup table. */
-
-
 /* mk_crc32_table -- Create a fast CRC lookup table for either a CCITT CRC-32 or
 		     a PKZIP/ARJ CRC-32.
 
-   To create the table for CCITT CRC-32:	mk_crc32_table (CRC32, crc32_hw);
-   To create the table for PKZIP/ARJ CRC-32:	mk_crc32_table (CRC32_REV, crc32_rev_hw); */
+   The lookup tables for the CCITT CRC-32 are generated at compile time
+   (see crc32_table.h), this function is only kept for existing callers. */
 
 
 void rip2_mk_crc32_table (unsigned long poly, CRC32FN crcfn)
 {
-	int i;
-
-	for (i = 0; i < 256; i++)
-		crc32_table [i] = (*crcfn)(i, poly, 0);
 }
 
 /* crc32_hw -- Simulates a normal 32-bit CRC hardware circuit. */
@@ -42,20 +37,37 @@ unsigned long rip2_crc32_hw (unsigned long data, unsigned long poly, unsigned lo
        return (crc);
 }
 
-/* buf_crc32 -- Calculate a CRC-32 in the normal order. */
+/* buf_crc32 -- Calculate a CRC-32 in the normal order.
+
+   Eight bytes are handled per iteration (slice-by-8). The data is loaded
+   a byte at a time, so it may be unaligned and the result does not depend
+   on the endianness of the CPU. */
 
-static unsigned long buf_crc32 (unsigned char *data, unsigned count, unsigned long crc)
+static unsigned int buf_crc32 (const unsigned char *data, unsigned count, unsigned int crc)
 {
+	const unsigned int (*t)[256] = crc32_table;
+	unsigned int a;
+
+	while (count >= 8) {
+		a = crc ^ ((unsigned int)data[0] << 24 | (unsigned int)data[1] << 16 |
+			   (unsigned int)data[2] << 8 | data[3]);
+		crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff] ^
+		      t[5][(a >> 8) & 0xff] ^ t[4][a & 0xff] ^
+		      t[3][data[4]] ^ t[2][data[5]] ^
+		      t[1][data[6]] ^ t[0][data[7]];
+		data += 8;
+		count -= 8;
+	}
 	while (count-- != 0)
-		crc = (crc << 8) ^ crc32_table [((crc >> 24) ^ *data++) & 0xff];
+		crc = (crc << 8) ^ t[0][((crc >> 24) ^ *data++) & 0xff];
 	return (crc);
 }
 /* crc32 -- Calculate a normal CRC-32 for a linear data block. */
 
 unsigned long rip2_crc32 (unsigned char *data, unsigned count)
 {
-	unsigned long crc;
+	unsigned int crc;
 
-	crc = buf_crc32 (data, count, 0xffffffffl);
+	crc = buf_crc32 (data, count, 0xffffffff);
 	return (~crc);
 }
@@ -39,6 +39,215 @@ static int  rip2_size      = 0;
 #define FLASH_WRITE(to, len, retlen, buf)       rip2_flash_write((to), (len), ((size_t *)retlen), ((unsigned char *)buf))
 #define FLASH_CLEAR(to, len, retlen)            rip2_flash_clear((to), (len), ((size_t *)retlen))
 
+/*
+ * RAM copy of the index area with a table sorted by ID, so that lookups and
+ * index walks do not need one flash read per index item. It is built from the
+ * sector copy made by rip2_init() or with a single read of the index area,
+ * and dropped whenever an index item is added or invalidated.
+ * The payload of small items that are not encrypted nor signed is cached as
+ * well once it has been read and its CRC verified.
+ * All accesses are done with the RIP2_BIG_LOCK held.
+ */
+#define RIP2_DATA_CACHE_MAX_LEN     512
+
+typedef struct {
+    T_RIP2_ID   id;
+    int         pos;        /* offset of the index item in the RIP2 sector */
+    uint8_t     *data;      /* cached payload or NULL */
+} T_RIP2_IDX_REF;
+
+static int              rip2_idx_cached     = 0;
+static uint8_t          *rip2_idx_copy      = NULL;
+static int              rip2_idx_copy_start = 0;    /* offset of the copy in the RIP2 sector */
+static T_RIP2_IDX_REF   *rip2_idx_refs      = NULL;
+static int              rip2_idx_nrefs      = 0;
+
+static void rip2_idx_cache_drop(void)
+{
+    int i;
+
+    for (i = 0; i < rip2_idx_nrefs; i++) {
+        if (rip2_idx_refs[i].data) {
+            FREE(rip2_idx_refs[i].data);
+        }
+    }
+    if (rip2_idx_refs) {
+        FREE(rip2_idx_refs);
+    }
+    if (rip2_idx_copy) {
+        FREE(rip2_idx_copy);
+    }
+
+    rip2_idx_refs   = NULL;
+    rip2_idx_nrefs  = 0;
+    rip2_idx_copy   = NULL;
+    rip2_idx_cached = 0;
+}
+
+/*
+ * Returns the position in rip2_idx_refs where id is or should be inserted.
+ */
+static int rip2_idx_cache_search(T_RIP2_ID id)
+{
+    int lo = 0, hi = rip2_idx_nrefs;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        if (rip2_idx_refs[mid].id < id) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/*
+ * Takes ownership of copy, which holds the index area starting at offset
+ * start of the RIP2 sector, and builds the ID table. Like rip2_get_idx(), the
+ * first valid item found walking from the end of the sector wins.
+ *
+ * RETURNS: RIP2_ERR_NOMEM if the table could not be allocated
+ *          RIP2_SUCCESS otherwise
+ */
+static int rip2_idx_cache_build(uint8_t *copy, int start)
+{
+    int         idx_top = rip2_size - sizeof(T_RIP2_HDR);
+    int         nitems  = (idx_top - start) / sizeof(T_RIP2_ITEM);
+    int         pos, i;
+    T_RIP2_ITEM item;
+
+    rip2_idx_cache_drop();
+
+    if (nitems > 0) {
+        rip2_idx_refs = ALLOC(nitems * sizeof(T_RIP2_IDX_REF));
+        if (rip2_idx_refs == NULL) {
+            FREE(copy);
+            return RIP2_ERR_NOMEM;
+        }
+    }
+
+    for (pos = idx_top - sizeof(T_RIP2_ITEM); pos >= start; pos -= sizeof(T_RIP2_ITEM)) {
+        memcpy(&item, copy + pos - start, sizeof(item));
+
+        if (BETOH16(item.ID) == 0xFFFF) {
+            break;
+        }
+        if (!(BETOH32(item.attr[ATTR_HI]) & RIP2_ATTR_VALID)) {
+            continue;
+        }
+
+        i = rip2_idx_cache_search(BETOH16(item.ID));
+        if (i < rip2_idx_nrefs && rip2_idx_refs[i].id == BETOH16(item.ID)) {
+            continue;
+        }
+
+        memmove(&rip2_idx_refs[i + 1], &rip2_idx_refs[i], (rip2_idx_nrefs - i) * sizeof(T_RIP2_IDX_REF));
+        rip2_idx_refs[i].id   = BETOH16(item.ID);
+        rip2_idx_refs[i].pos  = pos;
+        rip2_idx_refs[i].data = NULL;
+        rip2_idx_nrefs++;
+    }
+
+    rip2_idx_copy       = copy;
+    rip2_idx_copy_start = start;
+    rip2_idx_cached     = 1;
+
+    return RIP2_SUCCESS;
+}
+
+/*
+ * Makes sure the index cache is available, reading the index area from flash
+ * if needed.
+ *
+ * RETURNS: RIP2_ERR_NOMEM if the cache could not be allocated
+ *          RIP2_ERR_INV_RIP if the RIP2 was not initialized
+ *          RIP2_SUCCESS otherwise
+ */
+static int rip2_idx_cache_load(void)
+{
+    int     len;
+    uint8_t *copy = NULL;
+    size_t  ret = 0;
+
+    if (rip2_idx_cached) {
+        return RIP2_SUCCESS;
+    }
+
+    if (rip2_size == 0) {
+        return RIP2_ERR_INV_RIP;
+    }
+
+    len = rip2_size - sizeof(T_RIP2_HDR) - rip2_idx_end;
+    if (len > 0) {
+        copy = ALLOC(len);
+        if (copy == NULL) {
+            return RIP2_ERR_NOMEM;
+        }
+        FLASH_READ((size_t)RIP2_START + RIP2_OFFSET + rip2_idx_end, len, &ret, copy);
+    }
+
+    return rip2_idx_cache_build(copy, rip2_idx_end);
+}
+
+static T_RIP2_IDX_REF *rip2_idx_cache_find(T_RIP2_ID id)
+{
+    int i;
+
+    if (rip2_idx_cache_load() != RIP2_SUCCESS) {
+        return NULL;
+    }
+
+    i = rip2_idx_cache_search(id);
+    if (i < rip2_idx_nrefs && rip2_idx_refs[i].id == id) {
+        return &rip2_idx_refs[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * Reads the index item at flash address from, out of the index cache when
+ * possible. Everything below the cached index area is free space.
+ */
+static void rip2_read_idx_item(T_RIP2_ITEM *from,
+                               T_RIP2_ITEM *item)
+{
+    long    pos = (long)((size_t)from - (RIP2_START + RIP2_OFFSET));
+    size_t  ret = 0;
+
+    if (rip2_idx_cache_load() == RIP2_SUCCESS &&
+        pos >= 0 && pos + sizeof(T_RIP2_ITEM) <= rip2_size - sizeof(T_RIP2_HDR)) {
+        if (pos < rip2_idx_copy_start) {
+            memset(item, 0xFF, sizeof(*item));
+        }
+        else {
+            memcpy(item, rip2_idx_copy + pos - rip2_idx_copy_start, sizeof(*item));
+        }
+        return;
+    }
+
+    FLASH_READ((size_t)from, sizeof(T_RIP2_ITEM), &ret, item);
+}
+
+/*
+ * Keeps the cached copy of an index item in sync after it has been rewritten
+ * in flash without changing its ID nor its valid flag.
+ */
+static void rip2_idx_cache_update(T_RIP2_ITEM *from,
+                                  T_RIP2_ITEM *item)
+{
+    long pos = (long)((size_t)from - (RIP2_START + RIP2_OFFSET));
+
+    if (rip2_idx_cached && pos >= rip2_idx_copy_start &&
+        pos + sizeof(T_RIP2_ITEM) <= rip2_size - sizeof(T_RIP2_HDR)) {
+        memcpy(rip2_idx_copy + pos - rip2_idx_copy_start, item, sizeof(*item));
+    }
+}
+
 /*
  * Add a rip2 field: adds an index item and copies the data to the
  * right location.
@@ -56,6 +265,14 @@ static int rip2_add_item(uint8_t        *ripPtr,
 static int rip2_make_single_idx_valid(uint8_t   *ripStart,
                                       T_RIP2_ID id);
 
+/*
+ * Finds the first index item with the given RIP2 ID and the valid flag set
+ * and its offset in the RIP2 sector
+ */
+static int rip2_find_idx(T_RIP2_ID    id,
+                         T_RIP2_ITEM  *item,
+                         int          *pos);
+
 /**
  * Iterates over all index items which match the flags passed as an argument.
  * In case a NULL iterator was passed, the iterator will be restarted from
@@ -72,7 +289,6 @@ int rip2_get_next(T_RIP2_ITEM     **from,
                   T_RIP2_ITEM     *item)
 {
     T_RIP2_ITEM buf;
-    size_t ret = 0;            //not used, needed for linux/BL compatibility
 
     if (*from == NULL) {
         /* Reinitialize the iterator */
@@ -83,7 +299,7 @@ int rip2_get_next(T_RIP2_ITEM     **from,
                                 - sizeof(T_RIP2_ITEM));
     }
 
-    FLASH_READ((size_t)*from, sizeof(T_RIP2_ITEM), &ret, &buf);
+    rip2_read_idx_item(*from, &buf);
 
     /* iterate over index items, check flags, return if match */
     while (BETOH16(buf.ID) != 0xFFFF) {
@@ -96,7 +312,7 @@ int rip2_get_next(T_RIP2_ITEM     **from,
             return RIP2_SUCCESS;
         }
         (*from)--;
-        FLASH_READ((size_t)*from, sizeof(T_RIP2_ITEM), &ret, &buf);
+        rip2_read_idx_item(*from, &buf);
     }
 
     return RIP2_ERR_NOELEM;
@@ -121,7 +337,7 @@ static int rip2_make_single_idx_valid(uint8_t   *ripStart,
     int			data_len;
 
     from = (T_RIP2_ITEM *)(ripStart + RIP2_OFFSET + rip2_idx_end);
-    FLASH_READ((size_t)from, sizeof(T_RIP2_ITEM), &ret, &buf);
+    rip2_read_idx_item(from, &buf);
 
     /* iterate over index items, check flags, return if match */
     while (from < (T_RIP2_ITEM *)(ripStart + RIP2_OFFSET + rip2_size - sizeof(T_RIP2_HDR))) {
@@ -140,9 +356,12 @@ static int rip2_make_single_idx_valid(uint8_t   *ripStart,
             }
         }
         from++;
-        FLASH_READ((size_t)from, sizeof(T_RIP2_ITEM), &ret, &buf);
+        rip2_read_idx_item(from, &buf);
     }
 
+    /* valid flags and data changed */
+    rip2_idx_cache_drop();
+
     return found_last ? RIP2_SUCCESS : RIP2_ERR_NOELEM;
 }
 
@@ -223,15 +442,19 @@ int rip2_get_data_ex(uint8_t    *ripStart,
 {
     T_RIP2_ITEM item;
     uint32_t    addr;
+    T_RIP2_IDX_REF *ref;
+    int         pos;
 
     size_t ret = 0;
     uint32_t  rip2len, len;
     uint8_t   *buf = data;
 
-    if (RIP2_SUCCESS != rip2_get_idx(id, &item)) {
+    LOCK();
+
+    if (RIP2_SUCCESS != rip2_find_idx(id, &item, &pos)) {
+        UNLOCK();
         return RIP2_ERR_NOELEM;
     }
-    LOCK();
 
     rip2len = BETOH32(item.length);
     addr    = BETOH32(item.addr);
@@ -242,6 +465,19 @@ int rip2_get_data_ex(uint8_t    *ripStart,
         return RIP2_ERR_NOELEM;
     }
 
+    /* Plain items are the same in raw and decoded form */
+    ref = rip2_idx_cache_find(id);
+    if (ref && ref->pos == pos && ref->data) {
+        if (data) {
+            memcpy(data, ref->data, rip2len);
+        }
+        if (length) {
+            *length = rip2len;
+        }
+        UNLOCK();
+        return RIP2_SUCCESS;
+    }
+
     if (~BETOH32(item.attr[ATTR_HI]) & RIP2_ATTR_CRYPTO || (data == NULL)) {
         /* Encrypted or signed entries are larger than the caller expects, so allocate a buffer big enough.
            This function can also be called to obtain the length, when data=0. */
@@ -272,6 +508,15 @@ int rip2_get_data_ex(uint8_t    *ripStart,
         }
     }
 
+    /* Keep a copy of small plain items, their CRC has been verified */
+    if (ref && ref->pos == pos && !(~BETOH32(item.attr[ATTR_HI]) & RIP2_ATTR_CRYPTO) &&
+        rip2len > 0 && rip2len <= RIP2_DATA_CACHE_MAX_LEN) {
+        ref->data = ALLOC(rip2len);
+        if (ref->data) {
+            memcpy(ref->data, buf, rip2len);
+        }
+    }
+
     len = rip2len;
 #ifdef CONFIG_RIPDRV_CRYPTO_SUPPORT
     if (~BETOH32(item.attr[ATTR_HI]) & RIP2_ATTR_CRYPTO) {
@@ -350,6 +595,7 @@ static int rip2_add_idx(uint8_t       *ripStart,
         id, len, BETOH32(item.addr), attrHi);
 
     FLASH_WRITE(((size_t)ripStart + RIP2_OFFSET + (rip2_idx_end)), sizeof(T_RIP2_ITEM), &ret, &item);
+    rip2_idx_cache_drop();
 
     return RIP2_SUCCESS;
 }
@@ -368,7 +614,7 @@ static int rip2_invalidate_idx(uint8_t    *ripStart,
     size_t ret = 0;
 
 //    FLASH_READ((size_t)rip2_invalid_idx, sizeof(T_RIP2_ITEM), &ret, &item);
-	FLASH_READ(((size_t)ripStart + RIP2_OFFSET + (rip2_invalid_idx)), sizeof(T_RIP2_ITEM), &ret, &item);
+	rip2_read_idx_item((T_RIP2_ITEM *)(ripStart + RIP2_OFFSET + rip2_invalid_idx), &item);
     DBG("item with ID 0x%04x at location %x\r\n", id, rip2_invalid_idx);
     DBG("item with ID 0x%04x at location %x\r\n", BETOH16(item.ID), rip2_invalid_idx);
     if (BETOH16(item.ID) == id) {
@@ -378,6 +624,7 @@ static int rip2_invalidate_idx(uint8_t    *ripStart,
         //clear the valid bit on this item
         item.attr[ATTR_HI] = HTOBE32( BETOH32(item.attr[ATTR_HI]) & ~RIP2_ATTR_VALID);
         FLASH_WRITE(((size_t)ripStart + RIP2_OFFSET + (rip2_invalid_idx)), sizeof(T_RIP2_ITEM), &ret, &item);
+        rip2_idx_cache_drop();
         return RIP2_SUCCESS;
     }
 
@@ -537,7 +784,7 @@ int rip2_lock(T_RIP2_ID id)
                            (rip2_size - sizeof(T_RIP2_HDR))
                            - sizeof(T_RIP2_ITEM));
 
-    FLASH_READ((size_t)from, sizeof(T_RIP2_ITEM), &ret, &buf);
+    rip2_read_idx_item(from, &buf);
 
     /* iterate over all items, check ID: if match, check valid flag */
     while (BETOH16(buf.ID) != 0xFFFF) {
@@ -547,11 +794,12 @@ int rip2_lock(T_RIP2_ID id)
             if ((BETOH32(buf.attr[ATTR_HI]) & RIP2_ATTR_WRITABLE)) {
                 buf.attr[ATTR_HI] = HTOBE32( BETOH32(buf.attr[ATTR_HI]) & ~RIP2_ATTR_WRITABLE);
                 FLASH_WRITE((size_t)(from), sizeof(T_RIP2_ITEM), &ret, &buf);
+                rip2_idx_cache_update(from, &buf);
             }
             return (ret == 0) ? RIP2_SUCCESS : ret;
         }
         from--;
-        FLASH_READ((size_t)from, sizeof(T_RIP2_ITEM), &ret, &buf);
+        rip2_read_idx_item(from, &buf);
     }
 
     return RIP2_ERR_NOELEM;
@@ -826,21 +1074,32 @@ int rip2_drv_write_d(T_RIP2_ID     id,
 }
 
 /*
- * Finds the first index item address with the given RIP2 ID and the valid flag set.
+ * Finds the first index item with the given RIP2 ID and the valid flag set and
+ * its offset in the RIP2 sector. Falls back to walking the index in flash if
+ * the index cache is not available.
+ * Beware: callers of this function MUST hold the RIP2_BIG_LOCK.
  *
  * RETURNS: RIP2_ERR_NOELEM if no matching index found,
  *          RIP2_SUCCESS otherwise
  */
-int rip2_get_addr(T_RIP2_ID    id,
-                  int  *itemaddr)
+static int rip2_find_idx(T_RIP2_ID    id,
+                         T_RIP2_ITEM  *item,
+                         int          *pos)
 {
+    T_RIP2_IDX_REF *ref;
     T_RIP2_ITEM *from = NULL;
     T_RIP2_ITEM buf;
     size_t ret = 0;
 
-    DBG("%s: called for id 0x%x\n", __FUNCTION__, id);
-
-    LOCK();
+    if (rip2_idx_cache_load() == RIP2_SUCCESS) {
+        ref = rip2_idx_cache_find(id);
+        if (ref == NULL) {
+            return RIP2_ERR_NOELEM;
+        }
+        memcpy(item, rip2_idx_copy + ref->pos - rip2_idx_copy_start, sizeof(*item));
+        *pos = ref->pos;
+        return RIP2_SUCCESS;
+    }
 
     /* Some strange logic because we have to count backwards from the end of
      * the RIPv2 sector */
@@ -854,14 +1113,39 @@ int rip2_get_addr(T_RIP2_ID    id,
     while (BETOH16(buf.ID) != 0xFFFF) {
         if ((BETOH16(buf.ID) == id) &&
             (BETOH32(buf.attr[ATTR_HI]) & RIP2_ATTR_VALID)) {
-            *itemaddr = (int) from  - RIP2_OFFSET;
-            UNLOCK();
-            DBG("%s: found index item\n", __FUNCTION__);
+            memcpy(item, &buf, sizeof(buf));
+            *pos = (size_t)from - (RIP2_START + RIP2_OFFSET);
             return RIP2_SUCCESS;
         }
         from--;
         FLASH_READ((size_t)from, sizeof(T_RIP2_ITEM), &ret, &buf);
     }
+
+    return RIP2_ERR_NOELEM;
+}
+
+/*
+ * Finds the first index item address with the given RIP2 ID and the valid flag set.
+ *
+ * RETURNS: RIP2_ERR_NOELEM if no matching index found,
+ *          RIP2_SUCCESS otherwise
+ */
+int rip2_get_addr(T_RIP2_ID    id,
+                  int  *itemaddr)
+{
+    T_RIP2_ITEM buf;
+    int         pos;
+
+    DBG("%s: called for id 0x%x\n", __FUNCTION__, id);
+
+    LOCK();
+
+    if (rip2_find_idx(id, &buf, &pos) == RIP2_SUCCESS) {
+        *itemaddr = RIP2_START + pos;
+        UNLOCK();
+        DBG("%s: found index item\n", __FUNCTION__);
+        return RIP2_SUCCESS;
+    }
     DBG("%s: no index item for id 0x%x found\n", __FUNCTION__, id);
 
     UNLOCK();
@@ -877,33 +1161,16 @@ int rip2_get_addr(T_RIP2_ID    id,
 int rip2_get_idx(T_RIP2_ID    id,
                  T_RIP2_ITEM  *item)
 {
-    T_RIP2_ITEM *from = NULL;
-    T_RIP2_ITEM buf;
-    size_t ret = 0;
+    int pos;
 
     DBG("%s: called for id 0x%x\n", __FUNCTION__, id);
 
     LOCK();
 
-    /* Some strange logic because we have to count backwards from the end of
-     * the RIPv2 sector */
-    from = (T_RIP2_ITEM *)(RIP2_START + RIP2_OFFSET +
-                           (rip2_size - sizeof(T_RIP2_HDR))
-                           - sizeof(T_RIP2_ITEM));
-
-    FLASH_READ((size_t)from, sizeof(T_RIP2_ITEM), &ret, &buf);
-
-    /* iterate over all items, check ID: if match, check valid flag */
-    while (BETOH16(buf.ID) != 0xFFFF) {
-        if ((BETOH16(buf.ID) == id) &&
-            (BETOH32(buf.attr[ATTR_HI]) & RIP2_ATTR_VALID)) {
-            memcpy(item, &buf, sizeof(buf));
-            UNLOCK();
-            DBG("%s: found index item\n", __FUNCTION__);
-            return RIP2_SUCCESS;
-        }
-        from--;
-        FLASH_READ((size_t)from, sizeof(T_RIP2_ITEM), &ret, &buf);
+    if (rip2_find_idx(id, item, &pos) == RIP2_SUCCESS) {
+        UNLOCK();
+        DBG("%s: found index item\n", __FUNCTION__);
+        return RIP2_SUCCESS;
     }
     DBG("%s: no index item for id 0x%x found\n", __FUNCTION__, id);
 
@@ -984,6 +1251,8 @@ int rip2_init(uint8_t       *ripStart,
 
     LOCK();
 
+    rip2_idx_cache_drop();
+
     rip2_size      = size;
     rip2_idx_end   = size - sizeof(T_RIP2_HDR);
     rip2_data_end  = 0;
@@ -1049,6 +1318,17 @@ int rip2_init(uint8_t       *ripStart,
 
         // if data ends at an odd address, add 1 padding byte
         rip2_data_end = (dataFree % 2) ? dataFree + 1 : dataFree;
+
+        // build the index cache from what we just read, on failure it will
+        // be retried at the first lookup
+        if (rip2_idx_end < rip2_size - sizeof(T_RIP2_HDR)) {
+            uint8_t *copy = ALLOC(rip2_size - sizeof(T_RIP2_HDR) - rip2_idx_end);
+
+            if (copy != NULL) {
+                memcpy(copy, rip2buf + rip2_idx_end, rip2_size - sizeof(T_RIP2_HDR) - rip2_idx_end);
+                rip2_idx_cache_build(copy, rip2_idx_end);
+            }
+        }
         FREE(rip2buf);
     }
     else {
@@ -0,0 +1,42 @@
+#!/usr/bin/env python3
+#
+# Generates include/crc32_table.h, the slice-by-8 lookup tables used by
+# crc32.c for the (non reflected) CRC-32 polynomial 0x04c11db7.
+#
+#   scripts/mk_crc32_table.py > include/crc32_table.h
+
+POLY = 0x04c11db7
+SLICES = 8
+
+def crc32_hw(data):
+    crc = 0
+    data <<= 24
+    for _ in range(8):
+        if (data ^ crc) & 0x80000000:
+            crc = ((crc << 1) ^ POLY) & 0xffffffff
+        else:
+            crc = (crc << 1) & 0xffffffff
+        data <<= 1
+    return crc
+
+tables = [[crc32_hw(i) for i in range(256)]]
+for k in range(1, SLICES):
+    prev = tables[k - 1]
+    tables.append([((v << 8) & 0xffffffff) ^ tables[0][v >> 24] for v in prev])
+
+print("/* crc32_table.h -- slice-by-%d tables for the CRC-32 polynomial 0x%08x." % (SLICES, POLY))
+print("   Generated by scripts/mk_crc32_table.py, do not edit. */")
+print()
+print("#ifndef CRC32_TABLE__H")
+print("#define CRC32_TABLE__H")
+print()
+print("static const unsigned int crc32_table [%d][256] = {" % SLICES)
+for k, table in enumerate(tables):
+    print("\t{")
+    for i in range(0, 256, 6):
+        row = ", ".join("0x%08x" % v for v in table[i:i + 6])
+        print("\t\t%s%s" % (row, "," if i + 6 < 256 else ""))
+    print("\t}%s" % ("," if k + 1 < SLICES else ""))
+print("};")
+print()
+print("#endif\t/* ! CRC32_TABLE__H */")
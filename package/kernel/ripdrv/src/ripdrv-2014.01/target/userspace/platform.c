@@ -10,6 +10,9 @@ pthread_mutex_t rip2_biglock = PTHREAD_MUTEX_INITIALIZER;
 static void *rip_base = NULL;
 static size_t rip_size = 0;
 
+/* number of rip2_flash_read() calls, used by the unit tests */
+unsigned long rip2_flash_read_count = 0;
+
 
 int rip2_flash_init(void *base, size_t size)
 {
@@ -24,6 +27,8 @@ int rip2_flash_read(loff_t from,
                            size_t *retlen,
                            unsigned char *buf)
 {
+	rip2_flash_read_count++;
+
 	from -= RIP2_OFFSET;
 
 	if( (from<0) || (rip_size<from)) {
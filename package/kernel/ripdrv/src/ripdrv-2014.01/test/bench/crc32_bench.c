@@ -0,0 +1,78 @@
+/* crc32_bench.c -- compares rip2_crc32() with the byte-at-a-time CRC-32.
+
+   Usage: crc32bench [size in KiB] [iterations] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "crc.h"
+
+static uint32_t ref_table[256];
+
+static uint32_t ref_crc32(const unsigned char *data, unsigned count)
+{
+	uint32_t crc = 0xffffffff;
+
+	while (count-- != 0)
+		crc = (crc << 8) ^ ref_table[((crc >> 24) ^ *data++) & 0xff];
+	return ~crc;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned size = (argc > 1 ? atoi(argv[1]) : 64) * 1024;
+	int iterations = argc > 2 ? atoi(argv[2]) : 200;
+	unsigned char *buf;
+	uint32_t ref = 0, crc = 0;
+	double start, t_ref, t_crc;
+	unsigned i;
+	int n;
+
+	buf = malloc(size);
+	if (buf == NULL || iterations <= 0) {
+		fprintf(stderr, "usage: %s [size in KiB] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < 256; i++)
+		ref_table[i] = rip2_crc32_hw(i, CRC32, 0);
+
+	srand(1);
+	for (i = 0; i < size; i++)
+		buf[i] = rand();
+
+	start = now();
+	for (n = 0; n < iterations; n++) {
+		buf[0] = n;
+		ref += ref_crc32(buf, size);
+	}
+	t_ref = now() - start;
+
+	start = now();
+	for (n = 0; n < iterations; n++) {
+		buf[0] = n;
+		crc += rip2_crc32(buf, size);
+	}
+	t_crc = now() - start;
+
+	printf("byte-wise   : %8.1f MiB/s\n", (double)size * iterations / t_ref / (1 << 20));
+	printf("slice-by-8  : %8.1f MiB/s\n", (double)size * iterations / t_crc / (1 << 20));
+
+	free(buf);
+
+	if (crc != ref) {
+		fprintf(stderr, "CRC mismatch: %08x != %08x\n", crc, ref);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "unittest/unittest.h"
+
+#include "crc.h"
+
+/* The byte-at-a-time implementation crc32.c used before the slice-by-8
+ * tables, with its table built by the simulated hardware circuit. */
+static uint32_t ref_table[256];
+
+static uint32_t ref_crc32(const unsigned char *data, unsigned count)
+{
+    uint32_t crc = 0xffffffff;
+
+    while (count-- != 0)
+        crc = (crc << 8) ^ ref_table[((crc >> 24) ^ *data++) & 0xff];
+    return ~crc;
+}
+
+static void setup(void)
+{
+    int i;
+
+    for (i = 0; i < 256; i++)
+        ref_table[i] = rip2_crc32_hw(i, CRC32, 0);
+}
+
+START_TEST(test_crc32_known)
+    /* CRC-32/BZIP2 check value */
+    ck_assert_int_eq((uint32_t)rip2_crc32((unsigned char *)"123456789", 9), 0xfc891918);
+    ck_assert_int_eq((uint32_t)rip2_crc32((unsigned char *)"", 0), 0);
+END_TEST
+
+START_TEST(test_crc32_cross_check)
+    unsigned char *buf;
+    unsigned offset, len;
+    int i;
+
+    buf = malloc(4096 + 8);
+    ck_assert(buf != NULL);
+
+    srand(1);
+    for (i = 0; i < 4096 + 8; i++)
+        buf[i] = rand();
+
+    /* every alignment and every tail length */
+    for (offset = 0; offset < 8; offset++) {
+        for (len = 0; len <= 64; len++)
+            ck_assert_int_eq((uint32_t)rip2_crc32(buf + offset, len), ref_crc32(buf + offset, len));
+        ck_assert_int_eq((uint32_t)rip2_crc32(buf + offset, 4096), ref_crc32(buf + offset, 4096));
+    }
+
+    /* erased flash */
+    memset(buf, 0xFF, 4096);
+    ck_assert_int_eq((uint32_t)rip2_crc32(buf, 4096), ref_crc32(buf, 4096));
+
+    free(buf);
+END_TEST
+
+static singleTestCaseInfo testcases[] = {
+    { .name = "crc32 check value", .function = test_crc32_known},
+    { .name = "crc32 cross check", .function = test_crc32_cross_check},
+    { }
+};
+
+void register_crc32tests(Suite *s)
+{
+  TCase *tc = tcase_create("crc32_unit");
+  tcase_addtests(tc, testcases);
+  tcase_add_checked_fixture(tc, setup, NULL);
+  suite_add_tcase (s, tc);
+}
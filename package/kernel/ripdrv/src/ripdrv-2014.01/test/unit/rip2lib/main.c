@@ -3,10 +3,12 @@
 #include "unittest/unittest.h"
 
 extern void register_riptests(Suite *s);
+extern void register_crc32tests(Suite *s);
 
 static testCaseInfo testcases[] =
 {
   { .register_testcase = register_riptests,       .name = "RIP2 unittests" },
+  { .register_testcase = register_crc32tests,     .name = "CRC32 unittests" },
   { NULL }
 };
 
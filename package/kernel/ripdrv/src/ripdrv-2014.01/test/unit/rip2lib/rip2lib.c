@@ -12,6 +12,9 @@
 
 uint8_t *rip = NULL;
 
+/* number of flash reads done by the userspace platform */
+extern unsigned long rip2_flash_read_count;
+
 static void setup(void)
 {
     int rv;
@@ -32,6 +35,8 @@ static void setup(void)
 
 static void teardown(void)
 {
+    /* releases the index and data cache */
+    rip2_init(rip, 0, RIP2_SZ);
     free(rip);
     rip = NULL;
 }
@@ -100,10 +105,109 @@ START_TEST(test_rip2_get_item)
 	ck_assert_int_eq(item.addr, BETOH32(raw.addr));
 END_TEST
 
+START_TEST(test_rip2_idx_cache)
+    int rv;
+    T_RIP2_ID id;
+    T_RIP2_ITEM item;
+    int addr;
+    unsigned long reads;
+    char data[16];
+
+    for (id = 0x100; id < 0x120; id++) {
+        sprintf(data, "item%04x", id);
+        rv = rip2_drv_write((uint8_t*)data, strlen(data)+1, id, 0xFFFFFFFF, 0xFFFFFFFF);
+        ck_assert_int_eq(rv, RIP2_SUCCESS);
+    }
+
+    /* a boot time verify fills the index cache */
+    rv = rip2_init(NULL, 1, RIP2_SZ);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+
+    reads = rip2_flash_read_count;
+    for (id = 0x100; id < 0x120; id++) {
+        rv = rip2_get_idx(id, &item);
+        ck_assert_int_eq(rv, RIP2_SUCCESS);
+        rv = rip2_get_addr(id, &addr);
+        ck_assert_int_eq(rv, RIP2_SUCCESS);
+    }
+    rv = rip2_get_idx(0x9999, &item);
+    ck_assert_int_eq(rv, RIP2_ERR_NOELEM);
+    ck_assert_int_eq(rip2_flash_read_count, reads);
+
+    /* after an index change the cache is rebuilt with a single read */
+    rv = rip2_drv_write((uint8_t*)"new", 4, 0x9999, 0xFFFFFFFF, 0xFFFFFFFF);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+    reads = rip2_flash_read_count;
+    for (id = 0x100; id < 0x120; id++) {
+        rv = rip2_get_idx(id, &item);
+        ck_assert_int_eq(rv, RIP2_SUCCESS);
+    }
+    rv = rip2_get_idx(0x9999, &item);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+    ck_assert_int_eq(rip2_flash_read_count, reads + 1);
+END_TEST
+
+START_TEST(test_rip2_data_cache)
+    int rv;
+    T_RIP2_ID id = 0x9999;
+    T_RIP2_ITEM item;
+    char buffer[10];
+    unsigned long sz;
+    unsigned long reads;
+
+    rv = rip2_drv_write((uint8_t*)"DATA", 5, id, 0xFFFFFFFF, 0xFFFFFFFF);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+
+    sz = sizeof(buffer);
+    rv = rip2_drv_read(&sz, id, buffer);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+
+    /* the second read is served from RAM */
+    reads = rip2_flash_read_count;
+    sz = sizeof(buffer);
+    rv = rip2_drv_read(&sz, id, buffer);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+    ck_assert_int_eq(sz, 5);
+    ck_assert(strcmp(buffer, "DATA")==0);
+    ck_assert_int_eq(rip2_flash_read_count, reads);
+
+    /* an update is never hidden by the cache */
+    rv = rip2_drv_write((uint8_t*)"NEW", 4, id, 0xFFFFFFFF, 0xFFFFFFFF);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+    sz = sizeof(buffer);
+    rv = rip2_drv_read(&sz, id, buffer);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+    ck_assert_int_eq(sz, 4);
+    ck_assert(strcmp(buffer, "NEW")==0);
+
+    /* neither is a lock */
+    rip2_lock(id);
+    rv = rip2_get_idx(id, &item);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+    ck_assert_int_eq(BETOH32(item.attr[ATTR_HI]) & RIP2_ATTR_WRITABLE, 0);
+    rv = rip2_drv_write((uint8_t*)"NEWER", 6, id, 0xFFFFFFFF, 0xFFFFFFFF);
+    ck_assert_int_eq(rv, RIP2_ERR_PERM);
+
+    /* or a delete */
+    id = 0x8888;
+    rv = rip2_drv_write((uint8_t*)"DATA", 5, id, 0xFFFFFFFF, 0xFFFFFFFF);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+    sz = sizeof(buffer);
+    rv = rip2_drv_read(&sz, id, buffer);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+    rv = rip2_drv_write_d(id, 0);
+    ck_assert_int_eq(rv, RIP2_SUCCESS);
+    sz = sizeof(buffer);
+    rv = rip2_drv_read(&sz, id, buffer);
+    ck_assert_int_eq(rv, RIP2_ERR_NOELEM);
+END_TEST
+
 static singleTestCaseInfo testcases[] = {
     { .name = "rip2init, init only", .function = test_rip2_init__init},
     { .name = "rip2_drv_read", .function = test_rip2_drv_read},
     { .name = "rip2_get_item", .function = test_rip2_get_item},
+    { .name = "rip2 index cache", .function = test_rip2_idx_cache},
+    { .name = "rip2 data cache", .function = test_rip2_data_cache},
     { }
 };
 
@@ -216,6 +216,27 @@ struct crypt_op {
 	caddr_t		iv;
 };
 
+/*
+ * Asynchronous symmetric operations.  CIOCASYNCCRYPT queues up to count
+ * operations and returns the number queued in count,  it only fails if
+ * none could be queued.  CIOCASYNCFETCH returns up to count completed
+ * operations with their status,  waiting for the first one unless the
+ * descriptor is non-blocking or none are outstanding.  The buffers of an
+ * operation must stay valid until it has been fetched.  Buffers of
+ * in-place (src == dst) operations may be handed to the driver directly
+ * instead of being copied.
+ */
+struct crypt_aop {
+	struct crypt_op	cop;
+	caddr_t		opaque;		/* returned untouched */
+	int		error;		/* returns: status of the op */
+};
+
+struct crypt_mop {
+	u_int32_t	count;		/* # of ops (rw) */
+	struct crypt_aop *aops;
+};
+
 /*
  * Parameters for looking up a crypto driver/device by
  * device name or by id.  The latter are returned for
@@ -273,6 +294,8 @@ struct crypt_kop {
 #define CIOCGSESSION2	_IOWR('c', 106, struct session2_op)
 #define CIOCKEY2	_IOWR('c', 107, struct crypt_kop)
 #define CIOCFINDDEV	_IOWR('c', 108, struct crypt_find_op)
+#define CIOCASYNCCRYPT	_IOWR('c', 109, struct crypt_mop)
+#define CIOCASYNCFETCH	_IOWR('c', 110, struct crypt_mop)
 
 struct cryptotstat {
 	struct timespec	acc;		/* total accumulated time */
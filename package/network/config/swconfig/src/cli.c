@@ -41,6 +41,7 @@ enum {
 	CMD_LOAD,
 	CMD_HELP,
 	CMD_SHOW,
+	CMD_DUMP,
 };
 
 static void
@@ -164,11 +165,96 @@ show_vlan(struct switch_dev *dev, int vlan, bool all)
 	show_attrs(dev, dev->vlan_ops, &val);
 }
 
+struct show_arg {
+	int group;
+	int port_vlan;
+	unsigned char *vlans;	/* only show these vlans, if set */
+};
+
+static int
+mark_vlan(struct switch_dev *dev, struct switch_attr *attr,
+		struct switch_val *val, void *arg)
+{
+	unsigned char *vlans = arg;
+
+	if (!val->err && val->len)
+		vlans[val->port_vlan] = 1;
+
+	return 0;
+}
+
+static int
+show_bulk_val(struct switch_dev *dev, struct switch_attr *attr,
+		struct switch_val *val, void *arg)
+{
+	struct show_arg *s = arg;
+
+	if (attr->atype == SWLIB_ATTR_GROUP_VLAN && s->vlans &&
+	    !s->vlans[val->port_vlan])
+		return 0;
+
+	if (attr->atype != s->group || val->port_vlan != s->port_vlan) {
+		s->group = attr->atype;
+		s->port_vlan = val->port_vlan;
+
+		switch (attr->atype) {
+		case SWLIB_ATTR_GROUP_GLOBAL:
+			printf("Global attributes:\n");
+			break;
+		case SWLIB_ATTR_GROUP_PORT:
+			printf("Port %d:\n", val->port_vlan);
+			break;
+		case SWLIB_ATTR_GROUP_VLAN:
+			printf("VLAN %d:\n", val->port_vlan);
+			break;
+		}
+	}
+
+	printf("\t%s: ", attr->name);
+	if (val->err < 0)
+		printf("???");
+	else
+		print_attr_val(attr, val);
+	putchar('\n');
+
+	return 0;
+}
+
+/* show attribute values, fetched with a single dump request */
+static int
+show_bulk(struct switch_dev *dev, unsigned int groups, const char *name,
+		int port_vlan, bool used_vlans)
+{
+	struct show_arg s = {
+		.group = -1,
+		.port_vlan = -1,
+	};
+	int err;
+
+	if (used_vlans && dev->vlans > 0) {
+		s.vlans = calloc(dev->vlans, 1);
+		if (!s.vlans)
+			return -ENOMEM;
+
+		err = swlib_get_attrs_bulk(dev, 1 << SWLIB_ATTR_GROUP_VLAN,
+				"ports", -1, mark_vlan, s.vlans);
+		if (err < 0)
+			goto out;
+	}
+
+	err = swlib_get_attrs_bulk(dev, groups, name, port_vlan,
+			show_bulk_val, &s);
+
+out:
+	free(s.vlans);
+	return err;
+}
+
 static void
 print_usage(void)
 {
 	printf("swconfig list\n");
-	printf("swconfig dev <dev> [port <port>|vlan <vlan>] (help|set <key> <value>|get <key>|load <config>|show)\n");
+	printf("swconfig dev <dev> [port <port>|vlan <vlan>] (help|set <key> <value>|get <key>|load <config>|show|dump [<key>])\n");
 	exit(1);
 }
 
@@ -254,6 +340,10 @@ int main(int argc, char **argv)
 			ckey = argv[++i];
 		} else if (!strcmp(arg, "show")) {
 			cmd = CMD_SHOW;
+		} else if (!strcmp(arg, "dump")) {
+			cmd = CMD_DUMP;
+			if (i+1 < argc)
+				ckey = argv[++i];
 		} else {
 			print_usage();
 		}
@@ -325,6 +415,18 @@ int main(int argc, char **argv)
 		list_attributes(dev);
 		break;
 	case CMD_SHOW:
+		/* older kernels lack the dump request */
+		if (cport >= 0) {
+			if (!show_bulk(dev, 1 << SWLIB_ATTR_GROUP_PORT, NULL, cport, false))
+				break;
+		} else if (cvlan >= 0) {
+			if (!show_bulk(dev, 1 << SWLIB_ATTR_GROUP_VLAN, NULL, cvlan, false))
+				break;
+		} else {
+			if (!show_bulk(dev, 0, NULL, -1, true))
+				break;
+		}
+
 		if (cport >= 0 || cvlan >= 0) {
 			if (cport >= 0)
 				show_port(dev, cport);
@@ -338,6 +440,20 @@ int main(int argc, char **argv)
 				show_vlan(dev, i, true);
 		}
 		break;
+	case CMD_DUMP:
+		if (cport >= 0)
+			err = show_bulk(dev, 1 << SWLIB_ATTR_GROUP_PORT, ckey, cport, false);
+		else if (cvlan >= 0)
+			err = show_bulk(dev, 1 << SWLIB_ATTR_GROUP_VLAN, ckey, cvlan, false);
+		else
+			err = show_bulk(dev, 0, ckey, -1, false);
+
+		if (err < 0) {
+			fprintf(stderr, "failed\n");
+			retval = -1;
+			goto out;
+		}
+		break;
 	}
 
 out:
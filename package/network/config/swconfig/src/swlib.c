@@ -71,8 +71,8 @@ wait_handler(struct nl_msg *msg, void *arg)
 
 /* helper function for performing netlink requests */
 static int
-swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
-		int (*data)(struct nl_msg *, void *), void *arg)
+swlib_request(int cmd, int (*call)(struct nl_msg *, void *),
+		int (*data)(struct nl_msg *, void *), void *arg, int dump)
 {
 	struct nl_msg *msg;
 	struct nl_cb *cb = NULL;
@@ -86,7 +86,7 @@ swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
 		exit(1);
 	}
 
-	if (!data)
+	if (dump)
 		flags |= NLM_F_DUMP;
 
 	genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ, genl_family_get_id(family), 0, flags, cmd, 0);
@@ -112,7 +112,7 @@ swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
 	if (call)
 		nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, call, arg);
 
-	if (data)
+	if (!dump)
 		nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, wait_handler, &finished);
 	else
 		nl_cb_set(cb, NL_CB_FINISH, NL_CB_CUSTOM, wait_handler, &finished);
@@ -133,6 +133,13 @@ nla_put_failure:
 	return err;
 }
 
+static int
+swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
+		int (*data)(struct nl_msg *, void *), void *arg)
+{
+	return swlib_request(cmd, call, data, arg, !data);
+}
+
 static int
 send_attr(struct nl_msg *msg, void *arg)
 {
@@ -256,6 +263,135 @@ swlib_get_attr(struct switch_dev *dev, struct switch_attr *attr, struct switch_v
 	return err;
 }
 
+struct bulk_arg {
+	struct switch_dev *dev;
+	unsigned int groups;
+	const char *name;
+	int port_vlan;
+	struct switch_port *ports;
+	swlib_bulk_cb cb;
+	void *arg;
+	int err;
+};
+
+static int
+send_bulk(struct nl_msg *msg, void *arg)
+{
+	struct bulk_arg *b = arg;
+
+	NLA_PUT_U32(msg, SWITCH_ATTR_ID, b->dev->id);
+	if (b->groups)
+		NLA_PUT_U32(msg, SWITCH_ATTR_OP_GROUPS, b->groups);
+	if (b->name)
+		NLA_PUT_STRING(msg, SWITCH_ATTR_OP_NAME, b->name);
+	if (b->port_vlan >= 0) {
+		NLA_PUT_U32(msg, SWITCH_ATTR_OP_PORT, b->port_vlan);
+		NLA_PUT_U32(msg, SWITCH_ATTR_OP_VLAN, b->port_vlan);
+	}
+
+	return 0;
+
+nla_put_failure:
+	return -1;
+}
+
+static int
+store_bulk_val(struct nl_msg *msg, void *arg)
+{
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct bulk_arg *b = arg;
+	struct switch_attr *attr;
+	struct switch_val val;
+	int id;
+
+	if (b->err)
+		goto done;
+
+	if (nla_parse(tb, SWITCH_ATTR_MAX - 1, genlmsg_attrdata(gnlh, 0),
+			genlmsg_attrlen(gnlh, 0), NULL) < 0)
+		goto done;
+
+	if (!tb[SWITCH_ATTR_OP_GROUP] || !tb[SWITCH_ATTR_OP_ID])
+		goto done;
+
+	switch(nla_get_u32(tb[SWITCH_ATTR_OP_GROUP])) {
+	case SWITCH_GROUP_GLOBAL:
+		attr = b->dev->ops;
+		break;
+	case SWITCH_GROUP_PORT:
+		attr = b->dev->port_ops;
+		break;
+	case SWITCH_GROUP_VLAN:
+		attr = b->dev->vlan_ops;
+		break;
+	default:
+		goto done;
+	}
+
+	id = nla_get_u32(tb[SWITCH_ATTR_OP_ID]);
+	while (attr && attr->id != id)
+		attr = attr->next;
+
+	if (!attr)
+		goto done;
+
+	memset(&val, 0, sizeof(val));
+	val.attr = attr;
+	val.err = 0;
+	if (tb[SWITCH_ATTR_OP_PORT])
+		val.port_vlan = nla_get_u32(tb[SWITCH_ATTR_OP_PORT]);
+	else if (tb[SWITCH_ATTR_OP_VLAN])
+		val.port_vlan = nla_get_u32(tb[SWITCH_ATTR_OP_VLAN]);
+
+	if (tb[SWITCH_ATTR_OP_VALUE_INT]) {
+		val.value.i = nla_get_u32(tb[SWITCH_ATTR_OP_VALUE_INT]);
+	} else if (tb[SWITCH_ATTR_OP_VALUE_STR]) {
+		val.value.s = nla_get_string(tb[SWITCH_ATTR_OP_VALUE_STR]);
+	} else if (tb[SWITCH_ATTR_OP_VALUE_PORTS]) {
+		val.value.ports = b->ports;
+		val.err = store_port_val(msg, tb[SWITCH_ATTR_OP_VALUE_PORTS], &val);
+	} else {
+		/* the driver failed to read the value */
+		val.err = -EIO;
+	}
+
+	b->err = b->cb(b->dev, attr, &val, b->arg);
+
+done:
+	return NL_SKIP;
+}
+
+int
+swlib_get_attrs_bulk(struct switch_dev *dev, unsigned int groups,
+		const char *name, int port_vlan, swlib_bulk_cb cb, void *arg)
+{
+	struct bulk_arg b;
+	int err;
+
+	memset(&b, 0, sizeof(b));
+	b.dev = dev;
+	b.groups = groups;
+	b.name = name;
+	b.port_vlan = port_vlan;
+	b.cb = cb;
+	b.arg = arg;
+
+	if (dev->ports > 0) {
+		b.ports = malloc(sizeof(struct switch_port) * dev->ports);
+		if (!b.ports)
+			return -ENOMEM;
+	}
+
+	err = swlib_request(SWITCH_CMD_DUMP_ATTRS, store_bulk_val, send_bulk,
+			&b, 1);
+	free(b.ports);
+
+	if (err < 0)
+		return err;
+
+	return b.err;
+}
+
 static int
 send_attr_ports(struct nl_msg *msg, struct switch_val *val)
 {
@@ -52,6 +52,10 @@ Usage of the library functions:
   switch_set_attr() and switch_get_attr() can alter or request the values
   of attributes.
 
+  swlib_get_attrs_bulk() requests the values of many attributes at once,
+  e.g. all of them or the "mib" attribute of every port, and passes them
+  to a callback as they arrive.
+
 Usage of the switch_attr struct:
 
   ->atype: attribute group, one of:
@@ -229,6 +233,31 @@ int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *attr,
 int swlib_get_attr(struct switch_dev *dev, struct switch_attr *attr,
 		struct switch_val *val);
 
+/**
+ * swlib_bulk_cb: callback for swlib_get_attrs_bulk
+ * @dev: switch device struct
+ * @attr: switch attribute struct
+ * @val: attribute value, val->err is set if the value could not be read
+ * @arg: argument passed to swlib_get_attrs_bulk
+ * string values and port lists are only valid during the call,
+ * a non-zero return value ignores the rest of the reply
+ */
+typedef int (*swlib_bulk_cb)(struct switch_dev *dev, struct switch_attr *attr,
+		struct switch_val *val, void *arg);
+
+/**
+ * swlib_get_attrs_bulk: get the values of many attributes with one request
+ * @dev: switch device struct
+ * @groups: bit mask of (1 << SWLIB_ATTR_GROUP_*), 0 for all groups
+ * @name: only get attributes with this name, NULL for all
+ * @port_vlan: only get this port or vlan, -1 for all
+ * @cb: called for every value, in the order of the attribute lists
+ * @arg: passed to the callback
+ * returns 0 on success, or an error if the kernel does not support it
+ */
+int swlib_get_attrs_bulk(struct switch_dev *dev, unsigned int groups,
+		const char *name, int port_vlan, swlib_bulk_cb cb, void *arg);
+
 /**
  * swlib_apply_from_uci: set up the switch from a uci configuration
  * @dev: switch device struct
@@ -58,6 +58,8 @@ enum config_iface_attr {
     IFACE_ATTR_DEL_OPTIONS,
     IFACE_ATTR_ADD_OPTIONS,
     IFACE_ATTR_OPTION_FORMAT_SCRIPT,
+    IFACE_ATTR_OPTION_FORMAT_HELPER,
+    IFACE_ATTR_OPTION_CACHE_TTL,
     IFACE_ATTR_MAX
 };
 
@@ -67,6 +69,8 @@ static const struct blobmsg_policy iface_attrs[IFACE_ATTR_MAX] = {
     [IFACE_ATTR_DEL_OPTIONS] = { .name = "del_options", .type = BLOBMSG_TYPE_ARRAY },
     [IFACE_ATTR_ADD_OPTIONS] = { .name = "add_options", .type = BLOBMSG_TYPE_ARRAY },
     [IFACE_ATTR_OPTION_FORMAT_SCRIPT] = { .name = "option_format_script", .type = BLOBMSG_TYPE_STRING },
+    [IFACE_ATTR_OPTION_FORMAT_HELPER] = { .name = "option_format_helper", .type = BLOBMSG_TYPE_STRING },
+    [IFACE_ATTR_OPTION_CACHE_TTL] = { .name = "option_cache_ttl", .type = BLOBMSG_TYPE_INT32 },
 };
 
 const struct uci_blob_param_list interface_attr_list = {
@@ -185,6 +189,25 @@ static struct interface *config_interface_parse(void *data, size_t len, const ch
 			iface->format_script = strdup(script);
 	}
 
+	if (iface->format_helper) {
+		free(iface->format_helper);
+		iface->format_helper = NULL;
+	}
+	if ((c = attr[IFACE_ATTR_OPTION_FORMAT_HELPER])) {
+		const char *helper = blobmsg_get_string(c);
+
+		if (helper[0])
+			iface->format_helper = strdup(helper);
+	}
+
+	if ((c = attr[IFACE_ATTR_OPTION_CACHE_TTL]))
+		iface->option_cache_ttl = blobmsg_get_u32(c);
+	else
+		iface->option_cache_ttl = DEFAULT_OPTION_CACHE_TTL;
+
+	/* generated options may depend on the configuration */
+	option_cache_flush();
+
 	return iface;
 }
 
@@ -299,6 +322,9 @@ void config_interface_close(struct interface *iface)
 	if (iface->format_script)
 		free(iface->format_script);
 
+	if (iface->format_helper)
+		free(iface->format_helper);
+
 	free(iface);
 }
 
@@ -23,6 +23,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 #include <net/if.h>
 #include <netinet/in.h>
@@ -43,6 +44,7 @@
  #                                                                       #
  ####################################################################### */
 #define DHCPSNOOPER_MESSAGE_SIZE	4096
+#define VERDICT_BATCH_SIZE		32
 
 /*#######################################################################
  #                                                                      #
@@ -67,6 +69,14 @@ static struct nfq_handle *nfq_h;
 static struct nfq_q_handle *nfq_qh;
 static struct dhcpsnooper_event nfq_event = { { .fd = -1, .cb = dhcpsnooper_receive_events} , .handle_dgram = dhcpsnooper_handle_dgram};
 
+/* unmodified packets waiting for a batch verdict */
+static uint32_t verdict_last_id;
+static int verdict_pending;
+
+static const uint32_t latency_bucket_limits[LATENCY_BUCKETS - 1] = { 100, 1000, 10000, 100000 };
+
+struct dhcpsnooper_stats stats;
+
 /*#######################################################################
  #                                                                      #
  #  INTERNAL FUNCTIONS  (standard for multi-process support)            #
@@ -154,6 +164,39 @@ static int delete_dhcp_options(struct interface *iface, uint8_t *indata, int inl
 	return -1;
 }
 
+static void stats_update_latency(const struct timespec *start)
+{
+	struct timespec now;
+	uint32_t us;
+	int bucket;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+
+	stats.packets++;
+	stats.latency_total_us += us;
+	if (stats.packets == 1 || us < stats.latency_min_us)
+		stats.latency_min_us = us;
+	if (us > stats.latency_max_us)
+		stats.latency_max_us = us;
+
+	for (bucket = 0; bucket < LATENCY_BUCKETS - 1 && us >= latency_bucket_limits[bucket]; bucket++)
+		;
+	stats.latency_hist[bucket]++;
+}
+
+/* accept all unmodified packets queued up to verdict_last_id */
+static int flush_verdicts(void)
+{
+	if (!verdict_pending)
+		return 0;
+
+	verdict_pending = 0;
+	stats.verdict_batches++;
+
+	return nfq_set_verdict_batch(nfq_qh, verdict_last_id, NF_ACCEPT);
+}
+
 static int nfq_queue_callback(struct nfq_q_handle *qh, _unused struct nfgenmsg *nfmsg, struct nfq_data *nfd, _unused void *unused)
 {
 	uint32_t id = 0;
@@ -165,6 +208,9 @@ static int nfq_queue_callback(struct nfq_q_handle *qh, _unused struct nfgenmsg *
 	struct iphdr *iph;
 	struct udphdr *udph;
 	uint8_t outdata[DHCPSNOOPER_MESSAGE_SIZE];
+	struct timespec start;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	ph = nfq_get_msg_packet_hdr(nfd);
 	if (ph) {
@@ -179,9 +225,7 @@ static int nfq_queue_callback(struct nfq_q_handle *qh, _unused struct nfgenmsg *
 		char ifname_phys_in[IF_NAMESIZE] = "", ifname_phys_out[IF_NAMESIZE] = "";
 		char src_mac[6 * 3] = "";
 		uint32_t ifid;
-		int i, cmdlen = 0, fatal_error = 0;
-		char cmd[1024];
-		FILE *fcmd;
+		int i, fatal_error = 0;
 		int datalen, dataspace;
 
 		for (i = 0; i < OPTS_ARRAY_SIZE && iface->add_options[i]; i++) {
@@ -207,17 +251,6 @@ static int nfq_queue_callback(struct nfq_q_handle *qh, _unused struct nfgenmsg *
 				ifid = nfq_get_physoutdev(nfd);
 				if (ifid)
 					if_indextoname(ifid, ifname_phys_out);
-
-				cmdlen = snprintf(cmd, sizeof(cmd), "'%s' '%s' '%s' '%s' '%s' ",
-						iface->format_script, iface->ifname,
-						ifname_phys_in, ifname_phys_out,
-						src_mac);
-
-				if (cmdlen >= (int)sizeof(cmd)) {
-					syslog(LOG_ERR, "Option format script command line too long");
-					fatal_error = 1;
-					break;
-				}
 			}
 
 			if (DHCPSNOOPER_MESSAGE_SIZE - outlen < 4) {
@@ -226,39 +259,19 @@ static int nfq_queue_callback(struct nfq_q_handle *qh, _unused struct nfgenmsg *
 				break;
 			}
 
-			/* command: script bridge inport outport dhclient_macaddr opt_num */
-			if (snprintf(cmd + cmdlen, sizeof(cmd) - cmdlen, "%d", iface->add_options[i]) >= (int)(sizeof(cmd) - cmdlen)) {
-				syslog(LOG_ERR, "Option format script command line too long");
+			/* generate the option content and append it at the end of the message,
+			   option_generate() needs one spare byte to detect overlong content */
+			dataspace = DHCPSNOOPER_MESSAGE_SIZE - outlen - 2 /* opt tag and length */ - 1;
+			datalen = option_generate(iface, ifname_phys_in, ifname_phys_out, src_mac,
+					iface->add_options[i], outdata + outlen + 2, dataspace);
+			if (datalen < 0) {
 				fatal_error = 1;
 				break;
 			}
-
-			syslog(LOG_DEBUG, "Executing %s", cmd);
-			fcmd = popen(cmd, "r");
-			if (fcmd == NULL) {
-				syslog(LOG_ERR, "Failed to execute option format script");
-				fatal_error = 1;
-				break;
-			}
-
-			/* generate the option content and append it at the end of the message */
 			outdata[outlen++] = iface->add_options[i];
-			dataspace = DHCPSNOOPER_MESSAGE_SIZE - outlen - 1 /* opt length */;
-			if (dataspace > MAX_OPTION_LENGTH + 1)
-				dataspace = MAX_OPTION_LENGTH + 1;
-
-			datalen = fread(outdata + outlen + 1 /* opt length */, 1, dataspace, fcmd);
-			if (datalen >= dataspace) {
-				syslog(LOG_ERR, "Option %d too long", iface->add_options[i]);
-				fatal_error = 1;
-				pclose(fcmd);
-				break;
-			}
 			outdata[outlen++] = (uint8_t)datalen;
 			outlen += datalen;
 			syslog(LOG_DEBUG, "Added option %d length %u", iface->add_options[i], datalen);
-
-			pclose(fcmd);
 		}
 
 		/* add "end option" tag and some padding */
@@ -289,12 +302,24 @@ static int nfq_queue_callback(struct nfq_q_handle *qh, _unused struct nfgenmsg *
 			}
 			nfq_udp_compute_checksum_ipv4(udph, iph);
 			syslog(LOG_DEBUG, "Pass mangled packet with ID %u", id);
+			stats.mangled++;
+			stats_update_latency(&start);
 			return nfq_set_verdict(qh, id, NF_ACCEPT, outlen, outdata);
 		}
+
+		stats.errors++;
 	}
 
+	/* unmodified packets are accepted in batches, flushed at the latest when
+	   dhcpsnooper_receive_events() has drained the netlink socket */
 	syslog(LOG_DEBUG, "Pass unmodified packet with ID %u", id);
-	return nfq_set_verdict(qh, id, NF_ACCEPT, 0, NULL);
+	stats.unmodified++;
+	stats_update_latency(&start);
+	verdict_last_id = id;
+	if (++verdict_pending >= VERDICT_BATCH_SIZE)
+		return flush_verdicts();
+
+	return 0;
 }
 
 static void dhcpsnooper_handle_dgram(char *data, int len)
@@ -318,6 +343,8 @@ static void dhcpsnooper_receive_events(struct uloop_fd *u, _unused unsigned int
 
 		e->handle_dgram(buf, len);
 	}
+
+	flush_verdicts();
 }
 
 static void dhcpsnooper_run(void)
@@ -328,6 +355,8 @@ static void dhcpsnooper_run(void)
 
 	sigact.sa_handler = SIG_IGN;
 	sigaction(SIGUSR1, &sigact, NULL);
+	/* a dead option format helper is detected by the failed write */
+	sigaction(SIGPIPE, &sigact, NULL);
 
 	sigact.sa_handler = &handle_signal;
 	sigaction(SIGTERM, &sigact, NULL);
@@ -343,6 +372,8 @@ static void dhcpsnooper_run(void)
 static void dhcpsnooper_done(void)
 {
 	config_interfaces_close();
+	option_cache_flush();
+	option_helpers_close();
 
 	if (nfq_qh != NULL) {
 		nfq_destroy_queue(nfq_qh);
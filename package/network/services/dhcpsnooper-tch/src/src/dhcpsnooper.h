@@ -45,6 +45,10 @@
 #define BOOTREQUEST             1
 #define BOOTREPLY               2
 
+#define DEFAULT_OPTION_CACHE_TTL	60	/* seconds */
+
+#define LATENCY_BUCKETS		5	/* <100us, <1ms, <10ms, <100ms, >=100ms */
+
 #define OPTS_BITMAP_SIZE	((256 + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long)))
 #define OPTS_ARRAY_SIZE		8
 
@@ -75,6 +79,8 @@ struct interface {
 	unsigned long del_options[OPTS_BITMAP_SIZE];
 	uint8_t add_options[OPTS_ARRAY_SIZE];
 	char *format_script;
+	char *format_helper;
+	unsigned option_cache_ttl;
 
 	struct {
 	    uint8_t enable: 1,
@@ -82,6 +88,23 @@ struct interface {
 	} state;
 };
 
+struct dhcpsnooper_stats {
+	uint64_t packets;
+	uint64_t mangled;
+	uint64_t unmodified;
+	uint64_t errors;
+	uint64_t verdict_batches;
+	uint64_t cache_hits;
+	uint64_t cache_misses;
+	uint64_t helper_calls;
+	uint64_t helper_errors;
+	uint64_t script_calls;
+	uint64_t latency_total_us;	/* packet processing time, from dequeue to verdict */
+	uint32_t latency_min_us;
+	uint32_t latency_max_us;
+	uint64_t latency_hist[LATENCY_BUCKETS];
+};
+
 struct dhcp_packet {
 	uint8_t op;      /* BOOTREQUEST or BOOTREPLY */
 	uint8_t htype;
@@ -107,6 +130,7 @@ struct dhcp_packet {
 ###################################################################### */
 extern struct list_head interfaces;
 extern uint16_t queue_id;
+extern struct dhcpsnooper_stats stats;
 
 /*#######################################################################
 #                                                                      #
@@ -125,6 +149,11 @@ void config_interfaces_close(void);
 void config_interfaces_set_unused(void);
 void config_interfaces_flush_unused(void);
 
+int option_generate(struct interface *iface, const char *phys_in, const char *phys_out,
+		const char *mac, uint8_t opt, uint8_t *buf, int bufsize);
+void option_cache_flush(void);
+void option_helpers_close(void);
+
 int ubus_init(void);
 
 #endif
@@ -0,0 +1,451 @@
+/**************************** IDENTIFICATION *****************************
+** @file options.c
+** @author Alin Nastac
+** @brief Generates the content of the DHCP options added by dhcpsnooper
+** Project :
+** Module : dhcpsnooper
+** Reference(s):
+*************************************************************************/
+
+/*########################################################################
+ #                                                                       #
+ #  HEADER (INCLUDE) SECTION                                             #
+ #                                                                       #
+ ####################################################################### */
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libubox/avl.h>
+#include <libubox/avl-cmp.h>
+#include <libubox/list.h>
+#include <libubox/uloop.h>
+
+#include "dhcpsnooper.h"
+
+/*########################################################################
+ #                                                                       #
+ #  MACROS                                                               #
+ #                                                                       #
+ ####################################################################### */
+#define OPTION_CACHE_MAX_ENTRIES	1024
+#define OPTION_CACHE_KEY_SIZE		(4 * IF_NAMESIZE + 6 * 3 + 4)
+
+#define HELPER_TIMEOUT_MS		500	/* Maximum time to wait for a helper reply */
+#define HELPER_RESTART_DELAY		5	/* Seconds before restarting a failed helper */
+
+/*########################################################################
+#                                                                       #
+#  TYPES                                                                #
+#                                                                       #
+####################################################################### */
+struct option_cache_entry {
+	struct avl_node node;
+	struct list_head age;		/* Oldest entries first */
+	time_t expires;
+	int len;
+	uint8_t data[MAX_OPTION_LENGTH];
+	char key[OPTION_CACHE_KEY_SIZE];
+};
+
+/* Long-lived option format helper.
+ * For each option the helper reads one request line from stdin
+ *	<bridge> <inport> <outport> <dhclient_macaddr> <opt_num>\n
+ * where unknown values are passed as '-', and writes the reply to stdout
+ *	<length>\n<length bytes of option content>
+ */
+struct option_helper {
+	struct list_head head;
+	char *path;
+	pid_t pid;
+	int fd_in;			/* helper stdin */
+	int fd_out;			/* helper stdout */
+	time_t retry;			/* Don't restart before this time */
+};
+
+/*#######################################################################
+ #                                                                      #
+ #  VARIABLES                                                           #
+ #                                                                      #
+ ###################################################################### */
+static struct avl_tree option_cache = AVL_TREE_INIT(option_cache, avl_strcmp, false, NULL);
+static LIST_HEAD(option_cache_age);
+static int option_cache_entries;
+
+static LIST_HEAD(option_helpers);
+
+/*#######################################################################
+ #                                                                      #
+ #  INTERNAL FUNCTIONS                                                  #
+ #                                                                      #
+ ###################################################################### */
+
+static time_t monotonic_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static void option_cache_delete(struct option_cache_entry *e)
+{
+	avl_delete(&option_cache, &e->node);
+	list_del(&e->age);
+	option_cache_entries--;
+	free(e);
+}
+
+static struct option_cache_entry *option_cache_lookup(const char *key, time_t now)
+{
+	struct option_cache_entry *e;
+
+	e = avl_find_element(&option_cache, key, e, node);
+	if (!e)
+		return NULL;
+
+	if (e->expires <= now) {
+		option_cache_delete(e);
+		return NULL;
+	}
+
+	return e;
+}
+
+static void option_cache_store(const char *key, const uint8_t *data, int len, unsigned ttl, time_t now)
+{
+	struct option_cache_entry *e, *n;
+
+	/* entries are kept in age order: drop the expired ones, then the oldest if still full */
+	list_for_each_entry_safe(e, n, &option_cache_age, age) {
+		if (e->expires > now && option_cache_entries < OPTION_CACHE_MAX_ENTRIES)
+			break;
+		option_cache_delete(e);
+	}
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return;
+
+	strncpy(e->key, key, sizeof(e->key) - 1);
+	e->node.key = e->key;
+	e->expires = now + ttl;
+	e->len = len;
+	memcpy(e->data, data, len);
+
+	if (avl_insert(&option_cache, &e->node)) {
+		free(e);
+		return;
+	}
+	list_add_tail(&e->age, &option_cache_age);
+	option_cache_entries++;
+}
+
+static void option_helper_reaped(struct uloop_process *p, _unused int ret)
+{
+	free(p);
+}
+
+/* Runs on the packet path: the helper is killed, not waited for.
+ * It is reaped by uloop once it has exited.
+ */
+static void option_helper_stop(struct option_helper *h)
+{
+	struct uloop_process *p;
+
+	if (h->fd_in >= 0)
+		close(h->fd_in);
+	if (h->fd_out >= 0)
+		close(h->fd_out);
+	h->fd_in = h->fd_out = -1;
+
+	if (h->pid > 0) {
+		kill(h->pid, SIGKILL);
+
+		p = calloc(1, sizeof(*p));
+		if (p) {
+			p->pid = h->pid;
+			p->cb = option_helper_reaped;
+			uloop_process_add(p);
+		} else
+			waitpid(h->pid, NULL, WNOHANG);
+
+		h->pid = -1;
+	}
+}
+
+static int option_helper_start(struct option_helper *h, time_t now)
+{
+	int pin[2], pout[2];
+
+	if (h->retry > now)
+		return -1;
+
+	if (pipe(pin) < 0)
+		goto error;
+	if (pipe(pout) < 0) {
+		close(pin[0]);
+		close(pin[1]);
+		goto error;
+	}
+
+	h->pid = fork();
+	if (h->pid < 0) {
+		close(pin[0]);
+		close(pin[1]);
+		close(pout[0]);
+		close(pout[1]);
+		goto error;
+	}
+
+	if (h->pid == 0) {
+		int fd;
+
+		dup2(pin[0], STDIN_FILENO);
+		dup2(pout[1], STDOUT_FILENO);
+
+		/* don't leak the nfqueue, ubus and other helpers' descriptors */
+		for (fd = getdtablesize() - 1; fd > STDERR_FILENO; fd--)
+			close(fd);
+
+		execl(h->path, h->path, (char *)NULL);
+		_exit(127);
+	}
+
+	close(pin[0]);
+	close(pout[1]);
+	h->fd_in = pin[1];
+	h->fd_out = pout[0];
+	fcntl(h->fd_in, F_SETFD, FD_CLOEXEC);
+	fcntl(h->fd_out, F_SETFD, FD_CLOEXEC);
+	fcntl(h->fd_out, F_SETFL, fcntl(h->fd_out, F_GETFL) | O_NONBLOCK);
+
+	syslog(LOG_INFO, "Started option format helper %s pid %d", h->path, (int)h->pid);
+	return 0;
+
+error:
+	syslog(LOG_ERR, "Failed to start option format helper %s (%d <%s>)",
+		h->path, errno, strerror(errno));
+	h->retry = now + HELPER_RESTART_DELAY;
+	return -1;
+}
+
+static struct option_helper *option_helper_get(const char *path, time_t now)
+{
+	struct option_helper *h;
+
+	list_for_each_entry(h, &option_helpers, head)
+		if (!strcmp(h->path, path))
+			goto found;
+
+	h = calloc(1, sizeof(*h));
+	if (!h)
+		return NULL;
+
+	h->path = strdup(path);
+	if (!h->path) {
+		free(h);
+		return NULL;
+	}
+	h->pid = -1;
+	h->fd_in = h->fd_out = -1;
+	list_add(&h->head, &option_helpers);
+
+found:
+	if (h->pid < 0 && option_helper_start(h, now) < 0)
+		return NULL;
+
+	return h;
+}
+
+/* read exactly len bytes from the helper, within the reply deadline */
+static int option_helper_read(struct option_helper *h, uint8_t *buf, int len, int *timeout)
+{
+	int pos = 0;
+
+	while (pos < len) {
+		struct pollfd pfd = { .fd = h->fd_out, .events = POLLIN };
+		struct timespec t0, t1;
+		ssize_t n;
+		int rc;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		rc = poll(&pfd, 1, *timeout);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		*timeout -= (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0 || *timeout < 0)
+			return -1;
+
+		n = read(h->fd_out, buf + pos, len - pos);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (n <= 0)
+			return -1;
+		pos += n;
+	}
+
+	return 0;
+}
+
+static int option_helper_call(struct option_helper *h, const char *request, int reqlen,
+		uint8_t *buf, int bufsize)
+{
+	int timeout = HELPER_TIMEOUT_MS;
+	char lenbuf[8];
+	int i, len;
+
+	if (write(h->fd_in, request, reqlen) != reqlen)
+		return -1;
+
+	/* reply header: decimal length terminated by a newline */
+	for (i = 0; i < (int)sizeof(lenbuf) - 1; i++) {
+		if (option_helper_read(h, (uint8_t *)&lenbuf[i], 1, &timeout) < 0)
+			return -1;
+		if (lenbuf[i] == '\n')
+			break;
+	}
+	if (i == (int)sizeof(lenbuf) - 1)
+		return -1;
+	lenbuf[i] = '\0';
+
+	if (sscanf(lenbuf, "%d", &len) != 1 || len < 0 || len > bufsize)
+		return -1;
+
+	if (option_helper_read(h, buf, len, &timeout) < 0)
+		return -1;
+
+	return len;
+}
+
+static int option_script_call(const char *script, const char *ifname, const char *phys_in,
+		const char *phys_out, const char *mac, uint8_t opt, uint8_t *buf, int bufsize)
+{
+	char cmd[1024];
+	FILE *fcmd;
+	int len;
+
+	/* command: script bridge inport outport dhclient_macaddr opt_num */
+	if (snprintf(cmd, sizeof(cmd), "'%s' '%s' '%s' '%s' '%s' %d",
+			script, ifname, phys_in, phys_out, mac, opt) >= (int)sizeof(cmd)) {
+		syslog(LOG_ERR, "Option format script command line too long");
+		return -1;
+	}
+
+	syslog(LOG_DEBUG, "Executing %s", cmd);
+	fcmd = popen(cmd, "r");
+	if (fcmd == NULL) {
+		syslog(LOG_ERR, "Failed to execute option format script");
+		return -1;
+	}
+
+	/* read one byte more than allowed to detect overlong options */
+	len = fread(buf, 1, bufsize + 1, fcmd);
+	pclose(fcmd);
+
+	if (len > bufsize) {
+		syslog(LOG_ERR, "Option %d too long", opt);
+		return -1;
+	}
+
+	return len;
+}
+
+/*#######################################################################
+ #                                                                      #
+ #  EXTERNAL FUNCTIONS                                                  #
+ #                                                                      #
+ ###################################################################### */
+
+/* Generates the content of option opt into buf, which must hold bufsize + 1 bytes.
+ * The helper is used when configured, the format script otherwise or if the
+ * helper is not available. Results are cached for iface->option_cache_ttl seconds.
+ * Returns the content length or -1 on error.
+ */
+int option_generate(struct interface *iface, const char *phys_in, const char *phys_out,
+		const char *mac, uint8_t opt, uint8_t *buf, int bufsize)
+{
+	char key[OPTION_CACHE_KEY_SIZE];
+	struct option_cache_entry *e;
+	time_t now = monotonic_time();
+	int len = -1;
+
+	if (bufsize > MAX_OPTION_LENGTH)
+		bufsize = MAX_OPTION_LENGTH;
+
+	snprintf(key, sizeof(key), "%s %s %s %s %d", iface->ifname,
+		phys_in[0] ? phys_in : "-", phys_out[0] ? phys_out : "-",
+		mac[0] ? mac : "-", opt);
+
+	if (iface->option_cache_ttl) {
+		e = option_cache_lookup(key, now);
+		if (e && e->len <= bufsize) {
+			stats.cache_hits++;
+			memcpy(buf, e->data, e->len);
+			return e->len;
+		}
+		stats.cache_misses++;
+	}
+
+	if (iface->format_helper) {
+		struct option_helper *h = option_helper_get(iface->format_helper, now);
+
+		if (h) {
+			char request[OPTION_CACHE_KEY_SIZE + 1];
+			int reqlen = snprintf(request, sizeof(request), "%s\n", key);
+
+			stats.helper_calls++;
+			len = option_helper_call(h, request, reqlen, buf, bufsize);
+			if (len < 0) {
+				syslog(LOG_ERR, "Option format helper %s failed for option %d, restarting it",
+					h->path, opt);
+				stats.helper_errors++;
+				option_helper_stop(h);
+				h->retry = now + HELPER_RESTART_DELAY;
+			}
+		}
+	}
+
+	if (len < 0 && iface->format_script) {
+		stats.script_calls++;
+		len = option_script_call(iface->format_script, iface->ifname,
+				phys_in, phys_out, mac, opt, buf, bufsize);
+	}
+
+	if (len >= 0 && iface->option_cache_ttl)
+		option_cache_store(key, buf, len, iface->option_cache_ttl, now);
+
+	return len;
+}
+
+void option_cache_flush(void)
+{
+	struct option_cache_entry *e, *n;
+
+	list_for_each_entry_safe(e, n, &option_cache_age, age)
+		option_cache_delete(e);
+}
+
+void option_helpers_close(void)
+{
+	struct option_helper *h, *n;
+
+	list_for_each_entry_safe(h, n, &option_helpers, head) {
+		option_helper_stop(h);
+		list_del(&h->head);
+		free(h->path);
+		free(h);
+	}
+}
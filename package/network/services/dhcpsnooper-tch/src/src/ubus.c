@@ -80,6 +80,7 @@ static const struct blobmsg_policy iface_attrs[IFACE_ATTR_MAX] = {
 };
 
 static struct ubus_context *ubus = NULL;
+static struct blob_buf b;
 static struct ubus_event_handler event_handler = { .cb = handle_event, };
 static struct ubus_subscriber netifd;
 static struct ubus_request req_dump = { .list = LIST_HEAD_INIT(req_dump.list) };
@@ -189,6 +190,66 @@ static void handle_event(_unused struct ubus_context *ctx, _unused struct ubus_e
 	subscribe_sync_netifd();
 }
 
+static int handle_stats(struct ubus_context *ctx, _unused struct ubus_object *obj,
+		struct ubus_request_data *req, _unused const char *method,
+		_unused struct blob_attr *msg)
+{
+	static const char *const latency_names[LATENCY_BUCKETS] = {
+		"lt_100us", "lt_1ms", "lt_10ms", "lt_100ms", "ge_100ms"
+	};
+	void *t;
+	int i;
+
+	blob_buf_init(&b, 0);
+
+	blobmsg_add_u64(&b, "packets", stats.packets);
+	blobmsg_add_u64(&b, "mangled", stats.mangled);
+	blobmsg_add_u64(&b, "unmodified", stats.unmodified);
+	blobmsg_add_u64(&b, "errors", stats.errors);
+	blobmsg_add_u64(&b, "verdict_batches", stats.verdict_batches);
+	blobmsg_add_u64(&b, "cache_hits", stats.cache_hits);
+	blobmsg_add_u64(&b, "cache_misses", stats.cache_misses);
+	blobmsg_add_u64(&b, "helper_calls", stats.helper_calls);
+	blobmsg_add_u64(&b, "helper_errors", stats.helper_errors);
+	blobmsg_add_u64(&b, "script_calls", stats.script_calls);
+
+	t = blobmsg_open_table(&b, "latency");
+	blobmsg_add_u32(&b, "min_us", stats.latency_min_us);
+	blobmsg_add_u32(&b, "max_us", stats.latency_max_us);
+	blobmsg_add_u32(&b, "avg_us", stats.packets ? stats.latency_total_us / stats.packets : 0);
+	for (i = 0; i < LATENCY_BUCKETS; i++)
+		blobmsg_add_u64(&b, latency_names[i], stats.latency_hist[i]);
+	blobmsg_close_table(&b, t);
+
+	ubus_send_reply(ctx, req, b.head);
+
+	return 0;
+}
+
+static int handle_stats_reset(_unused struct ubus_context *ctx, _unused struct ubus_object *obj,
+		_unused struct ubus_request_data *req, _unused const char *method,
+		_unused struct blob_attr *msg)
+{
+	memset(&stats, 0, sizeof(stats));
+
+	return 0;
+}
+
+static struct ubus_method main_object_methods[] = {
+	UBUS_METHOD_NOARG("stats", handle_stats),
+	UBUS_METHOD_NOARG("reset", handle_stats_reset),
+};
+
+static struct ubus_object_type main_object_type =
+	UBUS_OBJECT_TYPE("dhcpsnooper", main_object_methods);
+
+static struct ubus_object main_object = {
+	.name = "dhcpsnooper",
+	.type = &main_object_type,
+	.methods = main_object_methods,
+	.n_methods = ARRAY_SIZE(main_object_methods),
+};
+
 /*#######################################################################
  #                                                                      #
  #  EXTERNAL FUNCTIONS                                                  #
@@ -206,6 +267,7 @@ int ubus_init(void)
 	ubus_register_subscriber(ubus, &netifd);
 
 	ubus_add_uloop(ubus);
+	ubus_add_object(ubus, &main_object);
 	ubus_register_event_handler(ubus, &event_handler, "ubus.object.add");
 	if (!ubus_lookup_id(ubus, "network.interface", &objid))
 		subscribe_sync_netifd();
@@ -16,6 +16,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <netdb.h>
 
@@ -24,6 +25,7 @@
 #include "utils.h"
 #include "options.h"
 #include "ipset_entries.h"
+#include "ipset_nl.h"
 #include "icmp_codes.h"
 
 const struct option ipset_entry_opts[] = {
@@ -102,35 +104,58 @@ static struct ipset_entry_type ipset_entry_types[] = {
 	T(LIST,   SET,  UNSPEC, UNSPEC, 0, 0),                       //LIST_SET_INDEX
 };
 
+struct elem_buf
+{
+	char *p;
+	char *end;
+};
+
+static void
+elem_pr(struct elem_buf *b, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(b->p, b->end - b->p, fmt, args);
+	va_end(args);
+
+	/* on truncation, leave p at end so that the caller notices it */
+	if (len < 0 || len >= b->end - b->p)
+		b->p = b->end;
+	else
+		b->p += len;
+}
+
 static void
-ipset_entry_set_port(struct protoent *p_protoent, struct ipset_entry *p_ipset_entry)
+ipset_entry_set_port(struct elem_buf *b, struct protoent *p_protoent, struct ipset_entry *p_ipset_entry)
 {
 	if (p_ipset_entry->port.set)
 	{
 		if (p_ipset_entry->port.port_min < p_ipset_entry->port.port_max)
-			pr(",%s:%d-%d", p_protoent->p_name, p_ipset_entry->port.port_min, p_ipset_entry->port.port_max);
+			elem_pr(b, ",%s:%d-%d", p_protoent->p_name, p_ipset_entry->port.port_min, p_ipset_entry->port.port_max);
 		else
-			pr(",%s:%d", p_protoent->p_name, p_ipset_entry->port.port_min);
+			elem_pr(b, ",%s:%d", p_protoent->p_name, p_ipset_entry->port.port_min);
 	}
 	else if (p_ipset_entry->icmp.family == FAMILY_V4)
 	{
-		pr(",icmp:%d/%d", p_ipset_entry->icmp.type, p_ipset_entry->icmp.code_min);
+		elem_pr(b, ",icmp:%d/%d", p_ipset_entry->icmp.type, p_ipset_entry->icmp.code_min);
 	}
 	else if (p_ipset_entry->icmp.family == FAMILY_V6)
 	{
-		pr(",icmpv6:%d/%d", p_ipset_entry->icmp.type6, p_ipset_entry->icmp.code6_min);
+		elem_pr(b, ",icmpv6:%d/%d", p_ipset_entry->icmp.type6, p_ipset_entry->icmp.code6_min);
 	}
 }
 
 static void
-ipset_entry_set_ip(bool first, struct address ip)
+ipset_entry_set_ip(struct elem_buf *b, bool first, struct address ip)
 {
 	if (ip.set)
-		pr("%s%s", first ? " " : ",", address_to_string(&ip, false, true));
+		elem_pr(b, "%s%s", first ? "" : ",", address_to_string(&ip, false, true));
 }
 
 static void
-ipset_entry_set_ip_nocid(bool first, struct address ip)
+ipset_entry_set_ip_nocid(struct elem_buf *b, bool first, struct address ip)
 {
 	if (ip.set)
 	{
@@ -138,7 +163,7 @@ ipset_entry_set_ip_nocid(bool first, struct address ip)
 		char *p = strchr(ip_str, '/');
 
 		if (p) *p = '\0';
-		pr("%s%s", first ? " " : ",", ip_str);
+		elem_pr(b, "%s%s", first ? "" : ",", ip_str);
 	}
 }
 
@@ -325,12 +350,19 @@ ipset_entry_verify(struct uci_element *e, struct ipset_entry *ipset_entry)
 	return false;
 }
 
-static void
-create_ipset_entry(struct ipset_entry *ipset_entry, struct state *state)
+/* Formats the element of an entry the way "ipset add" expects it,
+ * timeout and nomatch flag are not part of it.
+ */
+bool
+format_ipset_entry(struct ipset_entry *ipset_entry, char *buf, size_t len)
 {
 	struct protoent *p_protoent = getprotobynumber(ipset_entry->proto.protocol);
+	struct elem_buf b = { buf, buf + len };
+
+	if (len == 0)
+		return false;
 
-	pr("add %s ",ipset_entry->ipset.name);
+	buf[0] = '\0';
 
 	if (ipset_entry->typelist == ipset_entry_types[HASH_IP_INDEX].types //ip
 		|| ipset_entry->typelist == ipset_entry_types[HASH_NET_INDEX].types //net
@@ -338,103 +370,78 @@ create_ipset_entry(struct ipset_entry *ipset_entry, struct state *state)
 		|| ipset_entry->typelist == ipset_entry_types[HASH_NET_PORT_INDEX].types) //net,port
 	{
 		if (ipset_entry->ipset.ptr->family == FAMILY_V6)
-			ipset_entry_set_ip_nocid(1, ipset_entry->ip);
+			ipset_entry_set_ip_nocid(&b, 1, ipset_entry->ip);
 		else
-			ipset_entry_set_ip(1, ipset_entry->ip);
-		ipset_entry_set_ip(1, ipset_entry->network);
-		ipset_entry_set_port(p_protoent, ipset_entry);
+			ipset_entry_set_ip(&b, 1, ipset_entry->ip);
+		ipset_entry_set_ip(&b, 1, ipset_entry->network);
+		ipset_entry_set_port(&b, p_protoent, ipset_entry);
 	}
 	else if (ipset_entry->typelist == ipset_entry_types[HASH_IP_PORT_IP_INDEX].types) //ip,port,ip
 	{
 		if (!strcmp(ipset_entry->ipset.dir[0],"src"))
 			if (ipset_entry->ipset.ptr->family == FAMILY_V6) // use plain IP addresses
-				ipset_entry_set_ip_nocid(1, ipset_entry->ip_src);
+				ipset_entry_set_ip_nocid(&b, 1, ipset_entry->ip_src);
 			else
-				ipset_entry_set_ip(1, ipset_entry->ip_src);
+				ipset_entry_set_ip(&b, 1, ipset_entry->ip_src);
 		else
 			if (ipset_entry->ipset.ptr->family == FAMILY_V6) // use plain IP addresses
-				ipset_entry_set_ip_nocid(1, ipset_entry->ip_dest);
+				ipset_entry_set_ip_nocid(&b, 1, ipset_entry->ip_dest);
 			else
-				ipset_entry_set_ip(1, ipset_entry->ip_dest);
+				ipset_entry_set_ip(&b, 1, ipset_entry->ip_dest);
 
-		ipset_entry_set_port(p_protoent, ipset_entry);
+		ipset_entry_set_port(&b, p_protoent, ipset_entry);
 
 		if (!strcmp(ipset_entry->ipset.dir[2],"src"))//plain ipaddress
-			ipset_entry_set_ip_nocid(0, ipset_entry->ip_src);
+			ipset_entry_set_ip_nocid(&b, 0, ipset_entry->ip_src);
 		else
-			ipset_entry_set_ip_nocid(0, ipset_entry->ip_dest);
+			ipset_entry_set_ip_nocid(&b, 0, ipset_entry->ip_dest);
 	}
 	else if (ipset_entry->typelist == ipset_entry_types[HASH_IP_PORT_NET_INDEX].types) //ip,port,net
 	{
 		if (ipset_entry->ipset.ptr->family == FAMILY_V6)
-			ipset_entry_set_ip_nocid(1, ipset_entry->ip);
+			ipset_entry_set_ip_nocid(&b, 1, ipset_entry->ip);
 		else
-			ipset_entry_set_ip(1, ipset_entry->ip);
-		ipset_entry_set_port(p_protoent, ipset_entry);
-		ipset_entry_set_ip(0, ipset_entry->network);
+			ipset_entry_set_ip(&b, 1, ipset_entry->ip);
+		ipset_entry_set_port(&b, p_protoent, ipset_entry);
+		ipset_entry_set_ip(&b, 0, ipset_entry->network);
 	}
 
-	if (ipset_entry->timeout > 0)
-		pr(" timeout %u", ipset_entry->timeout);
-
-	if (ipset_entry->nomatch)
-		pr(" nomatch");
-
-	pr("\n");
+	return b.p > buf && b.p < b.end;
 }
 
 void
 create_ipset_entries(struct state *state)
 {
-	bool exec = false;
+	char elem[IPSET_ELEM_MAXLEN];
 	struct ipset_entry *ipset_entry;
 
+	/* entries of sets managed by us are loaded by create_ipsets() */
 	list_for_each_entry(ipset_entry, &state->ipset_entries, list)
 	{
-		if (!exec)
-		{
-			exec = command_pipe(false, "ipset", "-exist", "-");
+		if (!ipset_entry->ipset.ptr->external)
+			continue;
 
-			if (!exec)
-				return;
-		}
+		if (!format_ipset_entry(ipset_entry, elem, sizeof(elem)))
+			continue;
 
-		create_ipset_entry(ipset_entry, state);
+		ipset_nl_add(ipset_entry->ipset.name, elem,
+		             ipset_entry->timeout, ipset_entry->nomatch);
 	}
 
-	if (exec)
-	{
-		pr("quit\n");
-		command_close();
-	}
+	ipset_nl_commit();
 }
 
 void
 flush_ipset_entries(struct state *state)
 {
-	bool exec = false;
 	struct ipset_entry *ipset_entry;
 
 	/* flush ipset entries */
 	list_for_each_entry(ipset_entry, &state->ipset_entries, list)
 	{
-		if (!exec)
-		{
-			exec = command_pipe(false, "ipset", "-exist", "-");
-
-			if (!exec)
-				return;
-		}
-
 		info(" * Flushing entries of ipset %s", ipset_entry->ipset.name);
 
-		pr("flush %s\n", ipset_entry->ipset.name);
-	}
-
-	if (exec)
-	{
-		pr("quit\n");
-		command_close();
+		ipset_nl_flush(ipset_entry->ipset.name);
 	}
 }
 
@@ -23,8 +23,12 @@
 #include "utils.h"
 #include "ipsets.h"
 
+/* big enough for "ip,proto:port-port,ip" with IPv6 addresses and ranges */
+#define IPSET_ELEM_MAXLEN	256
+
 extern const struct option ipset_entry_opts[];
 
+bool format_ipset_entry(struct ipset_entry *ipset_entry, char *buf, size_t len);
 void load_ipset_entries(struct state *state);
 void create_ipset_entries(struct state *state);
 void flush_ipset_entries(struct state *state);
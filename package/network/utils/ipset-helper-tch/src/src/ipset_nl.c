@@ -0,0 +1,318 @@
+/*
+ * ipset_nl.c
+ *
+ * Netlink (libipset) backend used to manipulate kernel ipsets without
+ * spawning the ipset utility.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <libipset/data.h>
+#include <libipset/parse.h>
+#include <libipset/session.h>
+#include <libipset/types.h>
+
+#include "utils.h"
+#include "ipset_nl.h"
+
+static struct ipset_session *session = NULL;
+
+/* add/del requests are aggregated by libipset only when they carry a
+ * (restore) line number */
+static uint32_t lineno = 0;
+
+static char *save_buf = NULL;
+static size_t save_len = 0;
+static size_t save_size = 0;
+
+
+/* collects the output of list requests, which may come in several chunks */
+static int
+save_output(const char *fmt, ...)
+{
+	va_list args;
+	int len;
+	char *tmp;
+
+	va_start(args, fmt);
+	len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+
+	if (len < 0)
+		return len;
+
+	if (save_len + len + 1 > save_size)
+	{
+		size_t size = save_size ? save_size : 4096;
+
+		while (save_len + len + 1 > size)
+			size *= 2;
+
+		tmp = realloc(save_buf, size);
+
+		if (!tmp)
+			return -1;
+
+		save_buf = tmp;
+		save_size = size;
+	}
+
+	va_start(args, fmt);
+	vsnprintf(save_buf + save_len, save_size - save_len, fmt, args);
+	va_end(args);
+
+	save_len += len;
+
+	return len;
+}
+
+static bool
+report(const char *name, bool quiet)
+{
+	const char *msg = ipset_session_error(session);
+
+	if (msg && !quiet)
+		warn("ipset %s: %s", name, msg);
+
+	ipset_session_report_reset(session);
+
+	return false;
+}
+
+static bool
+set_name(const char *name, bool quiet)
+{
+	ipset_data_reset(ipset_session_data(session));
+
+	if (ipset_parse_setname(session, IPSET_SETNAME, name) < 0)
+		return report(name, quiet);
+
+	return true;
+}
+
+static bool
+run_cmd(enum ipset_cmd cmd, const char *name, bool quiet)
+{
+	if (ipset_cmd(session, cmd, 0) < 0)
+		return report(name, quiet);
+
+	return true;
+}
+
+bool
+ipset_nl_open(void)
+{
+	if (session)
+		return true;
+
+	ipset_load_types();
+
+	session = ipset_session_init(save_output);
+
+	if (!session)
+		return false;
+
+	/* same semantics as "ipset -exist" */
+	ipset_envopt_parse(session, IPSET_ENV_EXIST, NULL);
+	ipset_session_output(session, IPSET_LIST_SAVE);
+
+	return true;
+}
+
+void
+ipset_nl_close(void)
+{
+	if (!session)
+		return;
+
+	ipset_nl_commit();
+	ipset_session_fini(session);
+	session = NULL;
+
+	free(save_buf);
+	save_buf = NULL;
+	save_len = save_size = 0;
+}
+
+bool
+ipset_nl_create(const char *name, const char *type, const char *family,
+                const char *range, int timeout, int maxelem,
+                int netmask, int hashsize)
+{
+	char buf[16];
+
+	if (!set_name(name, false))
+		return false;
+
+	if (ipset_parse_typename(session, IPSET_OPT_TYPENAME, type) < 0 ||
+	    !ipset_type_get(session, IPSET_CMD_CREATE))
+		return report(name, false);
+
+	if (family && ipset_parse_family(session, IPSET_OPT_FAMILY, family) < 0)
+		return report(name, false);
+
+	if (range)
+	{
+		if (!strncmp(type, "bitmap:port", strlen("bitmap:port")))
+		{
+			if (ipset_parse_tcp_port(session, IPSET_OPT_PORT, range) < 0)
+				return report(name, false);
+		}
+		else if (ipset_parse_netrange(session, IPSET_OPT_IP, range) < 0)
+		{
+			return report(name, false);
+		}
+	}
+
+	if (timeout > 0)
+	{
+		snprintf(buf, sizeof(buf), "%u", timeout);
+		if (ipset_parse_timeout(session, IPSET_OPT_TIMEOUT, buf) < 0)
+			return report(name, false);
+	}
+
+	if (maxelem > 0)
+	{
+		snprintf(buf, sizeof(buf), "%u", maxelem);
+		if (ipset_parse_uint32(session, IPSET_OPT_MAXELEM, buf) < 0)
+			return report(name, false);
+	}
+
+	if (netmask > 0)
+	{
+		snprintf(buf, sizeof(buf), "%u", netmask);
+		if (ipset_parse_netmask(session, IPSET_OPT_NETMASK, buf) < 0)
+			return report(name, false);
+	}
+
+	if (hashsize > 0)
+	{
+		snprintf(buf, sizeof(buf), "%u", hashsize);
+		if (ipset_parse_uint32(session, IPSET_OPT_HASHSIZE, buf) < 0)
+			return report(name, false);
+	}
+
+	return run_cmd(IPSET_CMD_CREATE, name, false);
+}
+
+bool
+ipset_nl_destroy(const char *name, bool quiet)
+{
+	if (!set_name(name, quiet))
+		return false;
+
+	return run_cmd(IPSET_CMD_DESTROY, name, quiet);
+}
+
+bool
+ipset_nl_flush(const char *name)
+{
+	if (!set_name(name, false))
+		return false;
+
+	return run_cmd(IPSET_CMD_FLUSH, name, false);
+}
+
+bool
+ipset_nl_rename(const char *from, const char *to)
+{
+	if (!set_name(from, false))
+		return false;
+
+	if (ipset_parse_setname(session, IPSET_OPT_SETNAME2, to) < 0)
+		return report(from, false);
+
+	return run_cmd(IPSET_CMD_RENAME, from, false);
+}
+
+bool
+ipset_nl_swap(const char *from, const char *to)
+{
+	if (!set_name(from, false))
+		return false;
+
+	if (ipset_parse_setname(session, IPSET_OPT_SETNAME2, to) < 0)
+		return report(from, false);
+
+	return run_cmd(IPSET_CMD_SWAP, from, false);
+}
+
+static bool
+adt_elem(enum ipset_cmd cmd, const char *name, const char *elem,
+         int timeout, bool nomatch)
+{
+	const struct ipset_type *type;
+	char buf[16];
+
+	if (!set_name(name, false))
+		return false;
+
+	if (!(type = ipset_type_get(session, cmd)) ||
+	    ipset_parse_elem(session, type->last_elem_optional, elem) < 0)
+		return report(name, false);
+
+	if (timeout > 0)
+	{
+		snprintf(buf, sizeof(buf), "%u", timeout);
+		if (ipset_parse_timeout(session, IPSET_OPT_TIMEOUT, buf) < 0)
+			return report(name, false);
+	}
+
+	if (nomatch && ipset_parse_flag(session, IPSET_OPT_NOMATCH, NULL) < 0)
+		return report(name, false);
+
+	if (pr_debug)
+		info("%s %s %s", cmd == IPSET_CMD_ADD ? "add" : "del", name, elem);
+
+	if (ipset_cmd(session, cmd, ++lineno) < 0)
+		return report(name, false);
+
+	return true;
+}
+
+bool
+ipset_nl_add(const char *name, const char *elem, int timeout, bool nomatch)
+{
+	return adt_elem(IPSET_CMD_ADD, name, elem, timeout, nomatch);
+}
+
+bool
+ipset_nl_del(const char *name, const char *elem)
+{
+	return adt_elem(IPSET_CMD_DEL, name, elem, 0, false);
+}
+
+bool
+ipset_nl_commit(void)
+{
+	lineno = 0;
+
+	if (ipset_commit(session) < 0)
+		return report("commit", false);
+
+	return true;
+}
+
+char *
+ipset_nl_save(const char *name)
+{
+	char *rv;
+
+	if (!set_name(name, true))
+		return NULL;
+
+	save_len = 0;
+
+	if (!run_cmd(IPSET_CMD_LIST, name, true) || !save_buf)
+		return NULL;
+
+	save_buf[save_len] = '\0';
+	rv = save_buf;
+
+	save_buf = NULL;
+	save_len = save_size = 0;
+
+	return rv;
+}
@@ -0,0 +1,36 @@
+/*
+ * ipset_nl.h
+ *
+ * Netlink (libipset) backend used to manipulate kernel ipsets without
+ * spawning the ipset utility.
+ *
+ * This file must not depend on options.h: the libipset headers define a
+ * "struct ipset_type" which clashes with our "enum ipset_type".
+ */
+
+#ifndef SRC_IPSET_NL_H_
+#define SRC_IPSET_NL_H_
+
+#include <stdbool.h>
+
+bool ipset_nl_open(void);
+void ipset_nl_close(void);
+
+bool ipset_nl_create(const char *name, const char *type, const char *family,
+                     const char *range, int timeout, int maxelem,
+                     int netmask, int hashsize);
+bool ipset_nl_destroy(const char *name, bool quiet);
+bool ipset_nl_flush(const char *name);
+bool ipset_nl_rename(const char *from, const char *to);
+bool ipset_nl_swap(const char *from, const char *to);
+
+/* add/del requests are aggregated, send them with ipset_nl_commit() */
+bool ipset_nl_add(const char *name, const char *elem, int timeout, bool nomatch);
+bool ipset_nl_del(const char *name, const char *elem);
+bool ipset_nl_commit(void);
+
+/* returns the set in "ipset save" format (to be freed by the caller),
+ * NULL if it does not exist */
+char * ipset_nl_save(const char *name);
+
+#endif /* SRC_IPSET_NL_H_ */
@@ -16,12 +16,15 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdio.h>
 #include <string.h>
 
 #include "libubox/utils.h"
 #include "utils.h"
 #include "options.h"
 #include "ipsets.h"
+#include "ipset_entries.h"
+#include "ipset_nl.h"
 
 
 const struct option ipset_opts[] = {
@@ -299,132 +302,323 @@ load_ipsets(struct state *state)
 }
 
 
-static void
-create_ipset(struct ipset *ipset, struct state *state)
+static bool
+create_ipset(struct ipset *ipset, const char *name)
 {
-	bool first = true;
-
-	struct ipset_datatype *type;
+	char type[64], range[sizeof("65535-65535")];
+	const char *family = NULL;
+	const char *iprange = NULL;
+	struct ipset_datatype *dt;
+	int len;
 
-	info(" * Creating ipset %s", ipset->name);
-
-	first = true;
-	pr("create %s %s", ipset->name, ipset_method_names[ipset->method]);
+	len = snprintf(type, sizeof(type), "%s", ipset_method_names[ipset->method]);
 
-	list_for_each_entry(type, &ipset->datatypes, list)
+	list_for_each_entry(dt, &ipset->datatypes, list)
 	{
-		pr("%c%s", first ? ':' : ',', ipset_type_names[type->type]);
-		first = false;
+		len += snprintf(type + len, sizeof(type) - len, "%c%s",
+		                (dt->list.prev == &ipset->datatypes) ? ':' : ',',
+		                ipset_type_names[dt->type]);
 	}
 
 	if (ipset->method == IPSET_METHOD_HASH)
-		pr(" family inet%s", (ipset->family == FAMILY_V4) ? "" : "6");
+		family = (ipset->family == FAMILY_V4) ? "inet" : "inet6";
 
 	if (ipset->iprange.set)
 	{
-		pr(" range %s", address_to_string(&ipset->iprange, false, true));
+		iprange = address_to_string(&ipset->iprange, false, true);
 	}
 	else if (ipset->portrange.set)
 	{
-		pr(" range %u-%u",
-		       ipset->portrange.port_min, ipset->portrange.port_max);
+		snprintf(range, sizeof(range), "%u-%u",
+		         ipset->portrange.port_min, ipset->portrange.port_max);
+		iprange = range;
 	}
 
-	if (ipset->timeout > 0)
-		pr(" timeout %u", ipset->timeout);
+	return ipset_nl_create(name, type, family, iprange, ipset->timeout,
+	                       ipset->maxelem, ipset->netmask, ipset->hashsize);
+}
+
+static void
+fill_ipset(struct state *state, struct ipset *ipset, const char *name)
+{
+	char elem[IPSET_ELEM_MAXLEN];
+	struct ipset_entry *ipset_entry;
 
-	if (ipset->maxelem > 0)
-		pr(" maxelem %u", ipset->maxelem);
+	list_for_each_entry(ipset_entry, &state->ipset_entries, list)
+	{
+		if (ipset_entry->ipset.ptr != ipset)
+			continue;
 
-	if (ipset->netmask > 0)
-		pr(" netmask %u", ipset->netmask);
+		if (!format_ipset_entry(ipset_entry, elem, sizeof(elem)))
+			continue;
 
-	if (ipset->hashsize > 0)
-		pr(" hashsize %u", ipset->hashsize);
+		ipset_nl_add(name, elem, ipset_entry->timeout, ipset_entry->nomatch);
+	}
 
-	pr("\n");
+	ipset_nl_commit();
 }
 
-void
-create_ipsets(struct state *state)
+/* one "add <set> <elem> [options]" line of an "ipset save" output */
+struct member
 {
-	int tries;
-	bool exec = false;
-	struct ipset *ipset;
+	char *elem;
+	char *opts;
+};
 
+static int
+cmp_member(const void *a, const void *b)
+{
+	return strcmp(((const struct member *)a)->elem,
+	              ((const struct member *)b)->elem);
+}
 
-	/* spawn ipsets */
-	list_for_each_entry(ipset, &state->ipsets, list)
+/* Splits a save output into its header (the create options) and its sorted
+ * members. The buffer is modified in place.
+ */
+static bool
+parse_save(char *save, char **header, struct member **members, int *count)
+{
+	struct member *m = NULL, *tmp;
+	int n = 0, size = 0;
+	char *line, *next, *p;
+
+	*header = NULL;
+
+	for (line = save; line && *line; line = next)
 	{
-		if (ipset->external)
+		if ((next = strchr(line, '\n')) != NULL)
+			*next++ = '\0';
+
+		/* skip the command and the set name */
+		if (!(p = strchr(line, ' ')) || !(p = strchr(p + 1, ' ')))
+			continue;
+
+		p++;
+
+		if (!strncmp(line, "create ", 7))
+		{
+			*header = p;
+			continue;
+		}
+
+		if (strncmp(line, "add ", 4))
 			continue;
 
-		if (!exec)
+		if (n == size)
 		{
-			exec = command_pipe(false, "ipset", "-exist", "-");
+			size = size ? size * 2 : 64;
+			tmp = realloc(m, size * sizeof(*m));
+
+			if (!tmp)
+			{
+				free(m);
+				return false;
+			}
 
-			if (!exec)
-				return;
+			m = tmp;
 		}
 
-		create_ipset(ipset, state);
-	}
+		m[n].elem = p;
+		m[n].opts = "";
 
-	if (exec)
-	{
-		pr("quit\n");
-		command_close();
+		if ((p = strchr(p, ' ')) != NULL)
+		{
+			*p++ = '\0';
+			m[n].opts = p;
+		}
+
+		n++;
 	}
 
-	/* wait for ipsets to appear */
-	list_for_each_entry(ipset, &state->ipsets, list)
-	{
-		if (ipset->external)
-			continue;
+	if (n)
+		qsort(m, n, sizeof(*m), cmp_member);
 
-		for (tries = 0; !check_ipset(ipset) && tries < 10; tries++)
-			usleep(50000);
-	}
+	*members = m;
+	*count = n;
+
+	return *header != NULL;
 }
 
-void
-destroy_ipsets(struct state *state)
+/* hashsize grows with the number of members, it does not make two
+ * headers different */
+static bool
+same_header(const char *a, const char *b)
 {
-	int tries;
-	bool exec = false;
-	struct ipset *ipset;
+	const char *ha = strstr(a, " hashsize ");
+	const char *hb = strstr(b, " hashsize ");
 
-	/* destroy ipsets */
-	list_for_each_entry(ipset, &state->ipsets, list)
+	if (!ha || !hb)
+		return !strcmp(a, b);
+
+	if ((ha - a) != (hb - b) || strncmp(a, b, ha - a))
+		return false;
+
+	ha = strchr(ha + strlen(" hashsize "), ' ');
+	hb = strchr(hb + strlen(" hashsize "), ' ');
+
+	return !strcmp(ha ? ha : "", hb ? hb : "");
+}
+
+static void
+add_member(const char *name, struct member *m)
+{
+	char *p, *end;
+	int timeout = 0;
+
+	if ((p = strstr(m->opts, "timeout ")) != NULL)
+		timeout = strtol(p + strlen("timeout "), &end, 10);
+
+	ipset_nl_add(name, m->elem, timeout, strstr(m->opts, "nomatch") != NULL);
+}
+
+/* Brings the members of the live set to the members of the staging set.
+ * Members with a timeout are always refreshed, like a reload used to do.
+ */
+static void
+update_members(const char *name, struct member *cur, int ncur,
+               struct member *new, int nnew)
+{
+	int i = 0, j = 0, cmp, added = 0, deleted = 0;
+
+	while (i < ncur || j < nnew)
 	{
-		if (!exec)
+		if (i == ncur)
+			cmp = 1;
+		else if (j == nnew)
+			cmp = -1;
+		else
+			cmp = strcmp(cur[i].elem, new[j].elem);
+
+		if (cmp < 0)
+		{
+			ipset_nl_del(name, cur[i++].elem);
+			deleted++;
+		}
+		else if (cmp > 0)
+		{
+			add_member(name, &new[j++]);
+			added++;
+		}
+		else
 		{
-			exec = command_pipe(false, "ipset", "-exist", "-");
+			if (strcmp(cur[i].opts, new[j].opts) || strstr(new[j].opts, "timeout "))
+			{
+				add_member(name, &new[j]);
+				added++;
+			}
 
-			if (!exec)
-				return;
+			i++;
+			j++;
 		}
+	}
 
-		info(" * Deleting ipset %s", ipset->name);
+	ipset_nl_commit();
 
-		pr("flush %s\n", ipset->name);
-		pr("destroy %s\n", ipset->name);
-	}
+	if (added || deleted)
+		info("   %d added, %d deleted", added, deleted);
+}
+
+/* Loads the wanted definition and members of a set into a staging set, then
+ * either renames it (new set), applies the member delta to the live set
+ * (same definition) or swaps it with the live set (changed definition), so
+ * that the live set never shows up empty or partially loaded.
+ * The kernel only swaps sets of the same type and family. Other changes
+ * replace the live set by the staging set, which fails if the live set is
+ * referenced, e.g. by an iptables rule.
+ * Returns false if the set could not be brought to its definition.
+ */
+static bool
+sync_ipset(struct state *state, struct ipset *ipset)
+{
+	char *cur_save, *new_save;
+	char *cur_header, *new_header;
+	struct member *cur = NULL, *new = NULL;
+	int ncur = 0, nnew = 0;
+	bool parsed = false;
+	bool ok = true;
+
+	info(" * Creating ipset %s", ipset->name);
+
+	ipset_nl_destroy(IPSET_STAGING_NAME, true);
+
+	if (!create_ipset(ipset, IPSET_STAGING_NAME))
+		return false;
+
+	fill_ipset(state, ipset, IPSET_STAGING_NAME);
+
+	if (!(cur_save = ipset_nl_save(ipset->name)))
+		return ipset_nl_rename(IPSET_STAGING_NAME, ipset->name);
+
+	new_save = ipset_nl_save(IPSET_STAGING_NAME);
 
-	if (exec)
+	if (new_save)
+		parsed = parse_save(cur_save, &cur_header, &cur, &ncur) &&
+		         parse_save(new_save, &new_header, &new, &nnew);
+
+	if (parsed && same_header(cur_header, new_header))
+	{
+		update_members(ipset->name, cur, ncur, new, nnew);
+	}
+	else if (!ipset_nl_swap(IPSET_STAGING_NAME, ipset->name))
 	{
-		pr("quit\n");
-		command_close();
+		info("   cannot be swapped (type or family changed), re-creating it");
+
+		if (ipset_nl_destroy(ipset->name, false))
+		{
+			ok = ipset_nl_rename(IPSET_STAGING_NAME, ipset->name);
+		}
+		else
+		{
+			warn("Cannot replace ipset %s, it is in use: keeping its current definition",
+			     ipset->name);
+			ok = false;
+		}
 	}
 
-	/* wait for ipsets to disappear */
+	ipset_nl_destroy(IPSET_STAGING_NAME, true);
+
+	free(cur);
+	free(new);
+	free(cur_save);
+	free(new_save);
+
+	return ok;
+}
+
+/* returns false if one of the sets could not be brought to its definition */
+bool
+create_ipsets(struct state *state)
+{
+	struct ipset *ipset;
+	bool ok = true;
+
 	list_for_each_entry(ipset, &state->ipsets, list)
 	{
 		if (ipset->external)
 			continue;
 
-		for (tries = 0; check_ipset(ipset) && tries < 10; tries++)
-			usleep(50000);
+		if (!sync_ipset(state, ipset))
+			ok = false;
+	}
+
+	return ok;
+}
+
+/* destroys the sets of state that are not defined in keep (if given) */
+void
+destroy_ipsets(struct state *state, struct state *keep)
+{
+	struct ipset *ipset, *k;
+
+	list_for_each_entry(ipset, &state->ipsets, list)
+	{
+		if (keep && (k = lookup_ipset(keep, ipset->name)) != NULL && !k->external)
+			continue;
+
+		info(" * Deleting ipset %s", ipset->name);
+
+		ipset_nl_flush(ipset->name);
+		ipset_nl_destroy(ipset->name, false);
 	}
 }
 
@@ -25,12 +25,15 @@
 #include "utils.h"
 
 
+/* temporary set used to load a set before it replaces the live one */
+#define IPSET_STAGING_NAME	"ipset-helper.tmp"
+
 extern const struct option ipset_opts[];
 
 struct ipset * alloc_ipset(void);
 void load_ipsets(struct state *state);
-void create_ipsets(struct state *state);
-void destroy_ipsets(struct state *state);
+bool create_ipsets(struct state *state);
+void destroy_ipsets(struct state *state, struct state *keep);
 int update_state(struct state *state);
 void merge_state(struct state *dst, const struct state *src);
 
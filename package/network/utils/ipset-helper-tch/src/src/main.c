@@ -10,6 +10,7 @@
 #include "options.h"
 #include "ipsets.h"
 #include "ipset_entries.h"
+#include "ipset_nl.h"
 
 
 static struct state* run_state = NULL;
@@ -66,9 +67,9 @@ build_state(bool runtime)
 			error("Failed to load /etc/config/ipset");
 		}
 
-		if (!find_command("ipset"))
+		if (!ipset_nl_open())
 		{
-			error("Unable to locate ipset utility, disabling ipset support");
+			error("Unable to initialize ipset netlink session, disabling ipset support");
 		}
 
 		cfg_state = state;
@@ -103,12 +104,15 @@ free_state(struct state *state)
 static int
 start(void)
 {
-	/* Try to destroy all of the previous entries from the state file
+	int rv = 0;
+
+	/* Destroy the sets of the state file that are no longer configured,
+	 * the others are updated in place by create_ipsets()
 	 */
 	if (run_state)
 	{
 		update_state(run_state);
-		destroy_ipsets(run_state);
+		destroy_ipsets(run_state, cfg_state);
 	}
 
 	if (!cfg_state)
@@ -118,13 +122,14 @@ start(void)
 		return -1;
 	}
 
-	create_ipsets(cfg_state);
+	if (!create_ipsets(cfg_state))
+		rv = 1;
 	create_ipset_entries(cfg_state);
 
 	merge_state(cfg_state, run_state);
 	write_statefile(cfg_state);
 
-	return 0;
+	return rv;
 }
 
 static int
@@ -134,7 +139,7 @@ stop(void)
 		return -1;
 
 	flush_ipset_entries(run_state);
-	destroy_ipsets(run_state);
+	destroy_ipsets(run_state, NULL);
 
 	if (update_state(run_state) == 0)
 		unlink(STATEFILE);
@@ -226,5 +231,7 @@ out:
 
 	if (run_state)
 		free_state(run_state);
+
+	ipset_nl_close();
 	return rv;
 }
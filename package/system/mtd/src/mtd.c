@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/syscall.h>
 #include <fcntl.h>
@@ -46,6 +47,7 @@
 #include "mtd.h"
 
 #include <libubox/md5.h>
+#include "sha256.h"
 
 #define MAX_ARGS 8
 #define JFFS2_DEFAULT_DIR	"" /* directory name without /, empty means root dir */
@@ -56,11 +58,32 @@ static char *jffs2file = NULL, *jffs2dir = JFFS2_DEFAULT_DIR;
 static int buflen = 0;
 int quiet;
 int no_erase;
+int skip_unchanged;
+int verify_write;
 int mtdsize = 0;
 int erasesize = 0;
 int jffs2_skip_bytes=0;
 int mtdtype = 0;
 
+/* flash and images are read at least this much at a time */
+#define MTD_READ_CHUNK	(64 * 1024)
+
+enum {
+	HASH_MD5,
+	HASH_SHA256,
+};
+
+static int hash_type = HASH_MD5;
+
+struct mtd_hash {
+	union {
+		md5_ctx_t md5;
+		sha256_ctx_t sha256;
+	} ctx;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	int len;
+};
+
 int mtd_open(const char *mtd, bool block)
 {
 	FILE *fp;
@@ -273,11 +296,121 @@ mtd_erase(const char *mtd)
 
 }
 
+static void
+mtd_hash_begin(struct mtd_hash *h)
+{
+	if (hash_type == HASH_SHA256)
+		sha256_begin(&h->ctx.sha256);
+	else
+		md5_begin(&h->ctx.md5);
+}
+
+static void
+mtd_hash_update(struct mtd_hash *h, const void *data, size_t len)
+{
+	if (hash_type == HASH_SHA256)
+		sha256_hash(data, len, &h->ctx.sha256);
+	else
+		md5_hash(data, len, &h->ctx.md5);
+}
+
+static void
+mtd_hash_end(struct mtd_hash *h)
+{
+	if (hash_type == HASH_SHA256) {
+		sha256_end(h->digest, &h->ctx.sha256);
+		h->len = SHA256_DIGEST_SIZE;
+	} else {
+		md5_end(h->digest, &h->ctx.md5);
+		h->len = 16;
+	}
+}
+
+static void
+mtd_hash_print(struct mtd_hash *h, const char *name)
+{
+	int i;
+
+	for (i = 0; i < h->len; i++)
+		fprintf(stderr, "%02x", h->digest[i]);
+	fprintf(stderr, " - %s\n", name);
+}
+
+/* compares and prints the digests, returns 0 if they match */
+static int
+mtd_hash_compare(struct mtd_hash *m, const char *mtd,
+		 struct mtd_hash *f, const char *file)
+{
+	int ret;
+
+	mtd_hash_print(m, mtd);
+	mtd_hash_print(f, file);
+
+	ret = memcmp(m->digest, f->digest, m->len);
+	if (!ret)
+		fprintf(stderr, "Success\n");
+	else
+		fprintf(stderr, "Failed\n");
+
+	return ret;
+}
+
+/* reads until len bytes, end of file or an error */
+static ssize_t
+read_full(int fd, char *dest, size_t len)
+{
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < len) {
+		r = read(fd, dest + done, len - done);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (!r)
+			break;
+		done += r;
+	}
+
+	return done;
+}
+
+static int
+write_full(int fd, const char *data, size_t len)
+{
+	ssize_t r;
+
+	while (len > 0) {
+		r = write(fd, data, len);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += r;
+		len -= r;
+	}
+
+	return 0;
+}
+
+/* read size used for dump and verify, a multiple of the erase size */
+static int
+mtd_read_chunk(void)
+{
+	if (erasesize >= MTD_READ_CHUNK)
+		return erasesize;
+
+	return MTD_READ_CHUNK - MTD_READ_CHUNK % erasesize;
+}
+
 static int
 mtd_dump(const char *mtd, int part_offset, int size)
 {
 	int ret = 0, offset = 0;
-	int fd;
+	int fd, chunk;
 	char *buf;
 
 	if (quiet < 2)
@@ -295,17 +428,20 @@ mtd_dump(const char *mtd, int part_offset, int size)
 	if (part_offset)
 		lseek(fd, part_offset, SEEK_SET);
 
-	buf = malloc(erasesize);
-	if (!buf)
+	/* bad blocks have to be skipped one eraseblock at a time */
+	chunk = (mtdtype == MTD_NANDFLASH) ? erasesize : mtd_read_chunk();
+
+	buf = malloc(chunk);
+	if (!buf) {
+		close(fd);
 		return -1;
+	}
 
 	do {
-		int len = (size > erasesize) ? (erasesize) : (size);
-		int rlen = read(fd, buf, len);
+		int len = (size > chunk) ? (chunk) : (size);
+		int rlen = read_full(fd, buf, len);
 
 		if (rlen < 0) {
-			if (errno == EINTR)
-				continue;
 			ret = -1;
 			goto out;
 		}
@@ -315,12 +451,16 @@ mtd_dump(const char *mtd, int part_offset, int size)
 			fprintf(stderr, "skipping bad block at 0x%08x\n", offset);
 		} else {
 			size -= rlen;
-			write(1, buf, rlen);
+			if (write_full(1, buf, rlen) < 0) {
+				ret = -1;
+				goto out;
+			}
 		}
 		offset += rlen;
 	} while (size > 0);
 
 out:
+	free(buf);
 	close(fd);
 	return ret;
 }
@@ -328,16 +468,16 @@ out:
 static int
 mtd_verify(const char *mtd, char *file)
 {
-	uint32_t f_md5[4], m_md5[4];
+	struct mtd_hash f_hash, m_hash;
 	struct stat s;
-	md5_ctx_t ctx;
-	int ret = 0;
-	int fd;
+	char *fbuf = NULL, *mbuf = NULL;
+	int ret = -1;
+	int fd, ffd, chunk;
 
 	if (quiet < 2)
 		fprintf(stderr, "Verifying %s against %s ...\n", mtd, file);
 
-	if (stat(file, &s) || md5sum(file, f_md5) < 0) {
+	if (stat(file, &s) || (ffd = open(file, O_RDONLY)) < 0) {
 		fprintf(stderr, "Failed to hash %s\n", file);
 		return -1;
 	}
@@ -345,43 +485,213 @@ mtd_verify(const char *mtd, char *file)
 	fd = mtd_check_open(mtd);
 	if(fd < 0) {
 		fprintf(stderr, "Could not open mtd device: %s\n", mtd);
+		close(ffd);
 		return -1;
 	}
 
-	md5_begin(&ctx);
-	do {
-		char buf[256];
-		int len = (s.st_size > sizeof(buf)) ? (sizeof(buf)) : (s.st_size);
-		int rlen = read(fd, buf, len);
-
-		if (rlen < 0) {
-			if (errno == EINTR)
-				continue;
-			ret = -1;
+	chunk = mtd_read_chunk();
+	fbuf = malloc(chunk);
+	mbuf = malloc(chunk);
+	if (!fbuf || !mbuf)
+		goto out;
+
+	/* hash the image and the flash contents in the same pass */
+	mtd_hash_begin(&f_hash);
+	mtd_hash_begin(&m_hash);
+	while (s.st_size > 0) {
+		int len = (s.st_size > chunk) ? (chunk) : (s.st_size);
+		int flen = read_full(ffd, fbuf, len);
+		int mlen = read_full(fd, mbuf, len);
+
+		if (flen < 0) {
+			fprintf(stderr, "Failed to hash %s\n", file);
 			goto out;
 		}
-		if (!rlen)
-			break;
-		md5_hash(buf, rlen, &ctx);
-		s.st_size -= rlen;
-	} while (s.st_size > 0);
+		if (mlen < 0)
+			goto out;
 
-	md5_end(m_md5, &ctx);
+		mtd_hash_update(&f_hash, fbuf, flen);
+		mtd_hash_update(&m_hash, mbuf, mlen);
+		if (flen < len || mlen < len)
+			break;
+		s.st_size -= len;
+	}
+	mtd_hash_end(&f_hash);
+	mtd_hash_end(&m_hash);
 
-	fprintf(stderr, "%08x%08x%08x%08x - %s\n", m_md5[0], m_md5[1], m_md5[2], m_md5[3], mtd);
-	fprintf(stderr, "%08x%08x%08x%08x - %s\n", f_md5[0], f_md5[1], f_md5[2], f_md5[3], file);
-
-	ret = memcmp(f_md5, m_md5, sizeof(m_md5));
-	if (!ret)
-		fprintf(stderr, "Success\n");
-	else
-		fprintf(stderr, "Failed\n");
+	ret = mtd_hash_compare(&m_hash, mtd, &f_hash, file);
 
 out:
+	free(fbuf);
+	free(mbuf);
+	close(ffd);
 	close(fd);
 	return ret;
 }
 
+/*
+ * Image reader thread: reads the image into two eraseblock sized buffers
+ * while the previous block is being erased and written.
+ */
+static struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int fd;
+	char *data[2];
+	int len[2];
+	int full[2];
+	int rd, pos;
+	int err;
+	bool active;
+} reader;
+
+static void *
+reader_thread(void *arg)
+{
+	int wr = 0, len;
+	ssize_t r = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&reader.lock);
+		while (reader.full[wr])
+			pthread_cond_wait(&reader.cond, &reader.lock);
+		pthread_mutex_unlock(&reader.lock);
+
+		len = 0;
+		while (len < erasesize) {
+			r = read(reader.fd, reader.data[wr] + len, erasesize - len);
+			if (r < 0) {
+				if ((errno == EINTR) || (errno == EAGAIN))
+					continue;
+				break;
+			}
+			if (r == 0)
+				break;
+			len += r;
+		}
+
+		pthread_mutex_lock(&reader.lock);
+		if (r < 0)
+			reader.err = errno;
+		reader.len[wr] = len;
+		reader.full[wr] = 1;
+		pthread_cond_broadcast(&reader.cond);
+		pthread_mutex_unlock(&reader.lock);
+
+		/* a short block ends the image */
+		if (len < erasesize)
+			break;
+
+		wr ^= 1;
+	}
+
+	return NULL;
+}
+
+static void
+reader_start(int imagefd)
+{
+	reader.fd = imagefd;
+	reader.data[0] = malloc(erasesize);
+	reader.data[1] = malloc(erasesize);
+	pthread_mutex_init(&reader.lock, NULL);
+	pthread_cond_init(&reader.cond, NULL);
+
+	if (reader.data[0] && reader.data[1] &&
+	    !pthread_create(&reader.thread, NULL, reader_thread, NULL)) {
+		reader.active = true;
+		return;
+	}
+
+	/* fall back to reading synchronously */
+	free(reader.data[0]);
+	free(reader.data[1]);
+}
+
+static ssize_t
+reader_read(char *dest, int len)
+{
+	int n;
+
+	pthread_mutex_lock(&reader.lock);
+	while (!reader.full[reader.rd])
+		pthread_cond_wait(&reader.cond, &reader.lock);
+
+	n = reader.len[reader.rd] - reader.pos;
+	if (n == 0 && reader.err) {
+		errno = reader.err;
+		pthread_mutex_unlock(&reader.lock);
+		return -1;
+	}
+
+	/* the last block stays in place and keeps returning EOF */
+	if (n == 0 && reader.len[reader.rd] < erasesize) {
+		pthread_mutex_unlock(&reader.lock);
+		return 0;
+	}
+
+	if (n > len)
+		n = len;
+	pthread_mutex_unlock(&reader.lock);
+
+	memcpy(dest, reader.data[reader.rd] + reader.pos, n);
+	reader.pos += n;
+
+	if (reader.pos == erasesize) {
+		pthread_mutex_lock(&reader.lock);
+		reader.full[reader.rd] = 0;
+		reader.rd ^= 1;
+		reader.pos = 0;
+		pthread_cond_broadcast(&reader.cond);
+		pthread_mutex_unlock(&reader.lock);
+	}
+
+	return n;
+}
+
+static void
+reader_stop(void)
+{
+	if (!reader.active)
+		return;
+
+	/* the thread may be waiting for a free buffer */
+	pthread_cancel(reader.thread);
+	pthread_join(reader.thread, NULL);
+	free(reader.data[0]);
+	free(reader.data[1]);
+	reader.active = false;
+}
+
+static ssize_t
+image_read(int imagefd, char *dest, int len)
+{
+	if (reader.active)
+		return reader_read(dest, len);
+
+	return read(imagefd, dest, len);
+}
+
+/* compares the block at the current position with the data to write */
+static int
+mtd_block_unchanged(int fd, const char *data, int len)
+{
+	static char *cmpbuf = NULL;
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+
+	if (len != erasesize || pos < 0 || pos % erasesize)
+		return 0;
+
+	if (!cmpbuf && !(cmpbuf = malloc(erasesize)))
+		return 0;
+
+	if (pread(fd, cmpbuf, len, pos) != len)
+		return 0;
+
+	return !memcmp(cmpbuf, data, len);
+}
+
 static void
 indicate_writing(const char *mtd)
 {
@@ -403,6 +713,10 @@ mtd_write(int imagefd, const char *mtd, char *fis_layout, size_t part_offset)
 	uint32_t offset = 0;
 	int jffs2_replaced = 0;
 	int skip_bad_blocks = 0;
+	int unchanged;
+	int n_written = 0, n_unchanged = 0, n_bad = 0;
+	struct mtd_hash f_hash, m_hash;
+	char *vbuf = NULL;
 
 #ifdef FIS_SUPPORT
 	static struct fis_part new_parts[MAX_ARGS];
@@ -466,6 +780,18 @@ next:
 
 	r = 0;
 
+	if (verify_write) {
+		vbuf = malloc(erasesize);
+		if (!vbuf) {
+			fprintf(stderr, "Out of memory!\n");
+			exit(1);
+		}
+		mtd_hash_begin(&f_hash);
+		mtd_hash_begin(&m_hash);
+	}
+
+	reader_start(imagefd);
+
 resume:
 	next = strchr(mtd, ':');
 	if (next) {
@@ -489,7 +815,7 @@ resume:
 	for (;;) {
 		/* buffer may contain data already (from trx check or last mtd partition write attempt) */
 		while (buflen < erasesize) {
-			r = read(imagefd, buf + buflen, erasesize - buflen);
+			r = image_read(imagefd, buf + buflen, erasesize - buflen);
 			if (r < 0) {
 				if ((errno == EINTR) || (errno == EAGAIN))
 					continue;
@@ -548,6 +874,8 @@ resume:
 			mtd_parse_jffs2data(buf, jffs2dir);
 		}
 
+		unchanged = 0;
+
 		/* need to erase the next block before writing data to it */
 		if(!no_erase)
 		{
@@ -561,12 +889,21 @@ resume:
 
 					skip_bad_blocks += erasesize;
 					e += erasesize;
+					n_bad++;
 
 					// Move the file pointer along over the bad block.
 					lseek(fd, erasesize, SEEK_CUR);
 					continue;
 				}
 
+				/* the whole block is about to be rewritten with the same data */
+				if (skip_unchanged && !offset && w == e - skip_bad_blocks &&
+				    mtd_block_unchanged(fd, buf, buflen)) {
+					e += erasesize;
+					unchanged = 1;
+					break;
+				}
+
 				if (mtd_erase_block(fd, e) < 0) {
 					if (next) {
 						if (w < e) {
@@ -590,6 +927,27 @@ resume:
 			}
 		}
 
+		else if (skip_unchanged && !offset)
+			unchanged = mtd_block_unchanged(fd, buf, buflen);
+
+		if (unchanged) {
+			if (!quiet)
+				fprintf(stderr, "\b\b\b[s]");
+
+			if (verify_write) {
+				mtd_hash_update(&f_hash, buf, buflen);
+				mtd_hash_update(&m_hash, buf, buflen);
+			}
+
+			lseek(fd, buflen, SEEK_CUR);
+			w += buflen;
+			n_unchanged++;
+
+			buflen = 0;
+			offset = 0;
+			continue;
+		}
+
 		if (!quiet)
 			fprintf(stderr, "\b\b\b[w]");
 
@@ -602,12 +960,26 @@ resume:
 				exit(1);
 			}
 		}
+		if (verify_write) {
+			/* read back what has just been written */
+			off_t pos = lseek(fd, 0, SEEK_CUR) - buflen;
+
+			if (pread(fd, vbuf, buflen, pos) != buflen)
+				memset(vbuf, 0, buflen);
+
+			mtd_hash_update(&f_hash, buf + offset, buflen);
+			mtd_hash_update(&m_hash, vbuf, buflen);
+		}
+
 		w += buflen;
+		n_written++;
 
 		buflen = 0;
 		offset = 0;
 	}
 
+	reader_stop();
+
 	if (jffs2_replaced && trx_fixup) {
 		trx_fixup(fd, mtd);
 	}
@@ -615,8 +987,20 @@ resume:
 	if (!quiet)
 		fprintf(stderr, "\b\b\b\b    ");
 
-	if (quiet < 2)
+	if (quiet < 2) {
 		fprintf(stderr, "\n");
+		fprintf(stderr, "%d blocks written, %d unchanged, %d bad blocks skipped\n",
+			n_written, n_unchanged, n_bad);
+	}
+
+	if (verify_write) {
+		mtd_hash_end(&f_hash);
+		mtd_hash_end(&m_hash);
+		free(vbuf);
+
+		if (mtd_hash_compare(&m_hash, mtd, &f_hash, imagefile))
+			exit(1);
+	}
 
 #ifdef FIS_SUPPORT
 	if (fis_layout) {
@@ -657,6 +1041,10 @@ static void usage(void)
 	"        -q                      quiet mode (once: no [w] on writing,\n"
 	"                                           twice: no status messages)\n"
 	"        -n                      write without first erasing the blocks\n"
+	"        -c                      do not erase and write blocks which already\n"
+	"                                contain the data to write\n"
+	"        -v                      read back and verify the data while writing\n"
+	"        -a <hash>               hash used by verify and -v: md5 (default) or sha256\n"
 	"        -r                      reboot after successful command\n"
 	"        -f                      force write without trx checks\n"
 	"        -e <device>             erase <device> before executing the command\n"
@@ -724,7 +1112,7 @@ int main (int argc, char **argv)
 #ifdef FIS_SUPPORT
 			"F:"
 #endif
-			"frnqe:d:s:j:p:o:l:")) != -1)
+			"frncvqa:e:d:s:j:p:o:l:")) != -1)
 		switch (ch) {
 			case 'f':
 				force = 1;
@@ -735,6 +1123,22 @@ int main (int argc, char **argv)
 			case 'n':
 				no_erase = 1;
 				break;
+			case 'c':
+				skip_unchanged = 1;
+				break;
+			case 'v':
+				verify_write = 1;
+				break;
+			case 'a':
+				if (!strcmp(optarg, "md5")) {
+					hash_type = HASH_MD5;
+				} else if (!strcmp(optarg, "sha256")) {
+					hash_type = HASH_SHA256;
+				} else {
+					fprintf(stderr, "-a: unknown hash %s\n", optarg);
+					usage();
+				}
+				break;
 			case 'j':
 				jffs2file = optarg;
 				break;
@@ -0,0 +1,20 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_DIGEST_SIZE	32
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t count;
+	uint8_t buf[64];
+} sha256_ctx_t;
+
+/* same calling convention as the libubox md5_* functions */
+void sha256_begin(sha256_ctx_t *ctx);
+void sha256_hash(const void *data, size_t len, sha256_ctx_t *ctx);
+void sha256_end(void *digest, sha256_ctx_t *ctx);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Throughput benchmark for the nvram library
+ *
+ * Runs the same kind of batch "nvram set ... get ... commit" sequences
+ * as the command line tool against a scratch image file.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include <time.h>
+
+#include "nvram.h"
+
+extern size_t nvram_part_size;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int create_image(const char *file, size_t size)
+{
+	nvram_header_t hdr;
+	char *buf;
+	int fd;
+
+	if( (buf = malloc(size)) == NULL )
+		return -1;
+
+	memset(buf, 0xFF, size);
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = NVRAM_MAGIC;
+	hdr.len   = sizeof(hdr) + 4;
+	memcpy(buf, &hdr, sizeof(hdr));
+	memset(buf + sizeof(hdr), 0, 4);
+
+	if( (fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0 ||
+		write(fd, buf, size) != size )
+	{
+		free(buf);
+		return -1;
+	}
+
+	close(fd);
+	free(buf);
+	return 0;
+}
+
+int main( int argc, const char *argv[] )
+{
+	const char *file = (argc > 1) ? argv[1] : "/tmp/.nvram-bench";
+	int vars = (argc > 2) ? atoi(argv[2]) : 500;
+	int rounds = (argc > 3) ? atoi(argv[3]) : 100;
+	nvram_handle_t *nvram;
+	char name[32], value[64];
+	const char *v;
+	double start;
+	int i, stat = 0;
+
+	nvram_part_size = 0x10000;
+
+	if( create_image(file, nvram_part_size) ||
+		(nvram = nvram_open(file, NVRAM_RW)) == NULL )
+	{
+		fprintf(stderr, "Could not create %s\n", file);
+		return 1;
+	}
+
+	/* nvram set var=value [set ...] commit */
+	start = now();
+	for( i = 0; i < vars; i++ )
+	{
+		sprintf(name, "bench_var%d", i);
+		sprintf(value, "value-%d", i);
+		nvram_set(nvram, name, value);
+	}
+	nvram_commit(nvram);
+	printf("set:            %10.0f vars/s\n", vars / (now() - start));
+
+	/* nvram get var [get ...] */
+	start = now();
+	for( i = 0; i < vars * 10; i++ )
+	{
+		sprintf(name, "bench_var%d", i % vars);
+		if( nvram_get(nvram, name) == NULL )
+			stat = 1;
+	}
+	printf("get:            %10.0f vars/s\n", vars * 10 / (now() - start));
+
+	/* nvram set var=value commit, one variable at a time */
+	start = now();
+	for( i = 0; i < rounds; i++ )
+	{
+		sprintf(name, "bench_var%d", vars - 1 - (i % 8));
+		sprintf(value, "changed-%d", i);
+		nvram_set(nvram, name, value);
+		nvram_commit(nvram);
+	}
+	printf("set and commit: %10.0f commits/s\n", rounds / (now() - start));
+
+	nvram_close(nvram);
+
+	/* Read everything back from the image */
+	if( (nvram = nvram_open(file, NVRAM_RO)) == NULL )
+		return 1;
+
+	for( i = 0; i < vars; i++ )
+	{
+		sprintf(name, "bench_var%d", i);
+		sprintf(value, "value-%d", i);
+
+		if( (v = nvram_get(nvram, name)) == NULL ||
+			(strcmp(v, value) && strncmp(v, "changed-", 8)) )
+		{
+			fprintf(stderr, "Mismatch for %s\n", name);
+			stat = 1;
+		}
+	}
+
+	nvram_close(nvram);
+	unlink(file);
+
+	return stat;
+}
@@ -26,13 +26,13 @@ size_t nvram_part_size = 0;
  * -- Helper functions --
  */
 
-/* String hash */
+/* String hash (FNV-1a) */
 static uint32_t hash(const char *s)
 {
-	uint32_t hash = 0;
+	uint32_t hash = 2166136261u;
 
 	while (*s)
-		hash = 31 * hash + *s++;
+		hash = (hash ^ (uint8_t) *s++) * 16777619;
 
 	return hash;
 }
@@ -40,79 +40,197 @@ static uint32_t hash(const char *s)
 /* Free all tuples. */
 static void _nvram_free(nvram_handle_t *h)
 {
-	uint32_t i;
-	nvram_tuple_t *t, *next;
-
-	/* Free hash table */
-	for (i = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++) {
-		for (t = h->nvram_hash[i]; t; t = next) {
-			next = t->next;
-			free(t);
-		}
-		h->nvram_hash[i] = NULL;
+	struct nvram_arena *a, *next;
+
+	for (a = h->arena; a; a = next) {
+		next = a->next;
+		free(a);
 	}
 
-	/* Free dead table */
-	for (t = h->nvram_dead; t; t = next) {
-		next = t->next;
-		free(t);
+	free(h->nvram_hash);
+	free(h->tuples);
+
+	h->arena = NULL;
+	h->nvram_hash = NULL;
+	h->hash_size = 0;
+	h->tuples = NULL;
+	h->tuples_size = 0;
+	h->count = 0;
+	h->dirty = 0;
+}
+
+/* Allocate memory which lives until the handle is closed. */
+static void * _nvram_alloc(nvram_handle_t *h, unsigned int size)
+{
+	struct nvram_arena *a = h->arena;
+	void *p;
+
+	size = NVRAM_ROUNDUP(size, sizeof(void *));
+
+	if (!a || a->used + size > a->size) {
+		unsigned int chunk = size > NVRAM_ARENA_SIZE ? size : NVRAM_ARENA_SIZE;
+
+		if (!(a = malloc(sizeof(*a) + chunk)))
+			return NULL;
+
+		a->used = 0;
+		a->size = chunk;
+		a->next = h->arena;
+		h->arena = a;
 	}
 
-	h->nvram_dead = NULL;
+	p = &a->data[a->used];
+	a->used += size;
+
+	return p;
 }
 
-/* (Re)allocate NVRAM tuples. */
-static nvram_tuple_t * _nvram_realloc( nvram_handle_t *h, nvram_tuple_t *t,
-	const char *name, const char *value )
+/* Find the slot of a tuple, or the free slot it would go to. */
+static nvram_tuple_t ** _nvram_slot(nvram_handle_t *h, const char *name,
+	uint32_t hv)
 {
-	if ((strlen(value) + 1) > h->length - h->offset)
+	uint32_t mask = h->hash_size - 1;
+	uint32_t i = hv & mask;
+	nvram_tuple_t *t;
+
+	while ((t = h->nvram_hash[i]) != NULL &&
+		   (t->hash != hv || strcmp(t->name, name)))
+		i = (i + 1) & mask;
+
+	return &h->nvram_hash[i];
+}
+
+static nvram_tuple_t * _nvram_find(nvram_handle_t *h, const char *name)
+{
+	if (!h->hash_size)
 		return NULL;
 
-	if (!t) {
-		if (!(t = malloc(sizeof(nvram_tuple_t) + strlen(name) + 1)))
-			return NULL;
+	return *_nvram_slot(h, name, hash(name));
+}
+
+/* Make room for one more tuple, keeping the table at most 3/4 full. */
+static int _nvram_grow(nvram_handle_t *h)
+{
+	nvram_tuple_t **tuples;
+	unsigned int i, size;
 
-		/* Copy name */
-		t->name = (char *) &t[1];
-		strcpy(t->name, name);
+	if (h->count + 1 > h->tuples_size) {
+		size = h->tuples_size ? h->tuples_size * 2 : NVRAM_HASH_MIN_SIZE / 2;
+		if (!(tuples = realloc(h->tuples, size * sizeof(*tuples))))
+			return -1;
 
-		t->value = NULL;
+		h->tuples = tuples;
+		h->tuples_size = size;
 	}
 
-	/* Copy value */
-	if (!t->value || strcmp(t->value, value))
-	{
-		if(!(t->value = (char *) realloc(t->value, strlen(value)+1)))
-			return NULL;
+	if ((h->count + 1) * 4 <= h->hash_size * 3)
+		return 0;
 
-		strcpy(t->value, value);
-		t->value[strlen(value)] = '\0';
-	}
+	size = h->hash_size ? h->hash_size * 2 : NVRAM_HASH_MIN_SIZE;
+	if (!(tuples = calloc(size, sizeof(*tuples))))
+		return -1;
+
+	free(h->nvram_hash);
+	h->nvram_hash = tuples;
+	h->hash_size = size;
+
+	for (i = 0; i < h->count; i++)
+		*_nvram_slot(h, h->tuples[i]->name, h->tuples[i]->hash) = h->tuples[i];
+
+	return 0;
+}
+
+/* Add a new tuple at the end of the list. */
+static nvram_tuple_t * _nvram_add(nvram_handle_t *h, const char *name,
+	const char *value)
+{
+	unsigned int nlen = strlen(name) + 1;
+	unsigned int vlen = strlen(value) + 1;
+	nvram_tuple_t *t;
+
+	if (_nvram_grow(h) ||
+		!(t = _nvram_alloc(h, sizeof(nvram_tuple_t) + nlen + vlen)))
+		return NULL;
+
+	t->name = (char *) &t[1];
+	memcpy(t->name, name, nlen);
+	t->value = t->name + nlen;
+	memcpy(t->value, value, vlen);
+	t->size = vlen;
+	t->hash = hash(name);
+	t->next = NULL;
+	t->offset = 0;
+	t->index = h->count;
+
+	h->tuples[h->count++] = t;
+	*_nvram_slot(h, name, t->hash) = t;
 
 	return t;
 }
 
+/* Remove a tuple from the hash table and the list. */
+static void _nvram_remove(nvram_handle_t *h, nvram_tuple_t *t)
+{
+	uint32_t mask = h->hash_size - 1;
+	uint32_t i, j, k;
+
+	/* Backward shift deletion, no tombstones needed */
+	i = _nvram_slot(h, t->name, t->hash) - h->nvram_hash;
+	h->nvram_hash[i] = NULL;
+
+	for (j = (i + 1) & mask; h->nvram_hash[j]; j = (j + 1) & mask) {
+		k = h->nvram_hash[j]->hash & mask;
+
+		/* Leave entries which are still reachable from their home slot */
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		h->nvram_hash[i] = h->nvram_hash[j];
+		h->nvram_hash[j] = NULL;
+		i = j;
+	}
+
+	for (i = t->index; i + 1 < h->count; i++) {
+		h->tuples[i] = h->tuples[i + 1];
+		h->tuples[i]->index = i;
+	}
+	h->count--;
+
+	if (t->index < h->dirty)
+		h->dirty = t->index;
+}
+
 /* (Re)initialize the hash table. */
 static int _nvram_rehash(nvram_handle_t *h)
 {
 	nvram_header_t *header = nvram_header(h);
-	char buf[] = "0xXXXXXXXX", *name, *value, *eq;
+	char buf[] = "0xXXXXXXXX", *data, *name, *value, *eq;
+	nvram_tuple_t *t;
 
 	/* (Re)initialize hash table */
 	_nvram_free(h);
+	h->dirty = (unsigned int) -1;
 
 	/* Parse and set "name=value\0 ... \0\0" */
-	name = (char *) &header[1];
+	data = name = (char *) &header[1];
 
 	for (; *name; name = value + strlen(value) + 1) {
 		if (!(eq = strchr(name, '=')))
 			break;
 		*eq = '\0';
 		value = eq + 1;
-		nvram_set(h, name, value);
+		if ((t = _nvram_find(h, name)) != NULL) {
+			/* Duplicate, the stored layout has to be rewritten */
+			nvram_set(h, name, value);
+		} else if ((t = _nvram_add(h, name, value)) != NULL) {
+			t->offset = name - data;
+		}
 		*eq = '=';
 	}
 
+	if (h->dirty > h->count)
+		h->dirty = h->count;
+
 	/* Set special SDRAM parameters */
 	if (!nvram_get(h, "sdram_init")) {
 		sprintf(buf, "0x%04X", (uint16_t)(header->crc_ver_init >> 16));
@@ -149,55 +267,46 @@ nvram_header_t * nvram_header(nvram_handle_t *h)
 /* Get the value of an NVRAM variable. */
 char * nvram_get(nvram_handle_t *h, const char *name)
 {
-	uint32_t i;
 	nvram_tuple_t *t;
-	char *value;
 
 	if (!name)
 		return NULL;
 
-	/* Hash the name */
-	i = hash(name) % NVRAM_ARRAYSIZE(h->nvram_hash);
-
-	/* Find the associated tuple in the hash table */
-	for (t = h->nvram_hash[i]; t && strcmp(t->name, name); t = t->next);
+	t = _nvram_find(h, name);
 
-	value = t ? t->value : NULL;
-
-	return value;
+	return t ? t->value : NULL;
 }
 
 /* Set the value of an NVRAM variable. */
 int nvram_set(nvram_handle_t *h, const char *name, const char *value)
 {
-	uint32_t i;
-	nvram_tuple_t *t, *u, **prev;
+	unsigned int vlen = strlen(value) + 1;
+	nvram_tuple_t *t;
 
-	/* Hash the name */
-	i = hash(name) % NVRAM_ARRAYSIZE(h->nvram_hash);
+	if (vlen > h->length - h->offset)
+		return -12; /* -ENOMEM */
 
-	/* Find the associated tuple in the hash table */
-	for (prev = &h->nvram_hash[i], t = *prev;
-		 t && strcmp(t->name, name); prev = &t->next, t = *prev);
+	if (!(t = _nvram_find(h, name))) {
+		if (!(t = _nvram_add(h, name, value)))
+			return -12; /* -ENOMEM */
+	} else {
+		/* Unchanged */
+		if (!strcmp(t->value, value))
+			return 0;
 
-	/* (Re)allocate tuple */
-	if (!(u = _nvram_realloc(h, t, name, value)))
-		return -12; /* -ENOMEM */
+		/* Reuse the old value buffer when it is large enough */
+		if (vlen > t->size) {
+			if (!(t->value = _nvram_alloc(h, vlen)))
+				return -12; /* -ENOMEM */
 
-	/* Value reallocated */
-	if (t && t == u)
-		return 0;
+			t->size = vlen;
+		}
 
-	/* Move old tuple to the dead table */
-	if (t) {
-		*prev = t->next;
-		t->next = h->nvram_dead;
-		h->nvram_dead = t;
+		memcpy(t->value, value, vlen);
 	}
 
-	/* Add new tuple to the hash table */
-	u->next = h->nvram_hash[i];
-	h->nvram_hash[i] = u;
+	if (t->index < h->dirty)
+		h->dirty = t->index;
 
 	return 0;
 }
@@ -205,25 +314,13 @@ int nvram_set(nvram_handle_t *h, const char *name, const char *value)
 /* Unset the value of an NVRAM variable. */
 int nvram_unset(nvram_handle_t *h, const char *name)
 {
-	uint32_t i;
-	nvram_tuple_t *t, **prev;
+	nvram_tuple_t *t;
 
 	if (!name)
 		return 0;
 
-	/* Hash the name */
-	i = hash(name) % NVRAM_ARRAYSIZE(h->nvram_hash);
-
-	/* Find the associated tuple in the hash table */
-	for (prev = &h->nvram_hash[i], t = *prev;
-		 t && strcmp(t->name, name); prev = &t->next, t = *prev);
-
-	/* Move it to the dead table */
-	if (t) {
-		*prev = t->next;
-		t->next = h->nvram_dead;
-		h->nvram_dead = t;
-	}
+	if ((t = _nvram_find(h, name)) != NULL)
+		_nvram_remove(h, t);
 
 	return 0;
 }
@@ -231,28 +328,16 @@ int nvram_unset(nvram_handle_t *h, const char *name)
 /* Get all NVRAM variables. */
 nvram_tuple_t * nvram_getall(nvram_handle_t *h)
 {
-	int i;
-	nvram_tuple_t *t, *l, *x;
+	unsigned int i;
 
-	l = NULL;
+	if (!h->count)
+		return NULL;
 
-	for (i = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++) {
-		for (t = h->nvram_hash[i]; t; t = t->next) {
-			if( (x = (nvram_tuple_t *) malloc(sizeof(nvram_tuple_t))) != NULL )
-			{
-				x->name  = t->name;
-				x->value = t->value;
-				x->next  = l;
-				l = x;
-			}
-			else
-			{
-				break;
-			}
-		}
-	}
+	/* Chain the tuples in storage order */
+	for (i = 0; i < h->count; i++)
+		h->tuples[i]->next = (i + 1 < h->count) ? h->tuples[i + 1] : NULL;
 
-	return l;
+	return h->tuples[0];
 }
 
 /* Regenerate NVRAM. */
@@ -260,8 +345,8 @@ int nvram_commit(nvram_handle_t *h)
 {
 	nvram_header_t *header = nvram_header(h);
 	char *init, *config, *refresh, *ncdl;
-	char *ptr, *end;
-	int i;
+	char *data, *ptr, *end, *limit;
+	unsigned int i, len, old_len;
 	nvram_tuple_t *t;
 	nvram_header_t tmp;
 	uint8_t crc;
@@ -284,34 +369,53 @@ int nvram_commit(nvram_handle_t *h)
 		header->config_ncdl = strtoul(ncdl, NULL, 0);
 	}
 
-	/* Clear data area */
-	ptr = (char *) header + sizeof(nvram_header_t);
-	memset(ptr, 0xFF, nvram_part_size - h->offset - sizeof(nvram_header_t));
 	memset(&tmp, 0, sizeof(nvram_header_t));
 
+	data = (char *) header + sizeof(nvram_header_t);
+	limit = (char *) header + nvram_part_size - h->offset;
+	old_len = header->len;
+
 	/* Leave space for a double NUL at the end */
-	end = (char *) header + nvram_part_size - h->offset - 2;
+	end = limit - 2;
 
-	/* Write out all tuples */
-	for (i = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++) {
-		for (t = h->nvram_hash[i]; t; t = t->next) {
-			if ((ptr + strlen(t->name) + 1 + strlen(t->value) + 1) > end)
-				break;
-			ptr += sprintf(ptr, "%s=%s", t->name, t->value) + 1;
-		}
+	/* Tuples before the first changed one are already in place */
+	ptr = data;
+	if (h->dirty > 0) {
+		t = h->tuples[h->dirty - 1];
+		ptr += t->offset + strlen(t->name) + 1 + strlen(t->value) + 1;
 	}
 
-	/* End with a double NULL and pad to 4 bytes */
-	*ptr = '\0';
-	ptr++;
-
-	if( (int)ptr % 4 )
-		memset(ptr, 0, 4 - ((int)ptr % 4));
+	/* Write out the remaining tuples */
+	for (i = h->dirty; i < h->count; i++) {
+		t = h->tuples[i];
+		if ((ptr + strlen(t->name) + 1 + strlen(t->value) + 1) > end)
+			break;
+		t->offset = ptr - data;
+		ptr += sprintf(ptr, "%s=%s", t->name, t->value) + 1;
+	}
+	h->dirty = i;
 
-	ptr++;
+	/* End with a double NULL and pad to 4 bytes */
+	len = NVRAM_ROUNDUP(ptr + 1 - (char *) header, 4);
+	memset(ptr, 0, (char *) header + len - ptr);
+
+	/* Erase what is left of the old data */
+	if (old_len > len && old_len <= limit - (char *) header)
+		memset((char *) header + len, 0xFF, old_len - len);
+
+	/* The rest of the partition only has to be checked once */
+	if (!h->clean) {
+		for (ptr = (char *) header + len; ptr < limit; ptr++) {
+			if (*ptr != (char) 0xFF) {
+				memset(ptr, 0xFF, limit - ptr);
+				break;
+			}
+		}
+		h->clean = 1;
+	}
 
 	/* Set new length */
-	header->len = NVRAM_ROUNDUP(ptr - (char *) header, 4);
+	header->len = len;
 
 	/* Little-endian CRC8 over the last 11 bytes of the header */
 	tmp.crc_ver_init   = header->crc_ver_init;
@@ -327,12 +431,11 @@ int nvram_commit(nvram_handle_t *h)
 	/* Set new CRC8 */
 	header->crc_ver_init |= crc;
 
-	/* Write out */
+	/* Write out, the hash table already matches the stored data */
 	msync(h->mmap, h->length, MS_SYNC);
 	fsync(h->fd);
 
-	/* Reinitialize hash table */
-	return _nvram_rehash(h);
+	return 0;
 }
 
 /* Open NVRAM and obtain a handle. */
@@ -41,6 +41,18 @@ struct nvram_tuple {
 	char *name;
 	char *value;
 	struct nvram_tuple *next;
+	uint32_t hash;		/* hash of the name */
+	unsigned int size;	/* space available for the value */
+	unsigned int index;	/* position in the tuple list */
+	unsigned int offset;	/* position of "name=value" in the data area */
+};
+
+/* Tuples are carved out of these chunks and freed all at once */
+struct nvram_arena {
+	struct nvram_arena *next;
+	unsigned int used;
+	unsigned int size;
+	char data[];
 };
 
 struct nvram_handle {
@@ -48,8 +60,14 @@ struct nvram_handle {
 	char *mmap;
 	unsigned int length;
 	unsigned int offset;
-	struct nvram_tuple *nvram_hash[257];
-	struct nvram_tuple *nvram_dead;
+	struct nvram_tuple **nvram_hash;	/* open addressing, linear probing */
+	unsigned int hash_size;			/* slots, a power of two */
+	struct nvram_tuple **tuples;		/* tuples in storage order */
+	unsigned int count;
+	unsigned int tuples_size;
+	unsigned int dirty;			/* first tuple not stored as is */
+	int clean;				/* space after the data is erased */
+	struct nvram_arena *arena;
 };
 
 typedef struct nvram_handle nvram_handle_t;
@@ -69,7 +87,7 @@ char * nvram_get(nvram_handle_t *h, const char *name);
 /* Unset the value of an NVRAM variable. */
 int nvram_unset(nvram_handle_t *h, const char *name);
 
-/* Get all NVRAM variables. */
+/* Get all NVRAM variables, the list is owned by the handle. */
 nvram_tuple_t * nvram_getall(nvram_handle_t *h);
 
 /* Regenerate NVRAM. */
@@ -114,6 +132,8 @@ char * nvram_find_staging(void);
 
 /* NVRAM constants */
 #define NVRAM_MIN_SPACE			0x8000
+#define NVRAM_ARENA_SIZE		0x1000
+#define NVRAM_HASH_MIN_SIZE		256
 #define NVRAM_MAGIC			0x48534C46	/* 'FLSH' */
 #define NVRAM_VERSION		1
 
@@ -143,25 +143,54 @@ struct cryptocap {
 	int		cc_qblocked;		/* (q) symmetric q blocked */
 	int		cc_kqblocked;		/* (q) asymmetric q blocked */
 
-	int		cc_unqblocked;		/* (q) symmetric q blocked */
+	int		cc_qunblocks;		/* (q) # of symmetric q unblocks */
 	int		cc_unkqblocked;		/* (q) asymmetric q blocked */
 };
 static struct cryptocap *crypto_drivers = NULL;
 static int crypto_drivers_num = 0;
 
 /*
- * There are two queues for crypto requests; one for symmetric (e.g.
- * cipher) operations and one for asymmetric (e.g. MOD)operations.
- * A single mutex is used to lock access to both queues.  We could
- * have one per-queue but having one simplifies handling of block/unblock
- * operations.
+ * Symmetric (e.g. cipher) requests are spread over several queues, each
+ * with its own lock, worker thread and return thread, so that requests
+ * submitted on different CPUs do not contend with each other.  There is
+ * a single queue for asymmetric (e.g. MOD) operations, serviced by the
+ * worker of the first queue.  CRYPTO_Q_LOCK protects the asymmetric queue
+ * and the blocked state of the drivers, which is shared by all queues.
+ *
+ * Lock order is CRYPTO_QUEUE_LOCK, then CRYPTO_Q_LOCK.
  */
-static LIST_HEAD(crp_q);		/* crypto request queue */
+struct crypto_queue {
+	spinlock_t		cq_lock;
+	struct list_head	cq_q;		/* (cq) crypto request queue */
+	int			cq_allblocked;	/* (cq) all drivers of cq_q blocked */
+	wait_queue_head_t	cq_wait;
+	struct task_struct	*cq_proc;
+
+	spinlock_t		cq_ret_lock;
+	struct list_head	cq_ret_q;	/* (r) callback queues */
+	struct list_head	cq_ret_kq;
+	wait_queue_head_t	cq_ret_wait;
+	struct task_struct	*cq_retproc;
+} ____cacheline_aligned;
+
+#ifndef CONFIG_NR_CPUS
+#define CONFIG_NR_CPUS 1
+#endif
+
+static struct crypto_queue crypto_queues[CONFIG_NR_CPUS];
+static int crypto_queues_num = 0;
+static int crypto_cpu_queue[CONFIG_NR_CPUS];	/* queue used by each CPU */
+
+static int crypto_workers = 0;
+module_param(crypto_workers, int, 0444);
+MODULE_PARM_DESC(crypto_workers,
+		"Number of request queues and worker threads (0 = one per CPU)");
+
 static LIST_HEAD(crp_kq);		/* asym request queue */
 
 static spinlock_t crypto_q_lock;
 
-int crypto_all_qblocked = 0;  /* protect with Q_LOCK */
+int crypto_all_qblocked = 0;  /* every queue has cq_allblocked set */
 module_param(crypto_all_qblocked, int, 0444);
 MODULE_PARM_DESC(crypto_all_qblocked, "Are all crypto queues blocked");
 
@@ -180,29 +209,38 @@ MODULE_PARM_DESC(crypto_all_kqblocked, "Are all asym crypto queues blocked");
 				spin_unlock_irqrestore(&crypto_q_lock, q_flags); \
 			 })
 
+#define	CRYPTO_QUEUE_LOCK(cq) \
+			({ \
+				spin_lock_irqsave(&(cq)->cq_lock, cq_flags); \
+			 	dprintk("%s,%d: QUEUE_LOCK()\n", __FILE__, __LINE__); \
+			 })
+#define	CRYPTO_QUEUE_UNLOCK(cq) \
+			({ \
+			 	dprintk("%s,%d: QUEUE_UNLOCK()\n", __FILE__, __LINE__); \
+				spin_unlock_irqrestore(&(cq)->cq_lock, cq_flags); \
+			 })
+
 /*
- * There are two queues for processing completed crypto requests; one
- * for the symmetric and one for the asymmetric ops.  We only need one
+ * Each queue has two queues for processing completed crypto requests;
+ * one for the symmetric and one for the asymmetric ops.  We only need one
  * but have two to avoid type futzing (cryptop vs. cryptkop).  A single
  * mutex is used to lock access to both queues.  Note that this lock
  * must be separate from the lock on request queues to insure driver
- * callbacks don't generate lock order reversals.
+ * callbacks don't generate lock order reversals.  Completions are queued
+ * on the queue of the CPU they happen on.
  */
-static LIST_HEAD(crp_ret_q);		/* callback queues */
-static LIST_HEAD(crp_ret_kq);
-
-static spinlock_t crypto_ret_q_lock;
-#define	CRYPTO_RETQ_LOCK() \
+#define	CRYPTO_RETQ_LOCK(cq) \
 			({ \
-				spin_lock_irqsave(&crypto_ret_q_lock, r_flags); \
+				spin_lock_irqsave(&(cq)->cq_ret_lock, r_flags); \
 				dprintk("%s,%d: RETQ_LOCK\n", __FILE__, __LINE__); \
 			 })
-#define	CRYPTO_RETQ_UNLOCK() \
+#define	CRYPTO_RETQ_UNLOCK(cq) \
 			({ \
 			 	dprintk("%s,%d: RETQ_UNLOCK\n", __FILE__, __LINE__); \
-				spin_unlock_irqrestore(&crypto_ret_q_lock, r_flags); \
+				spin_unlock_irqrestore(&(cq)->cq_ret_lock, r_flags); \
 			 })
-#define	CRYPTO_RETQ_EMPTY()	(list_empty(&crp_ret_q) && list_empty(&crp_ret_kq))
+#define	CRYPTO_RETQ_EMPTY(cq) \
+			(list_empty(&(cq)->cq_ret_q) && list_empty(&(cq)->cq_ret_kq))
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,20)
 static kmem_cache_t *cryptop_zone;
@@ -229,8 +267,8 @@ EXPORT_SYMBOL(crypto_debug);
  * slow,  printing anything will just kill us
  */
 
-static int crypto_q_cnt = 0;
-module_param(crypto_q_cnt, int, 0444);
+static atomic_t crypto_q_cnt = ATOMIC_INIT(0);
+module_param_named(crypto_q_cnt, crypto_q_cnt.counter, int, 0444);
 MODULE_PARM_DESC(crypto_q_cnt,
 		"Current number of outstanding crypto requests");
 
@@ -272,15 +310,6 @@ module_param(crypto_max_loopcount, int, 0644);
 MODULE_PARM_DESC(crypto_max_loopcount,
 	   "Maximum number of crypto ops to do before yielding to other processes");
 
-#ifndef CONFIG_NR_CPUS
-#define CONFIG_NR_CPUS 1
-#endif
-
-static struct task_struct *cryptoproc[CONFIG_NR_CPUS];
-static struct task_struct *cryptoretproc[CONFIG_NR_CPUS];
-static DECLARE_WAIT_QUEUE_HEAD(cryptoproc_wait);
-static DECLARE_WAIT_QUEUE_HEAD(cryptoretproc_wait);
-
 static	int crypto_proc(void *arg);
 static	int crypto_ret_proc(void *arg);
 static	int crypto_invoke(struct cryptocap *cap, struct cryptop *crp, int hint);
@@ -298,6 +327,34 @@ crypto_checkdriver(u_int32_t hid)
 	return (hid >= crypto_drivers_num ? NULL : &crypto_drivers[hid]);
 }
 
+/*
+ * The queue serving the CPU we are running on.
+ */
+static __inline struct crypto_queue *
+crypto_cpu_q(void)
+{
+	return &crypto_queues[crypto_cpu_queue[raw_smp_processor_id()]];
+}
+
+/*
+ * Select the queue for a symmetric request.  Synchronous drivers do their
+ * work in the thread that dispatches to them, so their requests stay on
+ * the queue of the submitting CPU.  All requests for any other driver go
+ * to the same queue, which keeps them in order and keeps the handling of
+ * the driver's blocked state in one worker.
+ */
+static struct crypto_queue *
+crypto_select_queue(u_int32_t hid)
+{
+	struct cryptocap *cap = crypto_checkdriver(hid);
+
+	if (crypto_queues_num == 1)
+		return &crypto_queues[0];
+	if (cap == NULL || (cap->cc_flags & CRYPTOCAP_F_SYNC))
+		return crypto_cpu_q();
+	return &crypto_queues[hid % crypto_queues_num];
+}
+
 /*
  * Compare a driver's list of supported algorithms against another
  * list; return non-zero if all algorithms are supported.
@@ -772,31 +829,67 @@ int
 crypto_unblock(u_int32_t driverid, int what)
 {
 	struct cryptocap *cap;
-	int err;
-	unsigned long q_flags;
+	struct crypto_queue *cq;
+	int i, err;
+	unsigned long q_flags, cq_flags;
 
 	CRYPTO_Q_LOCK();
 	cap = crypto_checkdriver(driverid);
 	if (cap != NULL) {
 		if (what & CRYPTO_SYMQ) {
 			cap->cc_qblocked = 0;
-			cap->cc_unqblocked = 0;
-			crypto_all_qblocked = 0;
+			cap->cc_qunblocks++;
 		}
 		if (what & CRYPTO_ASYMQ) {
 			cap->cc_kqblocked = 0;
 			cap->cc_unkqblocked = 0;
 			crypto_all_kqblocked = 0;
 		}
-		wake_up_interruptible(&cryptoproc_wait);
 		err = 0;
 	} else
 		err = EINVAL;
 	CRYPTO_Q_UNLOCK(); //DAVIDM should this be a driver lock
 
+	if (err == 0) {
+		/* any queue may hold requests for this driver */
+		for (i = 0; i < crypto_queues_num; i++) {
+			cq = &crypto_queues[i];
+			CRYPTO_QUEUE_LOCK(cq);
+			if (what & CRYPTO_SYMQ)
+				cq->cq_allblocked = 0;
+			wake_up_interruptible(&cq->cq_wait);
+			CRYPTO_QUEUE_UNLOCK(cq);
+		}
+		if (what & CRYPTO_SYMQ)
+			crypto_all_qblocked = 0;
+	}
+
 	return err;
 }
 
+/*
+ * Hand a symmetric request to its driver.  If the driver ran out of
+ * resources it is marked ``blocked'' for cryptop's, unless it has been
+ * unblocked while we were calling it.
+ */
+static int
+crypto_invoke_sym(u_int32_t hid, struct cryptop *crp, int hint)
+{
+	int result, unblocks;
+	unsigned long q_flags;
+
+	unblocks = crypto_drivers[hid].cc_qunblocks;
+	result = crypto_invoke(crypto_checkdriver(hid), crp, hint);
+	if (result == ERESTART) {
+		CRYPTO_Q_LOCK();
+		if (crypto_drivers[hid].cc_qunblocks == unblocks)
+			crypto_drivers[hid].cc_qblocked = 1;
+		cryptostats.cs_blocks++;
+		CRYPTO_Q_UNLOCK();
+	}
+	return result;
+}
+
 /*
  * Add a crypto request to a queue, to be processed by the kernel thread.
  */
@@ -804,66 +897,61 @@ int
 crypto_dispatch(struct cryptop *crp)
 {
 	struct cryptocap *cap;
+	struct crypto_queue *cq;
+	u_int32_t hid;
 	int result = -1;
-	unsigned long q_flags;
+	unsigned long cq_flags;
 
 	dprintk("%s()\n", __FUNCTION__);
 
 	cryptostats.cs_ops++;
 
-	CRYPTO_Q_LOCK();
-	if (crypto_q_cnt >= crypto_q_max) {
+	if (atomic_inc_return(&crypto_q_cnt) > crypto_q_max) {
+		atomic_dec(&crypto_q_cnt);
 		cryptostats.cs_drops++;
-		CRYPTO_Q_UNLOCK();
 		return ENOMEM;
 	}
-	crypto_q_cnt++;
 
 	/* make sure we are starting a fresh run on this crp. */
 	crp->crp_flags &= ~CRYPTO_F_DONE;
 	crp->crp_etype = 0;
 
+	hid = CRYPTO_SESID2HID(crp->crp_sid);
+	cap = crypto_checkdriver(hid);
+	/* Driver cannot disappear when there is an active session. */
+	KASSERT(cap != NULL, ("%s: Driver disappeared.", __func__));
+
 	/*
 	 * Caller marked the request to be processed immediately; dispatch
 	 * it directly to the driver unless the driver is currently blocked.
 	 */
-	if ((crp->crp_flags & CRYPTO_F_BATCH) == 0) {
-		int hid = CRYPTO_SESID2HID(crp->crp_sid);
-		cap = crypto_checkdriver(hid);
-		/* Driver cannot disappear when there is an active session. */
-		KASSERT(cap != NULL, ("%s: Driver disappeared.", __func__));
-		if (!cap->cc_qblocked) {
-			crypto_all_qblocked = 0;
-			crypto_drivers[hid].cc_unqblocked = 1;
-			CRYPTO_Q_UNLOCK();
-			result = crypto_invoke(cap, crp, 0);
-			CRYPTO_Q_LOCK();
-			if (result == ERESTART)
-				if (crypto_drivers[hid].cc_unqblocked)
-					crypto_drivers[hid].cc_qblocked = 1;
-			crypto_drivers[hid].cc_unqblocked = 0;
-		}
-	}
+	if ((crp->crp_flags & CRYPTO_F_BATCH) == 0 && !cap->cc_qblocked)
+		result = crypto_invoke_sym(hid, crp, 0);
+
+	if (result != ERESTART && result != -1)
+		return result;
+
+	cq = crypto_select_queue(hid);
+	CRYPTO_QUEUE_LOCK(cq);
 	if (result == ERESTART) {
 		/*
-		 * The driver ran out of resources, mark the
-		 * driver ``blocked'' for cryptop's and put
-		 * the request back in the queue.  It would
-		 * best to put the request back where we got
-		 * it but that's hard so for now we put it
-		 * at the front.  This should be ok; putting
-		 * it at the end does not work.
+		 * The driver ran out of resources and has been marked
+		 * ``blocked'', put the request back in the queue.  It
+		 * would best to put the request back where we got it
+		 * but that's hard so for now we put it at the front.
+		 * This should be ok; putting it at the end does not work.
 		 */
-		list_add(&crp->crp_next, &crp_q);
-		cryptostats.cs_blocks++;
-		result = 0;
-	} else if (result == -1) {
-		TAILQ_INSERT_TAIL(&crp_q, crp, crp_next);
-		result = 0;
+		list_add(&crp->crp_next, &cq->cq_q);
+	} else {
+		TAILQ_INSERT_TAIL(&cq->cq_q, crp, crp_next);
+		if (!crypto_drivers[hid].cc_qblocked) {
+			cq->cq_allblocked = 0;
+			crypto_all_qblocked = 0;
+		}
 	}
-	wake_up_interruptible(&cryptoproc_wait);
-	CRYPTO_Q_UNLOCK();
-	return result;
+	wake_up_interruptible(&cq->cq_wait);
+	CRYPTO_QUEUE_UNLOCK(cq);
+	return 0;
 }
 
 /*
@@ -882,7 +970,7 @@ crypto_kdispatch(struct cryptkop *krp)
 	if (error == ERESTART) {
 		CRYPTO_Q_LOCK();
 		TAILQ_INSERT_TAIL(&crp_kq, krp, krp_next);
-		wake_up_interruptible(&cryptoproc_wait);
+		wake_up_interruptible(&crypto_queues[0].cq_wait);
 		CRYPTO_Q_UNLOCK();
 		error = 0;
 	}
@@ -1085,22 +1173,27 @@ crypto_freereq(struct cryptop *crp)
 #ifdef DIAGNOSTIC
 	{
 		struct cryptop *crp2;
-		unsigned long q_flags;
-
-		CRYPTO_Q_LOCK();
-		TAILQ_FOREACH(crp2, &crp_q, crp_next) {
-			KASSERT(crp2 != crp,
-			    ("Freeing cryptop from the crypto queue (%p).",
-			    crp));
-		}
-		CRYPTO_Q_UNLOCK();
-		CRYPTO_RETQ_LOCK();
-		TAILQ_FOREACH(crp2, &crp_ret_q, crp_next) {
-			KASSERT(crp2 != crp,
-			    ("Freeing cryptop from the return queue (%p).",
-			    crp));
+		struct crypto_queue *cq;
+		unsigned long cq_flags, r_flags;
+		int i;
+
+		for (i = 0; i < crypto_queues_num; i++) {
+			cq = &crypto_queues[i];
+			CRYPTO_QUEUE_LOCK(cq);
+			TAILQ_FOREACH(crp2, &cq->cq_q, crp_next) {
+				KASSERT(crp2 != crp,
+				    ("Freeing cryptop from the crypto queue (%p).",
+				    crp));
+			}
+			CRYPTO_QUEUE_UNLOCK(cq);
+			CRYPTO_RETQ_LOCK(cq);
+			TAILQ_FOREACH(crp2, &cq->cq_ret_q, crp_next) {
+				KASSERT(crp2 != crp,
+				    ("Freeing cryptop from the return queue (%p).",
+				    crp));
+			}
+			CRYPTO_RETQ_UNLOCK(cq);
 		}
-		CRYPTO_RETQ_UNLOCK();
 	}
 #endif
 
@@ -1145,14 +1238,10 @@ crypto_getreq(int num)
 void
 crypto_done(struct cryptop *crp)
 {
-	unsigned long q_flags;
-
 	dprintk("%s()\n", __FUNCTION__);
 	if ((crp->crp_flags & CRYPTO_F_DONE) == 0) {
 		crp->crp_flags |= CRYPTO_F_DONE;
-		CRYPTO_Q_LOCK();
-		crypto_q_cnt--;
-		CRYPTO_Q_UNLOCK();
+		atomic_dec(&crypto_q_cnt);
 	} else
 		printk("crypto: crypto_done op already done, flags 0x%x",
 				crp->crp_flags);
@@ -1175,14 +1264,15 @@ crypto_done(struct cryptop *crp)
 		 */
 		crp->crp_callback(crp);
 	} else {
+		struct crypto_queue *cq = crypto_cpu_q();
 		unsigned long r_flags;
 		/*
 		 * Normal case; queue the callback for the thread.
 		 */
-		CRYPTO_RETQ_LOCK();
-		wake_up_interruptible(&cryptoretproc_wait);/* shared wait channel */
-		TAILQ_INSERT_TAIL(&crp_ret_q, crp, crp_next);
-		CRYPTO_RETQ_UNLOCK();
+		CRYPTO_RETQ_LOCK(cq);
+		wake_up_interruptible(&cq->cq_ret_wait);
+		TAILQ_INSERT_TAIL(&cq->cq_ret_q, crp, crp_next);
+		CRYPTO_RETQ_UNLOCK(cq);
 	}
 }
 
@@ -1225,14 +1315,15 @@ crypto_kdone(struct cryptkop *krp)
 		 */
 		krp->krp_callback(krp);
 	} else {
+		struct crypto_queue *cq = crypto_cpu_q();
 		unsigned long r_flags;
 		/*
 		 * Normal case; queue the callback for the thread.
 		 */
-		CRYPTO_RETQ_LOCK();
-		wake_up_interruptible(&cryptoretproc_wait);/* shared wait channel */
-		TAILQ_INSERT_TAIL(&crp_ret_kq, krp, krp_next);
-		CRYPTO_RETQ_UNLOCK();
+		CRYPTO_RETQ_LOCK(cq);
+		wake_up_interruptible(&cq->cq_ret_wait);
+		TAILQ_INSERT_TAIL(&cq->cq_ret_kq, krp, krp_next);
+		CRYPTO_RETQ_UNLOCK(cq);
 	}
 }
 
@@ -1260,30 +1351,103 @@ crypto_getfeat(int *featp)
 }
 
 /*
- * Crypto thread, dispatches crypto requests.
+ * Process the first asymmetric request that can be, returns the request
+ * or NULL if there was none.
+ */
+static struct cryptkop *
+crypto_proc_kq(void)
+{
+	struct cryptkop *krp, *krpp;
+	struct cryptocap *cap;
+	int result;
+	unsigned long q_flags;
+
+	CRYPTO_Q_LOCK();
+	crypto_all_kqblocked = !list_empty(&crp_kq);
+
+	krp = NULL;
+	list_for_each_entry(krpp, &crp_kq, krp_next) {
+		cap = crypto_checkdriver(krpp->krp_hid);
+		if (cap == NULL || cap->cc_dev == NULL) {
+			/*
+			 * Operation needs to be migrated, invalidate
+			 * the assigned device so it will reselect a
+			 * new one below.  Propagate the original
+			 * crid selection flags if supplied.
+			 */
+			krpp->krp_hid = krpp->krp_crid &
+			    (CRYPTOCAP_F_SOFTWARE|CRYPTOCAP_F_HARDWARE);
+			if (krpp->krp_hid == 0)
+				krpp->krp_hid =
+			    CRYPTOCAP_F_SOFTWARE|CRYPTOCAP_F_HARDWARE;
+			krp = krpp;
+			break;
+		}
+		if (!cap->cc_kqblocked) {
+			krp = krpp;
+			break;
+		}
+	}
+	if (krp != NULL) {
+		crypto_all_kqblocked = 0;
+		list_del(&krp->krp_next);
+		CRYPTO_Q_UNLOCK();
+		/*
+		 * krp_hid may hold selection flags rather than a driver
+		 * (migrated request), crypto_kinvoke() picks the driver
+		 * and records it in krp_hid.
+		 */
+		result = crypto_kinvoke(krp, krp->krp_hid);
+		CRYPTO_Q_LOCK();
+		if (result == ERESTART) {
+			/*
+			 * The driver ran out of resources, mark the
+			 * driver ``blocked'' for cryptkop's and put
+			 * the request back in the queue.  It would
+			 * best to put the request back where we got
+			 * it but that's hard so for now we put it
+			 * at the front.  This should be ok; putting
+			 * it at the end does not work.
+			 */
+			/* XXX validate sid again? */
+			cap = crypto_checkdriver(krp->krp_hid);
+			if (cap != NULL)
+				cap->cc_kqblocked = 1;
+			list_add(&krp->krp_next, &crp_kq);
+			cryptostats.cs_kblocks++;
+		}
+	}
+	CRYPTO_Q_UNLOCK();
+	return krp;
+}
+
+/*
+ * Crypto thread, dispatches the crypto requests of one queue.  The
+ * thread of the first queue also dispatches the asymmetric requests.
  */
 static int
 crypto_proc(void *arg)
 {
+	struct crypto_queue *cq = arg;
 	struct cryptop *crp, *submit;
-	struct cryptkop *krp, *krpp;
+	struct cryptkop *krp;
 	struct cryptocap *cap;
 	u_int32_t hid;
-	int result, hint;
-	unsigned long q_flags;
+	int result, hint, i;
+	unsigned long cq_flags;
 	int loopcount = 0;
 
 	set_current_state(TASK_INTERRUPTIBLE);
 
-	CRYPTO_Q_LOCK();
+	CRYPTO_QUEUE_LOCK(cq);
 	for (;;) {
 		/*
 		 * we need to make sure we don't get into a busy loop with nothing
-		 * to do,  the two crypto_all_*blocked vars help us find out when
-		 * we are all full and can do nothing on any driver or Q.  If so we
-		 * wait for an unblock.
+		 * to do,  the cq_allblocked and crypto_all_kqblocked vars help us
+		 * find out when we are all full and can do nothing on any driver
+		 * or Q.  If so we wait for an unblock.
 		 */
-		crypto_all_qblocked  = !list_empty(&crp_q);
+		cq->cq_allblocked = !list_empty(&cq->cq_q);
 
 		/*
 		 * Find the first element in the queue that can be
@@ -1292,7 +1456,7 @@ crypto_proc(void *arg)
 		 */
 		submit = NULL;
 		hint = 0;
-		list_for_each_entry(crp, &crp_q, crp_next) {
+		list_for_each_entry(crp, &cq->cq_q, crp_next) {
 			hid = CRYPTO_SESID2HID(crp->crp_sid);
 			cap = crypto_checkdriver(hid);
 			/*
@@ -1330,82 +1494,27 @@ crypto_proc(void *arg)
 		}
 		if (submit != NULL) {
 			hid = CRYPTO_SESID2HID(submit->crp_sid);
-			crypto_all_qblocked = 0;
+			cq->cq_allblocked = 0;
 			list_del(&submit->crp_next);
-			crypto_drivers[hid].cc_unqblocked = 1;
-			cap = crypto_checkdriver(hid);
-			CRYPTO_Q_UNLOCK();
-			KASSERT(cap != NULL, ("%s:%u Driver disappeared.",
-			    __func__, __LINE__));
-			result = crypto_invoke(cap, submit, hint);
-			CRYPTO_Q_LOCK();
+			CRYPTO_QUEUE_UNLOCK(cq);
+			result = crypto_invoke_sym(hid, submit, hint);
+			CRYPTO_QUEUE_LOCK(cq);
 			if (result == ERESTART) {
 				/*
-				 * The driver ran out of resources, mark the
-				 * driver ``blocked'' for cryptop's and put
-				 * the request back in the queue.  It would
-				 * best to put the request back where we got
-				 * it but that's hard so for now we put it
-				 * at the front.  This should be ok; putting
-				 * it at the end does not work.
+				 * The driver is now ``blocked'', put the
+				 * request back at the front of the queue,
+				 * see crypto_dispatch().
 				 */
 				/* XXX validate sid again? */
-				list_add(&submit->crp_next, &crp_q);
-				cryptostats.cs_blocks++;
-				if (crypto_drivers[hid].cc_unqblocked)
-					crypto_drivers[hid].cc_qblocked=0;
-				crypto_drivers[hid].cc_unqblocked=0;
+				list_add(&submit->crp_next, &cq->cq_q);
 			}
-			crypto_drivers[hid].cc_unqblocked = 0;
 		}
 
-		crypto_all_kqblocked = !list_empty(&crp_kq);
-
-		/* As above, but for key ops */
 		krp = NULL;
-		list_for_each_entry(krpp, &crp_kq, krp_next) {
-			cap = crypto_checkdriver(krpp->krp_hid);
-			if (cap == NULL || cap->cc_dev == NULL) {
-				/*
-				 * Operation needs to be migrated, invalidate
-				 * the assigned device so it will reselect a
-				 * new one below.  Propagate the original
-				 * crid selection flags if supplied.
-				 */
-				krp->krp_hid = krp->krp_crid &
-				    (CRYPTOCAP_F_SOFTWARE|CRYPTOCAP_F_HARDWARE);
-				if (krp->krp_hid == 0)
-					krp->krp_hid =
-				    CRYPTOCAP_F_SOFTWARE|CRYPTOCAP_F_HARDWARE;
-				break;
-			}
-			if (!cap->cc_kqblocked) {
-				krp = krpp;
-				break;
-			}
-		}
-		if (krp != NULL) {
-			crypto_all_kqblocked = 0;
-			list_del(&krp->krp_next);
-			crypto_drivers[krp->krp_hid].cc_kqblocked = 1;
-			CRYPTO_Q_UNLOCK();
-			result = crypto_kinvoke(krp, krp->krp_hid);
-			CRYPTO_Q_LOCK();
-			if (result == ERESTART) {
-				/*
-				 * The driver ran out of resources, mark the
-				 * driver ``blocked'' for cryptkop's and put
-				 * the request back in the queue.  It would
-				 * best to put the request back where we got
-				 * it but that's hard so for now we put it
-				 * at the front.  This should be ok; putting
-				 * it at the end does not work.
-				 */
-				/* XXX validate sid again? */
-				list_add(&krp->krp_next, &crp_kq);
-				cryptostats.cs_kblocks++;
-			} else
-				crypto_drivers[krp->krp_hid].cc_kqblocked = 0;
+		if (cq == &crypto_queues[0]) {
+			CRYPTO_QUEUE_UNLOCK(cq);
+			krp = crypto_proc_kq();
+			CRYPTO_QUEUE_LOCK(cq);
 		}
 
 		if (submit == NULL && krp == NULL) {
@@ -1421,15 +1530,22 @@ crypto_proc(void *arg)
 			 * out of order if dispatched to different devices
 			 * and some become blocked while others do not.
 			 */
+			if (cq->cq_allblocked) {
+				for (i = 0; i < crypto_queues_num &&
+				     crypto_queues[i].cq_allblocked; i++)
+					;
+				crypto_all_qblocked = (i == crypto_queues_num);
+			}
 			dprintk("%s - sleeping (qe=%d qb=%d kqe=%d kqb=%d)\n",
 					__FUNCTION__,
-					list_empty(&crp_q), crypto_all_qblocked,
+					list_empty(&cq->cq_q), cq->cq_allblocked,
 					list_empty(&crp_kq), crypto_all_kqblocked);
 			loopcount = 0;
-			CRYPTO_Q_UNLOCK();
-			wait_event_interruptible(cryptoproc_wait,
-					!(list_empty(&crp_q) || crypto_all_qblocked) ||
-					!(list_empty(&crp_kq) || crypto_all_kqblocked) ||
+			CRYPTO_QUEUE_UNLOCK(cq);
+			wait_event_interruptible(cq->cq_wait,
+					!(list_empty(&cq->cq_q) || cq->cq_allblocked) ||
+					(cq == &crypto_queues[0] &&
+					 !(list_empty(&crp_kq) || crypto_all_kqblocked)) ||
 					kthread_should_stop());
 			if (signal_pending (current)) {
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,0)
@@ -1440,7 +1556,7 @@ crypto_proc(void *arg)
 				spin_unlock_irq(&current->sigmask_lock);
 #endif
 			}
-			CRYPTO_Q_LOCK();
+			CRYPTO_QUEUE_LOCK(cq);
 			dprintk("%s - awake\n", __FUNCTION__);
 			if (kthread_should_stop())
 				break;
@@ -1451,13 +1567,13 @@ crypto_proc(void *arg)
 			 * been using the CPU exclusively for a while.
 			 */
 			loopcount = 0;
-			CRYPTO_Q_UNLOCK();
+			CRYPTO_QUEUE_UNLOCK(cq);
 			schedule();
-			CRYPTO_Q_LOCK();
+			CRYPTO_QUEUE_LOCK(cq);
 		}
 		loopcount++;
 	}
-	CRYPTO_Q_UNLOCK();
+	CRYPTO_QUEUE_UNLOCK(cq);
 	return 0;
 }
 
@@ -1469,29 +1585,30 @@ crypto_proc(void *arg)
 static int
 crypto_ret_proc(void *arg)
 {
+	struct crypto_queue *cq = arg;
 	struct cryptop *crpt;
 	struct cryptkop *krpt;
 	unsigned long  r_flags;
 
 	set_current_state(TASK_INTERRUPTIBLE);
 
-	CRYPTO_RETQ_LOCK();
+	CRYPTO_RETQ_LOCK(cq);
 	for (;;) {
 		/* Harvest return q's for completed ops */
 		crpt = NULL;
-		if (!list_empty(&crp_ret_q))
-			crpt = list_entry(crp_ret_q.next, typeof(*crpt), crp_next);
+		if (!list_empty(&cq->cq_ret_q))
+			crpt = list_entry(cq->cq_ret_q.next, typeof(*crpt), crp_next);
 		if (crpt != NULL)
 			list_del(&crpt->crp_next);
 
 		krpt = NULL;
-		if (!list_empty(&crp_ret_kq))
-			krpt = list_entry(crp_ret_kq.next, typeof(*krpt), krp_next);
+		if (!list_empty(&cq->cq_ret_kq))
+			krpt = list_entry(cq->cq_ret_kq.next, typeof(*krpt), krp_next);
 		if (krpt != NULL)
 			list_del(&krpt->krp_next);
 
 		if (crpt != NULL || krpt != NULL) {
-			CRYPTO_RETQ_UNLOCK();
+			CRYPTO_RETQ_UNLOCK(cq);
 			/*
 			 * Run callbacks unlocked.
 			 */
@@ -1499,17 +1616,16 @@ crypto_ret_proc(void *arg)
 				crpt->crp_callback(crpt);
 			if (krpt != NULL)
 				krpt->krp_callback(krpt);
-			CRYPTO_RETQ_LOCK();
+			CRYPTO_RETQ_LOCK(cq);
 		} else {
 			/*
 			 * Nothing more to be processed.  Sleep until we're
 			 * woken because there are more returns to process.
 			 */
 			dprintk("%s - sleeping\n", __FUNCTION__);
-			CRYPTO_RETQ_UNLOCK();
-			wait_event_interruptible(cryptoretproc_wait,
-					!list_empty(&crp_ret_q) ||
-					!list_empty(&crp_ret_kq) ||
+			CRYPTO_RETQ_UNLOCK(cq);
+			wait_event_interruptible(cq->cq_ret_wait,
+					!CRYPTO_RETQ_EMPTY(cq) ||
 					kthread_should_stop());
 			if (signal_pending (current)) {
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,0)
@@ -1520,7 +1636,7 @@ crypto_ret_proc(void *arg)
 				spin_unlock_irq(&current->sigmask_lock);
 #endif
 			}
-			CRYPTO_RETQ_LOCK();
+			CRYPTO_RETQ_LOCK(cq);
 			dprintk("%s - awake\n", __FUNCTION__);
 			if (kthread_should_stop()) {
 				dprintk("%s - EXITING!\n", __FUNCTION__);
@@ -1529,7 +1645,7 @@ crypto_ret_proc(void *arg)
 			cryptostats.cs_rets++;
 		}
 	}
-	CRYPTO_RETQ_UNLOCK();
+	CRYPTO_RETQ_UNLOCK(cq);
 	return 0;
 }
 
@@ -1635,7 +1751,8 @@ DB_SHOW_COMMAND(kcrypto, db_show_kcrypto)
 static int
 crypto_init(void)
 {
-	int error;
+	struct crypto_queue *cq;
+	int error, i, n;
 	unsigned long cpu;
 
 	dprintk("%s(%p)\n", __FUNCTION__, (void *) crypto_init);
@@ -1646,7 +1763,6 @@ crypto_init(void)
 
 	spin_lock_init(&crypto_drivers_lock);
 	spin_lock_init(&crypto_q_lock);
-	spin_lock_init(&crypto_ret_q_lock);
 
 	cryptop_zone = kmem_cache_create("cryptop", sizeof(struct cryptop),
 				       0, SLAB_HWCACHE_ALIGN, NULL
@@ -1679,28 +1795,61 @@ crypto_init(void)
 
 	memset(crypto_drivers, 0, crypto_drivers_num * sizeof(struct cryptocap));
 
+	/*
+	 * One request queue per worker, by default one worker per CPU.
+	 * The CPUs without a worker of their own share the queues
+	 * round robin.
+	 */
+	n = 0;
+	ocf_for_each_cpu(cpu)
+		n++;
+	if (crypto_workers > 0 && crypto_workers < n)
+		n = crypto_workers;
+	if (n > CONFIG_NR_CPUS)
+		n = CONFIG_NR_CPUS;
+
+	for (i = 0; i < n; i++) {
+		cq = &crypto_queues[i];
+		spin_lock_init(&cq->cq_lock);
+		INIT_LIST_HEAD(&cq->cq_q);
+		init_waitqueue_head(&cq->cq_wait);
+		spin_lock_init(&cq->cq_ret_lock);
+		INIT_LIST_HEAD(&cq->cq_ret_q);
+		INIT_LIST_HEAD(&cq->cq_ret_kq);
+		init_waitqueue_head(&cq->cq_ret_wait);
+	}
+	crypto_queues_num = n;
+
+	i = 0;
 	ocf_for_each_cpu(cpu) {
-		cryptoproc[cpu] = kthread_create(crypto_proc, (void *) cpu,
+		crypto_cpu_queue[cpu] = i % n;
+		if (i++ >= n)
+			continue;
+		cq = &crypto_queues[crypto_cpu_queue[cpu]];
+
+		cq->cq_proc = kthread_create(crypto_proc, cq,
 									"ocf_%d", (int) cpu);
-		if (IS_ERR(cryptoproc[cpu])) {
-			error = PTR_ERR(cryptoproc[cpu]);
+		if (IS_ERR(cq->cq_proc)) {
+			error = PTR_ERR(cq->cq_proc);
+			cq->cq_proc = NULL;
 			printk("crypto: crypto_init cannot start crypto thread; error %d",
 				error);
 			goto bad;
 		}
-		kthread_bind(cryptoproc[cpu], cpu);
-		wake_up_process(cryptoproc[cpu]);
+		kthread_bind(cq->cq_proc, cpu);
+		wake_up_process(cq->cq_proc);
 
-		cryptoretproc[cpu] = kthread_create(crypto_ret_proc, (void *) cpu,
+		cq->cq_retproc = kthread_create(crypto_ret_proc, cq,
 									"ocf_ret_%d", (int) cpu);
-		if (IS_ERR(cryptoretproc[cpu])) {
-			error = PTR_ERR(cryptoretproc[cpu]);
+		if (IS_ERR(cq->cq_retproc)) {
+			error = PTR_ERR(cq->cq_retproc);
+			cq->cq_retproc = NULL;
 			printk("crypto: crypto_init cannot start cryptoret thread; error %d",
 					error);
 			goto bad;
 		}
-		kthread_bind(cryptoretproc[cpu], cpu);
-		wake_up_process(cryptoretproc[cpu]);
+		kthread_bind(cq->cq_retproc, cpu);
+		wake_up_process(cq->cq_retproc);
 	}
 
 	return 0;
@@ -1713,16 +1862,21 @@ bad:
 static void
 crypto_exit(void)
 {
-	int cpu;
+	struct crypto_queue *cq;
+	int i;
 
 	dprintk("%s()\n", __FUNCTION__);
 
 	/*
 	 * Terminate any crypto threads.
 	 */
-	ocf_for_each_cpu(cpu) {
-		kthread_stop(cryptoproc[cpu]);
-		kthread_stop(cryptoretproc[cpu]);
+	for (i = 0; i < crypto_queues_num; i++) {
+		cq = &crypto_queues[i];
+		if (cq->cq_proc)
+			kthread_stop(cq->cq_proc);
+		if (cq->cq_retproc)
+			kthread_stop(cq->cq_retproc);
+		cq->cq_proc = cq->cq_retproc = NULL;
 	}
 
 	/* 
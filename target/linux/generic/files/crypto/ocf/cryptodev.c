@@ -58,6 +58,8 @@ __FBSDID("$FreeBSD: src/sys/opencrypto/cryptodev.c,v 1.34 2007/05/09 19:37:02 gn
 #include <linux/file.h>
 #include <linux/mount.h>
 #include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
 #include <asm/uaccess.h>
 
 #include <cryptodev.h>
@@ -70,6 +72,20 @@ int cryptodev_debug = 0;
 module_param(cryptodev_debug, int, 0644);
 MODULE_PARM_DESC(cryptodev_debug, "Enable cryptodev debug");
 
+/*
+ * in-place operations on at least this many bytes use the user pages
+ * directly rather than a bounce buffer,  0 disables it
+ */
+static int cryptodev_zerocopy = 2048;
+module_param(cryptodev_zerocopy, int, 0644);
+MODULE_PARM_DESC(cryptodev_zerocopy,
+		"Minimum size of operations that pin user pages (0 = never)");
+
+static int cryptodev_max_async = 256;
+module_param(cryptodev_max_async, int, 0644);
+MODULE_PARM_DESC(cryptodev_max_async,
+		"Maximum outstanding asynchronous operations per descriptor");
+
 struct csession_info {
 	u_int16_t	blocksize;
 	u_int16_t	minkey, maxkey;
@@ -94,21 +110,59 @@ struct csession {
 
 	caddr_t		key;
 	int		keylen;
-	u_char		tmp_iv[EALG_MAX_BLOCK_LEN];
 
 	caddr_t		mackey;
 	int		mackeylen;
 
 	struct csession_info info;
 
-	struct iovec	iovec;
-	struct uio	uio;
-	int		error;
+	int		pending;	/* (f) async ops not yet fetched */
 };
 
+/*
+ * Sessions are hashed on their number,  which is handed out sequentially.
+ */
+#define CSE_HASH_SIZE	64		/* power of 2 */
+#define CSE_HASH(ses)	((ses) & (CSE_HASH_SIZE - 1))
+
 struct fcrypt {
-	struct list_head	csessions;
+	struct list_head	csessions[CSE_HASH_SIZE];
 	int		sesn;
+
+	spinlock_t	lock;		/* (f) protects the fields below */
+	struct list_head	done;	/* (f) completed async ops */
+	int		pending;	/* (f) async ops not yet fetched */
+	wait_queue_head_t	waitq;
+};
+
+/*
+ * A zero-copy operation gets one iovec for each physically contiguous
+ * run of pages and one for the MAC,  cryptosoft takes at most 16.
+ */
+#define CSE_MAX_IOV	16
+
+/*
+ * The state of one operation.  For a bounce buffered operation the buffer
+ * follows the structure.
+ */
+struct cryptodev_req {
+	struct list_head	list;
+	struct fcrypt	*fcr;		/* NULL for synchronous ops */
+	struct csession	*cse;
+	struct cryptop	*crp;
+	struct crypt_op	cop;
+	caddr_t		opaque;
+	struct mm_struct *mm;		/* the submitter's,  async ops only */
+	int		error;
+
+	struct uio	uio;
+	struct iovec	iovec[CSE_MAX_IOV];
+	caddr_t		buf;		/* bounce buffer,  NULL if zero-copy */
+	int		buf_alloced;
+	struct page	*pages[CSE_MAX_IOV];
+	int		npages;
+	int		dirty;		/* the pages were written to */
+	u_char		mac[HASH_MAX_LEN];
 };
 
 static struct csession *csefind(struct fcrypt *, u_int);
@@ -119,6 +173,9 @@ static struct csession *csecreate(struct fcrypt *, u_int64_t,
 static int csefree(struct csession *);
 
 static	int cryptodev_op(struct csession *, struct crypt_op *);
+static	int cryptodev_async_submit(struct fcrypt *, struct crypt_mop *);
+static	int cryptodev_async_fetch(struct file *, struct fcrypt *,
+		struct crypt_mop *);
 static	int cryptodev_key(struct crypt_kop *);
 static	int cryptodev_find(struct crypt_find_op *);
 
@@ -162,44 +219,154 @@ checkcrid(int crid)
 	return 0;
 }
 
+/*
+ * Pin the user pages of an in-place operation and point the iovecs at
+ * them.  Returns non-zero if the operation has to be bounce buffered.
+ */
 static int
-cryptodev_op(struct csession *cse, struct crypt_op *cop)
+cryptodev_pin(struct cryptodev_req *req)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,27)
+	struct csession *cse = req->cse;
+	unsigned long start = (unsigned long) req->cop.src;
+	struct iovec *iov = req->iovec;
+	int off, len, seg, n, i, iovcnt;
+	caddr_t base;
+
+	off = start & ~PAGE_MASK;
+	n = (off + req->cop.len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	if (n > CSE_MAX_IOV - 1)
+		return (E2BIG);
+
+	req->dirty = cse->info.blocksize != 0;
+	req->npages = get_user_pages_fast(start & PAGE_MASK, n, req->dirty,
+			req->pages);
+	if (req->npages != n)
+		goto fail;
+
+	iovcnt = 0;
+	len = req->cop.len;
+	for (i = 0; i < n; i++) {
+#ifdef CONFIG_HIGHMEM
+		if (PageHighMem(req->pages[i]))
+			goto fail;
+#endif
+		base = (caddr_t) page_address(req->pages[i]) + off;
+		seg = min_t(int, len, PAGE_SIZE - off);
+		if (iovcnt && (caddr_t) iov[iovcnt - 1].iov_base +
+				iov[iovcnt - 1].iov_len == base) {
+			iov[iovcnt - 1].iov_len += seg;
+		} else {
+			iov[iovcnt].iov_base = base;
+			iov[iovcnt].iov_len = seg;
+			iovcnt++;
+		}
+		len -= seg;
+		off = 0;
+	}
+	if (cse->info.authsize) {
+		iov[iovcnt].iov_base = req->mac;
+		iov[iovcnt].iov_len = cse->info.authsize;
+		iovcnt++;
+	}
+
+	/* most hardware drivers only take a single buffer */
+	if (iovcnt > 1 && !(CRYPTO_SESID2CAPS(cse->sid) & CRYPTOCAP_F_SYNC))
+		goto fail;
+
+	req->uio.uio_iovcnt = iovcnt;
+	return (0);
+
+fail:
+	for (i = 0; i < req->npages; i++)
+		put_page(req->pages[i]);
+	req->npages = 0;
+	return (EFAULT);
+#else
+	return (EOPNOTSUPP);
+#endif
+}
+
+static void
+cryptodev_req_free(struct cryptodev_req *req)
 {
-	struct cryptop *crp = NULL;
+	int i;
+
+	for (i = 0; i < req->npages; i++) {
+		if (req->dirty)
+			set_page_dirty_lock(req->pages[i]);
+		put_page(req->pages[i]);
+	}
+	if (req->crp)
+		crypto_freereq(req->crp);
+	if (req->buf_alloced)
+		kfree(req->buf);
+	kfree(req);
+}
+
+/*
+ * Set up a request for an operation,  ready to be dispatched.
+ */
+static struct cryptodev_req *
+cryptodev_req_new(struct csession *cse, struct crypt_op *cop, int *errorp)
+{
+	struct cryptodev_req *req;
+	struct cryptop *crp;
 	struct cryptodesc *crde = NULL, *crda = NULL;
-	int error = 0;
+	int error = 0, zerocopy, ilen;
 
 	dprintk("%s()\n", __FUNCTION__);
 	if (cop->len > CRYPTO_MAX_DATA_LEN) {
 		dprintk("%s: %d > %d\n", __FUNCTION__, cop->len, CRYPTO_MAX_DATA_LEN);
-		return (E2BIG);
+		*errorp = E2BIG;
+		return (NULL);
 	}
 
 	if (cse->info.blocksize && (cop->len % cse->info.blocksize) != 0) {
 		dprintk("%s: blocksize=%d len=%d\n", __FUNCTION__, cse->info.blocksize,
 				cop->len);
-		return (EINVAL);
+		*errorp = EINVAL;
+		return (NULL);
 	}
 
-	cse->uio.uio_iov = &cse->iovec;
-	cse->uio.uio_iovcnt = 1;
-	cse->uio.uio_offset = 0;
-#if 0
-	cse->uio.uio_resid = cop->len;
-	cse->uio.uio_segflg = UIO_SYSSPACE;
-	cse->uio.uio_rw = UIO_WRITE;
-	cse->uio.uio_td = td;
-#endif
-	cse->uio.uio_iov[0].iov_len = cop->len;
-	if (cse->info.authsize)
-		cse->uio.uio_iov[0].iov_len += cse->info.authsize;
-	cse->uio.uio_iov[0].iov_base = kmalloc(cse->uio.uio_iov[0].iov_len,
-			GFP_KERNEL);
-
-	if (cse->uio.uio_iov[0].iov_base == NULL) {
-		dprintk("%s: iov_base kmalloc(%d) failed\n", __FUNCTION__,
-				(int)cse->uio.uio_iov[0].iov_len);
-		return (ENOMEM);
+	ilen = cop->len + cse->info.authsize;
+	zerocopy = cryptodev_zerocopy > 0 && cop->len >= cryptodev_zerocopy &&
+			(cse->info.blocksize == 0 || cop->dst == cop->src);
+
+	req = kmalloc(sizeof(*req) + (zerocopy ? 0 : ilen), GFP_KERNEL);
+	if (req == NULL) {
+		dprintk("%s: req kmalloc(%d) failed\n", __FUNCTION__, ilen);
+		*errorp = ENOMEM;
+		return (NULL);
+	}
+	memset(req, 0, sizeof(*req));
+	req->cse = cse;
+	req->cop = *cop;
+	req->uio.uio_iov = req->iovec;
+	req->uio.uio_offset = 0;
+
+	if (!zerocopy || cryptodev_pin(req) != 0) {
+		if (zerocopy) {
+			req->buf = kmalloc(ilen, GFP_KERNEL);
+			if (req->buf == NULL) {
+				dprintk("%s: iov_base kmalloc(%d) failed\n", __FUNCTION__,
+						ilen);
+				error = ENOMEM;
+				goto bail;
+			}
+			req->buf_alloced = 1;
+		} else
+			req->buf = (caddr_t) (req + 1);
+
+		req->uio.uio_iovcnt = 1;
+		req->iovec[0].iov_base = req->buf;
+		req->iovec[0].iov_len = ilen;
+
+		if (copy_from_user(req->buf, cop->src, cop->len)) {
+			dprintk("%s: bad copy\n", __FUNCTION__);
+			error = EFAULT;
+			goto bail;
+		}
 	}
 
 	crp = crypto_getreq((cse->info.blocksize != 0) + (cse->info.authsize != 0));
@@ -208,6 +375,7 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		error = ENOMEM;
 		goto bail;
 	}
+	req->crp = crp;
 
 	if (cse->info.authsize && cse->info.blocksize) {
 		if (cop->op == COP_ENCRYPT) {
@@ -227,12 +395,6 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		goto bail;
 	}
 
-	if ((error = copy_from_user(cse->uio.uio_iov[0].iov_base, cop->src,
-					cop->len))) {
-		dprintk("%s: bad copy\n", __FUNCTION__);
-		goto bail;
-	}
-
 	if (crda) {
 		crda->crd_skip = 0;
 		crda->crd_len = cop->len;
@@ -256,13 +418,13 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		crde->crd_klen = cse->keylen * 8;
 	}
 
-	crp->crp_ilen = cse->uio.uio_iov[0].iov_len;
+	crp->crp_ilen = ilen;
 	crp->crp_flags = CRYPTO_F_IOV | CRYPTO_F_CBIMM
 		       | (cop->flags & COP_F_BATCH);
-	crp->crp_buf = (caddr_t)&cse->uio;
+	crp->crp_buf = (caddr_t)&req->uio;
 	crp->crp_callback = (int (*) (struct cryptop *)) cryptodev_cb;
 	crp->crp_sid = cse->sid;
-	crp->crp_opaque = (void *)cse;
+	crp->crp_opaque = (void *)req;
 
 	if (cop->iv) {
 		if (crde == NULL) {
@@ -275,12 +437,11 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 			dprintk("%s arc4 with IV\n", __FUNCTION__);
 			goto bail;
 		}
-		if ((error = copy_from_user(cse->tmp_iv, cop->iv,
-						cse->info.blocksize))) {
+		if (copy_from_user(crde->crd_iv, cop->iv, cse->info.blocksize)) {
 			dprintk("%s bad iv copy\n", __FUNCTION__);
+			error = EFAULT;
 			goto bail;
 		}
-		memcpy(crde->crd_iv, cse->tmp_iv, cse->info.blocksize);
 		crde->crd_flags |= CRD_F_IV_EXPLICIT | CRD_F_IV_PRESENT;
 		crde->crd_skip = 0;
 	} else if (cse->cipher == CRYPTO_ARC4) { /* XXX use flag? */
@@ -297,6 +458,78 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		goto bail;
 	}
 
+	return (req);
+
+bail:
+	cryptodev_req_free(req);
+	*errorp = error;
+	return (NULL);
+}
+
+/*
+ * Check the status of a completed operation and copy its results out.
+ */
+static int
+cryptodev_req_done(struct cryptodev_req *req)
+{
+	struct crypt_op *cop = &req->cop;
+	caddr_t mac;
+
+	if (req->crp->crp_etype != 0) {
+		dprintk("%s error in crp processing\n", __FUNCTION__);
+		return (req->crp->crp_etype);
+	}
+
+	if (req->error) {
+		dprintk("%s error in req processing\n", __FUNCTION__);
+		return (req->error);
+	}
+
+	if (req->buf) {
+		if (cop->dst && copy_to_user(cop->dst, req->buf, cop->len)) {
+			dprintk("%s bad dst copy\n", __FUNCTION__);
+			return (EFAULT);
+		}
+		mac = req->buf + cop->len;
+	} else {
+		/* a MAC-only op ran on the source pages,  copy them out */
+		if (cop->dst && cop->dst != cop->src) {
+			struct iovec *iov = req->iovec;
+			int off = 0, seg;
+
+			for (; off < cop->len; iov++) {
+				seg = min_t(int, iov->iov_len, cop->len - off);
+				if (copy_to_user(cop->dst + off, iov->iov_base, seg)) {
+					dprintk("%s bad dst copy\n", __FUNCTION__);
+					return (EFAULT);
+				}
+				off += seg;
+			}
+		}
+		mac = (caddr_t) req->mac;
+	}
+
+	if (cop->mac && copy_to_user(cop->mac, mac, req->cse->info.authsize)) {
+		dprintk("%s bad mac copy\n", __FUNCTION__);
+		return (EFAULT);
+	}
+
+	return (0);
+}
+
+static int
+cryptodev_op(struct csession *cse, struct crypt_op *cop)
+{
+	struct cryptodev_req *req;
+	struct cryptop *crp;
+	int error = 0;
+
+	dprintk("%s()\n", __FUNCTION__);
+	req = cryptodev_req_new(cse, cop, &error);
+	if (req == NULL)
+		return (error);
+	crp = req->crp;
+
 	/*
 	 * Let the dispatch run unlocked, then, interlock against the
 	 * callback before checking if the operation completed and going
@@ -331,46 +564,133 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 	} while ((crp->crp_flags & CRYPTO_F_DONE) == 0);
 	dprintk("%s finished WAITING error=%d\n", __FUNCTION__, error);
 
-	if (crp->crp_etype != 0) {
-		error = crp->crp_etype;
-		dprintk("%s error in crp processing\n", __FUNCTION__);
-		goto bail;
-	}
+	error = cryptodev_req_done(req);
 
-	if (cse->error) {
-		error = cse->error;
-		dprintk("%s error in cse processing\n", __FUNCTION__);
-		goto bail;
-	}
+bail:
+	cryptodev_req_free(req);
+	return (error);
+}
 
-	if (cop->dst && (error = copy_to_user(cop->dst,
-					cse->uio.uio_iov[0].iov_base, cop->len))) {
-		dprintk("%s bad dst copy\n", __FUNCTION__);
-		goto bail;
-	}
+/*
+ * Queue operations without waiting for them to complete.
+ */
+static int
+cryptodev_async_submit(struct fcrypt *fcr, struct crypt_mop *mop)
+{
+	struct crypt_aop aop;
+	struct cryptodev_req *req;
+	struct csession *cse;
+	unsigned long flags;
+	u_int32_t i;
+	int error = 0;
 
-	if (cop->mac &&
-			(error=copy_to_user(cop->mac,
-				(caddr_t)cse->uio.uio_iov[0].iov_base + cop->len,
-				cse->info.authsize))) {
-		dprintk("%s bad mac copy\n", __FUNCTION__);
-		goto bail;
+	dprintk("%s(%u)\n", __FUNCTION__, mop->count);
+	for (i = 0; i < mop->count; i++) {
+		if (copy_from_user(&aop, &mop->aops[i], sizeof(aop))) {
+			error = EFAULT;
+			break;
+		}
+		/* hold the lock until pending pins the session */
+		spin_lock_irqsave(&fcr->lock, flags);
+		cse = csefind(fcr, aop.cop.ses);
+		if (cse == NULL)
+			error = EINVAL;
+		else if (fcr->pending >= cryptodev_max_async)
+			error = EAGAIN;
+		else {
+			fcr->pending++;
+			cse->pending++;
+		}
+		spin_unlock_irqrestore(&fcr->lock, flags);
+		if (error)
+			break;
+
+		req = cryptodev_req_new(cse, &aop.cop, &error);
+		if (req != NULL) {
+			req->fcr = fcr;
+			req->opaque = aop.opaque;
+			req->mm = current->mm;
+			error = crypto_dispatch(req->crp);
+			if (error)
+				cryptodev_req_free(req);
+		}
+		if (error) {
+			spin_lock_irqsave(&fcr->lock, flags);
+			fcr->pending--;
+			cse->pending--;
+			spin_unlock_irqrestore(&fcr->lock, flags);
+			break;
+		}
 	}
 
-bail:
-	if (crp)
-		crypto_freereq(crp);
-	if (cse->uio.uio_iov[0].iov_base)
-		kfree(cse->uio.uio_iov[0].iov_base);
+	mop->count = i;
+	return (i ? 0 : error);
+}
 
-	return (error);
+/*
+ * Return completed asynchronous operations.
+ */
+static int
+cryptodev_async_fetch(struct file *filp, struct fcrypt *fcr,
+		struct crypt_mop *mop)
+{
+	struct crypt_aop aop;
+	struct cryptodev_req *req;
+	unsigned long flags;
+	u_int32_t i = 0;
+	int error = 0;
+
+	dprintk("%s(%u)\n", __FUNCTION__, mop->count);
+	while (i < mop->count) {
+		spin_lock_irqsave(&fcr->lock, flags);
+		if (list_empty(&fcr->done)) {
+			spin_unlock_irqrestore(&fcr->lock, flags);
+			if (i > 0 || fcr->pending == 0)
+				break;
+			if (filp->f_flags & O_NONBLOCK) {
+				error = EAGAIN;
+				break;
+			}
+			if (wait_event_interruptible(fcr->waitq,
+					!list_empty(&fcr->done))) {
+				error = EINTR;
+				break;
+			}
+			continue;
+		}
+		req = list_entry(fcr->done.next, struct cryptodev_req, list);
+		list_del(&req->list);
+		fcr->pending--;
+		req->cse->pending--;
+		spin_unlock_irqrestore(&fcr->lock, flags);
+
+		aop.cop = req->cop;
+		aop.opaque = req->opaque;
+		/* the results can only be copied to the submitter */
+		if (req->mm == current->mm)
+			aop.error = cryptodev_req_done(req);
+		else
+			aop.error = EFAULT;
+		cryptodev_req_free(req);
+
+		if (copy_to_user(&mop->aops[i], &aop, sizeof(aop))) {
+			error = EFAULT;
+			break;
+		}
+		i++;
+	}
+
+	mop->count = i;
+	return (i ? 0 : error);
 }
 
 static int
 cryptodev_cb(void *op)
 {
 	struct cryptop *crp = (struct cryptop *) op;
-	struct csession *cse = (struct csession *)crp->crp_opaque;
+	struct cryptodev_req *req = (struct cryptodev_req *)crp->crp_opaque;
+	struct fcrypt *fcr = req->fcr;
+	unsigned long flags;
 	int error;
 
 	dprintk("%s()\n", __FUNCTION__);
@@ -384,11 +704,23 @@ cryptodev_cb(void *op)
 		 */
 		crp->crp_flags |= CRYPTO_F_BATCH;
 #endif
-		return crypto_dispatch(crp);
+		error = crypto_dispatch(crp);
+		if (error == 0)
+			return (0);
+		/* nobody else will complete it,  fail it here */
+		dprintk("%s error in crypto_dispatch %d\n", __FUNCTION__, error);
+		crp->crp_etype = error;
+		crp->crp_flags |= CRYPTO_F_DONE;
 	}
 	if (error != 0 || (crp->crp_flags & CRYPTO_F_DONE)) {
-		cse->error = error;
-		wake_up_interruptible(&crp->crp_waitq);
+		req->error = error;
+		if (fcr) {
+			spin_lock_irqsave(&fcr->lock, flags);
+			list_add_tail(&req->list, &fcr->done);
+			spin_unlock_irqrestore(&fcr->lock, flags);
+			wake_up(&fcr->waitq);
+		} else
+			wake_up_interruptible(&crp->crp_waitq);
 	}
 	return (0);
 }
@@ -545,7 +877,7 @@ csefind(struct fcrypt *fcr, u_int ses)
 	struct csession *cse;
 
 	dprintk("%s()\n", __FUNCTION__);
-	list_for_each_entry(cse, &fcr->csessions, list)
+	list_for_each_entry(cse, &fcr->csessions[CSE_HASH(ses)], list)
 		if (cse->ses == ses)
 			return (cse);
 	return (NULL);
@@ -554,24 +886,17 @@ csefind(struct fcrypt *fcr, u_int ses)
 static int
 csedelete(struct fcrypt *fcr, struct csession *cse_del)
 {
-	struct csession *cse;
-
 	dprintk("%s()\n", __FUNCTION__);
-	list_for_each_entry(cse, &fcr->csessions, list) {
-		if (cse == cse_del) {
-			list_del(&cse->list);
-			return (1);
-		}
-	}
-	return (0);
+	list_del(&cse_del->list);
+	return (1);
 }
-	
+
 static struct csession *
 cseadd(struct fcrypt *fcr, struct csession *cse)
 {
 	dprintk("%s()\n", __FUNCTION__);
-	list_add_tail(&cse->list, &fcr->csessions);
 	cse->ses = fcr->sesn++;
+	list_add_tail(&cse->list, &fcr->csessions[CSE_HASH(cse->ses)]);
 	return (cse);
 }
 
@@ -580,6 +905,7 @@ csecreate(struct fcrypt *fcr, u_int64_t sid, struct cryptoini *crie,
 	struct cryptoini *cria, struct csession_info *info)
 {
 	struct csession *cse;
+	unsigned long flags;
 
 	dprintk("%s()\n", __FUNCTION__);
 	cse = (struct csession *) kmalloc(sizeof(struct csession), GFP_KERNEL);
@@ -598,7 +924,9 @@ csecreate(struct fcrypt *fcr, u_int64_t sid, struct cryptoini *crie,
 	cse->cipher = crie->cri_alg;
 	cse->mac = cria->cri_alg;
 	cse->info = *info;
+	spin_lock_irqsave(&fcr->lock, flags);
 	cseadd(fcr, cse);
+	spin_unlock_irqrestore(&fcr->lock, flags);
 	return (cse);
 }
 
@@ -632,8 +960,10 @@ cryptodev_ioctl(
 	struct crypt_op cop;
 	struct crypt_kop kop;
 	struct crypt_find_op fop;
+	struct crypt_mop mop;
 	u_int64_t sid;
 	u_int32_t ses = 0;
+	unsigned long flags;
 	int feat, fd, error = 0, crid;
 	mm_segment_t fs;
 
@@ -872,13 +1202,19 @@ bail:
 	case CIOCFSESSION:
 		dprintk("%s(CIOCFSESSION)\n", __FUNCTION__);
 		get_user(ses, (uint32_t*)arg);
+		spin_lock_irqsave(&fcr->lock, flags);
 		cse = csefind(fcr, ses);
-		if (cse == NULL) {
+		if (cse == NULL)
 			error = EINVAL;
+		else if (cse->pending)
+			error = EBUSY;
+		else
+			csedelete(fcr, cse);
+		spin_unlock_irqrestore(&fcr->lock, flags);
+		if (error) {
 			dprintk("%s(CIOCFSESSION) - Fail %d\n", __FUNCTION__, error);
 			break;
 		}
-		csedelete(fcr, cse);
 		error = csefree(cse);
 		break;
 	case CIOCCRYPT:
@@ -901,6 +1237,34 @@ bail:
 			goto bail;
 		}
 		break;
+	case CIOCASYNCCRYPT:
+		dprintk("%s(CIOCASYNCCRYPT)\n", __FUNCTION__);
+		if (copy_from_user(&mop, (void*)arg, sizeof(mop))) {
+			dprintk("%s(CIOCASYNCCRYPT) - bad copy\n", __FUNCTION__);
+			error = EFAULT;
+			goto bail;
+		}
+		error = cryptodev_async_submit(fcr, &mop);
+		if (copy_to_user((void*)arg, &mop, sizeof(mop))) {
+			dprintk("%s(CIOCASYNCCRYPT) - bad return copy\n", __FUNCTION__);
+			error = EFAULT;
+			goto bail;
+		}
+		break;
+	case CIOCASYNCFETCH:
+		dprintk("%s(CIOCASYNCFETCH)\n", __FUNCTION__);
+		if (copy_from_user(&mop, (void*)arg, sizeof(mop))) {
+			dprintk("%s(CIOCASYNCFETCH) - bad copy\n", __FUNCTION__);
+			error = EFAULT;
+			goto bail;
+		}
+		error = cryptodev_async_fetch(filp, fcr, &mop);
+		if (copy_to_user((void*)arg, &mop, sizeof(mop))) {
+			dprintk("%s(CIOCASYNCFETCH) - bad return copy\n", __FUNCTION__);
+			error = EFAULT;
+			goto bail;
+		}
+		break;
 	case CIOCKEY:
 	case CIOCKEY2:
 		dprintk("%s(CIOCKEY)\n", __FUNCTION__);
@@ -975,6 +1339,7 @@ static int
 cryptodev_open(struct inode *inode, struct file *filp)
 {
 	struct fcrypt *fcr;
+	int i;
 
 	dprintk("%s()\n", __FUNCTION__);
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,35)
@@ -995,7 +1360,11 @@ cryptodev_open(struct inode *inode, struct file *filp)
 	}
 	memset(fcr, 0, sizeof(*fcr));
 
-	INIT_LIST_HEAD(&fcr->csessions);
+	for (i = 0; i < CSE_HASH_SIZE; i++)
+		INIT_LIST_HEAD(&fcr->csessions[i]);
+	spin_lock_init(&fcr->lock);
+	INIT_LIST_HEAD(&fcr->done);
+	init_waitqueue_head(&fcr->waitq);
 	filp->private_data = fcr;
 	return(0);
 }
@@ -1005,6 +1374,10 @@ cryptodev_release(struct inode *inode, struct file *filp)
 {
 	struct fcrypt *fcr = filp->private_data;
 	struct csession *cse, *tmp;
+	struct cryptodev_req *req, *rtmp;
+	unsigned long flags;
+	LIST_HEAD(done);
+	int i;
 
 	dprintk("%s()\n", __FUNCTION__);
 	if (!filp) {
@@ -1012,19 +1385,51 @@ cryptodev_release(struct inode *inode, struct file *filp)
 		return(0);
 	}
 
-	list_for_each_entry_safe(cse, tmp, &fcr->csessions, list) {
-		list_del(&cse->list);
-		(void)csefree(cse);
+	/*
+	 * the asynchronous operations still in flight reference our
+	 * sessions,  wait for them to complete and drop their results
+	 */
+	for (;;) {
+		spin_lock_irqsave(&fcr->lock, flags);
+		list_splice_init(&fcr->done, &done);
+		spin_unlock_irqrestore(&fcr->lock, flags);
+		list_for_each_entry_safe(req, rtmp, &done, list) {
+			list_del(&req->list);
+			fcr->pending--;
+			cryptodev_req_free(req);
+		}
+		if (fcr->pending == 0)
+			break;
+		wait_event(fcr->waitq, !list_empty(&fcr->done));
+	}
+
+	for (i = 0; i < CSE_HASH_SIZE; i++) {
+		list_for_each_entry_safe(cse, tmp, &fcr->csessions[i], list) {
+			list_del(&cse->list);
+			(void)csefree(cse);
+		}
 	}
 	filp->private_data = NULL;
 	kfree(fcr);
 	return(0);
 }
 
+static unsigned int
+cryptodev_poll(struct file *filp, poll_table *wait)
+{
+	struct fcrypt *fcr = filp->private_data;
+
+	poll_wait(filp, &fcr->waitq, wait);
+	if (!list_empty(&fcr->done))
+		return(POLLIN | POLLRDNORM);
+	return(0);
+}
+
 static struct file_operations cryptodev_fops = {
 	.owner = THIS_MODULE,
 	.open = cryptodev_open,
 	.release = cryptodev_release,
+	.poll = cryptodev_poll,
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,36)
 	.ioctl = cryptodev_ioctl,
 #endif
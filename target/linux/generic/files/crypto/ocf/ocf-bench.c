@@ -99,6 +99,14 @@ static int request_cbimm = 1;
 module_param(request_cbimm, int, 0);
 MODULE_PARM_DESC(request_cbimm, "enable OCF immediate callback on completion");
 
+/*
+ * submit the requests from this many CPUs,  0 submits them all from the
+ * CPU the module is loaded on
+ */
+static int request_cpus = 0;
+module_param(request_cpus, int, 0);
+MODULE_PARM_DESC(request_cpus, "submit requests from this many CPUs");
+
 /*
  * a structure for each request
  */
@@ -108,6 +116,7 @@ typedef struct  {
 	IX_MBUF mbuf;
 #endif
 	unsigned char *buffer;
+	int cpu;
 } request_t;
 
 static request_t *requests;
@@ -124,6 +133,7 @@ static int total;
 static uint64_t ocf_cryptoid;
 static unsigned long jstart, jstop;
 
+static void ocf_schedule(request_t *r);
 static int ocf_init(void);
 static int ocf_cb(struct cryptop *crp);
 static void ocf_request(void *arg);
@@ -131,6 +141,53 @@ static void ocf_request(void *arg);
 static void ocf_request_wq(struct work_struct *work);
 #endif
 
+/*
+ * (re)submit a request from the CPU it was assigned to
+ */
+static void
+ocf_schedule(request_t *r)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,27) && defined(CONFIG_SMP)
+	if (r->cpu >= 0) {
+		schedule_work_on(r->cpu, &r->work);
+		return;
+	}
+#endif
+	schedule_work(&r->work);
+}
+
+/*
+ * spread the requests over the first request_cpus online CPUs,  returns
+ * the number of CPUs used
+ */
+static int
+ocf_assign_cpus(void)
+{
+	int i, n = 0;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,27) && defined(CONFIG_SMP)
+	int cpu, j;
+
+	for_each_online_cpu(cpu)
+		if (n < request_cpus)
+			n++;
+	for (i = 0; i < request_q_len; i++) {
+		requests[i].cpu = -1;
+		if (n == 0)
+			continue;
+		j = i % n;
+		for_each_online_cpu(cpu)
+			if (j-- == 0) {
+				requests[i].cpu = cpu;
+				break;
+			}
+	}
+#else
+	for (i = 0; i < request_q_len; i++)
+		requests[i].cpu = -1;
+#endif
+	return n ? n : 1;
+}
+
 static int
 ocf_init(void)
 {
@@ -184,7 +241,7 @@ ocf_cb(struct cryptop *crp)
 	}
 	spin_unlock_irqrestore(&ocfbench_counter_lock, flags);
 
-	schedule_work(&r->work);
+	ocf_schedule(r);
 	return 0;
 }
 
@@ -405,7 +462,7 @@ ixp_done(void)
 int
 ocfbench_init(void)
 {
-	int i;
+	int i, ncpus;
 	unsigned long mbps;
 	unsigned long flags;
 
@@ -439,6 +496,7 @@ ocfbench_init(void)
 	if (ocf_init() == -1)
 		return -EINVAL;
 
+	ncpus = ocf_assign_cpus();
 	spin_lock_init(&ocfbench_counter_lock);
 	total = outstanding = 0;
 	jstart = jiffies;
@@ -446,7 +504,10 @@ ocfbench_init(void)
 		spin_lock_irqsave(&ocfbench_counter_lock, flags);
 		outstanding++;
 		spin_unlock_irqrestore(&ocfbench_counter_lock, flags);
-		ocf_request(&requests[i]);
+		if (requests[i].cpu >= 0)
+			ocf_schedule(&requests[i]);
+		else
+			ocf_request(&requests[i]);
 	}
 	while (outstanding > 0)
 		schedule();
@@ -457,8 +518,9 @@ ocfbench_init(void)
 		mbps = (unsigned long) total * (unsigned long) request_size * 8;
 		mbps /= ((jstop - jstart) * 1000) / HZ;
 	}
-	printk("OCF: %d requests of %d bytes in %d jiffies (%d.%03d Mbps)\n",
-			total, request_size, (int)(jstop - jstart),
+	printk("OCF: %d requests of %d bytes from %d CPUs in %d jiffies "
+			"(%d.%03d Mbps)\n",
+			total, request_size, ncpus, (int)(jstop - jstart),
 			((int)mbps) / 1000, ((int)mbps) % 1000);
 	ocf_done();
 
@@ -301,6 +301,10 @@ static inline void *sg_virt(struct scatterlist *sg)
 #define ocf_for_each_cpu(cpu) for_each_present_cpu(cpu)
 #endif
 
+#ifndef raw_smp_processor_id
+#define raw_smp_processor_id() smp_processor_id()
+#endif
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,27)
 #include <linux/sched.h>
 #define	kill_proc(p,s,v)	send_sig(s,find_task_by_vpid(p),0)
@@ -314,6 +314,8 @@ static const struct nla_policy switch_policy[SWITCH_ATTR_MAX+1] = {
 	[SWITCH_ATTR_OP_VALUE_STR] = { .type = NLA_NUL_STRING },
 	[SWITCH_ATTR_OP_VALUE_PORTS] = { .type = NLA_NESTED },
 	[SWITCH_ATTR_TYPE] = { .type = NLA_U32 },
+	[SWITCH_ATTR_OP_NAME] = { .type = NLA_NUL_STRING },
+	[SWITCH_ATTR_OP_GROUPS] = { .type = NLA_U32 },
 };
 
 static const struct nla_policy port_policy[SWITCH_PORT_ATTR_MAX+1] = {
@@ -334,16 +336,11 @@ swconfig_unlock(void)
 }
 
 static struct switch_dev *
-swconfig_get_dev(struct genl_info *info)
+swconfig_find_dev(int id)
 {
 	struct switch_dev *dev = NULL;
 	struct switch_dev *p;
-	int id;
-
-	if (!info->attrs[SWITCH_ATTR_ID])
-		goto done;
 
-	id = nla_get_u32(info->attrs[SWITCH_ATTR_ID]);
 	swconfig_lock();
 	list_for_each_entry(p, &swdevs, dev_list) {
 		if (id != p->id)
@@ -357,10 +354,19 @@ swconfig_get_dev(struct genl_info *info)
 	else
 		DPRINTF("device %d not found\n", id);
 	swconfig_unlock();
-done:
+
 	return dev;
 }
 
+static struct switch_dev *
+swconfig_get_dev(struct genl_info *info)
+{
+	if (!info->attrs[SWITCH_ATTR_ID])
+		return NULL;
+
+	return swconfig_find_dev(nla_get_u32(info->attrs[SWITCH_ATTR_ID]));
+}
+
 static inline void
 swconfig_put_dev(struct switch_dev *dev)
 {
@@ -831,6 +837,204 @@ error:
 	return err;
 }
 
+static void
+swconfig_group_attrs(struct switch_dev *dev, int group,
+		const struct switch_attrlist **alist,
+		struct switch_attr **def_list, unsigned long **def_active,
+		int *n_def, int *count)
+{
+	switch (group) {
+	case SWITCH_GROUP_GLOBAL:
+		*alist = &dev->ops->attr_global;
+		*def_list = default_global;
+		*def_active = &dev->def_global;
+		*n_def = ARRAY_SIZE(default_global);
+		*count = 1;
+		break;
+	case SWITCH_GROUP_VLAN:
+		*alist = &dev->ops->attr_vlan;
+		*def_list = default_vlan;
+		*def_active = &dev->def_vlan;
+		*n_def = ARRAY_SIZE(default_vlan);
+		*count = dev->vlans;
+		break;
+	case SWITCH_GROUP_PORT:
+		*alist = &dev->ops->attr_port;
+		*def_list = default_port;
+		*def_active = &dev->def_port;
+		*n_def = ARRAY_SIZE(default_port);
+		*count = dev->ports;
+		break;
+	}
+}
+
+static int
+swconfig_dump_val(struct sk_buff *msg, struct netlink_callback *cb,
+		struct switch_dev *dev, int group, int port_vlan, int id,
+		const struct switch_attr *attr)
+{
+	struct nlattr *n, *p;
+	struct switch_val val;
+	void *hdr;
+	int i;
+
+	memset(&val, 0, sizeof(val));
+	val.attr = attr;
+	val.port_vlan = port_vlan;
+	if (attr->type == SWITCH_TYPE_PORTS) {
+		val.value.ports = dev->portbuf;
+		memset(dev->portbuf, 0,
+			sizeof(struct switch_port) * dev->ports);
+	}
+
+	hdr = genlmsg_put(msg, NETLINK_CB(cb->skb).pid, cb->nlh->nlmsg_seq,
+			&switch_fam, NLM_F_MULTI, SWITCH_CMD_DUMP_ATTRS);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	NLA_PUT_U32(msg, SWITCH_ATTR_OP_GROUP, group);
+	NLA_PUT_U32(msg, SWITCH_ATTR_OP_ID, id);
+	if (group == SWITCH_GROUP_PORT)
+		NLA_PUT_U32(msg, SWITCH_ATTR_OP_PORT, port_vlan);
+	else if (group == SWITCH_GROUP_VLAN)
+		NLA_PUT_U32(msg, SWITCH_ATTR_OP_VLAN, port_vlan);
+
+	/* failed reads are reported without a value */
+	if (attr->get(dev, attr, &val))
+		goto done;
+
+	switch(attr->type) {
+	case SWITCH_TYPE_INT:
+		NLA_PUT_U32(msg, SWITCH_ATTR_OP_VALUE_INT, val.value.i);
+		break;
+	case SWITCH_TYPE_STRING:
+		NLA_PUT_STRING(msg, SWITCH_ATTR_OP_VALUE_STR, val.value.s);
+		break;
+	case SWITCH_TYPE_PORTS:
+		n = nla_nest_start(msg, SWITCH_ATTR_OP_VALUE_PORTS);
+		if (!n)
+			goto nla_put_failure;
+		for (i = 0; i < val.len; i++) {
+			p = nla_nest_start(msg, SWITCH_ATTR_PORT);
+			if (!p)
+				goto nla_put_failure;
+			NLA_PUT_U32(msg, SWITCH_PORT_ID, val.value.ports[i].id);
+			if (val.value.ports[i].flags &
+			    (1 << SWITCH_PORT_FLAG_TAGGED))
+				NLA_PUT_FLAG(msg, SWITCH_PORT_FLAG_TAGGED);
+			nla_nest_end(msg, p);
+		}
+		nla_nest_end(msg, n);
+		break;
+	}
+
+done:
+	return genlmsg_end(msg, hdr);
+nla_put_failure:
+	genlmsg_cancel(msg, hdr);
+	return -EMSGSIZE;
+}
+
+/*
+ * Stream the values of all readable attributes, optionally limited to
+ * some groups, a single port or vlan and an attribute name.
+ * The position is kept in cb->args: group, port/vlan, attribute.
+ */
+static int
+swconfig_dump_attrs(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	static const int order[] = {
+		SWITCH_GROUP_GLOBAL, SWITCH_GROUP_PORT, SWITCH_GROUP_VLAN
+	};
+	struct nlattr *tb[SWITCH_ATTR_MAX + 1];
+	const struct switch_attrlist *alist;
+	const struct switch_attr *attr;
+	struct switch_attr *def_list;
+	unsigned long *def_active;
+	struct switch_dev *dev;
+	const char *name = NULL;
+	u32 groups = ~0;
+	int g = cb->args[0];
+	int idx = cb->args[1];
+	int a = cb->args[2];
+	int only, n_def, count, id, err;
+
+	if (g >= ARRAY_SIZE(order))
+		return 0;
+
+	err = nlmsg_parse(cb->nlh, GENL_HDRLEN + switch_fam.hdrsize, tb,
+			SWITCH_ATTR_MAX, switch_policy);
+	if (err < 0)
+		return err;
+
+	if (!tb[SWITCH_ATTR_ID])
+		return -EINVAL;
+
+	if (tb[SWITCH_ATTR_OP_GROUPS] && nla_get_u32(tb[SWITCH_ATTR_OP_GROUPS]))
+		groups = nla_get_u32(tb[SWITCH_ATTR_OP_GROUPS]);
+	if (tb[SWITCH_ATTR_OP_NAME])
+		name = nla_data(tb[SWITCH_ATTR_OP_NAME]);
+
+	dev = swconfig_find_dev(nla_get_u32(tb[SWITCH_ATTR_ID]));
+	if (!dev)
+		return -EINVAL;
+
+	for (; g < ARRAY_SIZE(order); g++, idx = 0, a = 0) {
+		if (!(groups & (1 << order[g])))
+			continue;
+
+		swconfig_group_attrs(dev, order[g], &alist, &def_list,
+				&def_active, &n_def, &count);
+
+		only = -1;
+		if (order[g] == SWITCH_GROUP_PORT && tb[SWITCH_ATTR_OP_PORT])
+			only = nla_get_u32(tb[SWITCH_ATTR_OP_PORT]);
+		else if (order[g] == SWITCH_GROUP_VLAN && tb[SWITCH_ATTR_OP_VLAN])
+			only = nla_get_u32(tb[SWITCH_ATTR_OP_VLAN]);
+
+		for (; idx < count; idx++, a = 0) {
+			if (only >= 0 && idx != only)
+				continue;
+
+			for (; a < alist->n_attr + n_def; a++) {
+				if (a < alist->n_attr) {
+					attr = &alist->attr[a];
+					id = a;
+				} else {
+					id = a - alist->n_attr;
+					if (!test_bit(id, def_active))
+						continue;
+					attr = &def_list[id];
+					id += SWITCH_ATTR_DEFAULTS_OFFSET;
+				}
+
+				if (attr->disabled || !attr->get ||
+				    attr->type == SWITCH_TYPE_NOVAL)
+					continue;
+
+				if (name && strcmp(name, attr->name))
+					continue;
+
+				err = swconfig_dump_val(skb, cb, dev, order[g],
+						idx, id, attr);
+
+				/* resume here with the next message, unless
+				 * the value does not even fit into an empty one */
+				if (err < 0 && skb->len)
+					goto out;
+			}
+		}
+	}
+
+out:
+	cb->args[0] = g;
+	cb->args[1] = idx;
+	cb->args[2] = a;
+	swconfig_put_dev(dev);
+
+	return skb->len;
+}
+
 static int
 swconfig_send_switch(struct sk_buff *msg, u32 pid, u32 seq, int flags,
 		const struct switch_dev *dev)
@@ -935,6 +1139,12 @@ static struct genl_ops swconfig_ops[] = {
 		.dumpit = swconfig_dump_switches,
 		.policy = switch_policy,
 		.done = swconfig_done,
+	},
+	{
+		.cmd = SWITCH_CMD_DUMP_ATTRS,
+		.dumpit = swconfig_dump_attrs,
+		.policy = switch_policy,
+		.done = swconfig_done,
 	}
 };
 
@@ -54,6 +54,9 @@ enum {
 	SWITCH_ATTR_OP_DESCRIPTION,
 	/* port lists */
 	SWITCH_ATTR_PORT,
+	/* attribute dumps */
+	SWITCH_ATTR_OP_GROUP,
+	SWITCH_ATTR_OP_GROUPS,
 	SWITCH_ATTR_MAX
 };
 
@@ -70,7 +73,16 @@ enum {
 	SWITCH_CMD_SET_PORT,
 	SWITCH_CMD_LIST_VLAN,
 	SWITCH_CMD_GET_VLAN,
-	SWITCH_CMD_SET_VLAN
+	SWITCH_CMD_SET_VLAN,
+	SWITCH_CMD_DUMP_ATTRS
+};
+
+/* attribute groups, used by SWITCH_CMD_DUMP_ATTRS */
+enum switch_attr_group {
+	SWITCH_GROUP_GLOBAL,
+	SWITCH_GROUP_VLAN,
+	SWITCH_GROUP_PORT,
+	SWITCH_GROUP_MAX
 };
 
 /* data types */